@@ -109,6 +109,7 @@ cmake -DCMAKE_BUILD_TYPE=Release -DDOCS=OFF ..
 %{__install} -m 755 %{_builddir}/%{name}-%{version}/build/src/pgagroal-cli %{buildroot}%{_bindir}/pgagroal-cli
 %{__install} -m 755 %{_builddir}/%{name}-%{version}/build/src/pgagroal-admin %{buildroot}%{_bindir}/pgagroal-admin
 %{__install} -m 755 %{_builddir}/%{name}-%{version}/build/src/pgagroal-vault %{buildroot}%{_bindir}/pgagroal-vault
+%{__install} -m 755 %{_builddir}/%{name}-%{version}/build/src/pgagroal-bench %{buildroot}%{_bindir}/pgagroal-bench
 
 %{__install} -m 755 %{_builddir}/%{name}-%{version}/build/src/libpgagroal.so.%{version} %{buildroot}%{_libdir}/libpgagroal.so.%{version}
 
@@ -116,6 +117,7 @@ chrpath -r %{_libdir} %{buildroot}%{_bindir}/pgagroal
 chrpath -r %{_libdir} %{buildroot}%{_bindir}/pgagroal-cli
 chrpath -r %{_libdir} %{buildroot}%{_bindir}/pgagroal-admin
 chrpath -r %{_libdir} %{buildroot}%{_bindir}/pgagroal-vault
+chrpath -r %{_libdir} %{buildroot}%{_bindir}/pgagroal-bench
 
 cd %{buildroot}%{_libdir}/
 %{__ln_s} -f libpgagroal.so.%{version} libpgagroal.so.2
@@ -191,6 +193,7 @@ cd %{buildroot}%{_libdir}/
 %{_bindir}/pgagroal-cli
 %{_bindir}/pgagroal-admin
 %{_bindir}/pgagroal-vault
+%{_bindir}/pgagroal-bench
 %{_libdir}/libpgagroal.so
 %{_libdir}/libpgagroal.so.2
 %{_libdir}/libpgagroal.so.%{version}
@@ -0,0 +1,1135 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgagroal */
+#include <pgagroal.h>
+#include <json.h>
+#include <management.h>
+#include <network.h>
+#include <security.h>
+#include <shmem.h>
+#include <utils.h>
+#include <value.h>
+#include <wire.h>
+
+/* system */
+#include <err.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <openssl/rand.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define BENCH_PROTOCOL         196608
+#define BENCH_STATEMENT        "pgagroal_bench"
+
+#define BENCH_DEFAULT_PORT     2345
+#define BENCH_DEFAULT_CLIENTS  10
+#define BENCH_DEFAULT_DURATION 10
+#define BENCH_DEFAULT_QUERY    "SELECT 1;"
+
+#define BENCH_SIMPLE   0
+#define BENCH_EXTENDED 1
+#define BENCH_PREPARED 2
+#define BENCH_MODES    3
+
+/** @struct options
+ * Defines the options of a benchmark run
+ */
+struct options
+{
+   char* host;             /**< The host, or the Unix Domain Socket directory */
+   int port;               /**< The port */
+   char* username;         /**< The user name */
+   char* password;         /**< The password */
+   char* database;         /**< The database */
+   char* query;            /**< The query */
+   char* pipeline;         /**< The pipeline label of the report */
+   int clients;            /**< The number of clients */
+   int duration;           /**< The duration in seconds */
+   int churn;              /**< Reconnect after this number of queries, or 0 */
+   int mix[BENCH_MODES];   /**< The weight of each query mode */
+   int32_t output_format;  /**< The output format */
+};
+
+/** @struct client_statistics
+ * Defines the statistics of a benchmark client
+ */
+struct client_statistics
+{
+   uint64_t queries[BENCH_MODES];              /**< The number of queries per mode */
+   uint64_t errors;                            /**< The number of failed queries */
+   uint64_t sum;                               /**< The total query time in microseconds */
+   uint64_t buckets[LATENCY_BUCKETS];          /**< The query latency histogram */
+   uint64_t connects;                          /**< The number of connects */
+   uint64_t connect_errors;                    /**< The number of failed connects */
+   uint64_t connect_sum;                       /**< The total connect time in microseconds */
+   uint64_t connect_buckets[LATENCY_BUCKETS];  /**< The connect latency histogram */
+} __attribute__((aligned(64)));
+
+/** @struct bench_connection
+ * Defines the connection of a benchmark client
+ */
+struct bench_connection
+{
+   struct wire wire; /**< The socket */
+   bool prepared;    /**< Is the named statement prepared */
+};
+
+static int parse_mix(char* mix, struct options* o);
+static int run_client(struct options* o, struct client_statistics* stats);
+static int select_mode(struct options* o);
+static int report(struct options* o, struct client_statistics* stats, uint64_t elapsed);
+static uint64_t percentile(uint64_t* buckets, double percentile);
+
+static int bench_connect(struct options* o, struct bench_connection* c);
+static void bench_disconnect(struct bench_connection* c);
+static int authenticate(struct options* o, struct bench_connection* c);
+static int auth_md5(struct options* o, struct bench_connection* c, char* salt);
+static int auth_scram256(struct options* o, struct bench_connection* c);
+static int execute(struct options* o, struct bench_connection* c, int mode, bool* failed);
+
+static void
+version(void)
+{
+   printf("pgagroal-bench %s\n", PGAGROAL_VERSION);
+   exit(1);
+}
+
+static void
+usage(void)
+{
+   printf("pgagroal-bench %s\n", PGAGROAL_VERSION);
+   printf("  Throughput and latency benchmark for pgagroal\n");
+   printf("\n");
+
+   printf("Usage:\n");
+   printf("  pgagroal-bench [ OPTIONS ]\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -h, --host HOST         Set the host name, or the Unix Domain Socket directory\n");
+   printf("                          Defaults to localhost\n");
+   printf("  -p, --port PORT         Set the port number\n");
+   printf("                          Defaults to %d\n", BENCH_DEFAULT_PORT);
+   printf("  -U, --user USER         Set the user name\n");
+   printf("  -P, --password PASSWORD Set the password for the user\n");
+   printf("                          Defaults to the PGPASSWORD environment variable\n");
+   printf("  -d, --database DATABASE Set the database\n");
+   printf("                          Defaults to the user name\n");
+   printf("  -c, --clients NUMBER    Set the number of concurrent clients\n");
+   printf("                          Defaults to %d\n", BENCH_DEFAULT_CLIENTS);
+   printf("  -T, --time SECONDS      Set the duration of the run\n");
+   printf("                          Defaults to %d\n", BENCH_DEFAULT_DURATION);
+   printf("  -q, --query QUERY       Set the query\n");
+   printf("                          Defaults to '%s'\n", BENCH_DEFAULT_QUERY);
+   printf("  -m, --mix MIX           Set the weight of each query mode, f.ex.\n");
+   printf("                          simple=70,extended=20,prepared=10\n");
+   printf("                          Defaults to simple=100\n");
+   printf("  -C, --churn NUMBER      Reconnect after NUMBER queries\n");
+   printf("  -n, --pipeline NAME     Set the pipeline name of the report\n");
+   printf("  -F, --format text|json  Set the output format\n");
+   printf("  -V, --version           Display version information\n");
+   printf("  -?, --help              Display help\n");
+   printf("\n");
+   printf("pgagroal: %s\n", PGAGROAL_HOMEPAGE);
+   printf("Report bugs: %s\n", PGAGROAL_ISSUES);
+}
+
+int
+main(int argc, char** argv)
+{
+   int c;
+   int option_index = 0;
+   int status;
+   size_t size;
+   bool aborted = false;
+   pid_t pid;
+   pid_t* pids = NULL;
+   uint64_t start;
+   uint64_t elapsed;
+   struct client_statistics* stats = NULL;
+   struct options o;
+
+   memset(&o, 0, sizeof(struct options));
+   o.host = "localhost";
+   o.port = BENCH_DEFAULT_PORT;
+   o.query = BENCH_DEFAULT_QUERY;
+   o.clients = BENCH_DEFAULT_CLIENTS;
+   o.duration = BENCH_DEFAULT_DURATION;
+   o.mix[BENCH_SIMPLE] = 100;
+   o.output_format = MANAGEMENT_OUTPUT_FORMAT_TEXT;
+
+   while (1)
+   {
+      // clang-format off
+      static struct option long_options[] =
+      {
+         {"host", required_argument, 0, 'h'},
+         {"port", required_argument, 0, 'p'},
+         {"user", required_argument, 0, 'U'},
+         {"password", required_argument, 0, 'P'},
+         {"database", required_argument, 0, 'd'},
+         {"clients", required_argument, 0, 'c'},
+         {"time", required_argument, 0, 'T'},
+         {"query", required_argument, 0, 'q'},
+         {"mix", required_argument, 0, 'm'},
+         {"churn", required_argument, 0, 'C'},
+         {"pipeline", required_argument, 0, 'n'},
+         {"format", required_argument, 0, 'F'},
+         {"version", no_argument, 0, 'V'},
+         {"help", no_argument, 0, '?'}
+      };
+      // clang-format on
+
+      c = getopt_long(argc, argv, "V?h:p:U:P:d:c:T:q:m:C:n:F:",
+                      long_options, &option_index);
+
+      if (c == -1)
+      {
+         break;
+      }
+
+      switch (c)
+      {
+         case 'h':
+            o.host = optarg;
+            break;
+         case 'p':
+            o.port = atoi(optarg);
+            break;
+         case 'U':
+            o.username = optarg;
+            break;
+         case 'P':
+            o.password = optarg;
+            break;
+         case 'd':
+            o.database = optarg;
+            break;
+         case 'c':
+            o.clients = atoi(optarg);
+            break;
+         case 'T':
+            o.duration = atoi(optarg);
+            break;
+         case 'q':
+            o.query = optarg;
+            break;
+         case 'm':
+            if (parse_mix(optarg, &o))
+            {
+               errx(1, "Invalid query mix: %s", optarg);
+            }
+            break;
+         case 'C':
+            o.churn = atoi(optarg);
+            break;
+         case 'n':
+            o.pipeline = optarg;
+            break;
+         case 'F':
+            if (!strncmp(optarg, "json", MISC_LENGTH))
+            {
+               o.output_format = MANAGEMENT_OUTPUT_FORMAT_JSON;
+            }
+            else if (!strncmp(optarg, "text", MISC_LENGTH))
+            {
+               o.output_format = MANAGEMENT_OUTPUT_FORMAT_TEXT;
+            }
+            else
+            {
+               errx(1, "Format type is not correct");
+            }
+            break;
+         case 'V':
+            version();
+            break;
+         case '?':
+            usage();
+            exit(1);
+            break;
+         default:
+            break;
+      }
+   }
+
+   if (o.username == NULL)
+   {
+      errx(1, "A user name is required");
+   }
+
+   if (o.password == NULL)
+   {
+      o.password = getenv("PGPASSWORD");
+   }
+
+   if (o.database == NULL)
+   {
+      o.database = o.username;
+   }
+
+   if (o.clients <= 0 || o.duration <= 0 || o.port <= 0 || o.churn < 0)
+   {
+      errx(1, "The clients, time, port and churn options must be positive");
+   }
+
+   signal(SIGPIPE, SIG_IGN);
+
+   size = o.clients * sizeof(struct client_statistics);
+   if (pgagroal_create_shared_memory(size, HUGEPAGE_OFF, (void**)&stats))
+   {
+      errx(1, "Error creating shared memory");
+   }
+   memset(stats, 0, size);
+
+   pids = calloc(o.clients, sizeof(pid_t));
+   if (pids == NULL)
+   {
+      goto error;
+   }
+
+   start = pgagroal_get_monotonic_micros();
+
+   for (int i = 0; i < o.clients; i++)
+   {
+      pids[i] = fork();
+
+      if (pids[i] == -1)
+      {
+         warn("Cannot create client %d", i);
+         o.clients = i;
+         break;
+      }
+      else if (pids[i] == 0)
+      {
+         exit(run_client(&o, &stats[i]));
+      }
+   }
+
+   for (int i = 0; i < o.clients; i++)
+   {
+      pid = waitpid(-1, &status, 0);
+      if (pid == -1)
+      {
+         break;
+      }
+
+      for (int j = 0; j < o.clients; j++)
+      {
+         if (pids[j] == pid)
+         {
+            pids[j] = 0;
+         }
+      }
+
+      if ((!WIFEXITED(status) || WEXITSTATUS(status) != 0) && !aborted)
+      {
+         /* A client that failed would skew the report, so the others are stopped */
+         warnx("A client failed, the run is aborted");
+         aborted = true;
+
+         for (int j = 0; j < o.clients; j++)
+         {
+            if (pids[j] > 0)
+            {
+               kill(pids[j], SIGTERM);
+            }
+         }
+      }
+   }
+
+   elapsed = pgagroal_get_monotonic_micros() - start;
+
+   if (o.clients == 0 || aborted || report(&o, stats, elapsed))
+   {
+      goto error;
+   }
+
+   free(pids);
+   pgagroal_destroy_shared_memory(stats, size);
+
+   exit(0);
+
+error:
+
+   free(pids);
+   pgagroal_destroy_shared_memory(stats, size);
+
+   exit(1);
+}
+
+static int
+parse_mix(char* mix, struct options* o)
+{
+   char* copy = NULL;
+   char* token = NULL;
+   char* saveptr = NULL;
+   int total = 0;
+
+   copy = strdup(mix);
+   if (copy == NULL)
+   {
+      goto error;
+   }
+
+   memset(&o->mix[0], 0, sizeof(o->mix));
+
+   token = strtok_r(copy, ",", &saveptr);
+   while (token != NULL)
+   {
+      char* weight = strchr(token, '=');
+      int mode;
+
+      if (weight == NULL)
+      {
+         goto error;
+      }
+      *weight = '\0';
+      weight++;
+
+      if (!strcmp(token, "simple"))
+      {
+         mode = BENCH_SIMPLE;
+      }
+      else if (!strcmp(token, "extended"))
+      {
+         mode = BENCH_EXTENDED;
+      }
+      else if (!strcmp(token, "prepared"))
+      {
+         mode = BENCH_PREPARED;
+      }
+      else
+      {
+         goto error;
+      }
+
+      o->mix[mode] = atoi(weight);
+      if (o->mix[mode] < 0)
+      {
+         goto error;
+      }
+      total += o->mix[mode];
+
+      token = strtok_r(NULL, ",", &saveptr);
+   }
+
+   if (total <= 0)
+   {
+      goto error;
+   }
+
+   free(copy);
+
+   return 0;
+
+error:
+
+   free(copy);
+
+   return 1;
+}
+
+static int
+run_client(struct options* o, struct client_statistics* stats)
+{
+   int mode;
+   int since_connect = 0;
+   bool failed;
+   uint64_t deadline;
+   uint64_t start;
+   uint64_t micros;
+   struct bench_connection* c = NULL;
+
+   srandom((unsigned int)(getpid() ^ time(NULL)));
+
+   c = calloc(1, sizeof(struct bench_connection));
+   if (c == NULL)
+   {
+      goto error;
+   }
+   pgagroal_wire_reset(&c->wire, -1);
+
+   deadline = pgagroal_get_monotonic_micros() + (uint64_t)o->duration * 1000000;
+
+   while (pgagroal_get_monotonic_micros() < deadline)
+   {
+      if (c->wire.fd == -1 || (o->churn > 0 && since_connect >= o->churn))
+      {
+         bench_disconnect(c);
+
+         start = pgagroal_get_monotonic_micros();
+         if (bench_connect(o, c))
+         {
+            if (c->wire.failed)
+            {
+               goto error;
+            }
+
+            bench_disconnect(c);
+            stats->connect_errors++;
+
+            /* Back off, so a refused connect doesn't spin */
+            SLEEP(10000000L);
+            continue;
+         }
+         micros = pgagroal_get_monotonic_micros() - start;
+
+         stats->connects++;
+         stats->connect_sum += micros;
+         stats->connect_buckets[pgagroal_latency_bucket(micros)]++;
+
+         since_connect = 0;
+      }
+
+      mode = select_mode(o);
+      failed = false;
+
+      start = pgagroal_get_monotonic_micros();
+      if (execute(o, c, mode, &failed))
+      {
+         if (c->wire.failed)
+         {
+            goto error;
+         }
+
+         bench_disconnect(c);
+         stats->errors++;
+         continue;
+      }
+      micros = pgagroal_get_monotonic_micros() - start;
+
+      since_connect++;
+
+      if (failed)
+      {
+         stats->errors++;
+         continue;
+      }
+
+      stats->queries[mode]++;
+      stats->sum += micros;
+      stats->buckets[pgagroal_latency_bucket(micros)]++;
+   }
+
+   if (c->wire.fd != -1)
+   {
+      /* Terminate */
+      pgagroal_wire_append_header(&c->wire, 'X', 4);
+      pgagroal_wire_flush(&c->wire);
+   }
+
+   bench_disconnect(c);
+   pgagroal_wire_destroy(&c->wire);
+   free(c);
+
+   return 0;
+
+error:
+
+   /* The messages can't be built without memory, so the run is aborted */
+   warnx("Out of memory");
+
+   if (c != NULL)
+   {
+      bench_disconnect(c);
+      pgagroal_wire_destroy(&c->wire);
+      free(c);
+   }
+
+   return 1;
+}
+
+static int
+select_mode(struct options* o)
+{
+   int total = 0;
+   int r;
+
+   for (int i = 0; i < BENCH_MODES; i++)
+   {
+      total += o->mix[i];
+   }
+
+   r = (int)(random() % total);
+
+   for (int i = 0; i < BENCH_MODES; i++)
+   {
+      if (r < o->mix[i])
+      {
+         return i;
+      }
+      r -= o->mix[i];
+   }
+
+   return BENCH_SIMPLE;
+}
+
+static int
+report(struct options* o, struct client_statistics* stats, uint64_t elapsed)
+{
+   uint64_t queries[BENCH_MODES] = {0};
+   uint64_t total = 0;
+   uint64_t errors = 0;
+   uint64_t sum = 0;
+   uint64_t buckets[LATENCY_BUCKETS] = {0};
+   uint64_t connects = 0;
+   uint64_t connect_errors = 0;
+   uint64_t connect_sum = 0;
+   uint64_t connect_buckets[LATENCY_BUCKETS] = {0};
+   double seconds;
+   struct json* j = NULL;
+
+   for (int i = 0; i < o->clients; i++)
+   {
+      for (int m = 0; m < BENCH_MODES; m++)
+      {
+         queries[m] += stats[i].queries[m];
+         total += stats[i].queries[m];
+      }
+      errors += stats[i].errors;
+      sum += stats[i].sum;
+      connects += stats[i].connects;
+      connect_errors += stats[i].connect_errors;
+      connect_sum += stats[i].connect_sum;
+
+      for (int b = 0; b < LATENCY_BUCKETS; b++)
+      {
+         buckets[b] += stats[i].buckets[b];
+         connect_buckets[b] += stats[i].connect_buckets[b];
+      }
+   }
+
+   seconds = (double)elapsed / 1000000.0;
+
+   if (pgagroal_json_create(&j))
+   {
+      goto error;
+   }
+
+   pgagroal_json_put(j, "Pipeline", (uintptr_t)(o->pipeline != NULL ? o->pipeline : "-"), ValueString);
+   pgagroal_json_put(j, "Clients", (uintptr_t)o->clients, ValueInt32);
+   pgagroal_json_put(j, "Duration", pgagroal_value_from_double(seconds), ValueDouble);
+   pgagroal_json_put(j, "Queries", (uintptr_t)total, ValueUInt64);
+   pgagroal_json_put(j, "Simple", (uintptr_t)queries[BENCH_SIMPLE], ValueUInt64);
+   pgagroal_json_put(j, "Extended", (uintptr_t)queries[BENCH_EXTENDED], ValueUInt64);
+   pgagroal_json_put(j, "Prepared", (uintptr_t)queries[BENCH_PREPARED], ValueUInt64);
+   pgagroal_json_put(j, "Errors", (uintptr_t)errors, ValueUInt64);
+   pgagroal_json_put(j, "QPS", pgagroal_value_from_double(seconds > 0 ? total / seconds : 0), ValueDouble);
+   pgagroal_json_put(j, "Average", (uintptr_t)(total > 0 ? sum / total : 0), ValueUInt64);
+   pgagroal_json_put(j, "P50", (uintptr_t)percentile(buckets, 0.50), ValueUInt64);
+   pgagroal_json_put(j, "P99", (uintptr_t)percentile(buckets, 0.99), ValueUInt64);
+   pgagroal_json_put(j, "P999", (uintptr_t)percentile(buckets, 0.999), ValueUInt64);
+   pgagroal_json_put(j, "Connects", (uintptr_t)connects, ValueUInt64);
+   pgagroal_json_put(j, "ConnectErrors", (uintptr_t)connect_errors, ValueUInt64);
+   pgagroal_json_put(j, "ConnectRate", pgagroal_value_from_double(seconds > 0 ? connects / seconds : 0), ValueDouble);
+   pgagroal_json_put(j, "ConnectAverage", (uintptr_t)(connects > 0 ? connect_sum / connects : 0), ValueUInt64);
+   pgagroal_json_put(j, "ConnectP50", (uintptr_t)percentile(connect_buckets, 0.50), ValueUInt64);
+   pgagroal_json_put(j, "ConnectP99", (uintptr_t)percentile(connect_buckets, 0.99), ValueUInt64);
+
+   if (o->output_format == MANAGEMENT_OUTPUT_FORMAT_JSON)
+   {
+      pgagroal_json_print(j, FORMAT_JSON);
+   }
+   else
+   {
+      pgagroal_json_print(j, FORMAT_TEXT);
+   }
+
+   pgagroal_json_destroy(j);
+
+   return 0;
+
+error:
+
+   pgagroal_json_destroy(j);
+
+   return 1;
+}
+
+static uint64_t
+percentile(uint64_t* buckets, double percentile)
+{
+   uint64_t count = 0;
+   uint64_t rank;
+   uint64_t seen = 0;
+
+   for (int i = 0; i < LATENCY_BUCKETS; i++)
+   {
+      count += buckets[i];
+   }
+
+   if (count == 0)
+   {
+      return 0;
+   }
+
+   rank = (uint64_t)(percentile * count);
+   if (rank < 1)
+   {
+      rank = 1;
+   }
+
+   for (int i = 0; i < LATENCY_BUCKETS; i++)
+   {
+      seen += buckets[i];
+      if (seen >= rank)
+      {
+         return pgagroal_latency_bucket_upper(i);
+      }
+   }
+
+   return pgagroal_latency_bucket_upper(LATENCY_BUCKETS - 1);
+}
+
+static int
+bench_connect(struct options* o, struct bench_connection* c)
+{
+   char file[MISC_LENGTH];
+   int fd = -1;
+   int32_t length;
+
+   c->prepared = false;
+
+   if (o->host[0] == '/')
+   {
+      memset(&file[0], 0, sizeof(file));
+      snprintf(&file[0], sizeof(file), ".s.PGSQL.%d", o->port);
+
+      if (pgagroal_connect_unix_socket(o->host, &file[0], &fd))
+      {
+         goto error;
+      }
+   }
+   else if (pgagroal_connect(o->host, o->port, &fd, false, true))
+   {
+      goto error;
+   }
+
+   pgagroal_wire_reset(&c->wire, fd);
+
+   /* StartupMessage */
+   length = 4 + 4 +
+            strlen("user") + 1 + strlen(o->username) + 1 +
+            strlen("database") + 1 + strlen(o->database) + 1 +
+            strlen("application_name") + 1 + strlen("pgagroal-bench") + 1 +
+            1;
+
+   pgagroal_wire_append_int32(&c->wire, length);
+   pgagroal_wire_append_int32(&c->wire, BENCH_PROTOCOL);
+   pgagroal_wire_append_string(&c->wire, "user");
+   pgagroal_wire_append_string(&c->wire, o->username);
+   pgagroal_wire_append_string(&c->wire, "database");
+   pgagroal_wire_append_string(&c->wire, o->database);
+   pgagroal_wire_append_string(&c->wire, "application_name");
+   pgagroal_wire_append_string(&c->wire, "pgagroal-bench");
+   pgagroal_wire_append_byte(&c->wire, '\0');
+
+   if (pgagroal_wire_flush(&c->wire) || authenticate(o, c))
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static void
+bench_disconnect(struct bench_connection* c)
+{
+   if (c->wire.fd != -1)
+   {
+      pgagroal_disconnect(c->wire.fd);
+      c->wire.fd = -1;
+   }
+}
+
+static int
+authenticate(struct options* o, struct bench_connection* c)
+{
+   char kind;
+   int length;
+   int32_t code;
+
+   while (1)
+   {
+      if (pgagroal_wire_read_message(&c->wire, &kind, &length))
+      {
+         goto error;
+      }
+
+      if (kind == 'E')
+      {
+         goto error;
+      }
+      else if (kind == 'Z')
+      {
+         break;
+      }
+      else if (kind != 'R')
+      {
+         /* ParameterStatus, BackendKeyData and NoticeResponse */
+         continue;
+      }
+
+      if (length < 4)
+      {
+         goto error;
+      }
+
+      code = pgagroal_read_int32(c->wire.message);
+
+      switch (code)
+      {
+         case 0:
+            break;
+         case 3:
+            if (o->password == NULL)
+            {
+               goto error;
+            }
+
+            pgagroal_wire_append_header(&c->wire, 'p', 4 + strlen(o->password) + 1);
+            pgagroal_wire_append_string(&c->wire, o->password);
+
+            if (pgagroal_wire_flush(&c->wire))
+            {
+               goto error;
+            }
+            break;
+         case 5:
+            if (o->password == NULL || length < 8 || auth_md5(o, c, c->wire.message + 4))
+            {
+               goto error;
+            }
+            break;
+         case 10:
+            if (o->password == NULL || auth_scram256(o, c))
+            {
+               goto error;
+            }
+            break;
+         default:
+            goto error;
+      }
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+auth_md5(struct options* o, struct bench_connection* c, char* salt)
+{
+   char* shadow = NULL;
+   char* salted = NULL;
+   char* md5 = NULL;
+   char* input = NULL;
+   size_t length;
+
+   input = pgagroal_append(input, o->password);
+   input = pgagroal_append(input, o->username);
+
+   if (input == NULL || pgagroal_md5(input, strlen(input), &shadow))
+   {
+      goto error;
+   }
+
+   length = strlen(shadow) + 4;
+   salted = calloc(1, length + 1);
+   if (salted == NULL)
+   {
+      goto error;
+   }
+
+   memcpy(salted, shadow, strlen(shadow));
+   memcpy(salted + strlen(shadow), salt, 4);
+
+   if (pgagroal_md5(salted, length, &md5))
+   {
+      goto error;
+   }
+
+   /* PasswordMessage */
+   pgagroal_wire_append_header(&c->wire, 'p', 4 + strlen("md5") + strlen(md5) + 1);
+   pgagroal_wire_append(&c->wire, "md5", strlen("md5"));
+   pgagroal_wire_append_string(&c->wire, md5);
+
+   if (pgagroal_wire_flush(&c->wire))
+   {
+      goto error;
+   }
+
+   free(input);
+   free(shadow);
+   free(salted);
+   free(md5);
+
+   return 0;
+
+error:
+
+   free(input);
+   free(shadow);
+   free(salted);
+   free(md5);
+
+   return 1;
+}
+
+static int
+auth_scram256(struct options* o, struct bench_connection* c)
+{
+   char kind;
+   int length;
+   int iterations;
+   char* p = NULL;
+   char* nonce = NULL;
+   char* client_first_bare = NULL;
+   char* server_first = NULL;
+   char* server_nonce = NULL;
+   char* client_final = NULL;
+   char* base64 = NULL;
+   size_t base64_length;
+   char* salt = NULL;
+   size_t salt_length = 0;
+   unsigned char raw[18];
+   unsigned char* proof = NULL;
+   unsigned char* signature = NULL;
+
+   if (RAND_bytes(&raw[0], sizeof(raw)) != 1 ||
+       pgagroal_base64_encode(&raw[0], sizeof(raw), &nonce, &base64_length))
+   {
+      goto error;
+   }
+
+   client_first_bare = pgagroal_append(client_first_bare, "n=,r=");
+   client_first_bare = pgagroal_append(client_first_bare, nonce);
+
+   /* SASLInitialResponse */
+   pgagroal_wire_append_header(&c->wire, 'p', 4 + strlen("SCRAM-SHA-256") + 1 + 4 + strlen("n,,") + strlen(client_first_bare));
+   pgagroal_wire_append_string(&c->wire, "SCRAM-SHA-256");
+   pgagroal_wire_append_int32(&c->wire, strlen("n,,") + strlen(client_first_bare));
+   pgagroal_wire_append(&c->wire, "n,,", strlen("n,,"));
+   pgagroal_wire_append(&c->wire, client_first_bare, strlen(client_first_bare));
+
+   /* AuthenticationSASLContinue */
+   if (pgagroal_wire_flush(&c->wire) || pgagroal_wire_read_message(&c->wire, &kind, &length) || kind != 'R' ||
+       length < 4 || pgagroal_read_int32(c->wire.message) != 11)
+   {
+      goto error;
+   }
+
+   server_first = strndup(c->wire.message + 4, length - 4);
+   if (server_first == NULL)
+   {
+      goto error;
+   }
+
+   p = strstr(server_first, "r=");
+   if (p == NULL || strncmp(p + 2, nonce, strlen(nonce)))
+   {
+      goto error;
+   }
+   server_nonce = strndup(p + 2, strcspn(p + 2, ","));
+
+   p = strstr(server_first, ",s=");
+   if (p == NULL ||
+       pgagroal_base64_decode(p + 3, strcspn(p + 3, ","), (void**)&salt, &salt_length))
+   {
+      goto error;
+   }
+
+   p = strstr(server_first, ",i=");
+   if (p == NULL || (iterations = atoi(p + 3)) <= 0)
+   {
+      goto error;
+   }
+
+   client_final = pgagroal_append(client_final, "c=biws,r=");
+   client_final = pgagroal_append(client_final, server_nonce);
+
+   if (pgagroal_scram256_proof(o->password, salt, salt_length, iterations,
+                               client_first_bare, server_first, client_final,
+                               &proof, &signature))
+   {
+      goto error;
+   }
+
+   if (pgagroal_base64_encode(proof, 32, &base64, &base64_length))
+   {
+      goto error;
+   }
+
+   client_final = pgagroal_append(client_final, ",p=");
+   client_final = pgagroal_append(client_final, base64);
+   free(base64);
+   base64 = NULL;
+
+   /* SASLResponse */
+   pgagroal_wire_append_header(&c->wire, 'p', 4 + strlen(client_final));
+   pgagroal_wire_append(&c->wire, client_final, strlen(client_final));
+
+   /* AuthenticationSASLFinal */
+   if (pgagroal_wire_flush(&c->wire) || pgagroal_wire_read_message(&c->wire, &kind, &length) || kind != 'R' ||
+       length < 4 || pgagroal_read_int32(c->wire.message) != 12)
+   {
+      goto error;
+   }
+
+   if (pgagroal_base64_encode(signature, 32, &base64, &base64_length))
+   {
+      goto error;
+   }
+
+   if (length - 4 < 2 + (int)base64_length || strncmp(c->wire.message + 4, "v=", 2) ||
+       strncmp(c->wire.message + 6, base64, base64_length))
+   {
+      goto error;
+   }
+
+   free(nonce);
+   free(client_first_bare);
+   free(server_first);
+   free(server_nonce);
+   free(client_final);
+   free(base64);
+   free(salt);
+   free(proof);
+   free(signature);
+
+   return 0;
+
+error:
+
+   free(nonce);
+   free(client_first_bare);
+   free(server_first);
+   free(server_nonce);
+   free(client_final);
+   free(base64);
+   free(salt);
+   free(proof);
+   free(signature);
+
+   return 1;
+}
+
+static int
+execute(struct options* o, struct bench_connection* c, int mode, bool* failed)
+{
+   char kind;
+   int length;
+   char* statement = "";
+
+   if (mode == BENCH_SIMPLE)
+   {
+      /* Query */
+      pgagroal_wire_append_header(&c->wire, 'Q', 4 + strlen(o->query) + 1);
+      pgagroal_wire_append_string(&c->wire, o->query);
+   }
+   else
+   {
+      if (mode == BENCH_PREPARED)
+      {
+         statement = BENCH_STATEMENT;
+      }
+
+      if (mode == BENCH_EXTENDED || !c->prepared)
+      {
+         /* Parse */
+         pgagroal_wire_append_header(&c->wire, 'P', 4 + strlen(statement) + 1 + strlen(o->query) + 1 + 2);
+         pgagroal_wire_append_string(&c->wire, statement);
+         pgagroal_wire_append_string(&c->wire, o->query);
+         pgagroal_wire_append_int16(&c->wire, 0);
+      }
+
+      /* Bind */
+      pgagroal_wire_append_header(&c->wire, 'B', 4 + 1 + strlen(statement) + 1 + 2 + 2 + 2);
+      pgagroal_wire_append_string(&c->wire, "");
+      pgagroal_wire_append_string(&c->wire, statement);
+      pgagroal_wire_append_int16(&c->wire, 0);
+      pgagroal_wire_append_int16(&c->wire, 0);
+      pgagroal_wire_append_int16(&c->wire, 0);
+
+      /* Execute */
+      pgagroal_wire_append_header(&c->wire, 'E', 4 + 1 + 4);
+      pgagroal_wire_append_string(&c->wire, "");
+      pgagroal_wire_append_int32(&c->wire, 0);
+
+      /* Sync */
+      pgagroal_wire_append_header(&c->wire, 'S', 4);
+   }
+
+   if (pgagroal_wire_flush(&c->wire))
+   {
+      goto error;
+   }
+
+   while (1)
+   {
+      if (pgagroal_wire_read_message(&c->wire, &kind, &length))
+      {
+         goto error;
+      }
+
+      if (kind == 'E')
+      {
+         *failed = true;
+      }
+      else if (kind == 'Z')
+      {
+         break;
+      }
+   }
+
+   if (mode == BENCH_PREPARED)
+   {
+      c->prepared = !*failed;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
@@ -51,6 +51,7 @@
 #include <sys/types.h>
 #include <err.h>
 #include <errno.h>
+#include <time.h>
 
 #include <openssl/ssl.h>
 
@@ -74,6 +75,7 @@
 #define COMMAND_CONFIG_GET     "conf-get"
 #define COMMAND_CONFIG_SET     "conf-set"
 #define COMMAND_CONFIG_ALIAS   "conf-alias"
+#define COMMAND_TRACKER        "tracker"
 
 #define OUTPUT_FORMAT_JSON     "json"
 #define OUTPUT_FORMAT_TEXT     "text"
@@ -92,6 +94,7 @@ static void help_ping(void);
 static void help_shutdown(void);
 static void help_status_details(void);
 static void help_switch_to(void);
+static void help_tracker(void);
 
 static int cancel_shutdown(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int conf_get(SSL* ssl, int socket, char* config_key, uint8_t compression, uint8_t encryption, int32_t output_format);
@@ -109,10 +112,12 @@ static int clear(SSL* ssl, int socket, uint8_t compression, uint8_t encryption,
 static int clear_server(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int status(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int switch_to(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format);
+static int tracker(SSL* ssl, int socket, char* filter, uint8_t compression, uint8_t encryption, int32_t output_format);
 
 static int process_result(SSL* ssl, int socket, int32_t output_format);
 static int process_get_result(SSL* ssl, int socket, char* config_key, int32_t output_format);
 static int process_set_result(SSL* ssl, int socket, char* config_key, int32_t output_format);
+static int process_tracker_result(SSL* ssl, int socket, char* filter, int32_t output_format);
 
 static int get_config_key_result(char* config_key, struct json* j, uintptr_t* r, int32_t output_format);
 static int conf_alias(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
@@ -313,6 +318,14 @@ const struct pgagroal_command command_table[] = {
       .deprecated = false,
       .log_message = "<status details>"
    },
+   {
+      .command = "tracker",
+      .subcommand = "",
+      .accepted_argument_count = {0, 1},
+      .action = MANAGEMENT_TRACKER,
+      .deprecated = false,
+      .log_message = "<tracker> [%s]"
+   },
 };
 // clang-format on
 
@@ -379,6 +392,8 @@ usage(void)
    printf("                           - 'server' (default) followed by a server name\n");
    printf("                           - a server name on its own\n");
    printf("                           - 'prometheus' to reset the Prometheus metrics\n");
+   printf("  tracker [filter]         Streams the connection tracking events, optionally only those\n");
+   printf("                           whose event, user name or database matches [filter]\n");
    printf("\n");
    printf("pgagroal: <%s>\n", PGAGROAL_HOMEPAGE);
    printf("Report bugs: <%s>\n", PGAGROAL_ISSUES);
@@ -835,6 +850,10 @@ username:
    {
       exit_code = conf_alias(s_ssl, socket, compression, encryption, output_format);
    }
+   else if (parsed.cmd->action == MANAGEMENT_TRACKER)
+   {
+      exit_code = tracker(s_ssl, socket, parsed.args[0], compression, encryption, output_format);
+   }
 
 done:
 
@@ -891,6 +910,13 @@ help_status_details(void)
    printf("  pgagroal-cli status [details]\n");
 }
 
+static void
+help_tracker(void)
+{
+   printf("Stream the connection tracking events of pgagroal\n");
+   printf("  pgagroal-cli tracker [event|username|database]\n");
+}
+
 static void
 help_disabledb(void)
 {
@@ -985,6 +1011,10 @@ display_helper(char* command)
    {
       help_switch_to();
    }
+   else if (!strcmp(command, COMMAND_TRACKER))
+   {
+      help_tracker();
+   }
    else
    {
       usage();
@@ -1231,6 +1261,26 @@ error:
    return 1;
 }
 
+static int
+tracker(SSL* ssl, int socket, char* filter, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   if (pgagroal_management_request_tracker(ssl, socket, compression, encryption, output_format))
+   {
+      goto error;
+   }
+
+   if (process_tracker_result(ssl, socket, filter, output_format))
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
 static int
 reload(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format)
 {
@@ -1361,6 +1411,104 @@ error:
    return 1;
 }
 
+static int
+process_tracker_result(SSL* ssl, int socket, char* filter, int32_t output_format)
+{
+   struct json* read = NULL;
+   struct json* response = NULL;
+   struct json* outcome = NULL;
+   struct json* events = NULL;
+   struct json_iterator* iter = NULL;
+
+   /* pgagroal sends the events in batches until the stream is interrupted */
+   while (!pgagroal_management_read_json(ssl, socket, NULL, NULL, &read))
+   {
+      outcome = (struct json*)pgagroal_json_get(read, MANAGEMENT_CATEGORY_OUTCOME);
+      if (!(bool)pgagroal_json_get(outcome, MANAGEMENT_ARGUMENT_STATUS))
+      {
+         if (MANAGEMENT_OUTPUT_FORMAT_RAW != output_format)
+         {
+            translate_json_object(read);
+         }
+         pgagroal_json_print(read, MANAGEMENT_OUTPUT_FORMAT_TEXT == output_format ? FORMAT_TEXT : FORMAT_JSON);
+         goto error;
+      }
+
+      response = (struct json*)pgagroal_json_get(read, MANAGEMENT_CATEGORY_RESPONSE);
+      events = (struct json*)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_EVENTS);
+
+      if ((uint64_t)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_LOST) > 0)
+      {
+         warnx("pgagroal-cli: %llu tracking events lost",
+               (unsigned long long)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_LOST));
+      }
+
+      if (events != NULL && !pgagroal_json_iterator_create(events, &iter))
+      {
+         while (pgagroal_json_iterator_next(iter))
+         {
+            struct json* e = (struct json*)iter->value->data;
+            char* name = (char*)pgagroal_json_get(e, MANAGEMENT_ARGUMENT_EVENT);
+            char* username = (char*)pgagroal_json_get(e, MANAGEMENT_ARGUMENT_USERNAME);
+            char* database = (char*)pgagroal_json_get(e, MANAGEMENT_ARGUMENT_DATABASE);
+
+            if (filter != NULL &&
+                (name == NULL || strcmp(filter, name)) &&
+                (username == NULL || strcmp(filter, username)) &&
+                (database == NULL || strcmp(filter, database)))
+            {
+               continue;
+            }
+
+            if (MANAGEMENT_OUTPUT_FORMAT_TEXT == output_format)
+            {
+               char ts[32];
+               struct tm tm;
+               int64_t timestamp = (int64_t)pgagroal_json_get(e, MANAGEMENT_ARGUMENT_TIMESTAMP);
+               time_t seconds = (time_t)(timestamp / 1000000);
+
+               localtime_r(&seconds, &tm);
+               strftime(&ts[0], sizeof(ts), "%Y-%m-%d %H:%M:%S", &tm);
+
+               printf("%s.%06lld %-26s pid=%d slot=%d state=%d user=%s database=%s app=%s server=%d fd=%d socket=%d active=%d\n",
+                      ts, (long long)(timestamp % 1000000),
+                      name != NULL ? name : "",
+                      (int)(int64_t)pgagroal_json_get(e, MANAGEMENT_ARGUMENT_PID),
+                      (int)(int64_t)pgagroal_json_get(e, MANAGEMENT_ARGUMENT_SLOT),
+                      (int)(int64_t)pgagroal_json_get(e, MANAGEMENT_ARGUMENT_STATE),
+                      username != NULL ? username : "",
+                      database != NULL ? database : "",
+                      (char*)pgagroal_json_get(e, MANAGEMENT_ARGUMENT_APPNAME) != NULL ? (char*)pgagroal_json_get(e, MANAGEMENT_ARGUMENT_APPNAME) : "",
+                      (int)(int64_t)pgagroal_json_get(e, MANAGEMENT_ARGUMENT_SERVER),
+                      (int)(int64_t)pgagroal_json_get(e, MANAGEMENT_ARGUMENT_FD),
+                      (int)(int64_t)pgagroal_json_get(e, MANAGEMENT_ARGUMENT_SOCKET),
+                      (int)(int64_t)pgagroal_json_get(e, MANAGEMENT_ARGUMENT_ACTIVE_CONNECTIONS));
+            }
+            else
+            {
+               pgagroal_json_print(e, FORMAT_JSON_COMPACT);
+            }
+         }
+
+         pgagroal_json_iterator_destroy(iter);
+         iter = NULL;
+
+         fflush(stdout);
+      }
+
+      pgagroal_json_destroy(read);
+      read = NULL;
+   }
+
+   return 0;
+
+error:
+
+   pgagroal_json_destroy(read);
+
+   return 1;
+}
+
 static int
 process_get_result(SSL* ssl, int socket, char* config_key, int32_t output_format)
 {
@@ -2029,6 +2177,9 @@ translate_command(int32_t cmd_code)
       case MANAGEMENT_SWITCH_TO:
          command_output = pgagroal_append(command_output, COMMAND_SWITCH_TO);
          break;
+      case MANAGEMENT_TRACKER:
+         command_output = pgagroal_append(command_output, COMMAND_TRACKER);
+         break;
       default:
          break;
    }
@@ -90,6 +90,7 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_LOG_ROTATION_SIZE                "log_rotation_size"
 #define CONFIGURATION_ARGUMENT_LOG_LINE_PREFIX                  "log_line_prefix"
 #define CONFIGURATION_ARGUMENT_LOG_MODE                         "log_mode"
+#define CONFIGURATION_ARGUMENT_LOG_ASYNC                        "log_async"
 #define CONFIGURATION_ARGUMENT_LOG_CONNECTIONS                  "log_connections"
 #define CONFIGURATION_ARGUMENT_LOG_DISCONNECTIONS               "log_disconnections"
 #define CONFIGURATION_ARGUMENT_BLOCKING_TIMEOUT                 "blocking_timeout"
@@ -100,6 +101,9 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_VALIDATION                       "validation"
 #define CONFIGURATION_ARGUMENT_BACKGROUND_INTERVAL              "background_interval"
 #define CONFIGURATION_ARGUMENT_MAX_RETRIES                      "max_retries"
+#define CONFIGURATION_ARGUMENT_MIN_SPARE_WORKERS                "min_spare_workers"
+#define CONFIGURATION_ARGUMENT_MAX_SPARE_WORKERS                "max_spare_workers"
+#define CONFIGURATION_ARGUMENT_TRANSACTION_WORKERS              "transaction_workers"
 #define CONFIGURATION_ARGUMENT_MAX_CONNECTIONS                  "max_connections"
 #define CONFIGURATION_ARGUMENT_ALLOW_UNKNOWN_USERS              "allow_unknown_users"
 #define CONFIGURATION_ARGUMENT_AUTHENTICATION_TIMEOUT           "authentication_timeout"
@@ -111,16 +115,23 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_TLS_CERT_FILE                    "tls_cert_file"
 #define CONFIGURATION_ARGUMENT_TLS_KEY_FILE                     "tls_key_file"
 #define CONFIGURATION_ARGUMENT_TLS_CA_FILE                      "tls_ca_file"
+#define CONFIGURATION_ARGUMENT_TLS_KTLS                         "tls_ktls"
 #define CONFIGURATION_ARGUMENT_METRICS_CERT_FILE                "metrics_cert_file"
 #define CONFIGURATION_ARGUMENT_METRICS_KEY_FILE                 "metrics_key_file"
 #define CONFIGURATION_ARGUMENT_METRICS_CA_FILE                  "metrics_ca_file"
 #define CONFIGURATION_ARGUMENT_EV_BACKEND                       "ev_backend"
+#define CONFIGURATION_ARGUMENT_IO_URING_MULTISHOT               "io_uring_multishot"
+#define CONFIGURATION_ARGUMENT_IO_URING_BUFFERS                 "io_uring_buffers"
+#define CONFIGURATION_ARGUMENT_IO_URING_REGISTERED_FILES        "io_uring_registered_files"
+#define CONFIGURATION_ARGUMENT_IO_URING_SQPOLL                  "io_uring_sqpoll"
 #define CONFIGURATION_ARGUMENT_KEEP_ALIVE                       "keep_alive"
 #define CONFIGURATION_ARGUMENT_NODELAY                          "nodelay"
+#define CONFIGURATION_ARGUMENT_SPLICE                           "splice"
 #define CONFIGURATION_ARGUMENT_BACKLOG                          "backlog"
 #define CONFIGURATION_ARGUMENT_HUGEPAGE                         "hugepage"
 #define CONFIGURATION_ARGUMENT_TRACKER                          "tracker"
 #define CONFIGURATION_ARGUMENT_TRACK_PREPARED_STATEMENTS        "track_prepared_statements"
+#define CONFIGURATION_ARGUMENT_TRACK_SESSION_PARAMETERS         "track_session_parameters"
 #define CONFIGURATION_ARGUMENT_PIDFILE                          "pidfile"
 #define CONFIGURATION_ARGUMENT_UPDATE_PROCESS_TITLE             "update_process_title"
 #define CONFIGURATION_ARGUMENT_PRIMARY                          "primary"
@@ -294,6 +305,49 @@ pgagroal_read_limit_configuration(void* shmem, char* filename);
 int
 pgagroal_validate_limit_configuration(void* shmem);
 
+/**
+ * Build the index of the LIMIT configuration, and make it the active index
+ * @param shmem The shared memory segment
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_build_limit_index(void* shmem);
+
+/**
+ * Get the active index of the LIMIT configuration. The index must be read
+ * between pgagroal_limit_read_begin and pgagroal_limit_read_retry
+ * @param shmem The shared memory segment
+ * @return The index
+ */
+struct limit_index*
+pgagroal_get_limit_index(void* shmem);
+
+/**
+ * Begin a read of the LIMIT configuration and its index
+ * @param shmem The shared memory segment
+ * @return The generation of the LIMIT configuration
+ */
+unsigned int
+pgagroal_limit_read_begin(void* shmem);
+
+/**
+ * End a read of the LIMIT configuration and its index
+ * @param shmem The shared memory segment
+ * @param generation The generation from pgagroal_limit_read_begin
+ * @return true if the LIMIT configuration changed during the read, and it must be read again
+ */
+bool
+pgagroal_limit_read_retry(void* shmem, unsigned int generation);
+
+/**
+ * Find a user name, database or alias in an index of the LIMIT configuration
+ * @param index The index
+ * @param name The name
+ * @return The entry, or NULL if no limit entry use the name
+ */
+struct limit_name*
+pgagroal_find_limit_name(struct limit_index* index, char* name);
+
 /**
  * Read the USERS configuration from a file
  * @param shmem The shared memory segment
@@ -44,9 +44,10 @@ extern "C" {
 #define CONNECTION_TRANSFER    0
 #define CONNECTION_RETURN      1
 #define CONNECTION_KILL        2
-#define CONNECTION_CLIENT_FD   3
-#define CONNECTION_REMOVE_FD   4
-#define CONNECTION_CLIENT_DONE 5
+#define CONNECTION_CLIENT_DONE 3
+#define CONNECTION_SESSION     4
+#define CONNECTION_FETCH_FD    5
+#define CONNECTION_WAKE        6
 
 /**
  * Connection: Get a connection
@@ -101,6 +102,61 @@ pgagroal_connection_transfer_write(int client_fd, int32_t slot);
 int
 pgagroal_connection_transfer_read(int client_fd, int32_t* slot, int* fd);
 
+/**
+ * Connection: Fetch the descriptor of a slot from the main process
+ * @param slot The slot
+ * @param fd The file descriptor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_connection_fetch(int32_t slot, int* fd);
+
+/**
+ * Connection: Client write, which hands over a client to a worker
+ * @param worker_fd The worker descriptor
+ * @param client_fd The client descriptor
+ * @param address The client address
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_connection_client_write(int worker_fd, int client_fd, char* address);
+
+/**
+ * Connection: Client read, which receives a client in a worker
+ * @param worker_fd The worker descriptor
+ * @param client_fd The client descriptor
+ * @param address The client address
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_connection_client_read(int worker_fd, int* client_fd, char** address);
+
+/**
+ * Connection: Session write, which hands over an authenticated client to a transaction worker
+ * @param worker_fd The worker descriptor
+ * @param client_fd The client descriptor
+ * @param username The user name
+ * @param database The database
+ * @param appname The application name
+ * @param address The client address
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_connection_session_write(int worker_fd, int client_fd, char* username, char* database, char* appname, char* address);
+
+/**
+ * Connection: Session read, which receives an authenticated client in a transaction worker
+ * @param worker_fd The worker descriptor
+ * @param client_fd The client descriptor
+ * @param username The user name (MAX_USERNAME_LENGTH)
+ * @param database The database (MAX_DATABASE_LENGTH)
+ * @param appname The application name (MAX_APPLICATION_NAME)
+ * @param address The client address (INET6_ADDRSTRLEN)
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_connection_session_read(int worker_fd, int* client_fd, char* username, char* database, char* appname, char* address);
+
 /**
  * Connection: Slot write
  * @param slot The slot
@@ -57,16 +57,17 @@ extern "C" {
 #endif /* HAVE_LINUX */
 
 #define EXPERIMENTAL_FEATURE_ZERO_COPY_ENABLED      0
-#define EXPERIMENTAL_FEATURE_FAST_POLL_ENABLED      0
 #define EXPERIMENTAL_FEATURE_USE_HUGE_ENABLED       0
-#define EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED 0
 #define EXPERIMENTAL_FEATURE_IOVECS                 0
 #define PGAGROAL_CONTEXT_MAIN                       0
 #define PGAGROAL_CONTEXT_VAULT                      1
 
 #define ALIGNMENT                                   sysconf(_SC_PAGESIZE)
 #define MAX_EVENTS                                  32
-#define INITIAL_BUFFER_COUNT                        1
+#define DEFAULT_IO_URING_BUFFERS                    8
+#define MAX_IO_URING_BUFFERS                        1024
+#define IO_URING_FIXED_FILES                        8
+#define IO_URING_SQPOLL_IDLE                        100
 #if HAVE_LINUX
 #define PGAGROAL_NSIG _NSIG
 #else
@@ -116,6 +117,7 @@ struct event_loop;
 typedef struct event_watcher
 {
    enum event_type type; /**<Type of the watcher. */
+   int index;            /**< Position in the list of events of the loop */
 } event_watcher_t;
 
 /**
@@ -187,21 +189,27 @@ struct event_loop
 {
    atomic_bool running;                 /**< Flag indicating if the event loop is running. */
    sigset_t sigset;                     /**< Signal set used for handling signals in the event loop. */
-   event_watcher_t* events[MAX_EVENTS]; /**< List of events */
+   event_watcher_t** events;            /**< List of events */
    int events_nr;                       /**< Size of list of events */
+   int events_size;                     /**< Capacity of list of events */
 
    struct
    {
       struct io_uring_buf_ring* br; /**< Buffer ring used internally by io_uring */
-      void* buf;                    /**< Pointer to the actual buffer being used */
-      bool pending_send;            /**< A send is still pending */
+      void* buf;                    /**< The memory of the buffers */
       int cnt;                      /**< The number of buffers */
    } br;                            /**< The buffer ring struct */
 
 #if HAVE_LINUX
+   struct
+   {
+      int fds[IO_URING_FIXED_FILES];  /**< The registered descriptors, -1 for a free entry */
+      int refs[IO_URING_FIXED_FILES]; /**< The number of watchers using each entry */
+      bool enabled;                   /**< Are the descriptors registered */
+   } files;                           /**< The registered files */
+
    struct io_uring ring_rcv; /**< io_uring ring for receive operations */
    struct io_uring ring_snd; /**< io_uring ring for send operations (separate to avoid CQE mixing) */
-   int bid;                  /**< Next buffer id */
 #if EXPERIMENTAL_FEATURE_IOVECS
    /* XXX: Test with iovecs for send/recv io_uring */
    int iovecs_nr;
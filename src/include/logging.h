@@ -35,6 +35,8 @@ extern "C" {
 
 #include <utils.h>
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 #define PGAGROAL_LOGGING_TYPE_CONSOLE            0
@@ -58,6 +60,9 @@ extern "C" {
 
 #define PGAGROAL_LOGGING_DEFAULT_LOG_LINE_PREFIX "%Y-%m-%d %H:%M:%S"
 
+#define PGAGROAL_LOGGING_RING_SLOTS              1024
+#define PGAGROAL_LOGGING_RECORD_SIZE             2048
+
 #define pgagroal_log_trace(...)                  pgagroal_log_line(PGAGROAL_LOGGING_LEVEL_DEBUG5, __FILE__, __LINE__, __VA_ARGS__)
 #define pgagroal_log_debug(...)                  pgagroal_log_line(PGAGROAL_LOGGING_LEVEL_DEBUG1, __FILE__, __LINE__, __VA_ARGS__)
 #define pgagroal_log_info(...)                   pgagroal_log_line(PGAGROAL_LOGGING_LEVEL_INFO, __FILE__, __LINE__, __VA_ARGS__)
@@ -65,6 +70,34 @@ extern "C" {
 #define pgagroal_log_error(...)                  pgagroal_log_line(PGAGROAL_LOGGING_LEVEL_ERROR, __FILE__, __LINE__, __VA_ARGS__)
 #define pgagroal_log_fatal(...)                  pgagroal_log_line(PGAGROAL_LOGGING_LEVEL_FATAL, __FILE__, __LINE__, __VA_ARGS__)
 
+/** @struct log_record
+ * A log line in the log ring
+ */
+struct log_record
+{
+   atomic_ulong sequence;                   /**< The sequence of the record */
+   atomic_int pid;                          /**< The process filling the record, or 0 */
+   int level;                               /**< The logging level */
+   int length;                              /**< The length of the line */
+   char line[PGAGROAL_LOGGING_RECORD_SIZE]; /**< The formatted line */
+} __attribute__((aligned(64)));
+
+/** @struct log_ring
+ * The log lines waiting for the log writer. Any process can append
+ * a line without blocking, and only the log writer removes them
+ */
+struct log_ring
+{
+   atomic_ulong head;                                      /**< The next record to append */
+   atomic_ulong tail;                                      /**< The next record to write */
+   atomic_ulong dropped;                                   /**< The number of lines dropped on a full ring */
+   atomic_bool running;                                    /**< Is the log writer wanted */
+   atomic_bool reopen;                                     /**< Reopen the log file */
+   atomic_uint wake;                                       /**< Increased to wake up the log writer */
+   atomic_bool sleeping;                                   /**< Is the log writer waiting for lines */
+   struct log_record records[PGAGROAL_LOGGING_RING_SLOTS]; /**< The records */
+} __attribute__((aligned(64)));
+
 #ifdef DEBUG
 #define PGAGROAL_LOG_POSTGRES(x) pgagroal_log_postgres(x)
 #else
@@ -92,6 +125,44 @@ pgagroal_start_logging(void);
 int
 pgagroal_stop_logging(void);
 
+/**
+ * Reopen the log file after the logging settings changed. With
+ * log_async the log writer reopens it, otherwise it is done here
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_reopen_logging(void);
+
+/**
+ * Create the log ring, after which all log lines are
+ * handed to the log writer
+ * @param p_size The resulting size of the shared memory segment
+ * @param p_shmem The resulting shared memory segment
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_init_log_ring(size_t* p_size, void** p_shmem);
+
+/**
+ * Run the log writer until it is stopped by
+ * pgagroal_stop_log_writer and the log ring is empty
+ */
+void
+pgagroal_log_writer(void);
+
+/**
+ * Ask the log writer to write the remaining lines and exit
+ */
+void
+pgagroal_stop_log_writer(void);
+
+/**
+ * Get the number of log lines dropped on a full log ring
+ * @return The number of lines
+ */
+unsigned long
+pgagroal_log_dropped(void);
+
 /**
  * Log a line
  * @param level The level
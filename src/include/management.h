@@ -91,6 +91,7 @@ extern "C" {
 #define MANAGEMENT_UPDATE_USER     21
 #define MANAGEMENT_REMOVE_USER     22
 #define MANAGEMENT_LIST_USERS      23
+#define MANAGEMENT_TRACKER         24
 /**
  * Management arguments
  */
@@ -102,20 +103,32 @@ extern "C" {
 #define MANAGEMENT_ARGUMENT_CONFIG_KEY          "ConfigKey"
 #define MANAGEMENT_ARGUMENT_CONFIG_VALUE        "ConfigValue"
 #define MANAGEMENT_ARGUMENT_CONNECTIONS         "Connections"
+#define MANAGEMENT_ARGUMENT_COUNT               "Count"
 #define MANAGEMENT_ARGUMENT_DATABASE            "Database"
 #define MANAGEMENT_ARGUMENT_DATABASES           "Databases"
 #define MANAGEMENT_ARGUMENT_ENABLED             "Enabled"
 #define MANAGEMENT_ARGUMENT_ENCRYPTION          "Encryption"
 #define MANAGEMENT_ARGUMENT_ERROR               "Error"
+#define MANAGEMENT_ARGUMENT_EVENT               "Event"
+#define MANAGEMENT_ARGUMENT_EVENTS              "Events"
 #define MANAGEMENT_ARGUMENT_FD                  "FD"
+#define MANAGEMENT_ARGUMENT_HAS_SECURITY        "HasSecurity"
+#define MANAGEMENT_ARGUMENT_HITS                "Hits"
 #define MANAGEMENT_ARGUMENT_HOST                "Host"
 #define MANAGEMENT_ARGUMENT_INITIAL_CONNECTIONS "InitialConnections"
+#define MANAGEMENT_ARGUMENT_LATENCIES           "Latencies"
 #define MANAGEMENT_ARGUMENT_LIMITS              "Limits"
+#define MANAGEMENT_ARGUMENT_LIMIT_RULE          "LimitRule"
+#define MANAGEMENT_ARGUMENT_LOST                "Lost"
 #define MANAGEMENT_ARGUMENT_MAX_CONNECTIONS     "MaxConnections"
 #define MANAGEMENT_ARGUMENT_MIN_CONNECTIONS     "MinConnections"
 #define MANAGEMENT_ARGUMENT_MODE                "Mode"
+#define MANAGEMENT_ARGUMENT_NEW                 "New"
 #define MANAGEMENT_ARGUMENT_NUMBER_OF_SERVERS   "NumberOfServers"
 #define MANAGEMENT_ARGUMENT_OUTPUT              "Output"
+#define MANAGEMENT_ARGUMENT_P50                 "P50"
+#define MANAGEMENT_ARGUMENT_P90                 "P90"
+#define MANAGEMENT_ARGUMENT_P99                 "P99"
 #define MANAGEMENT_ARGUMENT_PASSWORD            "Password"
 #define MANAGEMENT_ARGUMENT_PID                 "PID"
 #define MANAGEMENT_ARGUMENT_PORT                "Port"
@@ -123,14 +136,20 @@ extern "C" {
 #define MANAGEMENT_ARGUMENT_SERVER              "Server"
 #define MANAGEMENT_ARGUMENT_SERVERS             "Servers"
 #define MANAGEMENT_ARGUMENT_SERVER_VERSION      "ServerVersion"
+#define MANAGEMENT_ARGUMENT_SLOT                "Slot"
+#define MANAGEMENT_ARGUMENT_SOCKET              "Socket"
 #define MANAGEMENT_ARGUMENT_START_TIME          "StartTime"
 #define MANAGEMENT_ARGUMENT_STATE               "State"
 #define MANAGEMENT_ARGUMENT_STATUS              "Status"
+#define MANAGEMENT_ARGUMENT_SUM                 "Sum"
 #define MANAGEMENT_ARGUMENT_TIME                "Time"
 #define MANAGEMENT_ARGUMENT_TIMESTAMP           "Timestamp"
 #define MANAGEMENT_ARGUMENT_TIMESTAMP           "Timestamp"
+#define MANAGEMENT_ARGUMENT_TIMEOUTS            "Timeouts"
 #define MANAGEMENT_ARGUMENT_TOTAL_CONNECTIONS   "TotalConnections"
+#define MANAGEMENT_ARGUMENT_TX_MODE             "TxMode"
 #define MANAGEMENT_ARGUMENT_USERNAME            "Username"
+#define MANAGEMENT_ARGUMENT_WAITS               "Waits"
 
 /**
  * Management error
@@ -169,6 +188,10 @@ extern "C" {
 
 #define MANAGEMENT_ERROR_SWITCH_TO_FAILED                   1300
 
+#define MANAGEMENT_ERROR_TRACKER_NOFORK                     1400
+#define MANAGEMENT_ERROR_TRACKER_NETWORK                    1401
+#define MANAGEMENT_ERROR_TRACKER_DISABLED                   1402
+
 /**
  * Output formats
  */
@@ -329,6 +352,18 @@ pgagroal_management_request_details(SSL* ssl, int socket, uint8_t compression, u
 int
 pgagroal_management_request_ping(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
 
+/**
+ * Management operation: Stream the tracking events
+ * @param ssl The SSL connection
+ * @param socket The socket
+ * @param compression The compress method for wire protocol
+ * @param encryption The encrypt method for wire protocol
+ * @param output_format The output format
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_management_request_tracker(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
+
 /**
  * Management operation: Clear
  * @param ssl The SSL connection
@@ -52,7 +52,15 @@ struct message*
 pgagroal_memory_message(void);
 
 /**
- * Free the memory segment
+ * Mark the first bytes of the message data as used, so that they are
+ * cleared by the next pgagroal_memory_free
+ * @param size The number of bytes written
+ */
+void
+pgagroal_memory_used(size_t size);
+
+/**
+ * Free the memory segment, only the used part of the data is cleared
  */
 void
 pgagroal_memory_free(void);
@@ -99,6 +99,15 @@ pgagroal_connect_unix_socket(const char* directory, const char* file, int* fd);
 bool
 pgagroal_socket_isvalid(int fd);
 
+/**
+ * Set the blocking mode of a socket
+ * @param fd The descriptor
+ * @param value Make the socket non-blocking
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_socket_nonblocking(int fd, bool value);
+
 /**
  * Disconnect from a descriptor
  * @param fd The descriptor
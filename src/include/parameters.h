@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGAGROAL_PARAMETERS_H
+#define PGAGROAL_PARAMETERS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgagroal.h>
+#include <message.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define MAX_SESSION_PARAMETERS     24
+#define MAX_PARAMETER_NAME_LENGTH  64
+#define MAX_PARAMETER_VALUE_LENGTH 256
+#define MAX_PARAMETER_MESSAGE      (5 + MAX_PARAMETER_NAME_LENGTH + MAX_PARAMETER_VALUE_LENGTH)
+
+/** @struct parameter
+ * Defines a parameter reported by ParameterStatus
+ */
+struct parameter
+{
+   char name[MAX_PARAMETER_NAME_LENGTH];   /**< The name */
+   char value[MAX_PARAMETER_VALUE_LENGTH]; /**< The value */
+};
+
+/** @struct parameter_slot
+ * Defines the parameters of the connection of a slot.
+ *
+ * The parameters are only changed by the process that has the slot
+ */
+struct parameter_slot
+{
+   int backend_pid;                                     /**< The backend process id of the parameters */
+   int backend_secret;                                  /**< The backend secret of the parameters */
+   int number_of_parameters;                            /**< The number of parameters */
+   struct parameter parameters[MAX_SESSION_PARAMETERS]; /**< The parameters */
+};
+
+/** @struct parameter_client
+ * Defines the parameters of a client
+ */
+struct parameter_client
+{
+   struct parameter_slot* slots;               /**< The parameters of the slots */
+   bool known;                                 /**< Are the parameters of the client known */
+   struct parameter_slot parameters;           /**< The parameters which the client has seen */
+   int replays;                                /**< The number of replays which the server hasn't answered yet */
+   bool failed;                                /**< Did the server fail a replay */
+   int server_remaining;                       /**< The remaining bytes of the current server message */
+   bool server_drop;                           /**< Is the current server message removed */
+   char server_pending[MAX_PARAMETER_MESSAGE]; /**< The incomplete server message */
+   size_t server_pending_length;               /**< The length of the incomplete server message */
+   char* replay;                               /**< The replay for the server */
+   size_t replay_length;                       /**< The length of the replay */
+   size_t replay_size;                         /**< The size of the replay buffer */
+   char* buffer;                               /**< The rewritten data */
+   size_t buffer_size;                         /**< The size of the rewritten data buffer */
+   struct message message;                     /**< The rewritten message */
+};
+
+/**
+ * Get the size of the shared memory for the parameters of the slots
+ * @param shmem The shared memory segment
+ * @return The size
+ */
+size_t
+pgagroal_parameters_size(void* shmem);
+
+/**
+ * Create the parameter state of a client
+ * @param slots The parameters of the slots in shared memory
+ * @param client The resulting state
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_parameters_create(void* slots, struct parameter_client** client);
+
+/**
+ * Destroy the parameter state of a client
+ * @param client The state
+ */
+void
+pgagroal_parameters_destroy(struct parameter_client* client);
+
+/**
+ * A client got a connection. The parameters which differ between
+ * the client and the connection are prepared for replay. A client
+ * starts with the parameters which the connection had at startup,
+ * since these were sent during the authentication
+ * @param client The state
+ * @param slot The slot
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_parameters_start(struct parameter_client* client, int slot);
+
+/**
+ * Add the pending replay in front of the messages of a client
+ * @param client The state
+ * @param msg The message from the client
+ * @param result The message for the server
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_parameters_client(struct parameter_client* client, struct message* msg, struct message** result);
+
+/**
+ * Follow the ParameterStatus messages of a server, and remove the
+ * responses to the replays
+ * @param client The state
+ * @param slot The slot
+ * @param msg The message from the server
+ * @param result The message for the client, which may be empty
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_parameters_server(struct parameter_client* client, int slot, struct message* msg, struct message** result);
+
+/**
+ * Did the server fail a replay. The error is passed on to the client,
+ * and the client must be stopped once it has the whole error
+ * @param client The state
+ * @return True if the client must be stopped, otherwise false
+ */
+bool
+pgagroal_parameters_failed(struct parameter_client* client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -102,12 +102,26 @@ extern "C" {
 #endif
 #define NUMBER_OF_HBAS                 64
 #define NUMBER_OF_LIMITS               64
+#define NUMBER_OF_LIMIT_NAMES          1024
 #define NUMBER_OF_USERS                64
 #define NUMBER_OF_ADMINS               8
 #define NUMBER_OF_DISABLED             64
 
 #define NUMBER_OF_SECURITY_MESSAGES    5
 
+#define NUMBER_OF_SLOT_LISTS           256
+#define SLOT_LIST_SHARED               (NUMBER_OF_SLOT_LISTS - 1)
+#define SLOT_LIST_WORDS                ((MAX_NUMBER_OF_CONNECTIONS + 63) / 64)
+#define SLOT_LIST_SUMMARY_WORDS        ((SLOT_LIST_WORDS + 63) / 64)
+#define SLOT_LIST_RECENT               8
+#define WAIT_QUEUE_TICKETS             64
+
+#define SLOT_IDENTITY_EMPTY            0
+#define SLOT_IDENTITY_CLAIMED          1
+#define SLOT_IDENTITY_READY            2
+
+#define NUMBER_OF_TRANSACTION_WORKERS  64
+
 #define STATE_NOTINIT                  -2
 #define STATE_INIT                     -1
 #define STATE_FREE                     0
@@ -148,6 +162,13 @@ extern "C" {
 #define VALIDATION_BACKGROUND          2
 
 #define HISTOGRAM_BUCKETS              18
+#define PROMETHEUS_SHARDS              64
+#define LATENCY_BUCKETS                128
+#define NUMBER_OF_LATENCIES            64
+
+#define LATENCY_FREE                   0
+#define LATENCY_CLAIMING               1
+#define LATENCY_READY                  2
 
 #define HUGEPAGE_OFF                   0
 #define HUGEPAGE_TRY                   1
@@ -343,6 +364,23 @@ extern void* prometheus_shmem;
  */
 extern void* prometheus_cache_shmem;
 
+/**
+ * The shared memory segment for the security messages
+ * of the connections
+ */
+extern void* security_shmem;
+
+/**
+ * The shared memory segment for the log lines
+ * waiting for the log writer
+ */
+extern void* log_shmem;
+
+/**
+ * The shared memory segment for the tracking events
+ */
+extern void* tracker_shmem;
+
 /** @struct server
  * Defines a server
  */
@@ -357,6 +395,7 @@ struct server
    char tls_cert_file[MAX_PATH]; /**< TLS certificate path */
    char tls_key_file[MAX_PATH];  /**< TLS key path */
    char tls_ca_file[MAX_PATH];   /**< TLS CA certificate path */
+   bool tls_ktls;                /**< Hand the TLS session to the kernel after the handshake */
    atomic_schar state;           /**< The state of the server */
    int lineno;                   /**< The line number within the configuration file */
 } __attribute__((aligned(64)));
@@ -374,20 +413,93 @@ struct connection
    signed char server; /**< The server identifier */
    bool tx_mode;       /**< Connection in transaction mode */
 
-   signed char has_security;                                                  /**< The security identifier */
-   ssize_t security_lengths[NUMBER_OF_SECURITY_MESSAGES];                     /**< The lengths of the security messages */
-   char security_messages[NUMBER_OF_SECURITY_MESSAGES][SECURITY_BUFFER_SIZE]; /**< The security messages */
+   signed char has_security; /**< The security identifier */
 
    int backend_pid;    /**< The backend process id */
    int backend_secret; /**< The backend secret */
 
    signed char limit_rule; /**< The limit rule used */
+   int slot_list;          /**< The free slot list of the identity */
    time_t start_time;      /**< The start timestamp */
    time_t timestamp;       /**< The last used timestamp */
    pid_t pid;              /**< The associated process id */
    int fd;                 /**< The descriptor */
 } __attribute__((aligned(64)));
 
+/** @struct connection_security
+ * Defines the security messages of a connection, which are kept
+ * outside of struct connection in the security_shmem segment
+ */
+struct connection_security
+{
+   ssize_t lengths[NUMBER_OF_SECURITY_MESSAGES];                     /**< The lengths of the security messages */
+   char messages[NUMBER_OF_SECURITY_MESSAGES][SECURITY_BUFFER_SIZE]; /**< The security messages */
+};
+
+/** @struct slot_identity
+ * Defines the identity of a free slot list.
+ *
+ * An entry is claimed by the first process looking up the
+ * limit rule / username / database, and is never reused.
+ */
+struct slot_identity
+{
+   atomic_schar state;                 /**< The state of the entry */
+   signed char limit_rule;             /**< The limit rule */
+   char username[MAX_USERNAME_LENGTH]; /**< The user name */
+   char database[MAX_DATABASE_LENGTH]; /**< The database */
+} __attribute__((aligned(64)));
+
+/** @struct slot_list
+ * Defines a set of slots in shared memory.
+ *
+ * A slot is listed when its bit is set, and the summary has a bit
+ * for each word of slots which may have a slot listed, such that
+ * a slot is added, taken or removed without walking the list.
+ *
+ * The most recently added slots are remembered in a ring, which
+ * is only a hint, as the slots may have been taken since
+ */
+struct slot_list
+{
+   atomic_ullong summary[SLOT_LIST_SUMMARY_WORDS]; /**< The words which may have a slot listed */
+   atomic_ullong slots[SLOT_LIST_WORDS];           /**< The listed slots */
+   atomic_uint recent_count;                       /**< The number of slots added */
+   atomic_int recent[SLOT_LIST_RECENT];            /**< The most recently added slots */
+} __attribute__((aligned(64)));
+
+/** @struct wait_queue
+ * Defines a queue of processes waiting for a connection.
+ *
+ * The sequence is changed every time a connection is made
+ * available, and is used as the futex word on Linux.
+ *
+ * The waiting processes take a ticket, and only the process of
+ * the ticket being served looks for a connection. The others wait
+ * on the call word of their ticket, which is changed when it is
+ * their turn.
+ */
+struct wait_queue
+{
+   atomic_uint sequence;                      /**< The sequence */
+   atomic_int waiters;                        /**< The number of waiting processes */
+   atomic_uint next_ticket;                   /**< The next ticket */
+   atomic_uint serving;                       /**< The ticket being served */
+   atomic_ullong heartbeat;                   /**< When the ticket being served was last seen, in microseconds */
+   atomic_uint calls[WAIT_QUEUE_TICKETS];     /**< The call words of the tickets */
+   atomic_uint abandoned[WAIT_QUEUE_TICKETS]; /**< The tickets, plus one, that left the queue before their turn */
+} __attribute__((aligned(64)));
+
+/** @struct transaction_worker
+ * Defines a multi-client transaction worker
+ */
+struct transaction_worker
+{
+   atomic_int pid;      /**< The process identifier, or 0 if not ready */
+   atomic_int clients;  /**< The number of clients */
+   atomic_bool parked;  /**< Does the worker have clients waiting for a connection */
+} __attribute__((aligned(64)));
+
 /** @struct hba
  * Defines a HBA entry
  */
@@ -417,6 +529,30 @@ struct limit
    int lineno;                                     /**< The line number within the configuration file */
 } __attribute__((aligned(64)));
 
+/** @struct limit_name
+ * Defines a user name, database or alias used by the limit entries.
+ *
+ * Each mask has a bit set for every limit entry using the name
+ */
+struct limit_name
+{
+   uint32_t hash;                  /**< The hash of the name, 0 if not used */
+   uint64_t usernames;             /**< The limit entries using the name as user name */
+   uint64_t databases;             /**< The limit entries using the name as database */
+   uint64_t aliases;               /**< The limit entries using the name as alias */
+   char name[MAX_DATABASE_LENGTH]; /**< The name */
+};
+
+/** @struct limit_index
+ * Defines a hash table of the names used by the limit entries
+ */
+struct limit_index
+{
+   uint64_t all_usernames;                         /**< The limit entries for all user names */
+   uint64_t all_databases;                         /**< The limit entries for all databases */
+   struct limit_name names[NUMBER_OF_LIMIT_NAMES]; /**< The names */
+};
+
 /** @struct user
  * Defines a user
  */
@@ -488,26 +624,79 @@ struct prometheus_connection
    atomic_ullong query_count; /**< The number of queries per connection */
 } __attribute__((aligned(64)));
 
+/** @struct prometheus_shard
+ * Defines a shard of the hot path Prometheus counters.
+ * A process updates the shard of the CPU it runs on, and
+ * the shards are summed when the metrics are rendered
+ */
+struct prometheus_shard
+{
+   atomic_ullong query_count;      /**< The number of queries */
+   atomic_ullong tx_count;         /**< The number of transactions */
+   atomic_ullong network_sent;     /**< The bytes sent by clients */
+   atomic_ullong network_received; /**< The bytes received from servers */
+} __attribute__((aligned(64)));
+
+/** @struct prometheus_latency
+ * Defines the query latency histogram of an user and database.
+ * The buckets are log-linear in microseconds with four sub-buckets
+ * per power of two, so the relative error stays below 25%
+ */
+struct prometheus_latency
+{
+   atomic_int state;                       /**< The state of the entry */
+   atomic_int claimer;                     /**< The process claiming the entry */
+   atomic_int references;                  /**< The number of clients, or -1 while the entry is reused */
+   char username[MAX_USERNAME_LENGTH];     /**< The user name */
+   char database[MAX_DATABASE_LENGTH];     /**< The database */
+   atomic_ullong buckets[LATENCY_BUCKETS]; /**< The histogram buckets */
+   atomic_ullong count;                    /**< The number of queries */
+   atomic_ullong sum;                      /**< The total latency in microseconds */
+} __attribute__((aligned(64)));
+
+/** @struct prometheus_acquire
+ * Defines the pool acquisition statistics of a limit rule.
+ * The wait times of the acquired connections use the buckets
+ * of the query latencies
+ */
+struct prometheus_acquire
+{
+   atomic_ullong buckets[LATENCY_BUCKETS]; /**< The histogram buckets */
+   atomic_ullong sum;                      /**< The total wait time in microseconds */
+   atomic_ullong hit;                      /**< The number of connections acquired without waiting */
+   atomic_ullong wait;                     /**< The number of connections acquired after waiting */
+   atomic_ullong timeout;                  /**< The number of acquisitions that timed out */
+} __attribute__((aligned(64)));
+
 /** @struct prometheus_cache
  * A structure to handle the Prometheus response
  * so that it is possible to serve the very same
  * response over and over depending on the cache
  * settings.
  *
+ * The cache has two buffers. A single writer, holding
+ * the `lock` field, renders into the inactive buffer and
+ * publishes it by increasing the `generation` field, whose
+ * lowest bit selects the active buffer. Readers never take
+ * the lock, and always serve the last published snapshot.
+ * The `readers` field counts the readers of each buffer,
+ * so a writer never renders into a buffer being read.
+ *
  * The `valid_until` field stores the result
  * of `time(2)`.
  *
- * The cache is protected by the `lock` field.
- *
- * The `size` field stores the size of the allocated
- * `data` payload.
+ * The `size` field stores the size of each buffer
+ * in the `data` payload.
  */
 struct prometheus_cache
 {
-   time_t valid_until; /**< when the cache will become not valid */
-   atomic_schar lock;  /**< lock to protect the cache */
-   size_t size;        /**< size of the cache */
-   char data[];        /**< the payload */
+   atomic_uint generation; /**< The published generation */
+   atomic_schar lock;      /**< lock to serialize the writers */
+   atomic_int readers[2];  /**< The number of readers of each buffer */
+   time_t valid_until[2];  /**< when each buffer will become not valid */
+   size_t length[2];       /**< The length of each buffer */
+   size_t size;            /**< size of each buffer */
+   char data[];            /**< the payload of both buffers */
 } __attribute__((aligned(64)));
 
 /** @struct prometheus
@@ -560,11 +749,11 @@ struct main_prometheus
    atomic_ulong client_active;    /**< The number of active clients */
    atomic_ulong client_wait_time; /**< The time the client waits */
 
-   atomic_ullong query_count; /**< The number of queries */
-   atomic_ullong tx_count;    /**< The number of transactions */
+   struct prometheus_shard shards[PROMETHEUS_SHARDS]; /**< The hot path counters per CPU */
 
-   atomic_ullong network_sent;     /**< The bytes sent by clients */
-   atomic_ullong network_received; /**< The bytes received from servers */
+   struct prometheus_latency latencies[NUMBER_OF_LATENCIES]; /**< The query latencies per user and database */
+   atomic_int latency_reclaimer;                              /**< The process reusing a query latency entry */
+   struct prometheus_acquire acquires[NUMBER_OF_LIMITS + 1];  /**< The acquisitions per limit rule, the last without a rule */
 
    atomic_ulong server_error[NUMBER_OF_SERVERS];          /**< The number of errors for a server */
    atomic_ulong failed_servers;                           /**< The number of failed servers */
@@ -659,6 +848,8 @@ struct main_configuration
 
    unsigned int update_process_title; /**< Behaviour for updating the process title */
 
+   bool log_async; /**< Hand the log lines to a log writer process */
+
    bool authquery; /**< Is authentication query enabled */
 
    atomic_ushort active_connections; /**< The active number of connections */
@@ -673,16 +864,25 @@ struct main_configuration
    int validation;                                /**< Validation mode */
    unsigned int background_interval;              /**< Background validation timer in seconds */
    int max_retries;                               /**< The maximum number of retries */
+   int min_spare_workers;                         /**< The minimum number of idle pre-forked workers */
+   int max_spare_workers;                         /**< The maximum number of idle pre-forked workers */
+   int transaction_workers;                       /**< The number of multi-client transaction workers */
    int disconnect_client;                         /**< Disconnect client if idle for more than the specified seconds */
    bool disconnect_client_force;                  /**< Force a disconnect client if active for more than the specified seconds */
    char pidfile[MAX_PATH];                        /**< File containing the PID */
 
    int ev_backend;                 /**< Selected ev backend */
+   bool io_uring_multishot;        /**< io_uring multishot receive over a provided buffer ring */
+   int io_uring_buffers;           /**< The number of buffers in the io_uring buffer ring */
+   bool io_uring_registered_files; /**< Register the client and server descriptors with io_uring */
+   bool io_uring_sqpoll;           /**< Use an io_uring kernel submission thread */
    bool keep_alive;                /**< Use keep alive */
    bool nodelay;                   /**< Use NODELAY */
+   bool splice;                    /**< Relay large messages with splice() in the performance pipeline */
    int backlog;                    /**< The backlog for listen */
    bool tracker;                   /**< Tracker support */
    bool track_prepared_statements; /**< Track prepared statements (transaction pooling) */
+   bool track_session_parameters;  /**< Track session parameters (transaction pooling) */
 
    char unix_socket_dir[MISC_LENGTH]; /**< The directory for the Unix Domain Socket */
 
@@ -695,10 +895,24 @@ struct main_configuration
    int number_of_frontend_users; /**< The number of users */
    int number_of_admins;         /**< The number of admins */
 
-   atomic_schar states[MAX_NUMBER_OF_CONNECTIONS]; /**< The states */
+   atomic_schar states[MAX_NUMBER_OF_CONNECTIONS];        /**< The states */
+   atomic_uint fd_generations[MAX_NUMBER_OF_CONNECTIONS]; /**< The generation of the descriptor of each slot in the main process */
+
+   struct slot_identity slot_identities[NUMBER_OF_SLOT_LISTS]; /**< The identities of the free slot lists */
+   struct slot_list free_slots[NUMBER_OF_SLOT_LISTS];          /**< The free slots per limit rule / username / database */
+   struct slot_list notinit_slots;                             /**< The slots without a connection */
+   struct wait_queue wait_queues[NUMBER_OF_SLOT_LISTS];        /**< The processes waiting per limit rule / username / database */
+   atomic_int waiters;                                         /**< The number of processes waiting */
+
+   struct transaction_worker tx_workers[NUMBER_OF_TRANSACTION_WORKERS]; /**< The transaction workers */
+   atomic_int parked_workers;                                           /**< The number of transaction workers with waiting clients */
+
    struct server servers[NUMBER_OF_SERVERS];       /**< The servers */
    struct hba hbas[NUMBER_OF_HBAS];                /**< The HBA entries */
    struct limit limits[NUMBER_OF_LIMITS];          /**< The limit entries */
+   struct limit_index limit_indexes[2];            /**< The index of the limit entries */
+   atomic_int limit_index;                         /**< The active index of the limit entries */
+   atomic_uint limit_generation;                   /**< The generation of the limit entries, odd while they change */
    struct user users[NUMBER_OF_USERS];             /**< The users */
    struct user frontend_users[NUMBER_OF_USERS];    /**< The frontend users */
    struct user admins[NUMBER_OF_ADMINS];           /**< The admins */
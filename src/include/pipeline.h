@@ -82,6 +82,27 @@ struct pipeline session_pipeline(void);
  */
 struct pipeline transaction_pipeline(void);
 
+/**
+ * Run a transaction worker, which serves the clients handed over to it
+ * from a single event loop. This function doesn't return
+ * @param index The index of the worker
+ * @param argv The argv
+ */
+void
+pgagroal_transaction_worker(int index, char** argv);
+
+/**
+ * Hand over an authenticated client to the least loaded transaction worker
+ * @param client_fd The client descriptor
+ * @param username The user name
+ * @param database The database
+ * @param appname The application name
+ * @param address The client address
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_transaction_handover(int client_fd, char* username, char* database, char* appname, char* address);
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,12 +46,14 @@ extern "C" {
  * @param database The database
  * @param reuse Should a slot be reused
  * @param transaction_mode Obtain a connection in transaction mode
+ * @param wait Wait for a connection when the pool is full
+ * @param preferred The slot to reuse if it is free, or -1
  * @param slot The resulting slot
  * @param ssl The resulting SSL (can be NULL)
  * @return 0 upon success, 1 if pool is full, otherwise 2
  */
 int
-pgagroal_get_connection(char* username, char* database, bool reuse, bool transaction_mode, int* slot, SSL** ssl);
+pgagroal_get_connection(char* username, char* database, bool reuse, bool transaction_mode, bool wait, int preferred, int* slot, SSL** ssl);
 
 /**
  * Return a connection
@@ -163,6 +165,57 @@ pgagroal_pool_status(void);
 void
 pgagroal_prefill_if_can(bool do_fork, bool initial);
 
+/**
+ * The main process changed the descriptor of a slot, which
+ * increases the generation of the descriptor
+ * @param slot The slot
+ */
+void
+pgagroal_pool_descriptor_changed(int slot);
+
+/**
+ * Does the process know the descriptor of a slot, i.e. it didn't
+ * change in the main process since the process was forked
+ * @param slot The slot
+ * @return true if the descriptor is known, otherwise false
+ */
+bool
+pgagroal_pool_descriptor_known(int slot);
+
+/**
+ * Add a slot to a slot list
+ * @param list The slot list
+ * @param slot The slot
+ */
+void
+pgagroal_slot_list_add(struct slot_list* list, int slot);
+
+/**
+ * Remove a slot from a slot list
+ * @param list The slot list
+ * @param slot The slot
+ */
+void
+pgagroal_slot_list_remove(struct slot_list* list, int slot);
+
+/**
+ * Find a recently added slot which is still listed in a slot list
+ * @param list The slot list
+ * @param n The position, where 0 is the most recently added slot
+ * @return The slot, or -1 if it has been taken since
+ */
+int
+pgagroal_slot_list_recent(struct slot_list* list, int n);
+
+/**
+ * Find the lowest slot listed in a slot list
+ * @param list The slot list
+ * @param from The first slot to consider
+ * @return The slot, or -1 if there is none below max_connections
+ */
+int
+pgagroal_slot_list_next(struct slot_list* list, int from);
+
 #ifdef __cplusplus
 }
 #endif
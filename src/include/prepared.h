@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGAGROAL_PREPARED_H
+#define PGAGROAL_PREPARED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgagroal.h>
+#include <art.h>
+#include <message.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MAX_PREPARED_STATEMENTS 64
+
+/** @struct prepared_slot
+ * Defines the prepared statements of the connection of a slot.
+ *
+ * The statements are known by the hash of their Parse message, and are only
+ * changed by the process that has the slot
+ */
+struct prepared_slot
+{
+   int backend_pid;                           /**< The backend process id of the statements */
+   int backend_secret;                        /**< The backend secret of the statements */
+   uint32_t clock;                            /**< The use counter */
+   uint64_t hashes[MAX_PREPARED_STATEMENTS];  /**< The statements, 0 if not used */
+   uint32_t used[MAX_PREPARED_STATEMENTS];    /**< The last use of the statements */
+};
+
+/** @struct prepared_request
+ * Defines a request which the server hasn't answered yet
+ */
+struct prepared_request
+{
+   char kind;     /**< The kind of the request, Parse, Close, Sync, 'd' for a Describe of the client
+                       or 'D' for a Describe that answers a Parse of the client */
+   bool injected; /**< Was the request added by pgagroal */
+   uint64_t hash; /**< The hash of the statement, 0 if not known */
+};
+
+/** @struct prepared_client
+ * Defines the prepared statements of a client
+ */
+struct prepared_client
+{
+   struct prepared_slot* slots;       /**< The prepared statements of the slots */
+   struct art* statements;            /**< The Parse messages of the client by statement name */
+   struct prepared_request* requests; /**< The requests which the server hasn't answered yet */
+   int requests_size;                 /**< The size of the request ring */
+   int requests_head;                 /**< The first request */
+   int requests_count;                /**< The number of requests */
+   int client_remaining;              /**< The remaining bytes of the current client message */
+   int server_remaining;              /**< The remaining bytes of the current server message */
+   bool server_skip;                  /**< Are the remaining bytes of the current server message removed */
+   char* pending;                     /**< The incomplete client message */
+   size_t pending_length;             /**< The length of the incomplete client message */
+   size_t pending_size;               /**< The size of the incomplete client message buffer */
+   char server_pending[8];            /**< The incomplete server message */
+   size_t server_pending_length;      /**< The length of the incomplete server message */
+   char* buffer;                      /**< The rewritten data */
+   size_t buffer_length;              /**< The length of the rewritten data */
+   size_t buffer_size;                /**< The size of the rewritten data buffer */
+   struct message message;            /**< The rewritten message */
+};
+
+/**
+ * Get the size of the shared memory for the prepared statements of the slots
+ * @param shmem The shared memory segment
+ * @return The size
+ */
+size_t
+pgagroal_prepared_size(void* shmem);
+
+/**
+ * Create the prepared statement state of a client
+ * @param slots The prepared statements of the slots in shared memory
+ * @param client The resulting state
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_prepared_create(void* slots, struct prepared_client** client);
+
+/**
+ * Destroy the prepared statement state of a client
+ * @param client The state
+ */
+void
+pgagroal_prepared_destroy(struct prepared_client* client);
+
+/**
+ * A client got a connection. The statements of the slot are forgotten
+ * if the slot has another connection than when they were prepared
+ * @param client The state
+ * @param slot The slot
+ */
+void
+pgagroal_prepared_start(struct prepared_client* client, int slot);
+
+/**
+ * Rewrite the messages of a client. Named statements are renamed to
+ * a name which is unique for the pool, and are prepared again on a
+ * connection that doesn't have them. An incomplete message is kept
+ * until the rest of it is received
+ * @param client The state
+ * @param slot The slot
+ * @param msg The message from the client
+ * @param result The message for the server, which may be empty
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_prepared_client(struct prepared_client* client, int slot, struct message* msg, struct message** result);
+
+/**
+ * Rewrite the messages of a server. The responses to the requests added
+ * by pgagroal are removed
+ * @param client The state
+ * @param slot The slot
+ * @param msg The message from the server
+ * @param result The message for the client, which may be empty
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_prepared_server(struct prepared_client* client, int slot, struct message* msg, struct message** result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
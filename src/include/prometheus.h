@@ -35,8 +35,14 @@ extern "C" {
 #endif
 
 #include <ev.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+// Pool acquisition results
+#define ACQUIRE_HIT     0
+#define ACQUIRE_WAIT    1
+#define ACQUIRE_TIMEOUT 2
+
 // Certificate type constants
 #define PGAGROAL_CERT_TYPE_MAIN    "main"
 #define PGAGROAL_CERT_TYPE_METRICS "metrics"
@@ -68,12 +74,14 @@ extern "C" {
 #define PROMETHEUS_DEFAULT_CACHE_SIZE (256 * 1024)
 
 /**
- * Create a prometheus instance
- * @param client_ssl The client SSL structure
- * @param fd The client descriptor
+ * Run the metrics server until it receives SIGQUIT.
+ * The server keeps HTTP/1.1 connections open between scrapes
+ * @param fds The metrics descriptors
+ * @param fds_length The number of metrics descriptors
+ * @param argv The argv
  */
 void
-pgagroal_prometheus(SSL* client_ssl, int fd);
+pgagroal_prometheus_server(int* fds, int fds_length, char** argv);
 
 /**
  * Create a prometheus instance for vault
@@ -102,6 +110,60 @@ pgagroal_vault_init_prometheus(size_t* p_size, void** p_shmem);
 void
 pgagroal_prometheus_session_time(double time);
 
+/**
+ * Get the query latency histogram of an user and database,
+ * claiming a free entry, or reusing an entry without clients,
+ * if there is none yet. The index is released with
+ * pgagroal_prometheus_query_latency_release
+ * @param username The user name
+ * @param database The database
+ * @return The index of the histogram, or -1 if all entries are in use
+ */
+int
+pgagroal_prometheus_query_latency_index(char* username, char* database);
+
+/**
+ * Release the query latency histogram of a client
+ * @param index The index of the histogram
+ */
+void
+pgagroal_prometheus_query_latency_release(int index);
+
+/**
+ * Add a query latency to a histogram
+ * @param index The index of the histogram
+ * @param micros The latency in microseconds
+ */
+void
+pgagroal_prometheus_query_latency(int index, uint64_t micros);
+
+/**
+ * Get a percentile of a query latency histogram
+ * @param index The index of the histogram
+ * @param percentile The percentile, between 0 and 100
+ * @return The upper bound of the bucket holding the percentile in microseconds
+ */
+uint64_t
+pgagroal_prometheus_query_latency_percentile(int index, double percentile);
+
+/**
+ * Add a pool acquisition
+ * @param limit_index The limit rule, or -1 if none
+ * @param result The result (ACQUIRE_HIT, ACQUIRE_WAIT or ACQUIRE_TIMEOUT)
+ * @param micros The wait time in microseconds
+ */
+void
+pgagroal_prometheus_connection_acquire(int limit_index, int result, uint64_t micros);
+
+/**
+ * Get a percentile of the pool acquisition wait times
+ * @param limit_index The limit rule, or -1 if none
+ * @param percentile The percentile, between 0 and 100
+ * @return The upper bound of the bucket holding the percentile in microseconds
+ */
+uint64_t
+pgagroal_prometheus_connection_acquire_percentile(int limit_index, double percentile);
+
 /**
  * Connection error
  */
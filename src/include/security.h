@@ -102,6 +102,25 @@ pgagroal_get_master_key(char** masterkey);
 int
 pgagroal_md5(char* str, int length, char** md5);
 
+/**
+ * Calculate the SCRAM-SHA-256 ClientProof and ServerSignature of an exchange
+ * @param password The password
+ * @param salt The salt
+ * @param salt_length The length of the salt
+ * @param iterations The number of iterations
+ * @param client_first_message_bare The client-first-message-bare
+ * @param server_first_message The server-first-message
+ * @param client_final_message_wo_proof The client-final-message-without-proof
+ * @param proof The ClientProof of 32 bytes
+ * @param signature The ServerSignature of 32 bytes
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_scram256_proof(char* password, char* salt, int salt_length, int iterations,
+                        char* client_first_message_bare, char* server_first_message,
+                        char* client_final_message_wo_proof,
+                        unsigned char** proof, unsigned char** signature);
+
 /**
  * Is the user known to the system
  * @param user The user name
@@ -182,9 +201,12 @@ pgagroal_close_ssl(SSL* ssl);
 /**
  * Check if a request is SSL request or not
  * @param client_fd The client file descriptor
+ * @param wait Wait for the client to send data
+ * @param ssl_request The result
+ * @return 0 upon success, 1 if the client didn't send data yet, otherwise 2
  */
-bool
-pgagroal_is_ssl_request(int client_fd);
+int
+pgagroal_is_ssl_request(int client_fd, bool wait, bool* ssl_request);
 
 /**
  * Extract server parameters received during the latest authentication
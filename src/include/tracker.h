@@ -34,9 +34,13 @@ extern "C" {
 #endif
 
 #include <pgagroal.h>
+#include <json.h>
 
+#include <stdatomic.h>
 #include <stdlib.h>
 
+#include <openssl/ssl.h>
+
 #define TRACKER_CLIENT_START               0
 #define TRACKER_CLIENT_STOP                1
 
@@ -74,6 +78,61 @@ extern "C" {
 #define TRACKER_SOCKET_DISASSOCIATE_CLIENT 102
 #define TRACKER_SOCKET_DISASSOCIATE_SERVER 103
 
+#define TRACKER_RING_SLOTS                 8192
+#define TRACKER_NAME_LENGTH                64
+
+/** @struct tracker_event
+ * A tracking event. The strings are truncated to TRACKER_NAME_LENGTH - 1
+ */
+struct tracker_event
+{
+   atomic_ulong sequence;               /**< The position of the event plus one, 0 while it is written */
+   long long timestamp;                 /**< The time in microseconds since the epoch */
+   int id;                              /**< The event identifier */
+   int pid;                             /**< The process */
+   int slot;                            /**< The slot, or -1 */
+   int state;                           /**< The state of the slot, or -3 */
+   int server;                          /**< The server, or -1 */
+   int fd;                              /**< The descriptor of the slot, or -1 */
+   int socket;                          /**< The socket of a socket event, or -1 */
+   int limit_rule;                      /**< The limit rule, or -1 */
+   int active_connections;              /**< The number of active connections */
+   signed char new;                     /**< Is the connection new, or -1 */
+   signed char tx_mode;                 /**< Is the connection in transaction mode, or -1 */
+   signed char has_security;            /**< The security message type, or -3 */
+   char username[TRACKER_NAME_LENGTH];  /**< The user name */
+   char database[TRACKER_NAME_LENGTH];  /**< The database */
+   char appname[TRACKER_NAME_LENGTH];   /**< The application name */
+} __attribute__((aligned(64)));
+
+/** @struct tracker_ring
+ * The most recent tracking events. A process takes a position with a single
+ * atomic increment and overwrites the oldest event, so the events are
+ * available until TRACKER_RING_SLOTS newer events are written
+ */
+struct tracker_ring
+{
+   atomic_ulong head;                                /**< The next position */
+   struct tracker_event events[TRACKER_RING_SLOTS]; /**< The events */
+} __attribute__((aligned(64)));
+
+/**
+ * Create the shared memory segment for the tracking events
+ * @param p_size The resulting size of the shared memory segment
+ * @param p_shmem The resulting shared memory segment
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_init_tracker(size_t* p_size, void** p_shmem);
+
+/**
+ * Get the name of a tracking event
+ * @param id The event identifier
+ * @return The name
+ */
+char*
+pgagroal_tracker_event_name(int id);
+
 /**
  * Tracking event: Basic
  * @param id The event identifier
@@ -99,6 +158,17 @@ pgagroal_tracking_event_slot(int id, int slot);
 void
 pgagroal_tracking_event_socket(int id, int socket);
 
+/**
+ * Stream the tracking events to a management client until it disconnects
+ * @param ssl The SSL connection
+ * @param client_fd The client
+ * @param compression The compress method for wire protocol
+ * @param encryption The encrypt method for wire protocol
+ * @param payload The payload
+ */
+void
+pgagroal_tracker_stream(SSL* ssl, int client_fd, uint8_t compression, uint8_t encryption, struct json* payload);
+
 #ifdef __cplusplus
 }
 #endif
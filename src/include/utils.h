@@ -65,6 +65,27 @@ struct client
    struct client* next; /**< The next client */
 };
 
+/** @struct spare_worker
+ * Defines an idle pre-forked worker
+ */
+struct spare_worker
+{
+   pid_t pid;                 /**< The process id */
+   int fd;                    /**< The descriptor used to hand over a client */
+   unsigned long generation;  /**< The generation of the configuration at fork */
+   struct spare_worker* next; /**< The next spare worker */
+};
+
+/** @struct respawn
+ * Defines the restart state of a helper process
+ */
+struct respawn
+{
+   time_t started; /**< The time the process was started */
+   int failures;   /**< The number of runs in a row that ended too soon */
+   time_t next;    /**< The time of a pending restart, or 0 */
+};
+
 /** @struct pgagroal_command
  * Defines pgagroal commands.
  * The necessary fields are marked with an ">".
@@ -396,6 +417,30 @@ pgagroal_set_connection_proc_title(int argc, char** argv, struct connection* con
 char*
 pgagroal_get_timestamp_string(time_t start_time, time_t end_time, int32_t* seconds);
 
+/**
+ * Get the current value of the monotonic clock
+ * @return The number of microseconds
+ */
+uint64_t
+pgagroal_get_monotonic_micros(void);
+
+/**
+ * Get the log-linear latency bucket of a value, with four
+ * sub-buckets per power of two
+ * @param micros The value in microseconds
+ * @return The bucket, between 0 and LATENCY_BUCKETS - 1
+ */
+int
+pgagroal_latency_bucket(uint64_t micros);
+
+/**
+ * Get the upper bound of a log-linear latency bucket
+ * @param bucket The bucket
+ * @return The upper bound in microseconds
+ */
+uint64_t
+pgagroal_latency_bucket_upper(int bucket);
+
 /**
  * Provide the application version number as a unique value composed of the three
  * specified parts. For example, when invoked with (1,5,0) it returns 10500.
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGAGROAL_WIRE_H
+#define PGAGROAL_WIRE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define WIRE_BUFFER_SIZE 65536
+
+/** @struct wire
+ * Defines a blocking socket speaking the PostgreSQL wire protocol
+ * for the tools and the tests. The messages are appended to the
+ * output buffer and written by pgagroal_wire_flush
+ */
+struct wire
+{
+   int fd;                        /**< The socket */
+   char input[WIRE_BUFFER_SIZE];  /**< The input buffer */
+   size_t input_start;            /**< The start of the unread input */
+   size_t input_end;              /**< The end of the unread input */
+   char* message;                 /**< The payload of the last message */
+   size_t message_size;           /**< The size of the message buffer */
+   char* output;                  /**< The output buffer */
+   size_t output_length;          /**< The length of the output */
+   size_t output_size;            /**< The size of the output buffer */
+   bool failed;                   /**< Did an append fail */
+};
+
+/**
+ * Use a socket, discarding the buffered input and output
+ * @param w The wire
+ * @param fd The socket
+ */
+void
+pgagroal_wire_reset(struct wire* w, int fd);
+
+/**
+ * Free the buffers of a wire
+ * @param w The wire
+ */
+void
+pgagroal_wire_destroy(struct wire* w);
+
+/**
+ * Read bytes
+ * @param w The wire
+ * @param data The data, or NULL to skip the bytes
+ * @param length The number of bytes
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_wire_read(struct wire* w, void* data, size_t length);
+
+/**
+ * Read a message. The payload is kept in the message buffer of the wire
+ * until the next message, and is always terminated
+ * @param w The wire
+ * @param kind The kind of the message
+ * @param length The length of the payload
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_wire_read_message(struct wire* w, char* kind, int* length);
+
+/**
+ * Write the output buffer
+ * @param w The wire
+ * @return 0 upon success, otherwise 1, also after a failed append
+ */
+int
+pgagroal_wire_flush(struct wire* w);
+
+/**
+ * Append bytes to the output buffer. A failed append discards the
+ * output, and fails the appends and flushes until the wire is reset
+ * @param w The wire
+ * @param data The data
+ * @param length The number of bytes
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_wire_append(struct wire* w, void* data, size_t length);
+
+/**
+ * Append a byte to the output buffer
+ * @param w The wire
+ * @param b The byte
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_wire_append_byte(struct wire* w, char b);
+
+/**
+ * Append an int16 to the output buffer
+ * @param w The wire
+ * @param i The value
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_wire_append_int16(struct wire* w, int16_t i);
+
+/**
+ * Append an int32 to the output buffer
+ * @param w The wire
+ * @param i The value
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_wire_append_int32(struct wire* w, int32_t i);
+
+/**
+ * Append a string and its terminator to the output buffer
+ * @param w The wire
+ * @param str The string
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_wire_append_string(struct wire* w, char* str);
+
+/**
+ * Append the kind and the length of a message to the output buffer
+ * @param w The wire
+ * @param kind The kind
+ * @param length The length, including itself
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_wire_append_header(struct wire* w, char kind, int32_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -43,6 +43,7 @@
 /* system */
 #include <ctype.h>
 #include <errno.h>
+#include <sched.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -77,6 +78,10 @@ static int extract_value(char* str, int offset, char** value);
 static void extract_hba(char* str, char** type, char** database, char** user, char** address, char** method);
 static void extract_limit(char* str, int server_max, char** database, char** user, int* max_size, int* initial_size, int* min_size, char aliases[MAX_ALIASES][MAX_DATABASE_LENGTH], int* aliases_count);
 static void copy_limit(struct limit* dst, struct limit* src);
+static uint32_t limit_name_hash(char* name);
+static struct limit_name* add_limit_name(struct limit_index* index, char* name);
+static void limit_write_begin(struct main_configuration* config);
+static void limit_write_end(struct main_configuration* config);
 static unsigned int as_seconds(char* str, unsigned int* age, unsigned int default_age);
 static unsigned int as_bytes(char* str, unsigned int* bytes, unsigned int default_bytes);
 static int extract_alias_with_space(char* str, int offset, char** db_part);
@@ -158,6 +163,9 @@ pgagroal_init_configuration(void* shm)
    config->validation = VALIDATION_OFF;
    config->background_interval = DEFAULT_BACKGROUND_INTERVAL;
    config->max_retries = 5;
+   config->min_spare_workers = 0;
+   config->max_spare_workers = 0;
+   config->transaction_workers = 0;
    config->common.authentication_timeout = DEFAULT_AUTHENTICATION_TIMEOUT;
    config->disconnect_client = 0;
    config->disconnect_client_force = false;
@@ -166,18 +174,25 @@ pgagroal_init_configuration(void* shm)
 
    config->keep_alive = true;
    config->nodelay = true;
+   config->splice = false;
    config->backlog = -1;
    config->common.hugepage = HUGEPAGE_TRY;
    config->tracker = false;
    config->track_prepared_statements = false;
+   config->track_session_parameters = false;
 
    config->ev_backend = PGAGROAL_EVENT_BACKEND_AUTO;
+   config->io_uring_multishot = false;
+   config->io_uring_buffers = DEFAULT_IO_URING_BUFFERS;
+   config->io_uring_registered_files = false;
+   config->io_uring_sqpoll = false;
 
    config->common.log_type = PGAGROAL_LOGGING_TYPE_CONSOLE;
    config->common.log_level = PGAGROAL_LOGGING_LEVEL_INFO;
    config->common.log_connections = false;
    config->common.log_disconnections = false;
    config->common.log_mode = PGAGROAL_LOGGING_MODE_APPEND;
+   config->log_async = false;
    atomic_init(&config->common.log_lock, STATE_FREE);
 
    memcpy(config->common.default_log_path, "pgagroal.log", strlen("pgagroal.log"));
@@ -515,6 +530,24 @@ pgagroal_validate_configuration(void* shm, bool has_unix_socket, bool has_main_s
       config->max_connections = MAX_NUMBER_OF_CONNECTIONS;
    }
 
+   if (config->min_spare_workers < 0 || config->max_spare_workers < 0)
+   {
+      pgagroal_log_fatal("pgagroal: min_spare_workers and max_spare_workers must be greater or equal to 0");
+      return 1;
+   }
+
+   if (config->max_spare_workers < config->min_spare_workers)
+   {
+      pgagroal_log_warn("pgagroal: max_spare_workers (%d) is less than min_spare_workers (%d)", config->max_spare_workers, config->min_spare_workers);
+      config->max_spare_workers = config->min_spare_workers;
+   }
+
+   if (config->transaction_workers < 0 || config->transaction_workers > NUMBER_OF_TRANSACTION_WORKERS)
+   {
+      pgagroal_log_fatal("pgagroal: transaction_workers must be between 0 and %d", NUMBER_OF_TRANSACTION_WORKERS);
+      return 1;
+   }
+
    if (config->number_of_frontend_users > 0 && config->allow_unknown_users)
    {
       pgagroal_log_warn("pgagroal: Frontend users should not be used with allow_unknown_users");
@@ -592,6 +625,14 @@ pgagroal_validate_configuration(void* shm, bool has_unix_socket, bool has_main_s
                             config->servers[i].lineno);
          return 1;
       }
+
+      if (config->servers[i].tls_ktls && !config->servers[i].tls)
+      {
+         pgagroal_log_warn("pgagroal: tls_ktls requires tls for server [%s] (%s:%d)",
+                           config->servers[i].name,
+                           config->common.configuration_path[0],
+                           config->servers[i].lineno);
+      }
    }
 
    // check for duplicated servers
@@ -743,6 +784,33 @@ pgagroal_validate_configuration(void* shm, bool has_unix_socket, bool has_main_s
       }
    }
 
+   if (config->splice && config->pipeline != PIPELINE_PERFORMANCE)
+   {
+      pgagroal_log_warn("pgagroal: splice is only used by the performance pipeline");
+      config->splice = false;
+   }
+
+#if !HAVE_LINUX
+   if (config->splice)
+   {
+      pgagroal_log_warn("pgagroal: splice is only supported on Linux");
+      config->splice = false;
+   }
+#endif
+
+   if (config->transaction_workers > 0 && config->pipeline != PIPELINE_TRANSACTION)
+   {
+      pgagroal_log_warn("pgagroal: transaction_workers is only used by the transaction pipeline");
+      config->transaction_workers = 0;
+   }
+
+   if (config->io_uring_buffers < 1 || config->io_uring_buffers > MAX_IO_URING_BUFFERS ||
+       (config->io_uring_buffers & (config->io_uring_buffers - 1)) != 0)
+   {
+      pgagroal_log_fatal("pgagroal: io_uring_buffers must be a power of 2 between 1 and %d", MAX_IO_URING_BUFFERS);
+      return 1;
+   }
+
    if (config->ev_backend == PGAGROAL_EVENT_BACKEND_INVALID)
    {
       pgagroal_log_warn("Configured event backend is invalid. Default to 'auto'");
@@ -782,12 +850,20 @@ pgagroal_validate_configuration(void* shm, bool has_unix_socket, bool has_main_s
       }
 
       /* see doc: https://docs.kernel.org/admin-guide/sysctl/kernel.html#io-uring-disabled */
-      if (config->common.tls || (rval == '1') || (rval == '2'))
+      if (config->common.tls || config->transaction_workers > 0 || config->splice || (rval == '1') || (rval == '2'))
       {
          if (config->common.tls)
          {
             pgagroal_log_warn("io_uring not supported with tls on");
          }
+         else if (config->transaction_workers > 0)
+         {
+            pgagroal_log_warn("io_uring not supported with transaction_workers");
+         }
+         else if (config->splice)
+         {
+            pgagroal_log_warn("io_uring not supported with splice");
+         }
          else
          {
             pgagroal_log_warn("io_uring supported but not enabled. Enable io_uring by setting /proc/sys/kernel/io_uring_disabled to '0'");
@@ -1550,6 +1626,140 @@ pgagroal_validate_limit_configuration(void* shm)
    return 0;
 }
 
+int
+pgagroal_build_limit_index(void* shm)
+{
+   int next;
+   struct limit_index* index;
+   struct limit_name* entry;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shm;
+
+   /* Build the inactive index, such that the active index stays in use if this fails */
+   next = atomic_load(&config->limit_index) == 0 ? 1 : 0;
+   index = &config->limit_indexes[next];
+
+   memset(index, 0, sizeof(struct limit_index));
+
+   for (int i = 0; i < config->number_of_limits; i++)
+   {
+      uint64_t bit = 1ULL << i;
+
+      if (!strcmp("all", config->limits[i].username))
+      {
+         index->all_usernames |= bit;
+      }
+
+      if (!strcmp("all", config->limits[i].database))
+      {
+         index->all_databases |= bit;
+      }
+
+      entry = add_limit_name(index, config->limits[i].username);
+      if (entry == NULL)
+      {
+         goto error;
+      }
+      entry->usernames |= bit;
+
+      entry = add_limit_name(index, config->limits[i].database);
+      if (entry == NULL)
+      {
+         goto error;
+      }
+      entry->databases |= bit;
+
+      for (int j = 0; j < config->limits[i].aliases_count; j++)
+      {
+         entry = add_limit_name(index, config->limits[i].aliases[j]);
+         if (entry == NULL)
+         {
+            goto error;
+         }
+         entry->aliases |= bit;
+      }
+   }
+
+   atomic_store(&config->limit_index, next);
+
+   return 0;
+
+error:
+
+   pgagroal_log_error("Too many names in the limit entries (max %d)", NUMBER_OF_LIMIT_NAMES);
+
+   return 1;
+}
+
+struct limit_index*
+pgagroal_get_limit_index(void* shm)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shm;
+
+   return &config->limit_indexes[atomic_load(&config->limit_index)];
+}
+
+unsigned int
+pgagroal_limit_read_begin(void* shm)
+{
+   unsigned int generation;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shm;
+
+   /* An odd generation means that a reload is changing the entries */
+   while ((generation = atomic_load_explicit(&config->limit_generation, memory_order_acquire)) & 1)
+   {
+      sched_yield();
+   }
+
+   return generation;
+}
+
+bool
+pgagroal_limit_read_retry(void* shm, unsigned int generation)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shm;
+
+   atomic_thread_fence(memory_order_acquire);
+
+   return atomic_load_explicit(&config->limit_generation, memory_order_relaxed) != generation;
+}
+
+struct limit_name*
+pgagroal_find_limit_name(struct limit_index* index, char* name)
+{
+   uint32_t hash;
+   int position;
+
+   hash = limit_name_hash(name);
+   position = (int)(hash & (NUMBER_OF_LIMIT_NAMES - 1));
+
+   for (int i = 0; i < NUMBER_OF_LIMIT_NAMES; i++)
+   {
+      struct limit_name* entry = &index->names[position];
+
+      if (entry->hash == 0)
+      {
+         return NULL;
+      }
+
+      if (entry->hash == hash && !strcmp(name, entry->name))
+      {
+         return entry;
+      }
+
+      position = (position + 1) & (NUMBER_OF_LIMIT_NAMES - 1);
+   }
+
+   return NULL;
+}
+
 /**
  *
  */
@@ -2368,6 +2578,11 @@ pgagroal_reload_configuration(bool* r)
       goto error;
    }
 
+   if (pgagroal_build_limit_index(reload))
+   {
+      goto error;
+   }
+
    if (pgagroal_validate_users_configuration(reload))
    {
       goto error;
@@ -3442,18 +3657,23 @@ transfer_configuration(struct main_configuration* config, struct main_configurat
    if (strncmp(config->common.log_path, reload->common.log_path, MISC_LENGTH) || config->common.log_rotation_size != reload->common.log_rotation_size || config->common.log_rotation_age != reload->common.log_rotation_age || config->common.log_mode != reload->common.log_mode)
    {
       pgagroal_log_debug("Log restart triggered!");
-      pgagroal_stop_logging();
       config->common.log_rotation_size = reload->common.log_rotation_size;
       config->common.log_rotation_age = reload->common.log_rotation_age;
       config->common.log_mode = reload->common.log_mode;
       memcpy(config->common.log_line_prefix, reload->common.log_line_prefix, MISC_LENGTH);
       memcpy(config->common.log_path, reload->common.log_path, MISC_LENGTH);
-      pgagroal_start_logging();
+      pgagroal_reopen_logging();
    }
 
    config->common.log_connections = reload->common.log_connections;
    config->common.log_disconnections = reload->common.log_disconnections;
 
+   /* log_async */
+   if (restart_bool("log_async", config->log_async, reload->log_async))
+   {
+      changed = true;
+   }
+
    /* log_lock */
 
    config->authquery = reload->authquery;
@@ -3488,6 +3708,13 @@ transfer_configuration(struct main_configuration* config, struct main_configurat
    config->validation = reload->validation;
    config->background_interval = reload->background_interval;
    config->max_retries = reload->max_retries;
+   config->min_spare_workers = reload->min_spare_workers;
+   config->max_spare_workers = reload->max_spare_workers;
+   /* transaction_workers */
+   if (restart_int("transaction_workers", config->transaction_workers, reload->transaction_workers))
+   {
+      changed = true;
+   }
    config->common.authentication_timeout = reload->common.authentication_timeout;
    config->disconnect_client = reload->disconnect_client;
    config->disconnect_client_force = reload->disconnect_client_force;
@@ -3503,6 +3730,32 @@ transfer_configuration(struct main_configuration* config, struct main_configurat
       changed = true;
    }
 
+   if (restart_bool("io_uring_multishot", config->io_uring_multishot, reload->io_uring_multishot))
+   {
+      changed = true;
+   }
+
+   if (restart_int("io_uring_buffers", config->io_uring_buffers, reload->io_uring_buffers))
+   {
+      changed = true;
+   }
+
+   if (restart_bool("io_uring_registered_files", config->io_uring_registered_files, reload->io_uring_registered_files))
+   {
+      changed = true;
+   }
+
+   if (restart_bool("io_uring_sqpoll", config->io_uring_sqpoll, reload->io_uring_sqpoll))
+   {
+      changed = true;
+   }
+
+   /* splice */
+   if (restart_bool("splice", config->splice, reload->splice))
+   {
+      changed = true;
+   }
+
    config->keep_alive = reload->keep_alive;
    config->nodelay = reload->nodelay;
    config->backlog = reload->backlog;
@@ -3513,7 +3766,16 @@ transfer_configuration(struct main_configuration* config, struct main_configurat
       changed = true;
    }
    config->tracker = reload->tracker;
-   config->track_prepared_statements = reload->track_prepared_statements;
+
+   /* The prepared statements and the parameters of the connections are kept in the pipeline shared memory */
+   if (restart_bool("track_prepared_statements", config->track_prepared_statements, reload->track_prepared_statements))
+   {
+      changed = true;
+   }
+   if (restart_bool("track_session_parameters", config->track_session_parameters, reload->track_session_parameters))
+   {
+      changed = true;
+   }
 
    /* unix_socket_dir */
 
@@ -3572,6 +3834,8 @@ transfer_configuration(struct main_configuration* config, struct main_configurat
    else
    {
       // Successful reload - copy all limit configurations including aliases
+      limit_write_begin(config);
+
       for (int i = 0; i < reload->number_of_limits; i++)
       {
          copy_limit(&config->limits[i], &reload->limits[i]);
@@ -3586,6 +3850,14 @@ transfer_configuration(struct main_configuration* config, struct main_configurat
          }
       }
       config->number_of_limits = reload->number_of_limits;
+
+      /* The previous index stays active if the new one can't be built */
+      if (pgagroal_build_limit_index(config))
+      {
+         changed = true;
+      }
+
+      limit_write_end(config);
    }
 
    memset(&config->users[0], 0, sizeof(struct user) * NUMBER_OF_USERS);
@@ -3660,7 +3932,8 @@ is_same_tls(struct server* src, struct server* dst)
    if (src->tls == dst->tls &&
        !strncmp(src->tls_cert_file, dst->tls_cert_file, MAX_PATH) &&
        !strncmp(src->tls_key_file, dst->tls_key_file, MAX_PATH) &&
-       !strncmp(src->tls_ca_file, dst->tls_ca_file, MAX_PATH))
+       !strncmp(src->tls_ca_file, dst->tls_ca_file, MAX_PATH) &&
+       src->tls_ktls == dst->tls_ktls)
    {
       return true;
    }
@@ -3725,6 +3998,66 @@ copy_limit(struct limit* dst, struct limit* src)
    dst->lineno = src->lineno;
 }
 
+static uint32_t
+limit_name_hash(char* name)
+{
+   uint32_t hash = 2166136261u;
+
+   /* FNV-1a */
+   for (char* c = name; *c != '\0'; c++)
+   {
+      hash = (hash ^ (unsigned char)*c) * 16777619u;
+   }
+
+   /* 0 marks an unused entry */
+   return hash != 0 ? hash : 1;
+}
+
+static void
+limit_write_begin(struct main_configuration* config)
+{
+   /* Readers retry until the limit entries and their index match again */
+   atomic_fetch_add_explicit(&config->limit_generation, 1, memory_order_relaxed);
+   atomic_thread_fence(memory_order_release);
+}
+
+static void
+limit_write_end(struct main_configuration* config)
+{
+   atomic_fetch_add_explicit(&config->limit_generation, 1, memory_order_release);
+}
+
+static struct limit_name*
+add_limit_name(struct limit_index* index, char* name)
+{
+   uint32_t hash;
+   int position;
+
+   hash = limit_name_hash(name);
+   position = (int)(hash & (NUMBER_OF_LIMIT_NAMES - 1));
+
+   for (int i = 0; i < NUMBER_OF_LIMIT_NAMES; i++)
+   {
+      struct limit_name* entry = &index->names[position];
+
+      if (entry->hash == 0)
+      {
+         entry->hash = hash;
+         memcpy(&entry->name[0], name, MIN(strlen(name), MAX_DATABASE_LENGTH - 1));
+         return entry;
+      }
+
+      if (entry->hash == hash && !strcmp(name, entry->name))
+      {
+         return entry;
+      }
+
+      position = (position + 1) & (NUMBER_OF_LIMIT_NAMES - 1);
+   }
+
+   return NULL;
+}
+
 static void
 copy_server(struct server* dst, struct server* src)
 {
@@ -3906,6 +4239,8 @@ restart_server(struct server* src, struct server* dst)
       restart_string(restart_message, dst->tls_key_file, src->tls_key_file, false);
       snprintf(restart_message, sizeof(restart_message), "Server <%s>, parameter <tls_ca_file>", src->name);
       restart_string(restart_message, dst->tls_ca_file, src->tls_ca_file, false);
+      snprintf(restart_message, sizeof(restart_message), "Server <%s>, parameter <tls_ktls>", src->name);
+      restart_bool(restart_message, dst->tls_ktls, src->tls_ktls);
       return 1;
    }
 
@@ -4471,6 +4806,10 @@ pgagroal_write_config_value(char* buffer, char* config_key, size_t buffer_size)
       {
          return to_string(buffer, config->common.log_line_prefix, buffer_size);
       }
+      else if (!strncmp(key, "log_async", MISC_LENGTH))
+      {
+         return to_bool(buffer, config->log_async);
+      }
 
       else if (!strncmp(key, "log_level", MISC_LENGTH))
       {
@@ -4588,6 +4927,18 @@ pgagroal_write_config_value(char* buffer, char* config_key, size_t buffer_size)
       {
          return to_int(buffer, config->max_retries);
       }
+      else if (!strncmp(key, "min_spare_workers", MISC_LENGTH))
+      {
+         return to_int(buffer, config->min_spare_workers);
+      }
+      else if (!strncmp(key, "max_spare_workers", MISC_LENGTH))
+      {
+         return to_int(buffer, config->max_spare_workers);
+      }
+      else if (!strncmp(key, "transaction_workers", MISC_LENGTH))
+      {
+         return to_int(buffer, config->transaction_workers);
+      }
       else if (!strncmp(key, "authentication_timeout", MISC_LENGTH))
       {
          return to_int(buffer, config->common.authentication_timeout);
@@ -4620,6 +4971,26 @@ pgagroal_write_config_value(char* buffer, char* config_key, size_t buffer_size)
       {
          return to_int(buffer, config->nodelay);
       }
+      else if (!strncmp(key, "splice", MISC_LENGTH))
+      {
+         return to_bool(buffer, config->splice);
+      }
+      else if (!strncmp(key, "io_uring_multishot", MISC_LENGTH))
+      {
+         return to_bool(buffer, config->io_uring_multishot);
+      }
+      else if (!strncmp(key, "io_uring_buffers", MISC_LENGTH))
+      {
+         return to_int(buffer, config->io_uring_buffers);
+      }
+      else if (!strncmp(key, "io_uring_registered_files", MISC_LENGTH))
+      {
+         return to_bool(buffer, config->io_uring_registered_files);
+      }
+      else if (!strncmp(key, "io_uring_sqpoll", MISC_LENGTH))
+      {
+         return to_bool(buffer, config->io_uring_sqpoll);
+      }
       else if (!strncmp(key, "backlog", MISC_LENGTH))
       {
          return to_int(buffer, config->backlog);
@@ -4632,6 +5003,10 @@ pgagroal_write_config_value(char* buffer, char* config_key, size_t buffer_size)
       {
          return to_bool(buffer, config->track_prepared_statements);
       }
+      else if (!strncmp(key, "track_session_parameters", MISC_LENGTH))
+      {
+         return to_bool(buffer, config->track_session_parameters);
+      }
       else
       {
          goto error;
@@ -4722,6 +5097,10 @@ pgagroal_write_server_config_value(char* buffer, char* server_name, char* config
    {
       return to_string(buffer, config->servers[server_index].tls_ca_file, buffer_size);
    }
+   else if (!strncmp(config_key, "tls_ktls", MISC_LENGTH))
+   {
+      return to_bool(buffer, config->servers[server_index].tls_ktls);
+   }
    else
    {
       goto error;
@@ -5428,6 +5807,13 @@ pgagroal_apply_main_configuration(struct main_configuration* config,
          unknown = true;
       }
    }
+   else if (key_in_section("tls_ktls", section, key, false, &unknown))
+   {
+      if (as_bool(value, &srv->tls_ktls))
+      {
+         unknown = true;
+      }
+   }
    else if (key_in_section("tls_ca_file", section, key, true, NULL))
    {
       max = strlen(value);
@@ -5535,6 +5921,27 @@ pgagroal_apply_main_configuration(struct main_configuration* config,
          unknown = true;
       }
    }
+   else if (key_in_section("min_spare_workers", section, key, true, &unknown))
+   {
+      if (as_int(value, &config->min_spare_workers))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("max_spare_workers", section, key, true, &unknown))
+   {
+      if (as_int(value, &config->max_spare_workers))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("transaction_workers", section, key, true, &unknown))
+   {
+      if (as_int(value, &config->transaction_workers))
+      {
+         unknown = true;
+      }
+   }
    else if (key_in_section("authentication_timeout", section, key, true, &unknown))
    {
       if (as_seconds(value, &config->common.authentication_timeout, DEFAULT_AUTHENTICATION_TIMEOUT))
@@ -5631,6 +6038,13 @@ pgagroal_apply_main_configuration(struct main_configuration* config,
    {
       config->common.log_mode = as_logging_mode(value);
    }
+   else if (key_in_section("log_async", section, key, true, &unknown))
+   {
+      if (as_bool(value, &config->log_async))
+      {
+         unknown = true;
+      }
+   }
    else if (key_in_section("max_connections", section, key, true, &unknown))
    {
       if (as_int(value, &config->max_connections))
@@ -5651,6 +6065,34 @@ pgagroal_apply_main_configuration(struct main_configuration* config,
    {
       config->ev_backend = to_backend_type(value);
    }
+   else if (key_in_section("io_uring_multishot", section, key, true, &unknown))
+   {
+      if (as_bool(value, &config->io_uring_multishot))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("io_uring_buffers", section, key, true, &unknown))
+   {
+      if (as_int(value, &config->io_uring_buffers))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("io_uring_registered_files", section, key, true, &unknown))
+   {
+      if (as_bool(value, &config->io_uring_registered_files))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("io_uring_sqpoll", section, key, true, &unknown))
+   {
+      if (as_bool(value, &config->io_uring_sqpoll))
+      {
+         unknown = true;
+      }
+   }
    else if (key_in_section("keep_alive", section, key, true, &unknown))
    {
       if (as_bool(value, &config->keep_alive))
@@ -5665,6 +6107,13 @@ pgagroal_apply_main_configuration(struct main_configuration* config,
          unknown = true;
       }
    }
+   else if (key_in_section("splice", section, key, true, &unknown))
+   {
+      if (as_bool(value, &config->splice))
+      {
+         unknown = true;
+      }
+   }
    else if (key_in_section("backlog", section, key, true, &unknown))
    {
       if (as_int(value, &config->backlog))
@@ -5690,6 +6139,13 @@ pgagroal_apply_main_configuration(struct main_configuration* config,
          unknown = true;
       }
    }
+   else if (key_in_section("track_session_parameters", section, key, true, &unknown))
+   {
+      if (as_bool(value, &config->track_session_parameters))
+      {
+         unknown = true;
+      }
+   }
    else if (key_in_section("update_process_title", section, key, true, &unknown))
    {
       if (as_update_process_title(value, &config->update_process_title, UPDATE_PROCESS_TITLE_VERBOSE))
@@ -6056,6 +6512,12 @@ pgagroal_apply_configuration(char* config_key, char* config_value,
       goto error;
    }
 
+   if (pgagroal_build_limit_index(temp_config))
+   {
+      pgagroal_log_error("Limit configuration validation failed for %s = %s", config_key, config_value);
+      goto error;
+   }
+
    // Check if restart is required
    *restart_required = transfer_configuration(current_config, temp_config);
 
@@ -6258,6 +6720,7 @@ add_configuration_response(struct json* res)
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_LOG_ROTATION_SIZE, (uintptr_t)config->common.log_rotation_size, ValueInt64);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_LOG_LINE_PREFIX, (uintptr_t)config->common.log_line_prefix, ValueString);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_LOG_MODE, (uintptr_t)config->common.log_mode, ValueInt64);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_LOG_ASYNC, (uintptr_t)config->log_async, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_LOG_CONNECTIONS, (uintptr_t)config->common.log_connections, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_LOG_DISCONNECTIONS, (uintptr_t)config->common.log_disconnections, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_BLOCKING_TIMEOUT, (uintptr_t)config->blocking_timeout, ValueInt64);
@@ -6268,6 +6731,9 @@ add_configuration_response(struct json* res)
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_VALIDATION, (uintptr_t)config->validation, ValueInt64);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_BACKGROUND_INTERVAL, (uintptr_t)config->background_interval, ValueInt64);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_MAX_RETRIES, (uintptr_t)config->max_retries, ValueInt64);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_MIN_SPARE_WORKERS, (uintptr_t)config->min_spare_workers, ValueInt64);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_MAX_SPARE_WORKERS, (uintptr_t)config->max_spare_workers, ValueInt64);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_TRANSACTION_WORKERS, (uintptr_t)config->transaction_workers, ValueInt64);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_MAX_CONNECTIONS, (uintptr_t)config->max_connections, ValueInt64);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_ALLOW_UNKNOWN_USERS, (uintptr_t)config->allow_unknown_users, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_AUTHENTICATION_TIMEOUT, (uintptr_t)config->common.authentication_timeout, ValueInt64);
@@ -6283,12 +6749,18 @@ add_configuration_response(struct json* res)
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_METRICS_KEY_FILE, (uintptr_t)config->common.metrics_key_file, ValueString);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_METRICS_CA_FILE, (uintptr_t)config->common.metrics_ca_file, ValueString);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_EV_BACKEND, (uintptr_t)to_backend_str(config->ev_backend), ValueString);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_IO_URING_MULTISHOT, (uintptr_t)config->io_uring_multishot, ValueBool);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_IO_URING_BUFFERS, (uintptr_t)config->io_uring_buffers, ValueInt64);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_IO_URING_REGISTERED_FILES, (uintptr_t)config->io_uring_registered_files, ValueBool);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_IO_URING_SQPOLL, (uintptr_t)config->io_uring_sqpoll, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_KEEP_ALIVE, (uintptr_t)config->keep_alive, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_NODELAY, (uintptr_t)config->nodelay, ValueBool);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_SPLICE, (uintptr_t)config->splice, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_BACKLOG, (uintptr_t)config->backlog, ValueInt64);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_HUGEPAGE, (uintptr_t)config->common.hugepage, ValueChar);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_TRACKER, (uintptr_t)config->tracker, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_TRACK_PREPARED_STATEMENTS, (uintptr_t)config->track_prepared_statements, ValueBool);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_TRACK_SESSION_PARAMETERS, (uintptr_t)config->track_session_parameters, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_PIDFILE, (uintptr_t)config->pidfile, ValueString);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_UPDATE_PROCESS_TITLE, (uintptr_t)config->update_process_title, ValueInt64);
 }
@@ -6321,6 +6793,7 @@ add_servers_configuration_response(struct json* res)
       pgagroal_json_put(server_conf, CONFIGURATION_ARGUMENT_TLS_CERT_FILE, (uintptr_t)config->servers[i].tls_cert_file, ValueString);
       pgagroal_json_put(server_conf, CONFIGURATION_ARGUMENT_TLS_KEY_FILE, (uintptr_t)config->servers[i].tls_key_file, ValueString);
       pgagroal_json_put(server_conf, CONFIGURATION_ARGUMENT_TLS_CA_FILE, (uintptr_t)config->servers[i].tls_ca_file, ValueString);
+      pgagroal_json_put(server_conf, CONFIGURATION_ARGUMENT_TLS_KTLS, (uintptr_t)config->servers[i].tls_ktls, ValueBool);
 
       // Add this server to the server section using server name as key
       pgagroal_json_put(server_section, config->servers[i].name, (uintptr_t)server_conf, ValueJSON);
@@ -44,14 +44,23 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#include <netinet/in.h>
 
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 
+#define SESSION_USERNAME     0
+#define SESSION_DATABASE     (SESSION_USERNAME + MAX_USERNAME_LENGTH)
+#define SESSION_APPNAME      (SESSION_DATABASE + MAX_DATABASE_LENGTH)
+#define SESSION_ADDRESS      (SESSION_APPNAME + MAX_APPLICATION_NAME)
+#define SESSION_PAYLOAD_SIZE (SESSION_ADDRESS + INET6_ADDRSTRLEN)
+
 static int read_complete(SSL* ssl, int socket, void* buf, size_t size);
 static int write_complete(SSL* ssl, int socket, void* buf, size_t size);
 static int write_socket(int socket, void* buf, size_t size);
 static int write_ssl(SSL* ssl, void* buf, size_t size);
+static int send_descriptor(int socket, int fd, void* payload, size_t size);
+static int receive_descriptor(int socket, int* fd, void* payload, size_t size);
 
 int
 pgagroal_connection_get(int* client_fd)
@@ -290,6 +299,188 @@ error:
    return 1;
 }
 
+int
+pgagroal_connection_fetch(int32_t slot, int* fd)
+{
+   int client_fd = -1;
+   int32_t s = -1;
+
+   *fd = -1;
+
+   if (pgagroal_connection_get(&client_fd))
+   {
+      goto error;
+   }
+
+   if (pgagroal_connection_id_write(client_fd, CONNECTION_FETCH_FD))
+   {
+      goto error;
+   }
+
+   if (pgagroal_connection_slot_write(client_fd, slot))
+   {
+      goto error;
+   }
+
+   /* The main process closes the socket if it doesn't know the descriptor */
+   if (pgagroal_connection_transfer_read(client_fd, &s, fd))
+   {
+      goto error;
+   }
+
+   if (s != slot)
+   {
+      pgagroal_log_warn("pgagroal_connection_fetch: Slot %d Received %d", slot, s);
+      goto error;
+   }
+
+   pgagroal_disconnect(client_fd);
+
+   return 0;
+
+error:
+
+   if (*fd != -1)
+   {
+      pgagroal_disconnect(*fd);
+      *fd = -1;
+   }
+
+   if (client_fd != -1)
+   {
+      pgagroal_disconnect(client_fd);
+   }
+
+   return 1;
+}
+
+int
+pgagroal_connection_client_write(int worker_fd, int client_fd, char* address)
+{
+   char addr[INET6_ADDRSTRLEN];
+
+   /* The address is the payload, and the descriptor is the ancillary data */
+   memset(&addr[0], 0, sizeof(addr));
+   memcpy(&addr[0], address, MIN(strlen(address), sizeof(addr) - 1));
+
+   if (send_descriptor(worker_fd, client_fd, &addr[0], sizeof(addr)))
+   {
+      pgagroal_log_debug("pgagroal_connection_client_write: %d %s", worker_fd, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+pgagroal_connection_client_read(int worker_fd, int* client_fd, char** address)
+{
+   char addr[INET6_ADDRSTRLEN];
+   char* a = NULL;
+
+   *client_fd = -1;
+   *address = NULL;
+
+   memset(&addr[0], 0, sizeof(addr));
+
+   if (receive_descriptor(worker_fd, client_fd, &addr[0], sizeof(addr)))
+   {
+      /* 0 when the main process closed the descriptor */
+      goto error;
+   }
+
+   addr[sizeof(addr) - 1] = '\0';
+
+   a = calloc(1, strlen(addr) + 1);
+   if (a == NULL)
+   {
+      goto error;
+   }
+   memcpy(a, &addr[0], strlen(addr));
+
+   *address = a;
+
+   return 0;
+
+error:
+
+   if (*client_fd != -1)
+   {
+      pgagroal_disconnect(*client_fd);
+      *client_fd = -1;
+   }
+
+   return 1;
+}
+
+int
+pgagroal_connection_session_write(int worker_fd, int client_fd, char* username, char* database, char* appname, char* address)
+{
+   char session[SESSION_PAYLOAD_SIZE];
+
+   /* The identity of the client is the payload, and the descriptor is the ancillary data */
+   memset(&session[0], 0, sizeof(session));
+   memcpy(&session[SESSION_USERNAME], username, MIN(strlen(username), MAX_USERNAME_LENGTH - 1));
+   memcpy(&session[SESSION_DATABASE], database, MIN(strlen(database), MAX_DATABASE_LENGTH - 1));
+   memcpy(&session[SESSION_APPNAME], appname, MIN(strlen(appname), MAX_APPLICATION_NAME - 1));
+   memcpy(&session[SESSION_ADDRESS], address, MIN(strlen(address), INET6_ADDRSTRLEN - 1));
+
+   if (send_descriptor(worker_fd, client_fd, &session[0], sizeof(session)))
+   {
+      pgagroal_log_debug("pgagroal_connection_session_write: %d %s", worker_fd, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+pgagroal_connection_session_read(int worker_fd, int* client_fd, char* username, char* database, char* appname, char* address)
+{
+   char session[SESSION_PAYLOAD_SIZE];
+
+   *client_fd = -1;
+
+   memset(&session[0], 0, sizeof(session));
+
+   if (receive_descriptor(worker_fd, client_fd, &session[0], sizeof(session)))
+   {
+      goto error;
+   }
+
+   memcpy(username, &session[SESSION_USERNAME], MAX_USERNAME_LENGTH);
+   memcpy(database, &session[SESSION_DATABASE], MAX_DATABASE_LENGTH);
+   memcpy(appname, &session[SESSION_APPNAME], MAX_APPLICATION_NAME);
+   memcpy(address, &session[SESSION_ADDRESS], INET6_ADDRSTRLEN);
+
+   username[MAX_USERNAME_LENGTH - 1] = '\0';
+   database[MAX_DATABASE_LENGTH - 1] = '\0';
+   appname[MAX_APPLICATION_NAME - 1] = '\0';
+   address[INET6_ADDRSTRLEN - 1] = '\0';
+
+   return 0;
+
+error:
+
+   if (*client_fd != -1)
+   {
+      pgagroal_disconnect(*client_fd);
+      *client_fd = -1;
+   }
+
+   return 1;
+}
+
 int
 pgagroal_connection_slot_write(int client_fd, int32_t slot)
 {
@@ -909,3 +1100,112 @@ write_ssl(SSL* ssl, void* buf, size_t size)
 /*          return NULL; */
 /*    } */
 /* } */
+
+static int
+send_descriptor(int socket, int fd, void* payload, size_t size)
+{
+   struct cmsghdr* cmptr = NULL;
+   struct iovec iov[1];
+   struct msghdr msg;
+   int flags = 0;
+
+   /* The payload is the data, and the descriptor is the ancillary data */
+   iov[0].iov_base = payload;
+   iov[0].iov_len = size;
+
+   cmptr = calloc(1, CMSG_SPACE(sizeof(int)));
+   if (cmptr == NULL)
+   {
+      goto error;
+   }
+   cmptr->cmsg_level = SOL_SOCKET;
+   cmptr->cmsg_type = SCM_RIGHTS;
+   cmptr->cmsg_len = CMSG_LEN(sizeof(int));
+
+   msg.msg_name = NULL;
+   msg.msg_namelen = 0;
+   msg.msg_iov = iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = cmptr;
+   msg.msg_controllen = CMSG_SPACE(sizeof(int));
+   msg.msg_flags = 0;
+   *(int*)CMSG_DATA(cmptr) = fd;
+
+#ifdef MSG_NOSIGNAL
+   /* The receiver may be gone */
+   flags = MSG_NOSIGNAL;
+#endif
+
+   if (sendmsg(socket, &msg, flags) != (ssize_t)size)
+   {
+      goto error;
+   }
+
+   free(cmptr);
+
+   return 0;
+
+error:
+
+   if (cmptr != NULL)
+   {
+      free(cmptr);
+   }
+
+   return 1;
+}
+
+static int
+receive_descriptor(int socket, int* fd, void* payload, size_t size)
+{
+   struct cmsghdr* cmptr = NULL;
+   struct iovec iov[1];
+   struct msghdr msg;
+
+   *fd = -1;
+
+   iov[0].iov_base = payload;
+   iov[0].iov_len = size;
+
+   cmptr = (struct cmsghdr*)calloc(1, CMSG_SPACE(sizeof(int)));
+   if (cmptr == NULL)
+   {
+      goto error;
+   }
+   cmptr->cmsg_len = CMSG_LEN(sizeof(int));
+   cmptr->cmsg_level = SOL_SOCKET;
+   cmptr->cmsg_type = SCM_RIGHTS;
+
+   msg.msg_name = NULL;
+   msg.msg_namelen = 0;
+   msg.msg_iov = iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = cmptr;
+   msg.msg_controllen = CMSG_SPACE(sizeof(int));
+   msg.msg_flags = 0;
+
+   if (recvmsg(socket, &msg, MSG_WAITALL) != (ssize_t)size)
+   {
+      goto error;
+   }
+
+   if (CMSG_FIRSTHDR(&msg) == NULL || CMSG_FIRSTHDR(&msg)->cmsg_type != SCM_RIGHTS)
+   {
+      goto error;
+   }
+
+   *fd = *(int*)CMSG_DATA(cmptr);
+
+   free(cmptr);
+
+   return 0;
+
+error:
+
+   if (cmptr != NULL)
+   {
+      free(cmptr);
+   }
+
+   return 1;
+}
@@ -72,6 +72,9 @@ static int (*io_stop)(struct io_watcher*);
 
 static void signal_handler(int signum, siginfo_t* info, void* p);
 
+static int events_add(event_watcher_t* watcher);
+static int events_remove(event_watcher_t* watcher);
+
 static int (*periodic_init)(struct periodic_watcher*, int);
 static int (*periodic_start)(struct periodic_watcher*);
 static int (*periodic_stop)(struct periodic_watcher*);
@@ -83,9 +86,12 @@ static int ev_io_uring_destroy(void);
 static int ev_io_uring_loop(void);
 static int ev_io_uring_fork(void);
 static int ev_io_uring_handler(struct io_uring_cqe*);
-#if EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED
 static int ev_io_uring_setup_buffers(void);
-#endif /* EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED */
+static int ev_io_uring_setup_files(void);
+static int ev_io_uring_file_get(int fd);
+static void ev_io_uring_file_put(int fd);
+static int ev_io_uring_file_index(int fd);
+static void ev_io_uring_arm(struct io_watcher*);
 
 static int ev_io_uring_io_start(struct io_watcher*);
 static int ev_io_uring_io_stop(struct io_watcher*);
@@ -141,6 +147,9 @@ static struct signal_watcher* signal_watchers[PGAGROAL_NSIG] = {0};
 
 static struct io_uring_params params; /* io_uring argument params */
 static int ring_size;                 /* io_uring sqe ring_size */
+static bool multishot;                /* io_uring multishot receive over a provided buffer ring */
+static int buffer_count;              /* io_uring number of provided buffers */
+static bool registered_files;         /* io_uring registered worker descriptors */
 
 static int epoll_flags; /* Flags for epoll instance creation */
 
@@ -232,29 +241,68 @@ pgagroal_event_loop_init(void)
    static bool context_is_set = false;
 
    loop = calloc(1, sizeof(struct event_loop));
+   if (loop == NULL)
+   {
+      pgagroal_log_fatal("Failed to allocate loop");
+      return NULL;
+   }
+
+   loop->events = calloc(MAX_EVENTS, sizeof(event_watcher_t*));
+   if (loop->events == NULL)
+   {
+      pgagroal_log_fatal("Failed to allocate events");
+      goto error;
+   }
+   loop->events_size = MAX_EVENTS;
+
    sigemptyset(&loop->sigset);
 
    if (!context_is_set)
    {
 #if HAVE_LINUX
       /* io_uring context */
+      bool sqpoll = false;
 
-#if EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED
-      ring_size = 128;
-      params.cq_entries = 1024;
-#else
-      ring_size = 64;
-      params.cq_entries = 128;
-#endif /* EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED */
+      multishot = false;
+      buffer_count = DEFAULT_IO_URING_BUFFERS;
+      registered_files = false;
+
+      if (execution_context == PGAGROAL_CONTEXT_MAIN && shmem != NULL)
+      {
+         struct main_configuration* main_config = (struct main_configuration*)shmem;
+
+         multishot = main_config->io_uring_multishot;
+         buffer_count = main_config->io_uring_buffers;
+         registered_files = main_config->io_uring_registered_files;
+         sqpoll = main_config->io_uring_sqpoll;
+      }
+
+      if (multishot)
+      {
+         ring_size = 128;
+         params.cq_entries = 1024;
+      }
+      else
+      {
+         ring_size = 64;
+         params.cq_entries = 128;
+      }
 
       params.flags = 0;
       params.flags |= IORING_SETUP_CQSIZE; /* needed if I'm using cq_entries above */
-      params.flags |= IORING_SETUP_DEFER_TASKRUN;
-      params.flags |= IORING_SETUP_SINGLE_ISSUER;
 
-#if EXPERIMENTAL_FEATURE_FAST_POLL_ENABLED
-      params.flags |= IORING_FEAT_FAST_POLL;
-#endif /* EXPERIMENTAL_FEATURE_FAST_POLL_ENABLED */
+      if (sqpoll)
+      {
+         /* A kernel thread submits for us, which can't be combined with deferred task running */
+         params.flags |= IORING_SETUP_SQPOLL;
+         params.sq_thread_idle = IO_URING_SQPOLL_IDLE;
+      }
+      else
+      {
+         params.flags |= IORING_SETUP_DEFER_TASKRUN;
+         params.flags |= IORING_SETUP_SINGLE_ISSUER;
+      }
+
 #if EXPERIMENTAL_FEATURE_USE_HUGE_ENABLED
       /* XXX: Maybe this could be interesting if we cache the rings and the buffers? */
       params.flags |= IORING_SETUP_NO_MMAP;
@@ -290,6 +338,7 @@ pgagroal_event_loop_init(void)
    return loop;
 
 error:
+   free(loop->events);
    free(loop);
    loop = NULL;
 
@@ -348,6 +397,7 @@ pgagroal_event_loop_destroy(void)
    }
 #endif
 
+   free(loop->events);
    free(loop);
    loop = NULL;
 
@@ -404,47 +454,28 @@ pgagroal_io_start(struct io_watcher* watcher)
 {
    assert(loop != NULL && watcher != NULL);
 
-   if (loop->events_nr >= MAX_EVENTS)
+   if (events_add((event_watcher_t*)watcher))
    {
-      pgagroal_log_warn("pgagroal_io_start: MAX_EVENTS (%d) reached - cannot register new watcher (fd rcv=%d, snd=%d)",
-                        MAX_EVENTS, watcher->fds.worker.rcv_fd, watcher->fds.worker.snd_fd);
+      pgagroal_log_warn("pgagroal_io_start: cannot register new watcher (fd rcv=%d, snd=%d, events_nr=%d)",
+                        watcher->fds.worker.rcv_fd, watcher->fds.worker.snd_fd, loop->events_nr);
       return PGAGROAL_EVENT_RC_FATAL;
    }
 
-   loop->events[loop->events_nr] = (event_watcher_t*)watcher;
-   loop->events_nr++;
-
    return io_start(watcher);
 }
 
 int
 pgagroal_io_stop(struct io_watcher* watcher)
 {
-   int i;
-
    assert(loop != NULL && watcher != NULL);
 
-   for (i = 0; i < loop->events_nr; i++)
-   {
-      if (watcher == (struct io_watcher*)loop->events[i])
-      {
-         break;
-      }
-   }
-
-   if (i >= loop->events_nr)
+   if (events_remove((event_watcher_t*)watcher))
    {
       pgagroal_log_warn("pgagroal_io_stop: watcher not found in events list (fd rcv=%d, snd=%d, events_nr=%d) - possible double-stop",
                         watcher->fds.worker.rcv_fd, watcher->fds.worker.snd_fd, loop->events_nr);
       return PGAGROAL_EVENT_RC_ERROR;
    }
 
-   loop->events_nr--;
-   if (i != loop->events_nr)
-   {
-      loop->events[i] = loop->events[loop->events_nr];
-   }
-
    return io_stop(watcher);
 }
 
@@ -466,46 +497,74 @@ pgagroal_periodic_start(struct periodic_watcher* watcher)
 {
    assert(loop != NULL && watcher != NULL);
 
-   if (loop->events_nr >= MAX_EVENTS)
+   if (events_add((event_watcher_t*)watcher))
    {
-      pgagroal_log_warn("pgagroal_periodic_start: MAX_EVENTS (%d) reached - cannot register periodic watcher",
-                        MAX_EVENTS);
+      pgagroal_log_warn("pgagroal_periodic_start: cannot register periodic watcher (events_nr=%d)",
+                        loop->events_nr);
       return PGAGROAL_EVENT_RC_FATAL;
    }
 
-   loop->events[loop->events_nr] = (event_watcher_t*)watcher;
-   loop->events_nr++;
-
    return periodic_start(watcher);
 }
 
 int __attribute__((unused))
 pgagroal_periodic_stop(struct periodic_watcher* watcher)
 {
-   int i;
-
    assert(loop != NULL && watcher != NULL);
 
-   for (i = 0; i < loop->events_nr; i++)
+   if (events_remove((event_watcher_t*)watcher))
    {
-      if (watcher == (struct periodic_watcher*)loop->events[i])
+      return PGAGROAL_EVENT_RC_ERROR;
+   }
+
+   return periodic_stop(watcher);
+}
+
+static int
+events_add(event_watcher_t* watcher)
+{
+   if (loop->events_nr >= loop->events_size)
+   {
+      event_watcher_t** events = NULL;
+      int size = loop->events_size * 2;
+
+      events = realloc(loop->events, size * sizeof(event_watcher_t*));
+      if (events == NULL)
       {
-         break;
+         return 1;
       }
+
+      loop->events = events;
+      loop->events_size = size;
    }
 
-   if (i >= loop->events_nr)
+   watcher->index = loop->events_nr;
+   loop->events[loop->events_nr] = watcher;
+   loop->events_nr++;
+
+   return 0;
+}
+
+static int
+events_remove(event_watcher_t* watcher)
+{
+   int i = watcher->index;
+
+   /* The index is only trusted when it still points back to the watcher */
+   if (i < 0 || i >= loop->events_nr || loop->events[i] != watcher)
    {
-      return PGAGROAL_EVENT_RC_ERROR;
+      return 1;
    }
 
    loop->events_nr--;
    if (i != loop->events_nr)
    {
       loop->events[i] = loop->events[loop->events_nr];
+      loop->events[i]->index = i;
    }
+   watcher->index = -1;
 
-   return periodic_stop(watcher);
+   return 0;
 }
 
 int
@@ -517,16 +576,21 @@ pgagroal_event_prep_submit_send(struct io_watcher* watcher, struct message* msg)
    struct io_uring_cqe* cqe = NULL;
    int send_flags = 0;
    int ret;
-
-#if EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED
-   int bid = loop->bid;
-   void* data = loop->br.buf + bid * DEFAULT_BUFFER_SIZE;
-   msg->data = data;
-#endif /* EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED */
+   int fd = watcher->fds.worker.snd_fd;
+   int index = -1;
 
    ssize_t total_sent = 0;
    ssize_t to_send = msg->length;
 
+   if (loop->files.enabled)
+   {
+      index = ev_io_uring_file_index(fd);
+      if (index != -1)
+      {
+         fd = index;
+      }
+   }
+
    /*
     * Use the dedicated send_ring for sends.
     * This avoids CQE mixing issues where recv completions arrive on the
@@ -545,18 +609,23 @@ pgagroal_event_prep_submit_send(struct io_watcher* watcher, struct message* msg)
 #if EXPERIMENTAL_FEATURE_ZERO_COPY_ENABLED
       /* XXX: Implement zero copy send (this has been shown to speed up a little some
        * workloads, but the implementation is still problematic). */
-      io_uring_prep_send_zc(sqe, watcher->fds.worker.snd_fd,
+      io_uring_prep_send_zc(sqe, fd,
                             (char*)msg->data + total_sent,
                             to_send - total_sent,
                             send_flags, 0);
 #else
       send_flags |= MSG_NOSIGNAL;
-      io_uring_prep_send(sqe, watcher->fds.worker.snd_fd,
+      io_uring_prep_send(sqe, fd,
                          (char*)msg->data + total_sent,
                          to_send - total_sent,
                          send_flags);
 #endif /* EXPERIMENTAL_FEATURE_ZERO_COPY_ENABLED */
 
+      if (index != -1)
+      {
+         sqe->flags |= IOSQE_FIXED_FILE;
+      }
+
       io_uring_sqe_set_data(sqe, NULL);
 
       ret = io_uring_submit(&loop->ring_snd);
@@ -594,16 +663,6 @@ pgagroal_event_prep_submit_send(struct io_watcher* watcher, struct message* msg)
 
    sent_bytes = (int)total_sent;
 
-#if EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED
-   io_uring_buf_ring_add(loop->br.br,
-                         data,
-                         DEFAULT_BUFFER_SIZE,
-                         bid,
-                         DEFAULT_BUFFER_SIZE,
-                         1);
-   io_uring_buf_ring_advance(loop->br.br, 1);
-#endif /* EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED */
-
 #endif /* HAVE_LINUX */
    return sent_bytes;
 }
@@ -623,14 +682,6 @@ pgagroal_wait_recv(void)
 
 #if HAVE_LINUX
 
-static inline void __attribute__((unused))
-ev_io_uring_rearm_receive(struct event_loop* loop, struct io_watcher* watcher)
-{
-   struct io_uring_sqe* sqe = io_uring_get_sqe(&loop->ring_rcv);
-   io_uring_sqe_set_data(sqe, watcher);
-   io_uring_prep_recv_multishot(sqe, watcher->fds.worker.rcv_fd, NULL, 0, 0);
-}
-
 static int
 ev_io_uring_init(void)
 {
@@ -674,14 +725,23 @@ ev_io_uring_init(void)
       return rc;
    }
 
-#if EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED
-   rc = ev_io_uring_setup_buffers();
-   if (rc)
+   if (multishot)
    {
-      pgagroal_log_fatal("ev_io_uring_setup_buffers error");
-      return rc;
+      rc = ev_io_uring_setup_buffers();
+      if (rc)
+      {
+         pgagroal_log_fatal("ev_io_uring_setup_buffers error");
+         io_uring_queue_exit(&loop->ring_rcv);
+         io_uring_queue_exit(&loop->ring_snd);
+         return rc;
+      }
+   }
+
+   if (registered_files && ev_io_uring_setup_files())
+   {
+      /* Plain descriptors still work, so only lose the optimization */
+      pgagroal_log_debug("io_uring: registered files not available");
    }
-#endif /* EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED */
 
    return PGAGROAL_EVENT_RC_OK;
 }
@@ -689,6 +749,14 @@ ev_io_uring_init(void)
 static int
 ev_io_uring_destroy(void)
 {
+   if (loop->br.br != NULL)
+   {
+      io_uring_free_buf_ring(&loop->ring_rcv, loop->br.br, loop->br.cnt, 0);
+      loop->br.br = NULL;
+   }
+   free(loop->br.buf);
+   loop->br.buf = NULL;
+
    io_uring_queue_exit(&loop->ring_rcv);
    io_uring_queue_exit(&loop->ring_snd);
    return PGAGROAL_EVENT_RC_OK;
@@ -696,9 +764,28 @@ ev_io_uring_destroy(void)
 
 static int
 ev_io_uring_io_start(struct io_watcher* watcher)
+{
+   if (watcher->event_watcher.type == PGAGROAL_EVENT_TYPE_WORKER && loop->files.enabled)
+   {
+      ev_io_uring_file_get(watcher->fds.worker.rcv_fd);
+      if (watcher->fds.worker.snd_fd != watcher->fds.worker.rcv_fd)
+      {
+         ev_io_uring_file_get(watcher->fds.worker.snd_fd);
+      }
+   }
+
+   ev_io_uring_arm(watcher);
+
+   return PGAGROAL_EVENT_RC_OK;
+}
+
+static void
+ev_io_uring_arm(struct io_watcher* watcher)
 {
    struct io_uring_sqe* sqe = io_uring_get_sqe(&loop->ring_rcv);
    struct message* msg = NULL;
+   int fd;
+   int index = -1;
 
    io_uring_sqe_set_data(sqe, watcher);
    switch (watcher->event_watcher.type)
@@ -707,22 +794,40 @@ ev_io_uring_io_start(struct io_watcher* watcher)
          io_uring_prep_multishot_accept(sqe, watcher->fds.main.listen_fd, NULL, NULL, 0);
          break;
       case PGAGROAL_EVENT_TYPE_WORKER:
-#if EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED
-         io_uring_prep_recv_multishot(sqe, watcher->fds.worker.rcv_fd, msg, 0, 0); /* msg must be NULL */
-         sqe->buf_group = 0;
-         sqe->flags |= IOSQE_BUFFER_SELECT;
-#else
-         msg = pgagroal_memory_message();
-         /* Use MESSAGE_PARSE_BUFFER_SIZE to leave headroom and prevent buffer
-          * overflow when parsing message headers near the end of received data */
-         io_uring_prep_recv(sqe, watcher->fds.worker.rcv_fd, msg->data, MESSAGE_PARSE_BUFFER_SIZE, 0);
-#endif /* EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED */
+         fd = watcher->fds.worker.rcv_fd;
+         if (loop->files.enabled)
+         {
+            index = ev_io_uring_file_index(fd);
+            if (index != -1)
+            {
+               fd = index;
+            }
+         }
+
+         if (multishot)
+         {
+            /* The kernel picks a buffer from the ring for each completion */
+            io_uring_prep_recv_multishot(sqe, fd, NULL, 0, 0);
+            sqe->buf_group = 0;
+            sqe->flags |= IOSQE_BUFFER_SELECT;
+         }
+         else
+         {
+            msg = pgagroal_memory_message();
+            /* Use MESSAGE_PARSE_BUFFER_SIZE to leave headroom and prevent buffer
+             * overflow when parsing message headers near the end of received data */
+            io_uring_prep_recv(sqe, fd, msg->data, MESSAGE_PARSE_BUFFER_SIZE, 0);
+         }
+
+         if (index != -1)
+         {
+            sqe->flags |= IOSQE_FIXED_FILE;
+         }
          break;
       default:
          pgagroal_log_fatal("unknown event type: %d", watcher->event_watcher.type);
          exit(1);
    }
-   return PGAGROAL_EVENT_RC_OK;
 }
 
 static int
@@ -752,6 +857,15 @@ ev_io_uring_io_stop(struct io_watcher* target)
 
    io_uring_submit_and_wait_timeout(&loop->ring_rcv, &cqe, 0, &ts, NULL);
 
+   if (target->event_watcher.type == PGAGROAL_EVENT_TYPE_WORKER && loop->files.enabled)
+   {
+      ev_io_uring_file_put(target->fds.worker.rcv_fd);
+      if (target->fds.worker.snd_fd != target->fds.worker.rcv_fd)
+      {
+         ev_io_uring_file_put(target->fds.worker.snd_fd);
+      }
+   }
+
    return rc;
 }
 
@@ -907,10 +1021,9 @@ ev_io_uring_handler(struct io_uring_cqe* cqe)
    struct io_watcher* io;
    struct periodic_watcher* per;
    struct message* msg = pgagroal_memory_message();
-
-#if EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED
-   loop->bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
-#endif /* EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED */
+   void* data = NULL;
+   void* buffer = NULL;
+   int bid = 0;
 
    /* Cancelled requests will trigger the handler, but have NULL data. */
    if (!watcher)
@@ -948,7 +1061,16 @@ ev_io_uring_handler(struct io_uring_cqe* cqe)
          break;
       case PGAGROAL_EVENT_TYPE_WORKER:
          io = (struct io_watcher*)watcher;
-         if (cqe->res <= 0)
+         if (multishot && cqe->res == -ENOBUFS)
+         {
+            /* Every buffer was in use, so the receive ended; arm it again now that they are back */
+            pgagroal_log_trace("io_uring: out of buffers fd=%d", io->fds.worker.rcv_fd);
+            if (!(cqe->flags & IORING_CQE_F_MORE) && pgagroal_event_loop_is_running())
+            {
+               ev_io_uring_arm(io);
+            }
+         }
+         else if (cqe->res <= 0)
          {
             if (cqe->res == 0)
             {
@@ -969,12 +1091,35 @@ ev_io_uring_handler(struct io_uring_cqe* cqe)
             msg->length = cqe->res;
             rc = PGAGROAL_EVENT_RC_OK;
             pgagroal_log_trace("io_uring: recv %d bytes fd=%d", cqe->res, io->fds.worker.rcv_fd);
+
+            if (multishot)
+            {
+               /* Hand the provided buffer to the callback instead of copying it */
+               bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+               buffer = (char*)loop->br.buf + (size_t)bid * DEFAULT_BUFFER_SIZE;
+               data = msg->data;
+               msg->data = buffer;
+            }
+            else
+            {
+               pgagroal_memory_used(cqe->res);
+            }
+
             io->cb(io);
 
-            /* Only rearm if loop is still running and connection is good */
-            if (pgagroal_event_loop_is_running())
+            if (multishot)
+            {
+               msg->data = data;
+               io_uring_buf_ring_add(loop->br.br, buffer, MESSAGE_PARSE_BUFFER_SIZE, bid,
+                                     io_uring_buf_ring_mask(loop->br.cnt), 0);
+               io_uring_buf_ring_advance(loop->br.br, 1);
+            }
+
+            /* Only rearm if loop is still running and connection is good,
+             * a multishot receive stays armed until the kernel says otherwise */
+            if (pgagroal_event_loop_is_running() && (!multishot || !(cqe->flags & IORING_CQE_F_MORE)))
             {
-               ev_io_uring_io_start(io);
+               ev_io_uring_arm(io);
             }
          }
 
@@ -987,17 +1132,12 @@ ev_io_uring_handler(struct io_uring_cqe* cqe)
    return rc;
 }
 
-#if EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED
 static int
 ev_io_uring_setup_buffers(void)
 {
-   int rc;
-   int br_cnt = 1;
+   int rc = 0;
    int br_bgid = 0;
-   int br_mask = DEFAULT_BUFFER_SIZE;
    int br_flags = 0;
-   int bid = 0;
-   struct message* msg = pgagroal_memory_message();
 
 #if EXPERIMENTAL_FEATURE_USE_HUGE_ENABLED
    pgagroal_log_fatal("io_uring use_huge not implemented");
@@ -1005,39 +1145,150 @@ ev_io_uring_setup_buffers(void)
 #endif /* EXPERIMENTAL_FEATURE_USE_HUGE_ENABLED */
 
    loop->br.br = NULL;
-   loop->br.buf = msg->data;
-   loop->br.pending_send = false;
-   loop->br.cnt = 0;
+   loop->br.buf = NULL;
+   loop->br.cnt = buffer_count;
 
-   loop->br.br = io_uring_setup_buf_ring(&loop->ring_rcv, br_cnt, br_bgid, br_flags, &rc);
+   if (posix_memalign(&loop->br.buf, ALIGNMENT, (size_t)loop->br.cnt * DEFAULT_BUFFER_SIZE))
+   {
+      pgagroal_log_fatal("posix_memalign error: %s", strerror(errno));
+      loop->br.buf = NULL;
+      return PGAGROAL_EVENT_RC_FATAL;
+   }
+
+   loop->br.br = io_uring_setup_buf_ring(&loop->ring_rcv, loop->br.cnt, br_bgid, br_flags, &rc);
    if (!loop->br.br)
    {
       pgagroal_log_fatal("buffer ring register error %s", strerror(-rc));
+      free(loop->br.buf);
+      loop->br.buf = NULL;
       return PGAGROAL_EVENT_RC_FATAL;
    }
-   if (posix_memalign(&loop->br.buf, sysconf(_SC_PAGESIZE), 2 * DEFAULT_BUFFER_SIZE))
+
+   /* Leave the same headroom after each buffer as the single buffer receive does */
+   for (int bid = 0; bid < loop->br.cnt; bid++)
    {
-      pgagroal_log_fatal("posix_memalign error: %s", strerror(errno));
+      io_uring_buf_ring_add(loop->br.br,
+                            (char*)loop->br.buf + (size_t)bid * DEFAULT_BUFFER_SIZE,
+                            MESSAGE_PARSE_BUFFER_SIZE,
+                            bid,
+                            io_uring_buf_ring_mask(loop->br.cnt),
+                            bid);
    }
-   io_uring_buf_ring_add(loop->br.br,
-                         loop->br.buf,
-                         DEFAULT_BUFFER_SIZE,
-                         bid++,
-                         br_mask,
-                         loop->br.cnt++);
-
-   io_uring_buf_ring_add(loop->br.br,
-                         loop->br.buf + DEFAULT_BUFFER_SIZE,
-                         DEFAULT_BUFFER_SIZE,
-                         bid,
-                         br_mask,
-                         loop->br.cnt++);
 
    io_uring_buf_ring_advance(loop->br.br, loop->br.cnt);
 
    return PGAGROAL_EVENT_RC_OK;
 }
-#endif /* EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED */
+
+static int
+ev_io_uring_setup_files(void)
+{
+   int rc;
+
+   for (int i = 0; i < IO_URING_FIXED_FILES; i++)
+   {
+      loop->files.fds[i] = -1;
+      loop->files.refs[i] = 0;
+   }
+   loop->files.enabled = false;
+
+   rc = io_uring_register_files_sparse(&loop->ring_rcv, IO_URING_FIXED_FILES);
+   if (rc)
+   {
+      pgagroal_log_debug("io_uring_register_files_sparse (recv ring) error: %s", strerror(-rc));
+      return PGAGROAL_EVENT_RC_ERROR;
+   }
+
+   rc = io_uring_register_files_sparse(&loop->ring_snd, IO_URING_FIXED_FILES);
+   if (rc)
+   {
+      pgagroal_log_debug("io_uring_register_files_sparse (send ring) error: %s", strerror(-rc));
+      io_uring_unregister_files(&loop->ring_rcv);
+      return PGAGROAL_EVENT_RC_ERROR;
+   }
+
+   loop->files.enabled = true;
+
+   return PGAGROAL_EVENT_RC_OK;
+}
+
+static int
+ev_io_uring_file_get(int fd)
+{
+   int index = ev_io_uring_file_index(fd);
+
+   if (index != -1)
+   {
+      loop->files.refs[index]++;
+      return index;
+   }
+
+   for (int i = 0; i < IO_URING_FIXED_FILES; i++)
+   {
+      if (loop->files.fds[i] == -1)
+      {
+         /* Both rings refer to the descriptor by the same index */
+         if (io_uring_register_files_update(&loop->ring_rcv, i, &fd, 1) != 1)
+         {
+            return -1;
+         }
+
+         if (io_uring_register_files_update(&loop->ring_snd, i, &fd, 1) != 1)
+         {
+            int none = -1;
+
+            io_uring_register_files_update(&loop->ring_rcv, i, &none, 1);
+            return -1;
+         }
+
+         loop->files.fds[i] = fd;
+         loop->files.refs[i] = 1;
+
+         return i;
+      }
+   }
+
+   /* Table full: the descriptor is used as is */
+   return -1;
+}
+
+static void
+ev_io_uring_file_put(int fd)
+{
+   int index = ev_io_uring_file_index(fd);
+   int none = -1;
+
+   if (index == -1)
+   {
+      return;
+   }
+
+   loop->files.refs[index]--;
+   if (loop->files.refs[index] > 0)
+   {
+      return;
+   }
+
+   io_uring_register_files_update(&loop->ring_rcv, index, &none, 1);
+   io_uring_register_files_update(&loop->ring_snd, index, &none, 1);
+
+   loop->files.fds[index] = -1;
+   loop->files.refs[index] = 0;
+}
+
+static int
+ev_io_uring_file_index(int fd)
+{
+   for (int i = 0; i < IO_URING_FIXED_FILES; i++)
+   {
+      if (loop->files.fds[i] == fd)
+      {
+         return i;
+      }
+   }
+
+   return -1;
+}
 
 int
 ev_epoll_loop(void)
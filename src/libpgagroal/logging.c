@@ -30,9 +30,12 @@
 #include <pgagroal.h>
 #include <logging.h>
 #include <prometheus.h>
+#include <shmem.h>
+#include <utils.h>
 
 /* system */
 #include <errno.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -41,11 +44,34 @@
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef HAVE_LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 #define LINE_LENGTH 32
 #define MAX_LENGTH  4096
 
+#define LOG_WRITER_SLEEP   1000000L
+#define LOG_WRITER_WAIT    100000ULL
+#define LOG_WRITER_STALL   1000000ULL
+#define LOG_WRITER_ABANDON 10000000ULL
+
+/* The sequence of a record that a process is filling, relative to its position */
+#define LOG_RECORD_FILLING 2
+
 static void output_log_line(char* l);
+static void log_ring_line(int level, char* file, int line, char* fmt, va_list vl);
+static bool log_ring_push(int level, char* line, int length);
+static int log_ring_drain(void);
+static void log_ring_write(struct log_record* record);
+static bool log_ring_skip(uint64_t stalled);
+static bool log_ring_ready(void);
+static void log_ring_wait(void);
+static void log_ring_wake(bool always);
+static int syslog_priority(int level);
+
+static bool log_writer = false;
 
 FILE* log_file;
 
@@ -195,6 +221,12 @@ pgagroal_start_logging(void)
 
    config = (struct configuration*)shmem;
 
+   /* The log writer owns the log file */
+   if (log_shmem != NULL && !log_writer)
+   {
+      return 0;
+   }
+
    if (config->log_type == PGAGROAL_LOGGING_TYPE_FILE && !log_file)
    {
       log_file_open();
@@ -214,6 +246,24 @@ pgagroal_start_logging(void)
    return 0;
 }
 
+/**
+ *
+ */
+int
+pgagroal_reopen_logging(void)
+{
+   /* The log writer reopens the log file the next time it wakes up */
+   if (log_shmem != NULL && !log_writer)
+   {
+      atomic_store(&((struct log_ring*)log_shmem)->reopen, true);
+      log_ring_wake(true);
+      return 0;
+   }
+
+   pgagroal_stop_logging();
+   return pgagroal_start_logging();
+}
+
 int
 log_file_open(void)
 {
@@ -281,6 +331,11 @@ pgagroal_stop_logging(void)
 
    config = (struct configuration*)shmem;
 
+   if (log_shmem != NULL && !log_writer)
+   {
+      return 0;
+   }
+
    if (config->log_type == PGAGROAL_LOGGING_TYPE_FILE)
    {
       if (log_file != NULL)
@@ -300,6 +355,150 @@ pgagroal_stop_logging(void)
    return 0;
 }
 
+/**
+ *
+ */
+int
+pgagroal_init_log_ring(size_t* p_size, void** p_shmem)
+{
+   struct log_ring* ring = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (pgagroal_create_shared_memory(sizeof(struct log_ring), config->hugepage, (void**)&ring))
+   {
+      goto error;
+   }
+
+   memset(ring, 0, sizeof(struct log_ring));
+
+   atomic_init(&ring->head, 0);
+   atomic_init(&ring->tail, 0);
+   atomic_init(&ring->dropped, 0);
+   atomic_init(&ring->running, true);
+   atomic_init(&ring->reopen, false);
+   atomic_init(&ring->wake, 0);
+   atomic_init(&ring->sleeping, false);
+
+   for (unsigned long i = 0; i < PGAGROAL_LOGGING_RING_SLOTS; i++)
+   {
+      atomic_init(&ring->records[i].sequence, i);
+      atomic_init(&ring->records[i].pid, 0);
+   }
+
+   *p_shmem = ring;
+   *p_size = sizeof(struct log_ring);
+
+   return 0;
+
+error:
+
+   *p_shmem = NULL;
+   *p_size = 0;
+
+   return 1;
+}
+
+/**
+ *
+ */
+void
+pgagroal_log_writer(void)
+{
+   uint64_t now;
+   uint64_t stalled = 0;
+   pid_t parent;
+   struct log_ring* ring;
+   struct configuration* config;
+
+   ring = (struct log_ring*)log_shmem;
+   config = (struct configuration*)shmem;
+
+   log_writer = true;
+   parent = getppid();
+
+   /* The main process decides when the log writer stops */
+   signal(SIGINT, SIG_IGN);
+   signal(SIGTERM, SIG_IGN);
+   signal(SIGHUP, SIG_IGN);
+
+   while (true)
+   {
+      if (atomic_exchange(&ring->reopen, false) && config->log_type == PGAGROAL_LOGGING_TYPE_FILE)
+      {
+         if (log_file != NULL)
+         {
+            fclose(log_file);
+         }
+         log_file_open();
+      }
+
+      if (log_ring_drain() > 0)
+      {
+         stalled = 0;
+         continue;
+      }
+
+      if (atomic_load(&ring->head) != atomic_load(&ring->tail))
+      {
+         /* A process stopped between taking a record and publishing it */
+         now = pgagroal_get_monotonic_micros();
+
+         if (stalled == 0)
+         {
+            stalled = now;
+         }
+         else if (now - stalled >= LOG_WRITER_STALL && log_ring_skip(now - stalled))
+         {
+            stalled = 0;
+         }
+      }
+      else if (!atomic_load(&ring->running) || getppid() != parent)
+      {
+         break;
+      }
+      else
+      {
+         stalled = 0;
+      }
+
+      log_ring_wait();
+   }
+
+   if (config->log_type == PGAGROAL_LOGGING_TYPE_FILE && log_file != NULL)
+   {
+      fflush(log_file);
+   }
+}
+
+/**
+ *
+ */
+void
+pgagroal_stop_log_writer(void)
+{
+   if (log_shmem != NULL)
+   {
+      atomic_store(&((struct log_ring*)log_shmem)->running, false);
+      log_ring_wake(true);
+   }
+}
+
+/**
+ *
+ */
+unsigned long
+pgagroal_log_dropped(void)
+{
+   if (log_shmem == NULL)
+   {
+      return 0;
+   }
+
+   return atomic_load(&((struct log_ring*)log_shmem)->dropped);
+}
+
 void
 pgagroal_log_line(int level, char* file, int line, char* fmt, ...)
 {
@@ -333,6 +532,17 @@ pgagroal_log_line(int level, char* file, int line, char* fmt, ...)
             break;
       }
 
+      if (log_shmem != NULL)
+      {
+         va_list vl;
+
+         va_start(vl, fmt);
+         log_ring_line(level, file, line, fmt, vl);
+         va_end(vl);
+
+         return;
+      }
+
 retry:
       isfree = STATE_FREE;
 
@@ -448,7 +658,8 @@ pgagroal_log_mem(void* data, size_t size)
 retry:
          isfree = STATE_FREE;
 
-         if (atomic_compare_exchange_strong(&config->common.log_lock, &isfree, STATE_IN_USE))
+         /* The log ring takes whole lines without a lock, so the lines of the dump can be interleaved with the lines of other processes */
+         if (log_shmem != NULL || atomic_compare_exchange_strong(&config->common.log_lock, &isfree, STATE_IN_USE))
          {
             if (size > MAX_LENGTH)
             {
@@ -622,7 +833,10 @@ retry:
                }
             }
 
-            atomic_store(&config->common.log_lock, STATE_FREE);
+            if (log_shmem == NULL)
+            {
+               atomic_store(&config->common.log_lock, STATE_FREE);
+            }
          }
          else
          {
@@ -731,7 +945,11 @@ output_log_line(char* l)
 
    config = (struct main_configuration*)shmem;
 
-   if (config->common.log_type == PGAGROAL_LOGGING_TYPE_CONSOLE)
+   if (log_shmem != NULL)
+   {
+      log_ring_push(PGAGROAL_LOGGING_LEVEL_DEBUG5, l, MIN((int)strlen(l), PGAGROAL_LOGGING_RECORD_SIZE - 1));
+   }
+   else if (config->common.log_type == PGAGROAL_LOGGING_TYPE_CONSOLE)
    {
       fprintf(stdout, "%s", l);
       fprintf(stdout, "\n");
@@ -759,3 +977,347 @@ pgagroal_log_is_enabled(int level)
 
    return false;
 }
+
+static void
+log_ring_line(int level, char* file, int line, char* fmt, va_list vl)
+{
+   char buf[256];
+   char record[PGAGROAL_LOGGING_RECORD_SIZE];
+   int length = 0;
+   int n;
+   struct tm tm;
+   time_t t;
+   char* filename;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->log_type == PGAGROAL_LOGGING_TYPE_CONSOLE || config->log_type == PGAGROAL_LOGGING_TYPE_FILE)
+   {
+      t = time(NULL);
+      localtime_r(&t, &tm);
+
+      filename = strrchr(file, '/');
+      if (filename != NULL)
+      {
+         filename = filename + 1;
+      }
+      else
+      {
+         filename = file;
+      }
+
+      if (strlen(config->log_line_prefix) == 0)
+      {
+         memcpy(config->log_line_prefix, PGAGROAL_LOGGING_DEFAULT_LOG_LINE_PREFIX, strlen(PGAGROAL_LOGGING_DEFAULT_LOG_LINE_PREFIX));
+      }
+
+      buf[strftime(buf, sizeof(buf), config->log_line_prefix, &tm)] = '\0';
+
+      if (config->log_type == PGAGROAL_LOGGING_TYPE_CONSOLE)
+      {
+         length = snprintf(&record[0], sizeof(record), "%s %s%-5s\x1b[0m \x1b[90m%s:%d\x1b[0m ",
+                           buf, colors[level - 1], levels[level - 1],
+                           filename, line);
+      }
+      else
+      {
+         length = snprintf(&record[0], sizeof(record), "%s %-5s %s:%d ",
+                           buf, levels[level - 1], filename, line);
+      }
+
+      length = MAX(0, MIN(length, (int)sizeof(record) - 1));
+   }
+
+   /* Longer lines are truncated to the size of a record */
+   n = vsnprintf(&record[length], sizeof(record) - length, fmt, vl);
+   if (n > 0)
+   {
+      length = MIN(length + n, (int)sizeof(record) - 1);
+   }
+
+   log_ring_push(level, &record[0], length);
+}
+
+static bool
+log_ring_push(int level, char* line, int length)
+{
+   unsigned long pos;
+   unsigned long sequence;
+   unsigned long expected;
+   long diff;
+   struct log_record* record = NULL;
+   struct log_ring* ring;
+
+   ring = (struct log_ring*)log_shmem;
+
+   pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+   while (true)
+   {
+      record = &ring->records[pos & (PGAGROAL_LOGGING_RING_SLOTS - 1)];
+      sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+      diff = (long)(sequence - pos);
+
+      if (diff == 0)
+      {
+         if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1,
+                                                   memory_order_relaxed, memory_order_relaxed))
+         {
+            break;
+         }
+      }
+      else if (diff < 0)
+      {
+         /* The log writer is behind, so the line is dropped instead of waiting */
+         atomic_fetch_add(&ring->dropped, 1);
+         return false;
+      }
+      else
+      {
+         pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+      }
+   }
+
+   /* The log writer gives up on a record that isn't filled in time, and the line is dropped */
+   expected = pos;
+   if (!atomic_compare_exchange_strong(&record->sequence, &expected, pos + LOG_RECORD_FILLING))
+   {
+      return false;
+   }
+
+   atomic_store(&record->pid, getpid());
+
+   memcpy(&record->line[0], line, length);
+   record->line[length] = '\0';
+   record->length = length;
+   record->level = level;
+
+   expected = pos + LOG_RECORD_FILLING;
+   if (!atomic_compare_exchange_strong(&record->sequence, &expected, pos + 1))
+   {
+      return false;
+   }
+
+   log_ring_wake(false);
+
+   return true;
+}
+
+static int
+log_ring_drain(void)
+{
+   int count = 0;
+   unsigned long tail;
+   struct log_record* record = NULL;
+   struct log_ring* ring;
+   struct configuration* config;
+
+   ring = (struct log_ring*)log_shmem;
+   config = (struct configuration*)shmem;
+
+   tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+   while (true)
+   {
+      record = &ring->records[tail & (PGAGROAL_LOGGING_RING_SLOTS - 1)];
+
+      if (atomic_load_explicit(&record->sequence, memory_order_acquire) != tail + 1)
+      {
+         break;
+      }
+
+      log_ring_write(record);
+
+      atomic_store(&record->pid, 0);
+      atomic_store_explicit(&record->sequence, tail + PGAGROAL_LOGGING_RING_SLOTS, memory_order_release);
+      tail++;
+      atomic_store_explicit(&ring->tail, tail, memory_order_relaxed);
+
+      count++;
+   }
+
+   if (count > 0)
+   {
+      if (config->log_type == PGAGROAL_LOGGING_TYPE_CONSOLE)
+      {
+         fflush(stdout);
+      }
+      else if (config->log_type == PGAGROAL_LOGGING_TYPE_FILE && log_file != NULL)
+      {
+         fflush(log_file);
+
+         if (log_rotation_required())
+         {
+            log_file_rotate();
+         }
+      }
+   }
+
+   return count;
+}
+
+static void
+log_ring_write(struct log_record* record)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->log_type == PGAGROAL_LOGGING_TYPE_CONSOLE)
+   {
+      fwrite(&record->line[0], 1, record->length, stdout);
+      fputc('\n', stdout);
+   }
+   else if (config->log_type == PGAGROAL_LOGGING_TYPE_FILE)
+   {
+      if (log_file != NULL)
+      {
+         fwrite(&record->line[0], 1, record->length, log_file);
+         fputc('\n', log_file);
+      }
+   }
+   else if (config->log_type == PGAGROAL_LOGGING_TYPE_SYSLOG)
+   {
+      syslog(syslog_priority(record->level), "%s", &record->line[0]);
+   }
+}
+
+static bool
+log_ring_skip(uint64_t stalled)
+{
+   pid_t pid;
+   unsigned long tail;
+   unsigned long sequence;
+   struct log_record* record = NULL;
+   struct log_ring* ring;
+
+   ring = (struct log_ring*)log_shmem;
+
+   tail = atomic_load(&ring->tail);
+   record = &ring->records[tail & (PGAGROAL_LOGGING_RING_SLOTS - 1)];
+
+   /* The process didn't start to fill the record, and can't do so once it is recycled */
+   sequence = tail;
+   if (atomic_compare_exchange_strong(&record->sequence, &sequence, tail + PGAGROAL_LOGGING_RING_SLOTS))
+   {
+      goto skipped;
+   }
+
+   if (sequence != tail + LOG_RECORD_FILLING)
+   {
+      return false;
+   }
+
+   /* A record that is being filled is only recycled when its process is gone */
+   pid = (pid_t)atomic_load(&record->pid);
+
+   if (pid > 0)
+   {
+      if (kill(pid, 0) == 0 || errno != ESRCH)
+      {
+         errno = 0;
+         return false;
+      }
+      errno = 0;
+   }
+   else if (stalled < LOG_WRITER_ABANDON)
+   {
+      return false;
+   }
+
+   atomic_store(&record->pid, 0);
+
+   if (!atomic_compare_exchange_strong(&record->sequence, &sequence, tail + PGAGROAL_LOGGING_RING_SLOTS))
+   {
+      return false;
+   }
+
+skipped:
+
+   atomic_store(&ring->tail, tail + 1);
+   atomic_fetch_add(&ring->dropped, 1);
+
+   return true;
+}
+
+static bool
+log_ring_ready(void)
+{
+   unsigned long tail;
+   struct log_ring* ring;
+
+   ring = (struct log_ring*)log_shmem;
+
+   tail = atomic_load(&ring->tail);
+
+   return atomic_load(&ring->records[tail & (PGAGROAL_LOGGING_RING_SLOTS - 1)].sequence) == tail + 1;
+}
+
+static void
+log_ring_wait(void)
+{
+   unsigned int wake;
+   struct log_ring* ring;
+
+   ring = (struct log_ring*)log_shmem;
+
+   wake = atomic_load(&ring->wake);
+   atomic_store(&ring->sleeping, true);
+
+   /* A line published before the log writer was marked as sleeping didn't wake it up */
+   if (!log_ring_ready() && !atomic_load(&ring->reopen))
+   {
+#ifdef HAVE_LINUX
+      struct timespec ts;
+
+      ts.tv_sec = 0;
+      ts.tv_nsec = (long)LOG_WRITER_WAIT * 1000L;
+
+      /* Returns at once if a wake up happened since it was read */
+      syscall(SYS_futex, (uint32_t*)&ring->wake, FUTEX_WAIT, wake, &ts, NULL, 0);
+      errno = 0;
+#else
+      SLEEP(LOG_WRITER_SLEEP);
+#endif
+   }
+
+   atomic_store(&ring->sleeping, false);
+}
+
+static void
+log_ring_wake(bool always)
+{
+   struct log_ring* ring;
+
+   ring = (struct log_ring*)log_shmem;
+
+   if (always || atomic_load(&ring->sleeping))
+   {
+      atomic_fetch_add(&ring->wake, 1);
+#ifdef HAVE_LINUX
+      syscall(SYS_futex, (uint32_t*)&ring->wake, FUTEX_WAKE, 1, NULL, NULL, 0);
+#endif
+   }
+}
+
+static int
+syslog_priority(int level)
+{
+   switch (level)
+   {
+      case PGAGROAL_LOGGING_LEVEL_DEBUG5:
+      case PGAGROAL_LOGGING_LEVEL_DEBUG1:
+         return LOG_DEBUG;
+      case PGAGROAL_LOGGING_LEVEL_INFO:
+         return LOG_INFO;
+      case PGAGROAL_LOGGING_LEVEL_WARN:
+         return LOG_WARNING;
+      case PGAGROAL_LOGGING_LEVEL_ERROR:
+         return LOG_ERR;
+      case PGAGROAL_LOGGING_LEVEL_FATAL:
+         return LOG_CRIT;
+      default:
+         return LOG_INFO;
+   }
+}
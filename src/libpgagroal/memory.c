@@ -45,6 +45,7 @@
 
 static struct message* message = NULL;
 static void* data = NULL;
+static size_t used = 0;
 
 /**
  *
@@ -72,6 +73,13 @@ pgagroal_memory_init(void)
       {
          goto error;
       }
+      used = 0;
+   }
+
+   /* The data of the previous message is still in the buffer */
+   if (message->data == data && message->length > 0)
+   {
+      pgagroal_memory_used((size_t)message->length);
    }
 
    message->kind = 0;
@@ -116,14 +124,32 @@ pgagroal_memory_free(void)
    assert(data != NULL);
 #endif
 
-   memset(message, 0, sizeof(struct message));
-   memset(data, 0, DEFAULT_BUFFER_SIZE);
+   if (message->data == data && message->length > 0)
+   {
+      pgagroal_memory_used((size_t)message->length);
+   }
+
+   /* Everything past the used part is still zero from the last free */
+   memset(data, 0, used);
+   used = 0;
 
    message->kind = 0;
    message->length = 0;
    message->data = data;
 }
 
+/**
+ *
+ */
+void
+pgagroal_memory_used(size_t size)
+{
+   if (size > used)
+   {
+      used = size < DEFAULT_BUFFER_SIZE ? size : DEFAULT_BUFFER_SIZE;
+   }
+}
+
 /**
  *
  */
@@ -135,4 +161,5 @@ pgagroal_memory_destroy(void)
 
    data = NULL;
    message = NULL;
+   used = 0;
 }
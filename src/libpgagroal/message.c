@@ -1342,6 +1342,7 @@ read_message(int socket, bool block, int timeout, struct message** msg)
 
       if (likely(numbytes > 0))
       {
+         pgagroal_memory_used(numbytes);
          m->kind = (signed char)(*((char*)m->data));
          m->length = numbytes;
          *msg = m;
@@ -1485,6 +1486,7 @@ ssl_read_message(SSL* ssl, int timeout, struct message** msg)
 
       if (likely(numbytes > 0))
       {
+         pgagroal_memory_used(numbytes);
          m->kind = (signed char)(*((char*)m->data));
          m->length = numbytes;
          *msg = m;
@@ -419,6 +419,37 @@ pgagroal_socket_isvalid(int fd)
    return true;
 }
 
+/**
+ *
+ */
+int
+pgagroal_socket_nonblocking(int fd, bool value)
+{
+   int flags;
+
+   flags = fcntl(fd, F_GETFL);
+   if (flags == -1)
+   {
+      goto error;
+   }
+
+   flags = value ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+
+   if (fcntl(fd, F_SETFL, flags) == -1)
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   pgagroal_log_debug("pgagroal_socket_nonblocking: %d %s", fd, strerror(errno));
+   errno = 0;
+
+   return 1;
+}
+
 /**
  *
  */
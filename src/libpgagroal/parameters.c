@@ -0,0 +1,666 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgagroal */
+#include <pgagroal.h>
+#include <deque.h>
+#include <logging.h>
+#include <message.h>
+#include <parameters.h>
+#include <security.h>
+#include <utils.h>
+#include <value.h>
+
+/* system */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct parameter_slot* get_slot(struct parameter_client* client, int slot);
+static int load_parameters(struct parameter_slot* ps, int slot);
+static char* parameter_get(struct parameter_slot* ps, char* name);
+static int parameter_put(struct parameter_slot* ps, char* name, char* value);
+static void parameter_remove(struct parameter_slot* ps, char* name);
+static bool parameter_settable(char* name);
+
+static int buffer_ensure(char** buffer, size_t* size, size_t length);
+static int replay_append(struct parameter_client* client, char* data);
+static int replay_append_literal(struct parameter_client* client, char* data);
+static int replay_add(struct parameter_client* client, char* name, char* value);
+static int replay_finish(struct parameter_client* client);
+
+static void server_parameter(struct parameter_client* client, struct parameter_slot* ps, char* data, int total, size_t available, bool seen);
+
+size_t
+pgagroal_parameters_size(void* shmem)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   return config->max_connections * sizeof(struct parameter_slot);
+}
+
+int
+pgagroal_parameters_create(void* slots, struct parameter_client** client)
+{
+   struct parameter_client* c = NULL;
+
+   *client = NULL;
+
+   c = (struct parameter_client*)calloc(1, sizeof(struct parameter_client));
+   if (c == NULL)
+   {
+      goto error;
+   }
+
+   c->slots = (struct parameter_slot*)slots;
+
+   *client = c;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+void
+pgagroal_parameters_destroy(struct parameter_client* client)
+{
+   if (client == NULL)
+   {
+      return;
+   }
+
+   free(client->replay);
+   free(client->buffer);
+   free(client);
+}
+
+int
+pgagroal_parameters_start(struct parameter_client* client, int slot)
+{
+   char* value = NULL;
+   struct parameter* p = NULL;
+   struct parameter_slot* ps = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   ps = get_slot(client, slot);
+
+   if (ps->backend_pid != config->connections[slot].backend_pid ||
+       ps->backend_secret != config->connections[slot].backend_secret)
+   {
+      if (load_parameters(ps, slot))
+      {
+         goto error;
+      }
+   }
+
+   if (!client->known)
+   {
+      if (load_parameters(&client->parameters, slot))
+      {
+         goto error;
+      }
+      client->known = true;
+   }
+
+   /* The stream from the server starts over */
+   client->replays = 0;
+   client->server_remaining = 0;
+   client->server_drop = false;
+   client->server_pending_length = 0;
+   client->replay_length = 0;
+   client->failed = false;
+
+   for (int i = 0; i < client->parameters.number_of_parameters; i++)
+   {
+      p = &client->parameters.parameters[i];
+
+      if (!parameter_settable(&p->name[0]))
+      {
+         continue;
+      }
+
+      value = parameter_get(ps, &p->name[0]);
+      if (value != NULL && !strcmp(value, &p->value[0]))
+      {
+         continue;
+      }
+
+      pgagroal_log_trace("pgagroal_parameters_start: %s = '%s' (slot %d)", &p->name[0], &p->value[0], slot);
+
+      if (replay_add(client, &p->name[0], &p->value[0]))
+      {
+         goto error;
+      }
+   }
+
+   if (client->replay_length > 0)
+   {
+      if (replay_finish(client))
+      {
+         goto error;
+      }
+   }
+
+   return 0;
+
+error:
+
+   client->replay_length = 0;
+
+   return 1;
+}
+
+int
+pgagroal_parameters_client(struct parameter_client* client, struct message* msg, struct message** result)
+{
+   if (client->replay_length == 0)
+   {
+      *result = msg;
+      return 0;
+   }
+
+   if (buffer_ensure(&client->buffer, &client->buffer_size, client->replay_length + msg->length))
+   {
+      goto error;
+   }
+
+   memcpy(client->buffer, client->replay, client->replay_length);
+   memcpy(client->buffer + client->replay_length, msg->data, msg->length);
+
+   client->message.kind = 'Q';
+   client->message.length = client->replay_length + msg->length;
+   client->message.data = client->buffer;
+   *result = &client->message;
+
+   client->replays++;
+   client->replay_length = 0;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+pgagroal_parameters_server(struct parameter_client* client, int slot, struct message* msg, struct message** result)
+{
+   char* data = NULL;
+   size_t length;
+   size_t offset = 0;
+   size_t written = 0;
+   size_t remaining;
+   struct parameter_slot* ps = NULL;
+
+   ps = get_slot(client, slot);
+
+   /* The responses are only removed, so the messages are rewritten in place */
+   if (client->server_pending_length > 0)
+   {
+      if (buffer_ensure(&client->buffer, &client->buffer_size, client->server_pending_length + msg->length))
+      {
+         goto error;
+      }
+
+      memcpy(client->buffer, &client->server_pending[0], client->server_pending_length);
+      memcpy(client->buffer + client->server_pending_length, msg->data, msg->length);
+
+      data = client->buffer;
+      length = client->server_pending_length + msg->length;
+   }
+   else
+   {
+      data = (char*)msg->data;
+      length = msg->length;
+   }
+
+   while (offset < length)
+   {
+      char kind;
+      int total;
+      bool drop;
+
+      if (client->server_remaining > 0)
+      {
+         remaining = MIN((size_t)client->server_remaining, length - offset);
+         if (!client->server_drop)
+         {
+            memmove(data + written, data + offset, remaining);
+            written += remaining;
+         }
+         client->server_remaining -= remaining;
+         offset += remaining;
+         continue;
+      }
+
+      if (client->failed)
+      {
+         /* Nothing after the error of a replay is for the client */
+         offset = length;
+         break;
+      }
+
+      if (length - offset < 5)
+      {
+         break;
+      }
+
+      kind = pgagroal_read_byte(data + offset);
+      total = pgagroal_read_int32(data + offset + 1) + 1;
+
+      if (total < 5)
+      {
+         pgagroal_log_debug("pgagroal_parameters_server: Invalid message (slot %d)", slot);
+         goto error;
+      }
+
+      if (kind == 'S' && length - offset < MIN((size_t)total, sizeof(client->server_pending)))
+      {
+         /* Wait for the rest of the parameter, or for the name of a parameter that is too long */
+         break;
+      }
+
+      /* Everything up to the ReadyForQuery of a replay is for pgagroal */
+      drop = client->replays > 0;
+
+      switch (kind)
+      {
+         case 'S':
+            server_parameter(client, ps, data + offset, total, length - offset, !drop);
+            break;
+         case 'E':
+            if (drop)
+            {
+               /* The client can't continue with other parameters than its own, so it gets the error */
+               pgagroal_log_warn("pgagroal: Unable to restore the parameters of the client (slot %d)", slot);
+               client->failed = true;
+               drop = false;
+            }
+            break;
+         case 'Z':
+            if (drop)
+            {
+               client->replays--;
+            }
+            break;
+         default:
+            break;
+      }
+
+      remaining = MIN((size_t)total, length - offset);
+      if (!drop)
+      {
+         memmove(data + written, data + offset, remaining);
+         written += remaining;
+      }
+      client->server_remaining = total - remaining;
+      client->server_drop = drop;
+      offset += remaining;
+   }
+
+   client->server_pending_length = length - offset;
+   memcpy(&client->server_pending[0], data + offset, client->server_pending_length);
+
+   client->message.data = data;
+   client->message.length = written;
+   client->message.kind = written > 0 ? pgagroal_read_byte(data) : 0;
+   *result = &client->message;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+bool
+pgagroal_parameters_failed(struct parameter_client* client)
+{
+   return client->failed && client->server_remaining == 0;
+}
+
+static struct parameter_slot*
+get_slot(struct parameter_client* client, int slot)
+{
+   return client->slots + slot;
+}
+
+static int
+load_parameters(struct parameter_slot* ps, int slot)
+{
+   struct deque* parameters = NULL;
+   struct deque_iterator* iter = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   /* The parameters of the startup of the connection */
+   if (pgagroal_extract_server_parameters(slot, &parameters))
+   {
+      goto error;
+   }
+
+   ps->number_of_parameters = 0;
+   ps->backend_pid = config->connections[slot].backend_pid;
+   ps->backend_secret = config->connections[slot].backend_secret;
+
+   if (pgagroal_deque_iterator_create(parameters, &iter))
+   {
+      goto error;
+   }
+
+   while (pgagroal_deque_iterator_next(iter))
+   {
+      parameter_put(ps, iter->tag, (char*)iter->value->data);
+   }
+
+   pgagroal_deque_iterator_destroy(iter);
+   pgagroal_deque_destroy(parameters);
+
+   return 0;
+
+error:
+
+   pgagroal_deque_destroy(parameters);
+
+   return 1;
+}
+
+static char*
+parameter_get(struct parameter_slot* ps, char* name)
+{
+   for (int i = 0; i < ps->number_of_parameters; i++)
+   {
+      if (!strcmp(&ps->parameters[i].name[0], name))
+      {
+         return &ps->parameters[i].value[0];
+      }
+   }
+
+   return NULL;
+}
+
+static int
+parameter_put(struct parameter_slot* ps, char* name, char* value)
+{
+   struct parameter* p = NULL;
+
+   if (strlen(name) >= MAX_PARAMETER_NAME_LENGTH || strlen(value) >= MAX_PARAMETER_VALUE_LENGTH)
+   {
+      /* Not restored, rather than restored wrong */
+      pgagroal_log_debug("parameter_put: %s is too long", name);
+      parameter_remove(ps, name);
+      return 1;
+   }
+
+   for (int i = 0; i < ps->number_of_parameters; i++)
+   {
+      if (!strcmp(&ps->parameters[i].name[0], name))
+      {
+         p = &ps->parameters[i];
+         break;
+      }
+   }
+
+   if (p == NULL)
+   {
+      if (ps->number_of_parameters >= MAX_SESSION_PARAMETERS)
+      {
+         pgagroal_log_debug("parameter_put: Too many parameters for %s", name);
+         return 1;
+      }
+
+      p = &ps->parameters[ps->number_of_parameters];
+      ps->number_of_parameters++;
+
+      memset(&p->name[0], 0, MAX_PARAMETER_NAME_LENGTH);
+      memcpy(&p->name[0], name, strlen(name));
+   }
+
+   memset(&p->value[0], 0, MAX_PARAMETER_VALUE_LENGTH);
+   memcpy(&p->value[0], value, strlen(value));
+
+   return 0;
+}
+
+static void
+parameter_remove(struct parameter_slot* ps, char* name)
+{
+   for (int i = 0; i < ps->number_of_parameters; i++)
+   {
+      if (!strcmp(&ps->parameters[i].name[0], name))
+      {
+         ps->number_of_parameters--;
+         ps->parameters[i] = ps->parameters[ps->number_of_parameters];
+         return;
+      }
+   }
+}
+
+static bool
+parameter_settable(char* name)
+{
+   /* The parameters which are reported, but can't be changed by a client */
+   static char* fixed[] = {"server_version", "server_encoding", "integer_datetimes",
+                           "in_hot_standby", "is_superuser", "session_authorization"};
+
+   for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++)
+   {
+      if (!strcmp(fixed[i], name))
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static int
+buffer_ensure(char** buffer, size_t* size, size_t length)
+{
+   char* b = NULL;
+   size_t s;
+
+   if (length <= *size)
+   {
+      return 0;
+   }
+
+   s = *size > 0 ? *size : 1024;
+   while (s < length)
+   {
+      s *= 2;
+   }
+
+   b = (char*)realloc(*buffer, s);
+   if (b == NULL)
+   {
+      return 1;
+   }
+
+   *buffer = b;
+   *size = s;
+
+   return 0;
+}
+
+static int
+replay_append(struct parameter_client* client, char* data)
+{
+   size_t length = strlen(data);
+
+   if (buffer_ensure(&client->replay, &client->replay_size, client->replay_length + length))
+   {
+      return 1;
+   }
+
+   memcpy(client->replay + client->replay_length, data, length);
+   client->replay_length += length;
+
+   return 0;
+}
+
+static int
+replay_append_literal(struct parameter_client* client, char* data)
+{
+   char c[2] = {0, 0};
+
+   /* An escape string literal means the same for every standard_conforming_strings */
+   if (replay_append(client, "E'"))
+   {
+      return 1;
+   }
+
+   for (size_t i = 0; i < strlen(data); i++)
+   {
+      c[0] = data[i];
+
+      if (c[0] == '\'' || c[0] == '\\')
+      {
+         if (replay_append(client, c))
+         {
+            return 1;
+         }
+      }
+
+      if (replay_append(client, c))
+      {
+         return 1;
+      }
+   }
+
+   return replay_append(client, "'");
+}
+
+static int
+replay_add(struct parameter_client* client, char* name, char* value)
+{
+   if (client->replay_length == 0)
+   {
+      /* Room for the message header */
+      if (replay_append(client, "Q0000SELECT "))
+      {
+         return 1;
+      }
+   }
+   else
+   {
+      if (replay_append(client, ", "))
+      {
+         return 1;
+      }
+   }
+
+   /* set_config() takes the value in the same form as it is reported */
+   if (replay_append(client, "pg_catalog.set_config(") ||
+       replay_append_literal(client, name) ||
+       replay_append(client, ", ") ||
+       replay_append_literal(client, value) ||
+       replay_append(client, ", false)"))
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+replay_finish(struct parameter_client* client)
+{
+   if (replay_append(client, ";"))
+   {
+      return 1;
+   }
+
+   if (buffer_ensure(&client->replay, &client->replay_size, client->replay_length + 1))
+   {
+      return 1;
+   }
+
+   client->replay[client->replay_length] = '\0';
+   client->replay_length++;
+
+   pgagroal_write_byte(client->replay, 'Q');
+   pgagroal_write_int32(client->replay + 1, client->replay_length - 1);
+
+   return 0;
+}
+
+static void
+server_parameter(struct parameter_client* client, struct parameter_slot* ps, char* data, int total, size_t available, bool seen)
+{
+   char* name = NULL;
+   char* value = NULL;
+   size_t size;
+   size_t name_length;
+   size_t value_length;
+
+   size = MIN((size_t)total, available);
+
+   name = data + 5;
+   name_length = strnlen(name, size - 5);
+   if (name_length == size - 5)
+   {
+      return;
+   }
+
+   if ((size_t)total > available)
+   {
+      /* Only the start of a parameter which is too long is buffered */
+      pgagroal_log_debug("server_parameter: %s is too long", name);
+      parameter_remove(ps, name);
+      parameter_remove(&client->parameters, name);
+      return;
+   }
+
+   value = name + name_length + 1;
+   value_length = strnlen(value, total - 5 - name_length - 1);
+   if (value_length == (size_t)(total - 5 - name_length - 1))
+   {
+      return;
+   }
+
+   if (parameter_put(ps, name, value))
+   {
+      /* A value which a slot can't keep would be replayed on every transaction */
+      parameter_remove(&client->parameters, name);
+      return;
+   }
+
+   /* The client only knows about the parameters that it received */
+   if (seen)
+   {
+      parameter_put(&client->parameters, name, value);
+   }
+}
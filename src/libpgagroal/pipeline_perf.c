@@ -34,10 +34,14 @@
 #include <message.h>
 #include <network.h>
 #include <pipeline.h>
+#include <pool.h>
+#include <prometheus.h>
+#include <utils.h>
 #include <worker.h>
 
 /* system */
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <netinet/in.h>
@@ -52,6 +56,35 @@ static void performance_stop(struct event_loop* loop, struct worker_io*);
 static void performance_destroy(void*, size_t);
 static void performance_periodic(void);
 
+#if HAVE_LINUX
+/* Messages of at least this size are relayed with splice() */
+#define RELAY_THRESHOLD 16384
+
+/** @struct relay
+ * The message framing of one direction of the splice() relay
+ */
+struct relay
+{
+   ssize_t remaining; /**< The bytes left of the current message, -1 if the framing is lost */
+   char header[5];    /**< The partial header of the next message */
+   int header_length; /**< The length of the partial header */
+   bool splicing;     /**< Is the current message relayed with splice() */
+   bool peek;         /**< Look at the next header before reading */
+};
+
+static void relay_init(struct relay* r);
+static bool relay_ready(struct relay* r, int from);
+static int relay_receive(struct relay* r, int from, ssize_t* length);
+static int relay_send(int to, ssize_t length);
+static void relay_track(struct relay* r, struct message* msg);
+
+static bool relay = false;
+static int relay_pipe[2] = {-1, -1};
+static ssize_t relay_pipe_size = 0;
+static struct relay client_relay;
+static struct relay server_relay;
+#endif
+
 static bool saw_x = false;
 
 struct pipeline
@@ -85,18 +118,62 @@ performance_start(struct event_loop* loop __attribute__((unused)), struct worker
 
    for (int i = 0; i < config->max_connections; i++)
    {
-      if (i != w->slot && !config->connections[i].new && config->connections[i].fd > 0)
+      if (i != w->slot && !config->connections[i].new && config->connections[i].fd > 0 &&
+          pgagroal_pool_descriptor_known(i))
       {
          pgagroal_disconnect(config->connections[i].fd);
       }
    }
 
+#if HAVE_LINUX
+   relay = false;
+
+   if (config->splice)
+   {
+      if (pipe2(relay_pipe, O_CLOEXEC | O_NONBLOCK) == 0)
+      {
+         fcntl(relay_pipe[1], F_SETPIPE_SZ, DEFAULT_BUFFER_SIZE);
+         relay_pipe_size = fcntl(relay_pipe[1], F_GETPIPE_SZ);
+
+         if (relay_pipe_size > 0)
+         {
+            relay_init(&client_relay);
+            relay_init(&server_relay);
+            relay = true;
+         }
+         else
+         {
+            close(relay_pipe[0]);
+            close(relay_pipe[1]);
+            relay_pipe[0] = -1;
+            relay_pipe[1] = -1;
+         }
+      }
+
+      if (!relay)
+      {
+         pgagroal_log_debug("performance_start: splice not available (slot %d): %s", w->slot, strerror(errno));
+         errno = 0;
+      }
+   }
+#endif
+
    return;
 }
 
 static void
 performance_stop(struct event_loop* loop __attribute__((unused)), struct worker_io* w __attribute__((unused)))
 {
+#if HAVE_LINUX
+   if (relay)
+   {
+      close(relay_pipe[0]);
+      close(relay_pipe[1]);
+      relay_pipe[0] = -1;
+      relay_pipe[1] = -1;
+      relay = false;
+   }
+#endif
 }
 
 static void
@@ -119,11 +196,50 @@ performance_client(struct io_watcher* watcher)
 
    wi = (struct worker_io*)watcher;
 
+#if HAVE_LINUX
+   if (relay && relay_ready(&client_relay, wi->client_fd))
+   {
+      ssize_t length = 0;
+
+      status = relay_receive(&client_relay, wi->client_fd, &length);
+
+      if (status == MESSAGE_STATUS_ZERO)
+      {
+         goto client_done;
+      }
+      else if (status != MESSAGE_STATUS_OK)
+      {
+         goto client_error;
+      }
+
+      status = relay_send(wi->server_fd, length);
+
+      if (unlikely(status != MESSAGE_STATUS_OK))
+      {
+         goto server_error;
+      }
+
+      pgagroal_prometheus_network_sent_add(length);
+
+      errno = 0;
+
+      return;
+   }
+#endif
+
    status = pgagroal_recv_message(watcher, &msg);
    PGAGROAL_LOG_POSTGRES(msg);
 
    if (likely(status == MESSAGE_STATUS_OK))
    {
+#if HAVE_LINUX
+      if (relay)
+      {
+         relay_track(&client_relay, msg);
+         pgagroal_prometheus_network_sent_add(msg->length);
+      }
+#endif
+
       if (likely(msg->kind != 'X'))
       {
          status = pgagroal_send_message(watcher, msg);
@@ -203,10 +319,47 @@ performance_server(struct io_watcher* watcher)
 
    wi = (struct worker_io*)watcher;
 
+#if HAVE_LINUX
+   if (relay && relay_ready(&server_relay, wi->server_fd))
+   {
+      ssize_t length = 0;
+
+      status = relay_receive(&server_relay, wi->server_fd, &length);
+
+      if (status == MESSAGE_STATUS_ZERO)
+      {
+         goto server_done;
+      }
+      else if (status != MESSAGE_STATUS_OK)
+      {
+         goto server_error;
+      }
+
+      status = relay_send(wi->client_fd, length);
+
+      if (unlikely(status != MESSAGE_STATUS_OK))
+      {
+         goto client_error;
+      }
+
+      pgagroal_prometheus_network_received_add(length);
+
+      return;
+   }
+#endif
+
    status = pgagroal_recv_message(watcher, &msg);
 
    if (likely(status == MESSAGE_STATUS_OK))
    {
+#if HAVE_LINUX
+      if (relay)
+      {
+         relay_track(&server_relay, msg);
+         pgagroal_prometheus_network_received_add(msg->length);
+      }
+#endif
+
       status = pgagroal_send_message(watcher, msg);
 
       if (unlikely(status != MESSAGE_STATUS_OK))
@@ -277,3 +430,175 @@ server_error:
    pgagroal_event_loop_break();
    return;
 }
+
+#if HAVE_LINUX
+static void
+relay_init(struct relay* r)
+{
+   memset(r, 0, sizeof(struct relay));
+}
+
+static bool
+relay_ready(struct relay* r, int from)
+{
+   ssize_t numbytes;
+   int32_t length;
+
+   if (r->splicing)
+   {
+      return true;
+   }
+
+   if (r->remaining >= RELAY_THRESHOLD && r->header_length == 0)
+   {
+      /* The head of the message was copied, and nothing more will be looked at */
+      r->splicing = true;
+      return true;
+   }
+
+   if (r->remaining != 0 || r->header_length != 0 || !r->peek)
+   {
+      return false;
+   }
+
+   /* Only peek after a large message, since they tend to come in runs */
+   r->peek = false;
+
+   numbytes = recv(from, &r->header[0], sizeof(r->header), MSG_PEEK | MSG_DONTWAIT);
+   if (numbytes != (ssize_t)sizeof(r->header))
+   {
+      errno = 0;
+      return false;
+   }
+
+   length = pgagroal_read_int32(&r->header[1]);
+
+   /* Errors are copied so the FATAL check sees them */
+   if (r->header[0] == 'E' || length < 4 || 1 + (ssize_t)length < RELAY_THRESHOLD)
+   {
+      return false;
+   }
+
+   r->remaining = 1 + (ssize_t)length;
+   r->splicing = true;
+
+   return true;
+}
+
+static int
+relay_receive(struct relay* r, int from, ssize_t* length)
+{
+   ssize_t numbytes;
+
+   *length = 0;
+
+   numbytes = splice(from, NULL, relay_pipe[1], NULL, MIN(r->remaining, relay_pipe_size), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+   if (likely(numbytes > 0))
+   {
+      r->remaining -= numbytes;
+
+      if (r->remaining == 0)
+      {
+         r->splicing = false;
+         r->peek = true;
+      }
+
+      *length = numbytes;
+
+      return MESSAGE_STATUS_OK;
+   }
+   else if (numbytes == 0)
+   {
+      return MESSAGE_STATUS_ZERO;
+   }
+
+   if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+   {
+      errno = 0;
+      return MESSAGE_STATUS_OK;
+   }
+
+   pgagroal_log_error("splice error: fd=%d errno=%d", from, errno);
+
+   return MESSAGE_STATUS_ERROR;
+}
+
+static int
+relay_send(int to, ssize_t length)
+{
+   ssize_t numbytes;
+
+   while (length > 0)
+   {
+      numbytes = splice(relay_pipe[0], NULL, to, NULL, length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+      if (likely(numbytes > 0))
+      {
+         length -= numbytes;
+      }
+      else if (numbytes == -1 && (errno == EAGAIN || errno == EINTR))
+      {
+         errno = 0;
+      }
+      else
+      {
+         return MESSAGE_STATUS_ERROR;
+      }
+   }
+
+   return MESSAGE_STATUS_OK;
+}
+
+static void
+relay_track(struct relay* r, struct message* msg)
+{
+   ssize_t offset;
+   ssize_t needed;
+   int32_t length;
+
+   if (r->remaining < 0)
+   {
+      return;
+   }
+
+   r->peek = false;
+
+   if (r->remaining >= msg->length)
+   {
+      r->remaining -= msg->length;
+      return;
+   }
+
+   offset = r->remaining;
+
+   while (offset < msg->length)
+   {
+      needed = (ssize_t)sizeof(r->header) - r->header_length;
+
+      if (msg->length - offset < needed)
+      {
+         memcpy(&r->header[r->header_length], (char*)msg->data + offset, msg->length - offset);
+         r->header_length += msg->length - offset;
+         r->remaining = 0;
+         return;
+      }
+
+      memcpy(&r->header[r->header_length], (char*)msg->data + offset, needed);
+      r->header_length = 0;
+      offset += needed;
+
+      length = pgagroal_read_int32(&r->header[1]);
+      if (length < 4)
+      {
+         pgagroal_log_debug("relay_track: invalid message length %d", length);
+         r->remaining = -1;
+         return;
+      }
+
+      offset += length - 4;
+   }
+
+   r->remaining = offset - msg->length;
+}
+#endif
@@ -34,6 +34,7 @@
 #include <message.h>
 #include <network.h>
 #include <pipeline.h>
+#include <pool.h>
 #include <prometheus.h>
 #include <server.h>
 #include <shmem.h>
@@ -62,6 +63,8 @@ static bool in_tx;
 static int next_client_message;
 static int next_server_message;
 static bool saw_x = false;
+static int latency_index = -1;
+static uint64_t query_start = 0;
 
 #define CLIENT_INIT   0
 #define CLIENT_IDLE   1
@@ -141,10 +144,13 @@ session_start(struct event_loop* loop __attribute__((unused)), struct worker_io*
    in_tx = false;
    next_client_message = 0;
    next_server_message = 0;
+   latency_index = pgagroal_prometheus_query_latency_index(config->connections[w->slot].username, config->connections[w->slot].database);
+   query_start = 0;
 
    for (int i = 0; i < config->max_connections; i++)
    {
-      if (i != w->slot && !config->connections[i].new && config->connections[i].fd > 0)
+      if (i != w->slot && !config->connections[i].new && config->connections[i].fd > 0 &&
+          pgagroal_pool_descriptor_known(i))
       {
          pgagroal_disconnect(config->connections[i].fd);
       }
@@ -166,6 +172,9 @@ session_stop(struct event_loop* loop __attribute__((unused)), struct worker_io*
 {
    struct client_session* client;
 
+   pgagroal_prometheus_query_latency_release(latency_index);
+   latency_index = -1;
+
    if (pipeline_shmem != NULL)
    {
       client = pipeline_shmem + (w->slot * sizeof(struct client_session));
@@ -316,6 +325,11 @@ session_client(struct io_watcher* watcher)
                {
                   pgagroal_prometheus_query_count_add();
                   pgagroal_prometheus_query_count_specified_add(wi->slot);
+
+                  if (query_start == 0)
+                  {
+                     query_start = pgagroal_get_monotonic_micros();
+                  }
                }
 
                /* Calculate the offset to the next message */
@@ -471,6 +485,12 @@ session_server(struct io_watcher* watcher)
                }
 
                in_tx = tx_state != 'I';
+
+               if (query_start != 0)
+               {
+                  pgagroal_prometheus_query_latency(latency_index, pgagroal_get_monotonic_micros() - query_start);
+                  query_start = 0;
+               }
             }
 
             /* Calculate the offset to the next message */
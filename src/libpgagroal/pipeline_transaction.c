@@ -31,10 +31,13 @@
 #include <connection.h>
 #include <ev.h>
 #include <logging.h>
+#include <memory.h>
 #include <message.h>
 #include <network.h>
+#include <parameters.h>
 #include <pipeline.h>
 #include <pool.h>
+#include <prepared.h>
 #include <prometheus.h>
 #include <server.h>
 #include <shmem.h>
@@ -44,12 +47,48 @@
 
 /* system */
 #include <errno.h>
+#include <signal.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 #include <netinet/in.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
+/** @struct transaction_client
+ * Defines the state of a client in the transaction pipeline
+ */
+struct transaction_client
+{
+   struct worker_io client_io;             /**< The client I/O of a multiplexed client (always first) */
+   struct worker_io server_io;             /**< The server I/O */
+   struct worker_io* client;               /**< The client I/O */
+   int slot;                               /**< The slot, or -1 between transactions */
+   int last_slot;                          /**< The slot of the previous transaction, or -1 */
+   char username[MAX_USERNAME_LENGTH];     /**< The user name */
+   char database[MAX_DATABASE_LENGTH];     /**< The database */
+   char appname[MAX_APPLICATION_NAME];     /**< The application name */
+   char address[INET6_ADDRSTRLEN];         /**< The client address */
+   bool in_tx;                             /**< Is a transaction active */
+   int next_client_message;                /**< The remaining bytes of the current client message */
+   int next_server_message;                /**< The remaining bytes of the current server message */
+   struct prepared_client* prepared;       /**< The prepared statements, or NULL */
+   struct parameter_client* parameters;    /**< The session parameters, or NULL */
+   bool fatal;                             /**< Did the server report a FATAL error */
+   bool saw_x;                             /**< Did the client send Terminate */
+   bool io_watcher_active;                 /**< Is the server I/O active */
+   bool closed;                            /**< Is the client disconnected */
+   time_t start_time;                      /**< The start time */
+   int latency;                            /**< The query latency histogram */
+   uint64_t query_start;                   /**< The start of the current query in microseconds */
+   bool parked;                            /**< Is the client waiting for a connection */
+   time_t parked_time;                     /**< The time the client started to wait */
+   struct transaction_client* next_parked; /**< The next client waiting for a connection */
+   struct transaction_client* next;        /**< The next client */
+   struct transaction_client* previous;    /**< The previous client */
+};
+
 static int transaction_initialize(void*, void**, size_t*);
 static void transaction_start(struct event_loop* loop, struct worker_io*);
 static void transaction_client(struct io_watcher* watcher);
@@ -58,25 +97,41 @@ static void transaction_stop(struct event_loop* loop, struct worker_io*);
 static void transaction_destroy(void*, size_t);
 static void transaction_periodic(void);
 
+static int start_worker(void);
 static void start_mgt(struct event_loop* loop);
 static void shutdown_mgt(struct event_loop* loop);
 static void accept_cb(struct io_watcher* watcher);
+static int slot_fd(int32_t slot, int* fd);
+static void close_stale_fds(void);
+
+static void client_stop(struct transaction_client* c, int code);
+static int acquire_slot(struct transaction_client* c);
+static void park_client(struct transaction_client* c);
+static void unpark_client(struct transaction_client* c);
+static void resume_clients(void);
+static void mark_parked(bool parked);
+static void release_slot(struct transaction_client* c, int code);
+static int add_client(int client_fd, char* username, char* database, char* appname, char* address);
+static int create_tracking(struct transaction_client* c);
+static void destroy_tracking(struct transaction_client* c);
+static void disconnect_client(struct transaction_client* c, int code);
+static void reap_clients(void);
+static void worker_signal_cb(void);
 
-static int slot;
-static char username[MAX_USERNAME_LENGTH];
-static char database[MAX_DATABASE_LENGTH];
-static char appname[MAX_APPLICATION_NAME];
-static bool in_tx;
-static int next_client_message;
-static int next_server_message;
 static int unix_socket = -1;
-static int deallocate;
-static bool fatal;
 static int fds[MAX_NUMBER_OF_CONNECTIONS];
-static bool saw_x = false;
+static unsigned int generations[MAX_NUMBER_OF_CONNECTIONS];
 static struct io_watcher io_mgt;
-static struct worker_io server_io;
-static bool io_watcher_active = false;
+static struct periodic_watcher stale_fds;
+static struct transaction_client single;
+static bool multiplexed = false;
+static int worker_index = -1;
+static struct transaction_client* clients = NULL;
+static struct transaction_client* closed_clients = NULL;
+static struct transaction_client* reaped_clients = NULL;
+static struct transaction_client* parked_first = NULL;
+static struct transaction_client* parked_last = NULL;
+static bool resuming = false;
 
 struct pipeline
 transaction_pipeline(void)
@@ -94,60 +149,233 @@ transaction_pipeline(void)
    return pipeline;
 }
 
+void
+pgagroal_transaction_worker(int index, char** argv)
+{
+   struct event_loop* loop = NULL;
+   struct signal_watcher signal_watcher;
+   struct periodic_watcher reap;
+   struct periodic_watcher resume;
+   struct main_configuration* config = NULL;
+
+   pgagroal_start_logging();
+   pgagroal_memory_init();
+
+   config = (struct main_configuration*)shmem;
+
+   multiplexed = true;
+   worker_index = index;
+
+   pgagroal_set_proc_title(1, argv, "transaction worker", NULL);
+
+   loop = pgagroal_event_loop_init();
+   if (!loop)
+   {
+      pgagroal_log_fatal("pgagroal: Failed to create loop for transaction worker %d", index);
+      exit(1);
+   }
+
+   if (start_worker())
+   {
+      exit(1);
+   }
+
+   start_mgt(loop);
+
+   pgagroal_signal_init(&signal_watcher, worker_signal_cb, SIGQUIT);
+   pgagroal_signal_start(&signal_watcher);
+
+   memset(&reap, 0, sizeof(struct periodic_watcher));
+   pgagroal_periodic_init(&reap, reap_clients, 1000);
+   pgagroal_periodic_start(&reap);
+
+   /* Clients waiting for a connection are woken up by the returns, this catches the timeouts */
+   memset(&resume, 0, sizeof(struct periodic_watcher));
+   pgagroal_periodic_init(&resume, resume_clients, 1000);
+   pgagroal_periodic_start(&resume);
+
+   /* Ready for clients */
+   atomic_store(&config->tx_workers[index].pid, getpid());
+
+   pgagroal_log_debug("pgagroal: Transaction worker %d (%d)", index, getpid());
+
+   pgagroal_event_loop_run();
+
+   atomic_store(&config->tx_workers[index].pid, 0);
+
+   while (clients != NULL)
+   {
+      disconnect_client(clients, WORKER_SHUTDOWN);
+   }
+
+   mark_parked(false);
+
+   reap_clients();
+   reap_clients();
+
+   shutdown_mgt(loop);
+   pgagroal_event_loop_destroy();
+
+   pgagroal_memory_destroy();
+   pgagroal_stop_logging();
+
+   exit(0);
+}
+
+int
+pgagroal_transaction_handover(int client_fd, char* username, char* database, char* appname, char* address)
+{
+   int index = -1;
+   int least = 0;
+   int fd = -1;
+   pid_t pid = 0;
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   /* Pick the least loaded worker that is ready */
+   for (int i = 0; i < config->transaction_workers; i++)
+   {
+      if (atomic_load(&config->tx_workers[i].pid) > 0)
+      {
+         int c = atomic_load(&config->tx_workers[i].clients);
+
+         if (index == -1 || c < least)
+         {
+            index = i;
+            least = c;
+         }
+      }
+   }
+
+   if (index == -1)
+   {
+      goto error;
+   }
+
+   pid = (pid_t)atomic_load(&config->tx_workers[index].pid);
+
+   if (pgagroal_connection_get_pid(pid, &fd))
+   {
+      goto error;
+   }
+
+   if (pgagroal_connection_id_write(fd, CONNECTION_SESSION))
+   {
+      goto error;
+   }
+
+   /* Account for the client before the worker has seen it, so concurrent handovers spread out.
+    * The worker takes it back when it can't read or add the client, see accept_cb */
+   atomic_fetch_add(&config->tx_workers[index].clients, 1);
+
+   if (pgagroal_connection_session_write(fd, client_fd, username, database, appname, address))
+   {
+      goto error;
+   }
+
+   pgagroal_disconnect(fd);
+
+   pgagroal_log_debug("pgagroal_transaction_handover: Client %d to transaction worker %d (%d)", client_fd, index, pid);
+
+   return 0;
+
+error:
+
+   pgagroal_disconnect(fd);
+
+   return 1;
+}
+
 static int
-transaction_initialize(void* shmem __attribute__((unused)), void** pipeline_shmem __attribute__((unused)), size_t* pipeline_shmem_size __attribute__((unused)))
+transaction_initialize(void* shmem, void** pipeline_shmem, size_t* pipeline_shmem_size)
 {
+   void* p = NULL;
+   size_t size = 0;
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   *pipeline_shmem = NULL;
+   *pipeline_shmem_size = 0;
+
+   /* The prepared statements of the slots come first, then the session parameters */
+   if (config->track_prepared_statements)
+   {
+      size += pgagroal_prepared_size(shmem);
+   }
+
+   if (config->track_session_parameters)
+   {
+      size += pgagroal_parameters_size(shmem);
+   }
+
+   if (size == 0)
+   {
+      return 0;
+   }
+
+   if (pgagroal_create_shared_memory(size, config->common.hugepage, &p))
+   {
+      return 1;
+   }
+
+   memset(p, 0, size);
+
+   *pipeline_shmem = p;
+   *pipeline_shmem_size = size;
+
    return 0;
 }
 
 static void
 transaction_start(struct event_loop* loop, struct worker_io* w)
 {
-   char p[MISC_LENGTH];
-   bool is_new;
+   int slot;
+   bool transfer;
+   unsigned int generation;
    struct main_configuration* config = NULL;
 
    config = (struct main_configuration*)shmem;
 
-   slot = -1;
-   memcpy(&username[0], config->connections[w->slot].username, MAX_USERNAME_LENGTH);
-   memcpy(&database[0], config->connections[w->slot].database, MAX_DATABASE_LENGTH);
-   memcpy(&appname[0], config->connections[w->slot].appname, MAX_APPLICATION_NAME);
-   in_tx = false;
-   next_client_message = 0;
-   next_server_message = 0;
-   deallocate = false;
-
-   memset(&p, 0, sizeof(p));
-   snprintf(&p[0], sizeof(p), ".s.pgagroal.%d", getpid());
+   memset(&single, 0, sizeof(struct transaction_client));
+   single.client = w;
+   single.slot = -1;
+   single.last_slot = w->slot;
+   memcpy(&single.username[0], config->connections[w->slot].username, MAX_USERNAME_LENGTH);
+   memcpy(&single.database[0], config->connections[w->slot].database, MAX_DATABASE_LENGTH);
+   memcpy(&single.appname[0], config->connections[w->slot].appname, MAX_APPLICATION_NAME);
+   single.latency = pgagroal_prometheus_query_latency_index(&single.username[0], &single.database[0]);
 
-   if (pgagroal_bind_unix_socket(config->unix_socket_dir, &p[0], &unix_socket))
+   if (create_tracking(&single))
    {
-      pgagroal_log_fatal("pgagroal: Could not bind to %s/%s", config->unix_socket_dir, &p[0]);
       goto error;
    }
 
-   for (int i = 0; i < config->max_connections; i++)
+   if (start_worker())
    {
-      fds[i] = config->connections[i].fd;
+      goto error;
    }
 
    start_mgt(loop);
 
-   pgagroal_tracking_event_slot(TRACKER_TX_RETURN_CONNECTION_START, w->slot);
+   slot = w->slot;
+   transfer = config->connections[slot].new;
+   generation = atomic_load(&config->fd_generations[slot]);
 
-   is_new = config->connections[w->slot].new;
-   pgagroal_return_connection(w->slot, w->server_ssl, true);
+   pgagroal_tracking_event_slot(TRACKER_TX_RETURN_CONNECTION_START, slot);
 
-   w->server_fd = -1;
-   w->slot = -1;
-
-   if (is_new)
+   if (!pgagroal_return_connection(slot, w->server_ssl, true))
    {
-      /* Sleep for 5ms */
-      SLEEP(5000000L)
+      /* The descriptor used for the authentication stays valid, and the transfer of a new connection
+         to the main process is a change of the generation */
+      fds[slot] = w->server_fd;
+      generations[slot] = transfer ? generation + 1 : generation;
    }
 
+   w->server_fd = -1;
+   w->slot = -1;
+
    return;
 
 error:
@@ -158,37 +386,25 @@ error:
 }
 
 static void
-transaction_stop(struct event_loop* loop, struct worker_io* w)
+transaction_stop(struct event_loop* loop, struct worker_io* w __attribute__((unused)))
 {
-   if (slot != -1)
-   {
-      struct main_configuration* config = NULL;
-
-      config = (struct main_configuration*)shmem;
+   release_slot(&single, exit_code);
 
-      /* We are either in 'X' or the client terminated (consider cancel query) */
-      if (in_tx)
-      {
-         /* ROLLBACK */
-         pgagroal_write_rollback(w->server_ssl, config->connections[slot].fd);
-      }
+   destroy_tracking(&single);
 
-      if (io_watcher_active)
-      {
-         pgagroal_io_stop(&server_io.io);
-         io_watcher_active = false;
-      }
-      pgagroal_tracking_event_slot(TRACKER_TX_RETURN_CONNECTION_STOP, w->slot);
-      pgagroal_return_connection(slot, w->server_ssl, true);
-      slot = -1;
-   }
+   pgagroal_prometheus_query_latency_release(single.latency);
+   single.latency = -1;
 
    shutdown_mgt(loop);
 }
 
 static void
-transaction_destroy(void* pipeline_shmem __attribute__((unused)), size_t pipeline_shmem_size __attribute__((unused)))
+transaction_destroy(void* pipeline_shmem, size_t pipeline_shmem_size)
 {
+   if (pipeline_shmem != NULL)
+   {
+      pgagroal_destroy_shared_memory(pipeline_shmem, pipeline_shmem_size);
+   }
 }
 
 static void
@@ -200,44 +416,37 @@ static void
 transaction_client(struct io_watcher* watcher)
 {
    int status = MESSAGE_STATUS_ERROR;
-   SSL* s_ssl = NULL;
+   int ret;
    struct worker_io* wi = NULL;
    struct message* msg = NULL;
+   struct transaction_client* c = NULL;
    struct main_configuration* config = NULL;
 
    wi = (struct worker_io*)watcher;
+   c = multiplexed ? (struct transaction_client*)watcher : &single;
    config = (struct main_configuration*)shmem;
 
-   /* We can't use the information from wi except from client_fd/client_ssl */
-   if (slot == -1)
+   if (unlikely(c->closed))
+   {
+      /* A stale event for a client that was disconnected earlier in the same batch */
+      return;
+   }
+
+   if (c->slot == -1)
    {
-      pgagroal_tracking_event_basic(TRACKER_TX_GET_CONNECTION, &username[0], &database[0]);
-      if (pgagroal_get_connection(&username[0], &database[0], true, true, &slot, &s_ssl))
+      ret = acquire_slot(c);
+
+      if (ret == 1 && multiplexed)
+      {
+         /* The other clients of the worker are served while this one waits */
+         park_client(c);
+         return;
+      }
+      else if (ret)
       {
          pgagroal_write_pool_full(wi->client_ssl, wi->client_fd);
          goto get_error;
       }
-
-      wi->server_fd = fds[slot];
-      wi->server_ssl = s_ssl;
-      wi->slot = slot;
-
-      pgagroal_event_worker_init(&wi->io, wi->client_fd, wi->server_fd, transaction_client);
-
-      memcpy(&config->connections[slot].appname[0], &appname[0], MAX_APPLICATION_NAME);
-
-      pgagroal_event_worker_init(&server_io.io, config->connections[slot].fd,
-                                 wi->client_fd, transaction_server);
-      server_io.client_fd = wi->client_fd;
-      server_io.server_fd = config->connections[slot].fd;
-      server_io.slot = slot;
-      server_io.client_ssl = wi->client_ssl;
-      server_io.server_ssl = wi->server_ssl;
-
-      fatal = false;
-
-      pgagroal_io_start(&server_io.io);
-      io_watcher_active = true;
    }
 
    status = pgagroal_recv_message(watcher, &msg);
@@ -246,53 +455,68 @@ transaction_client(struct io_watcher* watcher)
    {
       pgagroal_prometheus_network_sent_add(msg->length);
 
+      if (c->prepared != NULL)
+      {
+         if (pgagroal_prepared_client(c->prepared, c->slot, msg, &msg))
+         {
+            goto client_error;
+         }
+
+         if (msg->length == 0)
+         {
+            /* Wait for the rest of the message */
+            return;
+         }
+      }
+
       if (likely(msg->kind != 'X'))
       {
          int offset = 0;
 
          while (offset < msg->length)
          {
-            if (next_client_message == 0)
+            if (c->next_client_message == 0)
             {
                char kind = pgagroal_read_byte(msg->data + offset);
                int length = pgagroal_read_int32(msg->data + offset + 1);
 
-               if (config->track_prepared_statements)
-               {
-                  /* The P message tell us the prepared statement */
-                  if (kind == 'P')
-                  {
-                     char* ps = pgagroal_read_string(msg->data + offset + 5);
-                     if (strcmp(ps, ""))
-                     {
-                        deallocate = true;
-                     }
-                  }
-               }
-
                /* The Q and E message tell us the execute of the simple query and the prepared statement */
                if (kind == 'Q' || kind == 'E')
                {
                   pgagroal_prometheus_query_count_add();
                   pgagroal_prometheus_query_count_specified_add(wi->slot);
+
+                  if (c->query_start == 0)
+                  {
+                     c->query_start = pgagroal_get_monotonic_micros();
+                  }
                }
 
                /* Calculate the offset to the next message */
                if (offset + length + 1 <= msg->length)
                {
-                  next_client_message = 0;
+                  c->next_client_message = 0;
                   offset += length + 1;
                }
                else
                {
-                  next_client_message = length + 1 - (msg->length - offset);
+                  c->next_client_message = length + 1 - (msg->length - offset);
                   offset = msg->length;
                }
             }
             else
             {
-               offset = MIN(next_client_message, msg->length);
-               next_client_message -= offset;
+               offset = MIN(c->next_client_message, msg->length);
+               c->next_client_message -= offset;
+            }
+         }
+
+         if (c->parameters != NULL)
+         {
+            /* The replay goes in front of the messages of the client, and isn't counted as a query */
+            if (pgagroal_parameters_client(c->parameters, msg, &msg))
+            {
+               goto client_error;
             }
          }
 
@@ -302,7 +526,7 @@ transaction_client(struct io_watcher* watcher)
          {
             if (config->failover)
             {
-               pgagroal_server_failover(slot);
+               pgagroal_server_failover(c->slot);
                pgagroal_write_client_failover(wi->client_ssl, wi->client_fd);
                pgagroal_prometheus_failed_servers();
 
@@ -316,8 +540,8 @@ transaction_client(struct io_watcher* watcher)
       }
       else if (msg->kind == 'X')
       {
-         saw_x = true;
-         pgagroal_event_loop_break();
+         c->saw_x = true;
+         client_stop(c, WORKER_SUCCESS);
       }
    }
    else if (status == MESSAGE_STATUS_ZERO)
@@ -333,59 +557,42 @@ transaction_client(struct io_watcher* watcher)
 
 client_done:
    pgagroal_log_debug("[C] Client done (slot %d database %s user %s): %s (socket %d status %d)",
-                      wi->slot, config->connections[wi->slot].database, config->connections[wi->slot].username,
+                      wi->slot, c->database, c->username,
                       strerror(errno), wi->client_fd, status);
    errno = 0;
 
-   if (saw_x)
-   {
-      exit_code = WORKER_SUCCESS;
-   }
-   else
-   {
-      exit_code = WORKER_SERVER_FAILURE;
-   }
-
-   pgagroal_event_loop_break();
+   client_stop(c, c->saw_x ? WORKER_SUCCESS : WORKER_SERVER_FAILURE);
    return;
 
 client_error:
    pgagroal_log_warn("[C] Client error (slot %d database %s user %s): %s (socket %d status %d)",
-                     wi->slot, config->connections[wi->slot].database, config->connections[wi->slot].username,
+                     wi->slot, c->database, c->username,
                      strerror(errno), wi->client_fd, status);
    pgagroal_log_message(msg);
    errno = 0;
 
-   exit_code = WORKER_CLIENT_FAILURE;
-
-   pgagroal_event_loop_break();
+   client_stop(c, WORKER_CLIENT_FAILURE);
    return;
 
 server_error:
    pgagroal_log_warn("[C] Server error (slot %d database %s user %s): %s (socket %d status %d)",
-                     wi->slot, config->connections[wi->slot].database, config->connections[wi->slot].username,
+                     wi->slot, c->database, c->username,
                      strerror(errno), wi->server_fd, status);
    pgagroal_log_message(msg);
    errno = 0;
 
-   exit_code = WORKER_SERVER_FAILURE;
-
-   pgagroal_event_loop_break();
+   client_stop(c, WORKER_SERVER_FAILURE);
    return;
 
 failover:
 
-   exit_code = WORKER_FAILOVER;
-
-   pgagroal_event_loop_break();
+   client_stop(c, WORKER_FAILOVER);
    return;
 
 get_error:
    pgagroal_log_warn("Failure during obtaining connection");
 
-   exit_code = WORKER_SERVER_FAILURE;
-
-   pgagroal_event_loop_break();
+   client_stop(c, WORKER_SERVER_FAILURE);
    return;
 }
 
@@ -395,10 +602,15 @@ transaction_server(struct io_watcher* watcher)
    int status = MESSAGE_STATUS_ERROR;
    struct worker_io* wi = NULL;
    struct message* msg = NULL;
-   struct main_configuration* config = NULL;
+   struct transaction_client* c = NULL;
 
    wi = (struct worker_io*)watcher;
-   config = (struct main_configuration*)shmem;
+   c = (struct transaction_client*)((char*)wi - offsetof(struct transaction_client, server_io));
+
+   if (unlikely(c->closed))
+   {
+      return;
+   }
 
    if (!pgagroal_socket_isvalid(wi->client_fd))
    {
@@ -411,11 +623,55 @@ transaction_server(struct io_watcher* watcher)
    {
       pgagroal_prometheus_network_received_add(msg->length);
 
+      if (c->parameters != NULL)
+      {
+         if (pgagroal_parameters_server(c->parameters, c->slot, msg, &msg))
+         {
+            goto server_error;
+         }
+
+         if (unlikely(c->parameters->failed))
+         {
+            /* The error of the replay goes to the client, which is stopped once it has all of it */
+            if (msg->length > 0 && pgagroal_send_message(watcher, msg) != MESSAGE_STATUS_OK)
+            {
+               goto client_error;
+            }
+
+            if (pgagroal_parameters_failed(c->parameters))
+            {
+               goto parameters_error;
+            }
+
+            return;
+         }
+
+         if (msg->length == 0)
+         {
+            /* Only responses to the replay of pgagroal */
+            return;
+         }
+      }
+
+      if (c->prepared != NULL)
+      {
+         if (pgagroal_prepared_server(c->prepared, c->slot, msg, &msg))
+         {
+            goto server_error;
+         }
+
+         if (msg->length == 0)
+         {
+            /* Only responses to requests of pgagroal */
+            return;
+         }
+      }
+
       int offset = 0;
 
       while (offset < msg->length)
       {
-         if (next_server_message == 0)
+         if (c->next_server_message == 0)
          {
             char kind = pgagroal_read_byte(msg->data + offset);
             int length = pgagroal_read_int32(msg->data + offset + 1);
@@ -425,30 +681,36 @@ transaction_server(struct io_watcher* watcher)
             {
                char tx_state = pgagroal_read_byte(msg->data + offset + 5);
 
-               if (tx_state != 'I' && !in_tx)
+               if (tx_state != 'I' && !c->in_tx)
                {
                   pgagroal_prometheus_tx_count_add();
                }
 
-               in_tx = tx_state != 'I';
+               c->in_tx = tx_state != 'I';
+
+               if (c->query_start != 0)
+               {
+                  pgagroal_prometheus_query_latency(c->latency, pgagroal_get_monotonic_micros() - c->query_start);
+                  c->query_start = 0;
+               }
             }
 
             /* Calculate the offset to the next message */
             if (offset + length + 1 <= msg->length)
             {
-               next_server_message = 0;
+               c->next_server_message = 0;
                offset += length + 1;
             }
             else
             {
-               next_server_message = length + 1 - (msg->length - offset);
+               c->next_server_message = length + 1 - (msg->length - offset);
                offset = msg->length;
             }
          }
          else
          {
-            offset = MIN(next_server_message, msg->length);
-            next_server_message -= offset;
+            offset = MIN(c->next_server_message, msg->length);
+            c->next_server_message -= offset;
          }
       }
 
@@ -463,27 +725,28 @@ transaction_server(struct io_watcher* watcher)
       {
          if (!strncmp(msg->data + 6, "FATAL", 5) || !strncmp(msg->data + 6, "PANIC", 5))
          {
-            fatal = true;
+            c->fatal = true;
          }
       }
 
       /* Check for ReadyForQuery message (Z) to detect transaction completion */
-      if (msg->kind == 'Z' && !in_tx && slot != -1)
+      if (msg->kind == 'Z' && !c->in_tx && c->slot != -1)
       {
          /* Transaction completed - stop I/O watcher immediately if still active */
-         if (io_watcher_active)
+         if (c->io_watcher_active)
          {
-            pgagroal_io_stop(&server_io.io);
-            io_watcher_active = false;
+            pgagroal_io_stop(&c->server_io.io);
+            c->io_watcher_active = false;
          }
 
-         if (!fatal)
+         if (!c->fatal)
          {
-            if (deallocate)
-            {
-               pgagroal_write_deallocate_all(wi->server_ssl, wi->server_fd);
-               deallocate = false;
-            }
+            int slot = c->slot;
+
+            /* The connection belongs to the pool from here, also when the return fails */
+            c->slot = -1;
+            c->last_slot = slot;
+            c->client->slot = -1;
 
             pgagroal_tracking_event_slot(TRACKER_TX_RETURN_CONNECTION, slot);
             if (pgagroal_return_connection(slot, wi->server_ssl, true))
@@ -491,12 +754,12 @@ transaction_server(struct io_watcher* watcher)
                goto return_error;
             }
 
-            slot = -1;
+            /* The workers aren't woken up by their own returns */
+            resume_clients();
          }
          else
          {
-            exit_code = WORKER_SERVER_FATAL;
-            pgagroal_event_loop_break();
+            client_stop(c, WORKER_SERVER_FATAL);
          }
       }
    }
@@ -513,52 +776,83 @@ transaction_server(struct io_watcher* watcher)
 
 client_error:
    pgagroal_log_warn("[S] Client error (slot %d database %s user %s): %s (socket %d status %d)",
-                     wi->slot, config->connections[wi->slot].database, config->connections[wi->slot].username,
+                     wi->slot, c->database, c->username,
                      strerror(errno), wi->client_fd, status);
    pgagroal_log_message(msg);
    errno = 0;
 
-   exit_code = WORKER_CLIENT_FAILURE;
-
-   pgagroal_event_loop_break();
+   client_stop(c, WORKER_CLIENT_FAILURE);
    return;
 
 server_done:
    pgagroal_log_debug("[S] Server done (slot %d database %s user %s): %s (socket %d status %d)",
-                      wi->slot, config->connections[wi->slot].database, config->connections[wi->slot].username,
+                      wi->slot, c->database, c->username,
                       strerror(errno), wi->server_fd, status);
    errno = 0;
 
-   pgagroal_event_loop_break();
+   client_stop(c, WORKER_SERVER_FAILURE);
    return;
 
 server_error:
    pgagroal_log_warn("[S] Server error (slot %d database %s user %s): %s (socket %d status %d)",
-                     wi->slot, config->connections[wi->slot].database, config->connections[wi->slot].username,
+                     wi->slot, c->database, c->username,
                      strerror(errno), wi->server_fd, status);
    pgagroal_log_message(msg);
    errno = 0;
 
-   exit_code = WORKER_SERVER_FAILURE;
+   client_stop(c, WORKER_SERVER_FAILURE);
+   return;
 
-   pgagroal_event_loop_break();
+parameters_error:
+   pgagroal_log_warn("[S] Parameters not restored (slot %d database %s user %s)",
+                     wi->slot, c->database, c->username);
+
+   client_stop(c, WORKER_SERVER_FAILURE);
    return;
 
 return_error:
    pgagroal_log_warn("Failure during connection return");
 
-   exit_code = WORKER_SERVER_FAILURE;
-
-   pgagroal_event_loop_break();
+   client_stop(c, WORKER_SERVER_FAILURE);
    return;
 }
 
+static int
+start_worker(void)
+{
+   char p[MISC_LENGTH];
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   memset(&p, 0, sizeof(p));
+   snprintf(&p[0], sizeof(p), ".s.pgagroal.%d", getpid());
+
+   if (pgagroal_bind_unix_socket(config->unix_socket_dir, &p[0], &unix_socket))
+   {
+      pgagroal_log_fatal("pgagroal: Could not bind to %s/%s", config->unix_socket_dir, &p[0]);
+      return 1;
+   }
+
+   /* The descriptors are fetched from the main process on first use of a slot */
+   for (int i = 0; i < config->max_connections; i++)
+   {
+      fds[i] = -1;
+   }
+
+   return 0;
+}
+
 static void
 start_mgt(struct event_loop* loop __attribute__((unused)))
 {
    memset(&io_mgt, 0, sizeof(struct io_watcher));
    pgagroal_event_accept_init(&io_mgt, unix_socket, accept_cb);
    pgagroal_io_start(&io_mgt);
+
+   memset(&stale_fds, 0, sizeof(struct periodic_watcher));
+   pgagroal_periodic_init(&stale_fds, close_stale_fds, 1000);
+   pgagroal_periodic_start(&stale_fds);
 }
 
 static void
@@ -572,6 +866,8 @@ shutdown_mgt(struct event_loop* loop __attribute__((unused)))
    memset(&p, 0, sizeof(p));
    snprintf(&p[0], sizeof(p), ".s.pgagroal.%d", getpid());
 
+   pgagroal_periodic_stop(&stale_fds);
+
    pgagroal_io_stop(&io_mgt);
    pgagroal_disconnect(unix_socket);
    errno = 0;
@@ -584,8 +880,11 @@ accept_cb(struct io_watcher* watcher)
 {
    int client_fd = -1;
    int id = -1;
-   int32_t slot = -1;
    int fd = -1;
+   char username[MAX_USERNAME_LENGTH];
+   char database[MAX_DATABASE_LENGTH];
+   char appname[MAX_APPLICATION_NAME];
+   char address[INET6_ADDRSTRLEN];
    struct main_configuration* config = NULL;
 
    config = (struct main_configuration*)shmem;
@@ -605,30 +904,29 @@ accept_cb(struct io_watcher* watcher)
       goto done;
    }
 
-   if (id == CONNECTION_CLIENT_FD)
-   {
-      if (pgagroal_connection_transfer_read(client_fd, &slot, &fd))
-      {
-         pgagroal_log_error("pgagroal: Management client_fd: ID: %d Slot %d FD %d", id, slot, fd);
-         goto done;
-      }
-
-      fds[slot] = fd;
-   }
-   else if (id == CONNECTION_REMOVE_FD)
+   if (id == CONNECTION_SESSION && multiplexed)
    {
-      if (pgagroal_connection_transfer_read(client_fd, &slot, &fd))
+      /* The client was accounted for by pgagroal_transaction_handover, and the
+       * metrics of the client are only accounted for once it is added */
+      if (pgagroal_connection_session_read(client_fd, &fd, &username[0], &database[0], &appname[0], &address[0]))
       {
-         pgagroal_log_error("pgagroal: Management remove_fd: ID: %d Slot %d FD %d", id, slot, fd);
+         pgagroal_log_error("pgagroal: Management session: ID: %d", id);
+         atomic_fetch_sub(&config->tx_workers[worker_index].clients, 1);
          goto done;
       }
 
-      if (fds[slot] == fd && !config->connections[slot].new && config->connections[slot].fd > 0)
+      if (add_client(fd, &username[0], &database[0], &appname[0], &address[0]))
       {
+         pgagroal_log_error("pgagroal: Transaction worker %d: Unable to add client %d", worker_index, fd);
+         atomic_fetch_sub(&config->tx_workers[worker_index].clients, 1);
          pgagroal_disconnect(fd);
-         fds[slot] = 0;
       }
    }
+   else if (id == CONNECTION_WAKE && multiplexed)
+   {
+      /* A connection was returned by another process */
+      resume_clients();
+   }
    else
    {
       pgagroal_log_debug("pgagroal: Unsupported management id: %d", id);
@@ -638,3 +936,590 @@ done:
 
    pgagroal_disconnect(client_fd);
 }
+
+static int
+slot_fd(int32_t slot, int* fd)
+{
+   int server_fd = -1;
+   unsigned int generation;
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   *fd = -1;
+
+   /* Read before the fetch, so a concurrent change makes the next use fetch again */
+   generation = atomic_load(&config->fd_generations[slot]);
+
+   if (config->connections[slot].new)
+   {
+      /* A connection created by this process isn't known to the main process yet */
+      server_fd = config->connections[slot].fd;
+   }
+   else if (fds[slot] != -1 && generations[slot] == generation)
+   {
+      *fd = fds[slot];
+      return 0;
+   }
+   else if (pgagroal_connection_fetch(slot, &server_fd))
+   {
+      goto error;
+   }
+
+   if (fds[slot] != -1 && fds[slot] != server_fd)
+   {
+      pgagroal_disconnect(fds[slot]);
+   }
+
+   fds[slot] = server_fd;
+   generations[slot] = generation;
+
+   *fd = server_fd;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static void
+close_stale_fds(void)
+{
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   /* The descriptors of the connections that were killed or transferred again aren't kept until the next use */
+   for (int i = 0; i < config->max_connections; i++)
+   {
+      if (fds[i] == -1 || config->connections[i].pid == getpid())
+      {
+         continue;
+      }
+
+      if (atomic_load(&config->fd_generations[i]) != generations[i])
+      {
+         pgagroal_disconnect(fds[i]);
+         fds[i] = -1;
+      }
+   }
+}
+
+static void
+client_stop(struct transaction_client* c, int code)
+{
+   if (multiplexed)
+   {
+      disconnect_client(c, code);
+   }
+   else
+   {
+      exit_code = code;
+      pgagroal_event_loop_break();
+   }
+}
+
+static int
+acquire_slot(struct transaction_client* c)
+{
+   int ret;
+   SSL* s_ssl = NULL;
+   struct worker_io* wi = NULL;
+   struct main_configuration* config = NULL;
+
+   wi = c->client;
+   config = (struct main_configuration*)shmem;
+
+   /* We can't use the information from wi except from client_fd/client_ssl */
+   pgagroal_tracking_event_basic(TRACKER_TX_GET_CONNECTION, &c->username[0], &c->database[0]);
+
+   /* A multiplexed worker serves other clients, so it can't block on a full pool */
+   ret = pgagroal_get_connection(&c->username[0], &c->database[0], true, true, !multiplexed, c->last_slot, &c->slot, &s_ssl);
+   if (ret)
+   {
+      c->slot = -1;
+      return ret;
+   }
+
+   if (slot_fd(c->slot, &wi->server_fd))
+   {
+      pgagroal_log_warn("pgagroal: Unable to fetch the descriptor for slot %d", c->slot);
+      pgagroal_return_connection(c->slot, s_ssl, true);
+      c->slot = -1;
+      return 2;
+   }
+
+   wi->server_ssl = s_ssl;
+   wi->slot = c->slot;
+
+   pgagroal_event_worker_init(&wi->io, wi->client_fd, wi->server_fd, transaction_client);
+
+   memcpy(&config->connections[c->slot].appname[0], &c->appname[0], MAX_APPLICATION_NAME);
+
+   pgagroal_event_worker_init(&c->server_io.io, wi->server_fd, wi->client_fd, transaction_server);
+   c->server_io.client_fd = wi->client_fd;
+   c->server_io.server_fd = wi->server_fd;
+   c->server_io.slot = c->slot;
+   c->server_io.client_ssl = wi->client_ssl;
+   c->server_io.server_ssl = wi->server_ssl;
+
+   c->fatal = false;
+
+   if (c->prepared != NULL)
+   {
+      pgagroal_prepared_start(c->prepared, c->slot);
+   }
+
+   if (c->parameters != NULL && pgagroal_parameters_start(c->parameters, c->slot))
+   {
+      pgagroal_log_warn("pgagroal: Unable to restore the parameters for slot %d", c->slot);
+   }
+
+   pgagroal_io_start(&c->server_io.io);
+   c->io_watcher_active = true;
+
+   return 0;
+}
+
+static void
+park_client(struct transaction_client* c)
+{
+   /* The messages of the client stay in its socket until it has a connection */
+   pgagroal_io_stop(&c->client_io.io);
+
+   c->parked = true;
+   c->parked_time = time(NULL);
+   c->next_parked = NULL;
+
+   if (parked_last != NULL)
+   {
+      parked_last->next_parked = c;
+   }
+   else
+   {
+      parked_first = c;
+   }
+   parked_last = c;
+
+   pgagroal_log_debug("pgagroal: Transaction worker %d: Client %d waits for a connection", worker_index, c->client_io.client_fd);
+
+   mark_parked(true);
+
+   /* A connection returned before the worker was marked didn't wake it up */
+   if (acquire_slot(c) == 0)
+   {
+      unpark_client(c);
+      pgagroal_io_start(&c->client_io.io);
+   }
+}
+
+static void
+unpark_client(struct transaction_client* c)
+{
+   struct transaction_client* p = NULL;
+   struct transaction_client* n = NULL;
+
+   if (!c->parked)
+   {
+      return;
+   }
+
+   n = parked_first;
+   while (n != NULL && n != c)
+   {
+      p = n;
+      n = n->next_parked;
+   }
+
+   if (n != NULL)
+   {
+      if (p != NULL)
+      {
+         p->next_parked = c->next_parked;
+      }
+      else
+      {
+         parked_first = c->next_parked;
+      }
+
+      if (parked_last == c)
+      {
+         parked_last = p;
+      }
+   }
+
+   c->parked = false;
+   c->next_parked = NULL;
+}
+
+static void
+resume_clients(void)
+{
+   int ret;
+   time_t now;
+   struct transaction_client* c = NULL;
+   struct transaction_client* next = NULL;
+   struct transaction_client* failed = NULL;
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   if (parked_first == NULL || resuming || !config->keep_running)
+   {
+      return;
+   }
+
+   resuming = true;
+   now = time(NULL);
+
+   /* Marked before the clients are tried, so a connection returned meanwhile wakes the worker again */
+   mark_parked(true);
+
+   /* In order of arrival, and an identity that didn't get a connection isn't tried again */
+   c = parked_first;
+   while (c != NULL)
+   {
+      next = c->next_parked;
+
+      if (failed != NULL &&
+          !strncmp(&failed->username[0], &c->username[0], MAX_USERNAME_LENGTH) &&
+          !strncmp(&failed->database[0], &c->database[0], MAX_DATABASE_LENGTH))
+      {
+         ret = 1;
+      }
+      else
+      {
+         ret = acquire_slot(c);
+      }
+
+      if (ret == 0)
+      {
+         unpark_client(c);
+         pgagroal_io_start(&c->client_io.io);
+      }
+      else if (ret == 1 && (config->blocking_timeout == 0 || difftime(now, c->parked_time) < config->blocking_timeout))
+      {
+         failed = c;
+      }
+      else
+      {
+         pgagroal_log_debug("pgagroal: Transaction worker %d: Client %d didn't get a connection", worker_index, c->client_io.client_fd);
+
+         unpark_client(c);
+         pgagroal_write_pool_full(c->client_io.client_ssl, c->client_io.client_fd);
+         disconnect_client(c, WORKER_SERVER_FAILURE);
+      }
+
+      c = next;
+   }
+
+   if (parked_first == NULL)
+   {
+      mark_parked(false);
+   }
+
+   resuming = false;
+}
+
+static void
+mark_parked(bool parked)
+{
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   /* The waker clears the flag, so only the one that changes it updates the count */
+   if (atomic_exchange(&config->tx_workers[worker_index].parked, parked) != parked)
+   {
+      if (parked)
+      {
+         atomic_fetch_add(&config->parked_workers, 1);
+      }
+      else
+      {
+         atomic_fetch_sub(&config->parked_workers, 1);
+      }
+   }
+}
+
+static void
+release_slot(struct transaction_client* c, int code)
+{
+   int fd = -1;
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   if (c->slot == -1)
+   {
+      return;
+   }
+
+   if (c->io_watcher_active)
+   {
+      pgagroal_io_stop(&c->server_io.io);
+      c->io_watcher_active = false;
+   }
+
+   if (multiplexed && (config->connections[c->slot].pid != getpid() ||
+                       atomic_load(&config->states[c->slot]) == STATE_FLUSH))
+   {
+      /* The connection was flushed while in use, and is killed by the flush */
+   }
+   else if (code == WORKER_SERVER_FAILURE || code == WORKER_SERVER_FATAL ||
+            code == WORKER_FAILOVER || code == WORKER_SHUTDOWN)
+   {
+      if (!multiplexed)
+      {
+         /* The worker kills the connection of the slot */
+         return;
+      }
+
+      fd = config->connections[c->slot].fd;
+
+      pgagroal_tracking_event_slot(TRACKER_WORKER_KILL1, c->slot);
+      pgagroal_kill_connection(c->slot, c->server_io.server_ssl);
+
+      /* Forget the descriptor of the slot, unless the kill already closed it */
+      if (fds[c->slot] != -1 && fds[c->slot] != fd)
+      {
+         pgagroal_disconnect(fds[c->slot]);
+      }
+      fds[c->slot] = -1;
+   }
+   else
+   {
+      /* We are either in 'X' or the client terminated (consider cancel query) */
+      if (c->in_tx)
+      {
+         /* ROLLBACK */
+         pgagroal_write_rollback(c->server_io.server_ssl, c->server_io.server_fd);
+      }
+
+      pgagroal_tracking_event_slot(TRACKER_TX_RETURN_CONNECTION_STOP, c->slot);
+      pgagroal_return_connection(c->slot, c->server_io.server_ssl, true);
+   }
+
+   c->slot = -1;
+   c->client->slot = -1;
+
+   if (multiplexed)
+   {
+      resume_clients();
+   }
+}
+
+static int
+add_client(int client_fd, char* username, char* database, char* appname, char* address)
+{
+   struct transaction_client* c = NULL;
+
+   c = (struct transaction_client*)calloc(1, sizeof(struct transaction_client));
+   if (c == NULL)
+   {
+      return 1;
+   }
+
+   c->client = &c->client_io;
+   c->slot = -1;
+   c->last_slot = -1;
+   memcpy(&c->username[0], username, MAX_USERNAME_LENGTH);
+   memcpy(&c->database[0], database, MAX_DATABASE_LENGTH);
+   memcpy(&c->appname[0], appname, MAX_APPLICATION_NAME);
+   memcpy(&c->address[0], address, INET6_ADDRSTRLEN);
+   c->start_time = time(NULL);
+   c->latency = pgagroal_prometheus_query_latency_index(&c->username[0], &c->database[0]);
+
+   if (create_tracking(c))
+   {
+      pgagroal_prometheus_query_latency_release(c->latency);
+      free(c);
+      return 1;
+   }
+
+   pgagroal_event_worker_init(&c->client_io.io, client_fd, -1, transaction_client);
+   c->client_io.client_fd = client_fd;
+   c->client_io.server_fd = -1;
+   c->client_io.slot = -1;
+
+   if (pgagroal_io_start(&c->client_io.io))
+   {
+      destroy_tracking(c);
+      pgagroal_prometheus_query_latency_release(c->latency);
+      free(c);
+      return 1;
+   }
+
+   c->next = clients;
+   if (clients != NULL)
+   {
+      clients->previous = c;
+   }
+   clients = c;
+
+   pgagroal_tracking_event_socket(TRACKER_SOCKET_ASSOCIATE_CLIENT, client_fd);
+   pgagroal_prometheus_client_sockets_add();
+   pgagroal_prometheus_client_active_add();
+
+   return 0;
+}
+
+static int
+create_tracking(struct transaction_client* c)
+{
+   char* slots = NULL;
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+   slots = (char*)pipeline_shmem;
+
+   if (config->track_prepared_statements)
+   {
+      if (pgagroal_prepared_create(slots, &c->prepared))
+      {
+         goto error;
+      }
+
+      slots += pgagroal_prepared_size(shmem);
+   }
+
+   if (config->track_session_parameters)
+   {
+      if (pgagroal_parameters_create(slots, &c->parameters))
+      {
+         goto error;
+      }
+   }
+
+   return 0;
+
+error:
+
+   destroy_tracking(c);
+
+   return 1;
+}
+
+static void
+destroy_tracking(struct transaction_client* c)
+{
+   pgagroal_prepared_destroy(c->prepared);
+   c->prepared = NULL;
+
+   pgagroal_parameters_destroy(c->parameters);
+   c->parameters = NULL;
+}
+
+static void
+disconnect_client(struct transaction_client* c, int code)
+{
+   bool parked;
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   if (c->closed)
+   {
+      return;
+   }
+
+   parked = c->parked;
+   unpark_client(c);
+
+   release_slot(c, code);
+
+   destroy_tracking(c);
+
+   pgagroal_prometheus_query_latency_release(c->latency);
+   c->latency = -1;
+
+   /* The I/O of a waiting client is stopped already */
+   if (!parked)
+   {
+      pgagroal_io_stop(&c->client_io.io);
+   }
+
+   if (config->common.log_disconnections)
+   {
+      pgagroal_log_info("disconnect: user=%s database=%s address=%s", c->username, c->database, c->address);
+   }
+
+   pgagroal_log_debug("client disconnect: %d", c->client_io.client_fd);
+   pgagroal_tracking_event_socket(TRACKER_SOCKET_DISASSOCIATE_CLIENT, c->client_io.client_fd);
+   pgagroal_disconnect(c->client_io.client_fd);
+
+   pgagroal_prometheus_session_time(difftime(time(NULL), c->start_time));
+   pgagroal_prometheus_client_active_sub();
+   pgagroal_prometheus_client_sockets_sub();
+   atomic_fetch_sub(&config->tx_workers[worker_index].clients, 1);
+
+   c->closed = true;
+
+   if (c->previous != NULL)
+   {
+      c->previous->next = c->next;
+   }
+   else
+   {
+      clients = c->next;
+   }
+
+   if (c->next != NULL)
+   {
+      c->next->previous = c->previous;
+   }
+
+   /* The loop may still hold events for the client, so it is freed later */
+   c->previous = NULL;
+   c->next = closed_clients;
+   closed_clients = c;
+}
+
+static void
+reap_clients(void)
+{
+   struct transaction_client* c = NULL;
+
+   /* Clients are freed one period after they were closed, so no event batch refers to them */
+   while (reaped_clients != NULL)
+   {
+      c = reaped_clients;
+      reaped_clients = c->next;
+      free(c);
+   }
+
+   reaped_clients = closed_clients;
+   closed_clients = NULL;
+}
+
+static void
+worker_signal_cb(void)
+{
+   struct transaction_client* c = NULL;
+   struct transaction_client* next = NULL;
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   if (!config->keep_running)
+   {
+      pgagroal_event_loop_break();
+      return;
+   }
+
+   /* A flush signals the process of a connection, so only the clients using a flushed connection are disconnected */
+   c = clients;
+   while (c != NULL)
+   {
+      next = c->next;
+
+      if (c->slot != -1 &&
+          (config->connections[c->slot].pid != getpid() || atomic_load(&config->states[c->slot]) == STATE_FLUSH))
+      {
+         disconnect_client(c, WORKER_SHUTDOWN);
+      }
+
+      c = next;
+   }
+}
@@ -45,6 +45,8 @@
 /* system */
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdatomic.h>
 #include <stdbool.h>
@@ -54,6 +56,10 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#ifdef HAVE_LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 static int find_best_rule(char* username, char* database);
 static bool remove_connection(char* username, char* database);
@@ -63,21 +69,54 @@ static bool is_alias_of_limit(char* database, int limit_index);
 static int get_connection_count_for_limit_rule(int rule_index, char* username);
 static char* resolve_database_name(char* database, int best_rule);
 static void check_graceful_shutdown_trigger(void);
+static int slot_list_find(int rule, char* username, char* database);
+static bool same_identity(int slot, int rule, char* username, char* database);
+static void free_slot_push(int list, int slot);
+static void free_slot_release(int slot);
+static int free_slot_take(int list, int rule, char* username, char* database, bool transaction_mode);
+static bool free_slot_try(int list, int slot, int rule, char* username, char* database, bool transaction_mode);
+static void free_slot_remove(int slot);
+static void notinit_slot_push(int slot);
+static int notinit_slot_pop(void);
+static void wait_queue_await(int list, unsigned int sequence, bool* queued, unsigned int* ticket, uint64_t timeout);
+static void wait_queue_wait(int list, unsigned int sequence, uint64_t timeout);
+static unsigned int wait_queue_enter(int list);
+static bool wait_queue_busy(int list);
+static bool wait_queue_head(int list, unsigned int ticket);
+static void wait_queue_turn(int list, unsigned int ticket, uint64_t timeout);
+static void wait_queue_leave(int list, unsigned int ticket);
+static void wait_queue_advance(int list, unsigned int ticket);
+static void wait_queue_signal(int list);
+static void wait_queue_signal_all(void);
+static void transaction_workers_wake(void);
+
+#define MAX_IDENTITY_SPINS  1000
+#define MAX_WAIT_QUEUE_WAIT 100000ULL
+#define WAIT_QUEUE_STALL    1000000ULL
+
+/* The generations of the descriptors known by this process, inherited from the main process */
+static unsigned int known_generations[MAX_NUMBER_OF_CONNECTIONS];
 
 int
-pgagroal_get_connection(char* username, char* database, bool reuse, bool transaction_mode, int* slot, SSL** ssl)
+pgagroal_get_connection(char* username, char* database, bool reuse, bool transaction_mode, bool wait, int preferred, int* slot, SSL** ssl)
 {
    bool do_init;
    bool has_lock;
    int connections;
-   signed char not_init;
    signed char free;
    int server;
    int fd;
+   bool waited;
    time_t start_time;
+   uint64_t start_micros;
+   uint64_t deadline;
    int best_rule;
    int retries;
    int ret;
+   int list;
+   unsigned int sequence;
+   bool queued;
+   unsigned int ticket;
    char* real_database;
 
    struct main_configuration* config;
@@ -89,8 +128,15 @@ pgagroal_get_connection(char* username, char* database, bool reuse, bool transac
    pgagroal_prometheus_connection_get();
 
    best_rule = find_best_rule(username, database);
+   real_database = resolve_database_name(database, best_rule);
+   list = slot_list_find(best_rule, username, real_database);
    retries = 0;
+   waited = false;
+   queued = false;
+   ticket = 0;
    start_time = time(NULL);
+   start_micros = pgagroal_get_monotonic_micros();
+   deadline = start_micros + (uint64_t)config->blocking_timeout * 1000000ULL;
    pgagroal_prometheus_connection_awaiting(best_rule);
 
 start:
@@ -100,6 +146,15 @@ start:
    do_init = false;
    has_lock = false;
 
+   /* Any connection made available after this point will wake us up */
+   sequence = atomic_load(&config->wait_queues[list].sequence);
+
+   /* The processes which waited first are served first */
+   if (wait && list != SLOT_LIST_SHARED && (queued ? !wait_queue_head(list, ticket) : wait_queue_busy(list)))
+   {
+      goto retry2;
+   }
+
    connections = atomic_fetch_add(&config->active_connections, 1);
    has_lock = true;
    if (connections >= config->max_connections)
@@ -109,37 +164,35 @@ start:
 
    if (reuse)
    {
-      for (int i = 0; *slot == -1 && i < config->max_connections; i++)
+      /* The slot used last by the caller has the caches of its backend warm */
+      if (preferred >= 0 && preferred < config->max_connections)
       {
          free = STATE_FREE;
 
-         if (atomic_compare_exchange_strong(&config->states[i], &free, STATE_IN_USE))
+         if (atomic_compare_exchange_strong(&config->states[preferred], &free, STATE_IN_USE))
          {
-            bool can_reuse = false;
-
-            // Check if same rule and username
-            if (best_rule == config->connections[i].limit_rule &&
-                !strcmp((const char*)(&config->connections[i].username), username))
-            {
-               real_database = resolve_database_name(database, best_rule);
-               // Check exact database match
-               if (!strcmp((const char*)(&config->connections[i].database), real_database))
-               {
-                  can_reuse = true;
-               }
-               // Check if both are aliases of the same real database
-            }
-
-            if (can_reuse)
+            if (same_identity(preferred, best_rule, username, real_database))
             {
-               *slot = i;
+               free_slot_remove(preferred);
+               *slot = preferred;
             }
             else
             {
-               atomic_store(&config->states[i], STATE_FREE);
+               free_slot_release(preferred);
             }
          }
       }
+
+      if (*slot == -1)
+      {
+         *slot = free_slot_take(list, best_rule, username, real_database, transaction_mode);
+      }
+
+      /* The identities without a list of their own share the last one */
+      if (*slot == -1 && list != SLOT_LIST_SHARED)
+      {
+         *slot = free_slot_take(SLOT_LIST_SHARED, best_rule, username, real_database, transaction_mode);
+      }
    }
 
    if (*slot == -1 && !transaction_mode)
@@ -154,21 +207,25 @@ start:
       }
 
       /* Ok, try and create a new connection */
-      for (int i = 0; *slot == -1 && i < config->max_connections; i++)
-      {
-         not_init = STATE_NOTINIT;
+      *slot = notinit_slot_pop();
 
-         if (atomic_compare_exchange_strong(&config->states[i], &not_init, STATE_INIT))
-         {
-            *slot = i;
-            do_init = true;
-         }
+      if (*slot != -1)
+      {
+         do_init = true;
       }
    }
 
    if (*slot != -1)
    {
+      if (queued)
+      {
+         /* The next in line is served while the connection is set up */
+         wait_queue_leave(list, ticket);
+         queued = false;
+      }
+
       config->connections[*slot].limit_rule = best_rule;
+      config->connections[*slot].slot_list = list;
       config->connections[*slot].pid = getpid();
 
       if (do_init)
@@ -177,8 +234,10 @@ start:
          if (pgagroal_get_primary(&server))
          {
             config->connections[*slot].limit_rule = -1;
+            config->connections[*slot].slot_list = -1;
             config->connections[*slot].pid = -1;
             atomic_store(&config->states[*slot], STATE_NOTINIT);
+            notinit_slot_push(*slot);
 
             if (!fork())
             {
@@ -208,8 +267,10 @@ start:
          {
             pgagroal_log_error("pgagroal: No connection to %s:%d", config->servers[server].host, config->servers[server].port);
             config->connections[*slot].limit_rule = -1;
+            config->connections[*slot].slot_list = -1;
             config->connections[*slot].pid = -1;
             atomic_store(&config->states[*slot], STATE_NOTINIT);
+            notinit_slot_push(*slot);
 
             pgagroal_prometheus_server_error(server);
 
@@ -234,7 +295,6 @@ start:
 
          memset(&config->connections[*slot].username, 0, MAX_USERNAME_LENGTH);
          memcpy(&config->connections[*slot].username, username, MIN(strlen(username), MAX_USERNAME_LENGTH - 1));
-         real_database = resolve_database_name(database, best_rule);
          memset(&config->connections[*slot].database, 0, MAX_DATABASE_LENGTH);
          memcpy(&config->connections[*slot].database, real_database, MIN(strlen(real_database), MAX_DATABASE_LENGTH - 1));
 
@@ -257,7 +317,8 @@ start:
             }
             else
             {
-               atomic_store(&config->states[*slot], STATE_FREE);
+               free_slot_release(*slot);
+               preferred = -1;
                goto retry;
             }
          }
@@ -299,6 +360,7 @@ start:
       {
          atomic_store(&prometheus->client_wait_time, difftime(time(NULL), start_time));
       }
+      pgagroal_prometheus_connection_acquire(best_rule, waited ? ACQUIRE_WAIT : ACQUIRE_HIT, pgagroal_get_monotonic_micros() - start_micros);
       pgagroal_prometheus_connection_success();
       pgagroal_tracking_event_slot(TRACKER_GET_CONNECTION_SUCCESS, *slot);
       pgagroal_prometheus_connection_unawaiting(best_rule);
@@ -316,14 +378,29 @@ retry:
          atomic_fetch_sub(&config->active_connections, 1);
       }
 retry2:
+      if (!wait)
+      {
+         /* The caller is woken up when a connection is returned, see pipeline_transaction.c */
+         pgagroal_prometheus_connection_unawaiting(best_rule);
+         return 1;
+      }
+
+      waited = true;
+
       if (config->blocking_timeout > 0)
       {
-         /* Sleep for 500ms */
-         SLEEP(500000000L)
+         uint64_t now = pgagroal_get_monotonic_micros();
+
+         if (now < deadline)
+         {
+            /* Wait until a connection is made available */
+            wait_queue_await(list, sequence, &queued, &ticket, deadline - now);
+         }
 
-         double diff = difftime(time(NULL), start_time);
-         if (diff >= (double)config->blocking_timeout)
+         if (pgagroal_get_monotonic_micros() >= deadline)
          {
+            /* Pass on a wake up, which may have been meant for us */
+            wait_queue_signal(list);
             goto timeout;
          }
 
@@ -359,18 +436,24 @@ retry2:
             }
          }
          else
-         /* Sleep for 1000 nanos */
          {
-            SLEEP_AND_GOTO(1000L, start)
+            /* Wait until a connection is made available */
+            wait_queue_await(list, sequence, &queued, &ticket, MAX_WAIT_QUEUE_WAIT);
+            goto start;
          }
       }
    }
 
 timeout:
+   if (queued)
+   {
+      wait_queue_leave(list, ticket);
+   }
    if (config->common.metrics > 0)
    {
       atomic_store(&prometheus->client_wait_time, difftime(time(NULL), start_time));
    }
+   pgagroal_prometheus_connection_acquire(best_rule, ACQUIRE_TIMEOUT, pgagroal_get_monotonic_micros() - start_micros);
    pgagroal_prometheus_connection_timeout();
    pgagroal_tracking_event_basic(TRACKER_GET_CONNECTION_TIMEOUT, username, database);
    pgagroal_prometheus_connection_unawaiting(best_rule);
@@ -402,6 +485,7 @@ pgagroal_return_connection(int slot, SSL* ssl, bool transaction_mode)
    signed char in_use;
    signed char age_check;
    int transfer_fd = -1;
+   int32_t ack = -1;
 
    config = (struct main_configuration*)shmem;
 
@@ -474,6 +558,13 @@ pgagroal_return_connection(int slot, SSL* ssl, bool transaction_mode)
                goto kill_connection;
             }
 
+            /* The slot is only freed once the main process knows the descriptor */
+            if (pgagroal_connection_slot_read(transfer_fd, &ack) || ack != slot)
+            {
+               pgagroal_log_warn("pgagroal_return_connection: Transfer of slot %d not acknowledged", slot);
+               goto kill_connection;
+            }
+
             pgagroal_disconnect(transfer_fd);
             transfer_fd = -1;
          }
@@ -505,8 +596,8 @@ pgagroal_return_connection(int slot, SSL* ssl, bool transaction_mode)
          config->connections[slot].pid = -1;
          config->connections[slot].tx_mode = transaction_mode;
          memset(&config->connections[slot].appname, 0, sizeof(config->connections[slot].appname));
-         atomic_store(&config->states[slot], STATE_FREE);
          atomic_fetch_sub(&config->active_connections, 1);
+         free_slot_release(slot);
 
          pgagroal_log_debug("Connection returned: slot=%d, active_connections=%d, gracefully=%s",
                             slot, atomic_load(&config->active_connections), config->gracefully ? "true" : "false");
@@ -544,9 +635,11 @@ pgagroal_kill_connection(int slot, SSL* ssl)
    int result = 0;
    int fd;
    int transfer_fd;
+   struct connection_security* security;
    struct main_configuration* config;
 
    config = (struct main_configuration*)shmem;
+   security = (struct connection_security*)security_shmem;
 
    pgagroal_log_debug("pgagroal_kill_connection: Slot %d FD %d State %d PID %d",
                       slot, config->connections[slot].fd, atomic_load(&config->states[slot]),
@@ -618,6 +711,9 @@ pgagroal_kill_connection(int slot, SSL* ssl)
       check_graceful_shutdown_trigger();
    }
 
+   /* The slot may still be listed as free, so remove it before the identity is cleared */
+   free_slot_remove(slot);
+
    memset(&config->connections[slot].username, 0, sizeof(config->connections[slot].username));
    memset(&config->connections[slot].database, 0, sizeof(config->connections[slot].database));
    memset(&config->connections[slot].appname, 0, sizeof(config->connections[slot].appname));
@@ -626,23 +722,22 @@ pgagroal_kill_connection(int slot, SSL* ssl)
    config->connections[slot].server = -1;
    config->connections[slot].tx_mode = false;
 
+   /* The messages are only read up to their lengths, and are cleared by the next authentication */
    config->connections[slot].has_security = SECURITY_INVALID;
-   for (int i = 0; i < NUMBER_OF_SECURITY_MESSAGES; i++)
-   {
-      config->connections[slot].security_lengths[i] = 0;
-      memset(&config->connections[slot].security_messages[i], 0, SECURITY_BUFFER_SIZE);
-   }
+   memset(&security[slot].lengths, 0, sizeof(security[slot].lengths));
 
    config->connections[slot].backend_pid = 0;
    config->connections[slot].backend_secret = 0;
 
    config->connections[slot].limit_rule = -1;
+   config->connections[slot].slot_list = -1;
    config->connections[slot].start_time = -1;
    config->connections[slot].timestamp = -1;
    config->connections[slot].fd = -1;
    config->connections[slot].pid = -1;
 
    atomic_store(&config->states[slot], STATE_NOTINIT);
+   notinit_slot_push(slot);
 
    pgagroal_prometheus_connection_kill();
 
@@ -653,6 +748,7 @@ void
 pgagroal_idle_timeout(void)
 {
    bool prefill;
+   int list;
    time_t now;
    signed char free;
    signed char idle_check;
@@ -685,6 +781,8 @@ pgagroal_idle_timeout(void)
          }
          else
          {
+            list = config->connections[i].slot_list;
+
             if (!atomic_compare_exchange_strong(&config->states[i], &idle_check, STATE_FREE))
             {
                pgagroal_prometheus_connection_idletimeout();
@@ -692,6 +790,10 @@ pgagroal_idle_timeout(void)
                pgagroal_kill_connection(i, NULL);
                prefill = true;
             }
+            else
+            {
+               free_slot_push(list, i);
+            }
          }
       }
    }
@@ -712,6 +814,7 @@ void
 pgagroal_max_connection_age(void)
 {
    bool prefill;
+   int list;
    time_t now;
    signed char free;
    signed char age_check;
@@ -744,6 +847,8 @@ pgagroal_max_connection_age(void)
          }
          else
          {
+            list = config->connections[i].slot_list;
+
             if (!atomic_compare_exchange_strong(&config->states[i], &age_check, STATE_FREE))
             {
                pgagroal_prometheus_connection_max_connection_age();
@@ -751,6 +856,10 @@ pgagroal_max_connection_age(void)
                pgagroal_kill_connection(i, NULL);
                prefill = true;
             }
+            else
+            {
+               free_slot_push(list, i);
+            }
          }
       }
    }
@@ -771,6 +880,7 @@ void
 pgagroal_validation(void)
 {
    bool prefill = true;
+   int list;
    time_t now;
    signed char free;
    signed char validation;
@@ -836,6 +946,8 @@ pgagroal_validation(void)
          }
          else
          {
+            list = config->connections[i].slot_list;
+
             if (!atomic_compare_exchange_strong(&config->states[i], &validation, STATE_FREE))
             {
                pgagroal_prometheus_connection_invalid();
@@ -843,6 +955,10 @@ pgagroal_validation(void)
                pgagroal_kill_connection(i, NULL);
                prefill = true;
             }
+            else
+            {
+               free_slot_push(list, i);
+            }
          }
       }
    }
@@ -1200,6 +1316,50 @@ pgagroal_pool_init(void)
       atomic_init(&config->states[i], STATE_NOTINIT);
    }
 
+   /* Slot lists */
+   for (int i = 0; i < NUMBER_OF_SLOT_LISTS; i++)
+   {
+      atomic_init(&config->slot_identities[i].state, SLOT_IDENTITY_EMPTY);
+
+      for (int j = 0; j < SLOT_LIST_SUMMARY_WORDS; j++)
+      {
+         atomic_init(&config->free_slots[i].summary[j], 0);
+      }
+
+      for (int j = 0; j < SLOT_LIST_WORDS; j++)
+      {
+         atomic_init(&config->free_slots[i].slots[j], 0);
+      }
+
+      atomic_init(&config->free_slots[i].recent_count, 0);
+      for (int j = 0; j < SLOT_LIST_RECENT; j++)
+      {
+         atomic_init(&config->free_slots[i].recent[j], -1);
+      }
+   }
+
+   for (int j = 0; j < SLOT_LIST_SUMMARY_WORDS; j++)
+   {
+      atomic_init(&config->notinit_slots.summary[j], 0);
+   }
+
+   for (int j = 0; j < SLOT_LIST_WORDS; j++)
+   {
+      atomic_init(&config->notinit_slots.slots[j], 0);
+   }
+
+   atomic_init(&config->notinit_slots.recent_count, 0);
+   for (int j = 0; j < SLOT_LIST_RECENT; j++)
+   {
+      atomic_init(&config->notinit_slots.recent[j], -1);
+   }
+
+   /* The lowest slots are handed out first */
+   for (int i = 0; i < config->max_connections; i++)
+   {
+      notinit_slot_push(i);
+   }
+
    /* Connections */
    for (int i = 0; i < config->max_connections; i++)
    {
@@ -1208,6 +1368,7 @@ pgagroal_pool_init(void)
       config->connections[i].server = -1;
       config->connections[i].has_security = SECURITY_INVALID;
       config->connections[i].limit_rule = -1;
+      config->connections[i].slot_list = -1;
       config->connections[i].start_time = -1;
       config->connections[i].timestamp = -1;
       config->connections[i].fd = -1;
@@ -1272,71 +1433,198 @@ pgagroal_pool_status(void)
    return 0;
 }
 
+void
+pgagroal_pool_descriptor_changed(int slot)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   known_generations[slot] = atomic_fetch_add(&config->fd_generations[slot], 1) + 1;
+}
+
+bool
+pgagroal_pool_descriptor_known(int slot)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   return atomic_load(&config->fd_generations[slot]) == known_generations[slot];
+}
+
+void
+pgagroal_slot_list_add(struct slot_list* list, int slot)
+{
+   int word = slot / 64;
+   unsigned long long bit = 1ULL << (word % 64);
+
+   atomic_fetch_or(&list->slots[word], 1ULL << (slot % 64));
+
+   /* The summary is marked after the slot, see pgagroal_slot_list_next() */
+   if ((atomic_load(&list->summary[word / 64]) & bit) == 0)
+   {
+      atomic_fetch_or(&list->summary[word / 64], bit);
+   }
+
+   atomic_store(&list->recent[atomic_fetch_add(&list->recent_count, 1) % SLOT_LIST_RECENT], slot);
+}
+
+void
+pgagroal_slot_list_remove(struct slot_list* list, int slot)
+{
+   atomic_fetch_and(&list->slots[slot / 64], ~(1ULL << (slot % 64)));
+}
+
+int
+pgagroal_slot_list_recent(struct slot_list* list, int n)
+{
+   int slot;
+   unsigned int count;
+
+   count = atomic_load(&list->recent_count);
+
+   if ((unsigned int)n >= count || n >= SLOT_LIST_RECENT)
+   {
+      return -1;
+   }
+
+   slot = atomic_load(&list->recent[(count - 1 - n) % SLOT_LIST_RECENT]);
+
+   if (slot < 0 || (atomic_load(&list->slots[slot / 64]) & (1ULL << (slot % 64))) == 0)
+   {
+      return -1;
+   }
+
+   return slot;
+}
+
+int
+pgagroal_slot_list_next(struct slot_list* list, int from)
+{
+   int words;
+   unsigned long long summary;
+   unsigned long long bits;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   words = (config->max_connections + 63) / 64;
+
+   for (int word = from / 64; word < words; word++)
+   {
+      summary = atomic_load(&list->summary[word / 64]) >> (word % 64);
+
+      if (summary == 0)
+      {
+         /* Continue with the next summary word */
+         word |= 63;
+         continue;
+      }
+
+      word += __builtin_ctzll(summary);
+
+      if (word >= words)
+      {
+         break;
+      }
+
+      bits = atomic_load(&list->slots[word]);
+
+      if (bits == 0)
+      {
+         /* A slot added meanwhile is seen by the second load, or marks the summary again */
+         atomic_fetch_and(&list->summary[word / 64], ~(1ULL << (word % 64)));
+
+         if (atomic_load(&list->slots[word]) != 0)
+         {
+            atomic_fetch_or(&list->summary[word / 64], 1ULL << (word % 64));
+         }
+
+         continue;
+      }
+
+      if (word == from / 64)
+      {
+         bits &= ~0ULL << (from % 64);
+      }
+
+      if (bits != 0)
+      {
+         return word * 64 + __builtin_ctzll(bits);
+      }
+   }
+
+   return -1;
+}
+
 static int
 find_best_rule(char* username, char* database)
 {
    int best_rule;
+   unsigned int generation;
+   uint64_t usernames;
+   uint64_t databases;
+   uint64_t precise;
+   uint64_t candidates;
+   struct limit_index* index;
+   struct limit_name* name;
    struct main_configuration* config;
 
-   best_rule = -1;
    config = (struct main_configuration*)shmem;
 
-   if (config->number_of_limits > 0)
+   do
    {
-      for (int i = 0; i < config->number_of_limits; i++)
+      best_rule = -1;
+      generation = pgagroal_limit_read_begin(shmem);
+
+      if (config->number_of_limits > 0)
       {
-         bool database_match = false;
+         index = pgagroal_get_limit_index(shmem);
 
-         // Check exact database name match or "all"
-         if (!strcmp("all", config->limits[i].database) || !strcmp(database, config->limits[i].database))
-         {
-            database_match = true;
-         }
-         else
-         {
-            // Check if database matches any alias for this limit entry
-            for (int j = 0; j < config->limits[i].aliases_count; j++)
-            {
-               if (!strcmp(database, config->limits[i].aliases[j]))
-               {
-                  database_match = true;
-                  pgagroal_log_debug("Database '%s' matched alias '%s' for rule %d",
-                                     database, config->limits[i].aliases[j], i);
-                  break;
-               }
-            }
-         }
+         // Rules naming the user name
+         name = pgagroal_find_limit_name(index, username);
+         usernames = name != NULL ? name->usernames : 0;
+
+         // Rules naming the database or one of its aliases
+         name = pgagroal_find_limit_name(index, database);
+         databases = name != NULL ? name->databases | name->aliases : 0;
 
-         // Check username match
-         bool username_match = (!strcmp("all", config->limits[i].username) || !strcmp(username, config->limits[i].username));
+         precise = usernames & databases;
+         candidates = (usernames | index->all_usernames) & (databases | index->all_databases);
 
-         /* There is a match */
-         if (username_match && database_match)
+         /* The rules are considered in the order of the configuration file */
+         while (candidates != 0)
          {
+            int i = __builtin_ctzll(candidates);
+            uint64_t bit = 1ULL << i;
+
+            candidates &= candidates - 1;
+
             if (best_rule == -1)
             {
                best_rule = i;
             }
             else
             {
-               if (!strcmp(username, config->limits[best_rule].username) &&
-                   (!strcmp(database, config->limits[best_rule].database) ||
-                    is_alias_of_limit(database, best_rule)))
+               uint64_t best = 1ULL << best_rule;
+
+               if (precise & best)
                {
                   /* We have a precise rule already */
                }
-               else if (!strcmp("all", config->limits[best_rule].username))
+               else if (index->all_usernames & best)
                {
                   /* User is better */
-                  if (strcmp("all", config->limits[i].username))
+                  if (!(index->all_usernames & bit))
                   {
                      best_rule = i;
                   }
                }
-               else if (!strcmp("all", config->limits[best_rule].database))
+               else if (index->all_databases & best)
                {
                   /* Database is better */
-                  if (strcmp("all", config->limits[i].database))
+                  if (!(index->all_databases & bit))
                   {
                      best_rule = i;
                   }
@@ -1345,6 +1633,7 @@ find_best_rule(char* username, char* database)
          }
       }
    }
+   while (pgagroal_limit_read_retry(shmem, generation));
 
    if (best_rule != -1)
    {
@@ -1358,6 +1647,9 @@ find_best_rule(char* username, char* database)
 static bool
 is_alias_of_limit(char* database, int limit_index)
 {
+   bool alias;
+   unsigned int generation;
+   struct limit_name* name;
    struct main_configuration* config = (struct main_configuration*)shmem;
 
    if (limit_index < 0 || limit_index >= config->number_of_limits)
@@ -1365,15 +1657,16 @@ is_alias_of_limit(char* database, int limit_index)
       return false;
    }
 
-   for (int i = 0; i < config->limits[limit_index].aliases_count; i++)
+   do
    {
-      if (!strcmp(database, config->limits[limit_index].aliases[i]))
-      {
-         return true;
-      }
+      generation = pgagroal_limit_read_begin(shmem);
+
+      name = pgagroal_find_limit_name(pgagroal_get_limit_index(shmem), database);
+      alias = name != NULL && (name->aliases & (1ULL << limit_index)) != 0;
    }
+   while (pgagroal_limit_read_retry(shmem, generation));
 
-   return false;
+   return alias;
 }
 
 static int
@@ -1397,17 +1690,10 @@ get_connection_count_for_limit_rule(int rule_index, char* username)
          {
             count++;
          }
-         else
+         else if (is_alias_of_limit((char*)(&config->connections[i].database), rule_index))
          {
-            // Check if this connection is for any alias of this database
-            for (int j = 0; j < config->limits[rule_index].aliases_count; j++)
-            {
-               if (!strcmp((const char*)(&config->connections[i].database), config->limits[rule_index].aliases[j]))
-               {
-                  count++;
-                  break;
-               }
-            }
+            // This connection is for an alias of this database
+            count++;
          }
       }
    }
@@ -1422,6 +1708,7 @@ static bool
 remove_connection(char* username, char* database)
 {
    signed char free;
+   int list;
    signed char remove;
    struct main_configuration* config;
 
@@ -1437,12 +1724,18 @@ remove_connection(char* username, char* database)
       {
          if (!strcmp(username, config->connections[i].username) && !strcmp(database, config->connections[i].database))
          {
+            list = config->connections[i].slot_list;
+
             if (!atomic_compare_exchange_strong(&config->states[i], &remove, STATE_FREE))
             {
                pgagroal_prometheus_connection_remove();
                pgagroal_tracking_event_slot(TRACKER_REMOVE_CONNECTION, i);
                pgagroal_kill_connection(i, NULL);
             }
+            else
+            {
+               free_slot_push(list, i);
+            }
          }
          else
          {
@@ -1523,10 +1816,12 @@ connection_details(int slot)
    int state;
    char time_buf[32];
    char start_buf[32];
+   struct connection_security* security;
    struct main_configuration* config;
    struct connection connection;
 
    config = (struct main_configuration*)shmem;
+   security = (struct connection_security*)security_shmem;
 
    connection = config->connections[slot];
    state = atomic_load(&config->states[slot]);
@@ -1566,8 +1861,8 @@ connection_details(int slot)
          pgagroal_log_trace("                      Auth: %d", connection.has_security);
          for (int i = 0; i < NUMBER_OF_SECURITY_MESSAGES; i++)
          {
-            pgagroal_log_trace("                      Size: %zd", connection.security_lengths[i]);
-            pgagroal_log_mem(&connection.security_messages[i], connection.security_lengths[i]);
+            pgagroal_log_trace("                      Size: %zd", security[slot].lengths[i]);
+            pgagroal_log_mem(&security[slot].messages[i], security[slot].lengths[i]);
          }
          pgagroal_log_trace("                      Backend PID: %d", connection.backend_pid);
          pgagroal_log_trace("                      Backend Secret: %d", connection.backend_secret);
@@ -1587,8 +1882,8 @@ connection_details(int slot)
          pgagroal_log_trace("                      Auth: %d", connection.has_security);
          for (int i = 0; i < NUMBER_OF_SECURITY_MESSAGES; i++)
          {
-            pgagroal_log_trace("                      Size: %zd", connection.security_lengths[i]);
-            pgagroal_log_mem(&connection.security_messages[i], connection.security_lengths[i]);
+            pgagroal_log_trace("                      Size: %zd", security[slot].lengths[i]);
+            pgagroal_log_mem(&security[slot].messages[i], security[slot].lengths[i]);
          }
          pgagroal_log_trace("                      Backend PID: %d", connection.backend_pid);
          pgagroal_log_trace("                      Backend Secret: %d", connection.backend_secret);
@@ -1608,8 +1903,8 @@ connection_details(int slot)
          pgagroal_log_trace("                      Auth: %d", connection.has_security);
          for (int i = 0; i < NUMBER_OF_SECURITY_MESSAGES; i++)
          {
-            pgagroal_log_trace("                      Size: %zd", connection.security_lengths[i]);
-            pgagroal_log_mem(&connection.security_messages[i], connection.security_lengths[i]);
+            pgagroal_log_trace("                      Size: %zd", security[slot].lengths[i]);
+            pgagroal_log_mem(&security[slot].messages[i], security[slot].lengths[i]);
          }
          pgagroal_log_trace("                      Backend PID: %d", connection.backend_pid);
          pgagroal_log_trace("                      Backend Secret: %d", connection.backend_secret);
@@ -1629,8 +1924,8 @@ connection_details(int slot)
          pgagroal_log_trace("                      Auth: %d", connection.has_security);
          for (int i = 0; i < NUMBER_OF_SECURITY_MESSAGES; i++)
          {
-            pgagroal_log_trace("                      Size: %zd", connection.security_lengths[i]);
-            pgagroal_log_mem(&connection.security_messages[i], connection.security_lengths[i]);
+            pgagroal_log_trace("                      Size: %zd", security[slot].lengths[i]);
+            pgagroal_log_mem(&security[slot].messages[i], security[slot].lengths[i]);
          }
          pgagroal_log_trace("                      Backend PID: %d", connection.backend_pid);
          pgagroal_log_trace("                      Backend Secret: %d", connection.backend_secret);
@@ -1650,8 +1945,8 @@ connection_details(int slot)
          pgagroal_log_trace("                      Auth: %d", connection.has_security);
          for (int i = 0; i < NUMBER_OF_SECURITY_MESSAGES; i++)
          {
-            pgagroal_log_trace("                      Size: %zd", connection.security_lengths[i]);
-            pgagroal_log_mem(&connection.security_messages[i], connection.security_lengths[i]);
+            pgagroal_log_trace("                      Size: %zd", security[slot].lengths[i]);
+            pgagroal_log_mem(&security[slot].messages[i], security[slot].lengths[i]);
          }
          pgagroal_log_trace("                      Backend PID: %d", connection.backend_pid);
          pgagroal_log_trace("                      Backend Secret: %d", connection.backend_secret);
@@ -1671,8 +1966,8 @@ connection_details(int slot)
          pgagroal_log_trace("                      Auth: %d", connection.has_security);
          for (int i = 0; i < NUMBER_OF_SECURITY_MESSAGES; i++)
          {
-            pgagroal_log_trace("                      Size: %zd", connection.security_lengths[i]);
-            pgagroal_log_mem(&connection.security_messages[i], connection.security_lengths[i]);
+            pgagroal_log_trace("                      Size: %zd", security[slot].lengths[i]);
+            pgagroal_log_mem(&security[slot].messages[i], security[slot].lengths[i]);
          }
          pgagroal_log_trace("                      Backend PID: %d", connection.backend_pid);
          pgagroal_log_trace("                      Backend Secret: %d", connection.backend_secret);
@@ -1692,8 +1987,8 @@ connection_details(int slot)
          pgagroal_log_trace("                      Auth: %d", connection.has_security);
          for (int i = 0; i < NUMBER_OF_SECURITY_MESSAGES; i++)
          {
-            pgagroal_log_trace("                      Size: %zd", connection.security_lengths[i]);
-            pgagroal_log_mem(&connection.security_messages[i], connection.security_lengths[i]);
+            pgagroal_log_trace("                      Size: %zd", security[slot].lengths[i]);
+            pgagroal_log_mem(&security[slot].messages[i], security[slot].lengths[i]);
          }
          pgagroal_log_trace("                      Backend PID: %d", connection.backend_pid);
          pgagroal_log_trace("                      Backend Secret: %d", connection.backend_secret);
@@ -1713,8 +2008,8 @@ connection_details(int slot)
          pgagroal_log_trace("                      Auth: %d", connection.has_security);
          for (int i = 0; i < NUMBER_OF_SECURITY_MESSAGES; i++)
          {
-            pgagroal_log_trace("                      Size: %zd", connection.security_lengths[i]);
-            pgagroal_log_mem(&connection.security_messages[i], connection.security_lengths[i]);
+            pgagroal_log_trace("                      Size: %zd", security[slot].lengths[i]);
+            pgagroal_log_mem(&security[slot].messages[i], security[slot].lengths[i]);
          }
          pgagroal_log_trace("                      Backend PID: %d", connection.backend_pid);
          pgagroal_log_trace("                      Backend Secret: %d", connection.backend_secret);
@@ -1809,14 +2104,568 @@ resolve_database_name(char* database, int best_rule)
    }
 
    // Check if this database name is an alias
-   for (int j = 0; j < config->limits[best_rule].aliases_count; j++)
+   if (is_alias_of_limit(database, best_rule))
    {
-      if (!strcmp(database, config->limits[best_rule].aliases[j]))
-      {
-         return config->limits[best_rule].database; // Return real database name
-      }
+      return config->limits[best_rule].database; // Return real database name
    }
 
    // Not an alias, return original name
    return database;
-}
\ No newline at end of file
+}
+
+static int
+slot_list_find(int rule, char* username, char* database)
+{
+   uint32_t hash = 2166136261u;
+   int index;
+   signed char state;
+   struct slot_identity* identity;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   /* FNV-1a over the limit rule, the username and the database */
+   hash = (hash ^ (unsigned char)rule) * 16777619u;
+
+   for (char* c = username; *c != '\0'; c++)
+   {
+      hash = (hash ^ (unsigned char)*c) * 16777619u;
+   }
+
+   hash = (hash ^ '/') * 16777619u;
+
+   for (char* c = database; *c != '\0'; c++)
+   {
+      hash = (hash ^ (unsigned char)*c) * 16777619u;
+   }
+
+   for (int probe = 0; probe < SLOT_LIST_SHARED; probe++)
+   {
+      index = (int)((hash + (uint32_t)probe) % SLOT_LIST_SHARED);
+      identity = &config->slot_identities[index];
+      state = atomic_load(&identity->state);
+
+      if (state == SLOT_IDENTITY_EMPTY &&
+          atomic_compare_exchange_strong(&identity->state, &state, SLOT_IDENTITY_CLAIMED))
+      {
+         identity->limit_rule = (signed char)rule;
+         memset(&identity->username, 0, MAX_USERNAME_LENGTH);
+         memcpy(&identity->username, username, MIN(strlen(username), MAX_USERNAME_LENGTH - 1));
+         memset(&identity->database, 0, MAX_DATABASE_LENGTH);
+         memcpy(&identity->database, database, MIN(strlen(database), MAX_DATABASE_LENGTH - 1));
+
+         atomic_store(&identity->state, SLOT_IDENTITY_READY);
+
+         return index;
+      }
+
+      /* Another process is writing the identity */
+      for (int spins = 0; state == SLOT_IDENTITY_CLAIMED && spins < MAX_IDENTITY_SPINS; spins++)
+      {
+         sched_yield();
+         state = atomic_load(&identity->state);
+      }
+
+      if (state != SLOT_IDENTITY_READY)
+      {
+         /* The identity is unknown, so it could be ours */
+         return SLOT_LIST_SHARED;
+      }
+
+      if (identity->limit_rule == rule &&
+          !strncmp(identity->username, username, MAX_USERNAME_LENGTH - 1) &&
+          !strncmp(identity->database, database, MAX_DATABASE_LENGTH - 1))
+      {
+         return index;
+      }
+   }
+
+   return SLOT_LIST_SHARED;
+}
+
+static bool
+same_identity(int slot, int rule, char* username, char* database)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   return rule == config->connections[slot].limit_rule &&
+          !strcmp((const char*)(&config->connections[slot].username), username) &&
+          !strcmp((const char*)(&config->connections[slot].database), database);
+}
+
+static void
+free_slot_push(int list, int slot)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   pgagroal_slot_list_add(&config->free_slots[list], slot);
+
+   wait_queue_signal(list);
+
+   if (atomic_load(&config->parked_workers) > 0)
+   {
+      transaction_workers_wake();
+   }
+}
+
+static void
+free_slot_release(int slot)
+{
+   int list;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   /* Read while the slot is still owned, as it can be killed once it is free */
+   list = config->connections[slot].slot_list;
+
+   atomic_store(&config->states[slot], STATE_FREE);
+
+   free_slot_push(list, slot);
+}
+
+static int
+free_slot_take(int list, int rule, char* username, char* database, bool transaction_mode)
+{
+   int candidate = -1;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   /* The most recently returned slots first, as their backends have warm caches */
+   for (int i = 0; i < SLOT_LIST_RECENT; i++)
+   {
+      candidate = pgagroal_slot_list_recent(&config->free_slots[list], i);
+
+      if (candidate != -1 && free_slot_try(list, candidate, rule, username, database, transaction_mode))
+      {
+         return candidate;
+      }
+   }
+
+   candidate = -1;
+
+   while ((candidate = pgagroal_slot_list_next(&config->free_slots[list], candidate + 1)) != -1)
+   {
+      if (free_slot_try(list, candidate, rule, username, database, transaction_mode))
+      {
+         return candidate;
+      }
+   }
+
+   return -1;
+}
+
+static bool
+free_slot_try(int list, int slot, int rule, char* username, char* database, bool transaction_mode)
+{
+   signed char free;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   /* A spare worker can't use a descriptor transferred after it was forked, see main.c */
+   if (!transaction_mode && !pgagroal_pool_descriptor_known(slot))
+   {
+      return false;
+   }
+
+   /* The shared list has slots of other identities, which are left alone */
+   if (list == SLOT_LIST_SHARED && !same_identity(slot, rule, username, database))
+   {
+      return false;
+   }
+
+   free = STATE_FREE;
+
+   /* A slot which isn't free is listed again, or removed, by its owner */
+   if (!atomic_compare_exchange_strong(&config->states[slot], &free, STATE_IN_USE))
+   {
+      return false;
+   }
+
+   if (same_identity(slot, rule, username, database))
+   {
+      pgagroal_slot_list_remove(&config->free_slots[list], slot);
+      return true;
+   }
+
+   /* The slot was killed, and reused by another identity, before it was listed */
+   if (config->connections[slot].slot_list != list)
+   {
+      pgagroal_slot_list_remove(&config->free_slots[list], slot);
+   }
+
+   free_slot_release(slot);
+
+   return false;
+}
+
+static void
+free_slot_remove(int slot)
+{
+   int list;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   list = config->connections[slot].slot_list;
+
+   if (list >= 0)
+   {
+      pgagroal_slot_list_remove(&config->free_slots[list], slot);
+   }
+}
+
+static void
+notinit_slot_push(int slot)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   pgagroal_slot_list_add(&config->notinit_slots, slot);
+
+   /* A new connection can be created for any username / database */
+   wait_queue_signal_all();
+}
+
+static int
+notinit_slot_pop(void)
+{
+   int candidate = -1;
+   signed char not_init;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   while ((candidate = pgagroal_slot_list_next(&config->notinit_slots, candidate + 1)) != -1)
+   {
+      not_init = STATE_NOTINIT;
+
+      if (atomic_compare_exchange_strong(&config->states[candidate], &not_init, STATE_INIT))
+      {
+         pgagroal_slot_list_remove(&config->notinit_slots, candidate);
+         return candidate;
+      }
+   }
+
+   return -1;
+}
+
+static void
+wait_queue_await(int list, unsigned int sequence, bool* queued, unsigned int* ticket, uint64_t timeout)
+{
+   /* The waiters of the shared list have different identities, so they can't wait in line */
+   if (list == SLOT_LIST_SHARED)
+   {
+      wait_queue_wait(list, sequence, timeout);
+      return;
+   }
+
+   if (!*queued)
+   {
+      *ticket = wait_queue_enter(list);
+      *queued = true;
+
+      if (wait_queue_head(list, *ticket))
+      {
+         /* Nobody is in front */
+         return;
+      }
+   }
+
+   if (wait_queue_head(list, *ticket))
+   {
+      wait_queue_wait(list, sequence, timeout);
+   }
+   else
+   {
+      wait_queue_turn(list, *ticket, timeout);
+   }
+}
+
+static void
+wait_queue_wait(int list, unsigned int sequence, uint64_t timeout)
+{
+   struct wait_queue* queue;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   queue = &config->wait_queues[list];
+
+   /* Bound the wait, such that a lost wake up can't stall the process */
+   timeout = MIN(timeout, MAX_WAIT_QUEUE_WAIT);
+
+   atomic_fetch_add(&config->waiters, 1);
+   atomic_fetch_add(&queue->waiters, 1);
+
+#ifdef HAVE_LINUX
+   struct timespec ts;
+
+   ts.tv_sec = (time_t)(timeout / 1000000ULL);
+   ts.tv_nsec = (long)(timeout % 1000000ULL) * 1000L;
+
+   /* Returns at once if the sequence changed since it was read */
+   syscall(SYS_futex, (uint32_t*)&queue->sequence, FUTEX_WAIT, sequence, &ts, NULL, 0);
+   errno = 0;
+#else
+   if (atomic_load(&queue->sequence) == sequence)
+   {
+      /* Sleep for 1ms */
+      SLEEP(1000000L)
+   }
+#endif
+
+   atomic_fetch_sub(&queue->waiters, 1);
+   atomic_fetch_sub(&config->waiters, 1);
+}
+
+static unsigned int
+wait_queue_enter(int list)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   return atomic_fetch_add(&config->wait_queues[list].next_ticket, 1);
+}
+
+static bool
+wait_queue_busy(int list)
+{
+   struct wait_queue* queue;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   queue = &config->wait_queues[list];
+
+   return atomic_load(&queue->next_ticket) != atomic_load(&queue->serving);
+}
+
+static bool
+wait_queue_head(int list, unsigned int ticket)
+{
+   struct wait_queue* queue;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   queue = &config->wait_queues[list];
+
+   /* A ticket which was skipped, see wait_queue_turn(), doesn't wait again */
+   if ((int)(ticket - atomic_load(&queue->serving)) > 0)
+   {
+      return false;
+   }
+
+   atomic_store(&queue->heartbeat, pgagroal_get_monotonic_micros());
+
+   return true;
+}
+
+static void
+wait_queue_turn(int list, unsigned int ticket, uint64_t timeout)
+{
+   unsigned int call;
+   unsigned int serving;
+   struct wait_queue* queue;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   queue = &config->wait_queues[list];
+
+   /* Read before the turn is checked, so a call in between isn't missed */
+   call = atomic_load(&queue->calls[ticket % WAIT_QUEUE_TICKETS]);
+
+   if (wait_queue_head(list, ticket))
+   {
+      return;
+   }
+
+   timeout = MIN(timeout, MAX_WAIT_QUEUE_WAIT);
+
+   atomic_fetch_add(&config->waiters, 1);
+   atomic_fetch_add(&queue->waiters, 1);
+
+#ifdef HAVE_LINUX
+   struct timespec ts;
+
+   ts.tv_sec = (time_t)(timeout / 1000000ULL);
+   ts.tv_nsec = (long)(timeout % 1000000ULL) * 1000L;
+
+   syscall(SYS_futex, (uint32_t*)&queue->calls[ticket % WAIT_QUEUE_TICKETS], FUTEX_WAIT, call, &ts, NULL, 0);
+   errno = 0;
+#else
+   if (atomic_load(&queue->calls[ticket % WAIT_QUEUE_TICKETS]) == call)
+   {
+      /* Sleep for 1ms */
+      SLEEP(1000000L)
+   }
+#endif
+
+   atomic_fetch_sub(&queue->waiters, 1);
+   atomic_fetch_sub(&config->waiters, 1);
+
+   /* The process being served checks the list at least every MAX_WAIT_QUEUE_WAIT, unless it is gone */
+   serving = atomic_load(&queue->serving);
+   if (serving != ticket && pgagroal_get_monotonic_micros() - atomic_load(&queue->heartbeat) > WAIT_QUEUE_STALL)
+   {
+      pgagroal_log_debug("wait_queue_turn: Skipping ticket %u of list %d", serving, list);
+      wait_queue_advance(list, serving);
+   }
+}
+
+static void
+wait_queue_leave(int list, unsigned int ticket)
+{
+   struct wait_queue* queue;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   queue = &config->wait_queues[list];
+
+   if ((int)(ticket - atomic_load(&queue->serving)) > 0)
+   {
+      /* The ticket is skipped when its turn comes, unless the turn comes now */
+      atomic_store(&queue->abandoned[ticket % WAIT_QUEUE_TICKETS], ticket + 1);
+
+      if (atomic_load(&queue->serving) != ticket)
+      {
+         return;
+      }
+   }
+
+   wait_queue_advance(list, ticket);
+}
+
+static void
+wait_queue_advance(int list, unsigned int ticket)
+{
+   unsigned int next;
+   struct wait_queue* queue;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   queue = &config->wait_queues[list];
+
+   next = ticket + 1;
+
+   /* Only one process moves the queue on from a ticket */
+   if (!atomic_compare_exchange_strong(&queue->serving, &ticket, next))
+   {
+      return;
+   }
+
+   while (atomic_load(&queue->abandoned[next % WAIT_QUEUE_TICKETS]) == next + 1)
+   {
+      unsigned int abandoned = next;
+
+      if (!atomic_compare_exchange_strong(&queue->serving, &abandoned, next + 1))
+      {
+         return;
+      }
+
+      next++;
+   }
+
+   atomic_store(&queue->heartbeat, pgagroal_get_monotonic_micros());
+   atomic_fetch_add(&queue->calls[next % WAIT_QUEUE_TICKETS], 1);
+
+#ifdef HAVE_LINUX
+   /* Only the tickets sharing the call word are woken, and all but one wait again */
+   syscall(SYS_futex, (uint32_t*)&queue->calls[next % WAIT_QUEUE_TICKETS], FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+   errno = 0;
+#endif
+}
+
+static void
+wait_queue_signal(int list)
+{
+   struct wait_queue* queue;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   queue = &config->wait_queues[list];
+
+   atomic_fetch_add(&queue->sequence, 1);
+
+   if (atomic_load(&queue->waiters) > 0)
+   {
+#ifdef HAVE_LINUX
+      long woken;
+
+      /* The waiters of the shared list have different identities, so all of them check the list */
+      woken = syscall(SYS_futex, (uint32_t*)&queue->sequence, FUTEX_WAKE, list == SLOT_LIST_SHARED ? INT_MAX : 1, NULL, NULL, 0);
+
+      /* No waiter woken means that it is about to wait, and sees the new sequence */
+      if (woken == -1)
+      {
+         pgagroal_log_debug("wait_queue_signal: %d %s", list, strerror(errno));
+         errno = 0;
+      }
+#endif
+   }
+}
+
+static void
+wait_queue_signal_all(void)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   if (atomic_load(&config->waiters) == 0)
+   {
+      return;
+   }
+
+   for (int i = 0; i < NUMBER_OF_SLOT_LISTS; i++)
+   {
+      if (atomic_load(&config->wait_queues[i].waiters) > 0)
+      {
+         wait_queue_signal(i);
+      }
+   }
+}
+
+static void
+transaction_workers_wake(void)
+{
+   int fd = -1;
+   pid_t pid;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   for (int i = 0; i < config->transaction_workers; i++)
+   {
+      pid = (pid_t)atomic_load(&config->tx_workers[i].pid);
+
+      /* A worker resumes its own clients after it returned a connection */
+      if (pid <= 0 || pid == getpid())
+      {
+         continue;
+      }
+
+      /* One wake up per wait, the worker marks itself again if clients are still waiting */
+      if (!atomic_exchange(&config->tx_workers[i].parked, false))
+      {
+         continue;
+      }
+
+      atomic_fetch_sub(&config->parked_workers, 1);
+
+      if (pgagroal_connection_get_pid(pid, &fd) || pgagroal_connection_id_write(fd, CONNECTION_WAKE))
+      {
+         pgagroal_log_debug("transaction_workers_wake: Worker %d (%d)", i, pid);
+         errno = 0;
+      }
+
+      pgagroal_disconnect(fd);
+      fd = -1;
+   }
+}
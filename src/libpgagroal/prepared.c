@@ -0,0 +1,1334 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgagroal */
+#include <pgagroal.h>
+#include <art.h>
+#include <logging.h>
+#include <message.h>
+#include <prepared.h>
+#include <utils.h>
+#include <value.h>
+
+/* system */
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define STATEMENT_NAME_LENGTH 26
+#define INITIAL_REQUESTS      16
+#define INITIAL_BUFFER_SIZE   8192
+
+#define RESET_NONE            0
+#define RESET_DISCARD         1
+#define RESET_DEALLOCATE      2
+#define RESET_PREPARE         3
+
+#define DESCRIBE_KEEP         0
+#define DESCRIBE_PARSED       1
+#define DESCRIBE_DROP         2
+
+/** @struct prepared_statement
+ * Defines a statement of a client
+ */
+struct prepared_statement
+{
+   uint64_t hash; /**< The hash of the Parse message of the client */
+   size_t length; /**< The length of the renamed Parse message */
+   char data[];   /**< The renamed Parse message */
+};
+
+static struct prepared_slot* get_slot(struct prepared_client* client, int slot);
+static bool slot_contains(struct prepared_slot* ps, uint64_t hash);
+static uint64_t slot_add(struct prepared_slot* ps, uint64_t hash);
+static void slot_remove(struct prepared_slot* ps, uint64_t hash);
+static void slot_clear(struct prepared_slot* ps);
+
+static uint64_t statement_hash(char* data, size_t length);
+static void statement_name(uint64_t hash, char* name);
+static bool resets_statements(char* query, size_t length);
+static size_t skip_literal(char* query, size_t length, size_t i);
+
+static int request_push(struct prepared_client* client, char kind, bool injected, uint64_t hash);
+static struct prepared_request* request_first(struct prepared_client* client);
+static void request_pop(struct prepared_client* client);
+
+static int buffer_ensure(char** buffer, size_t* size, size_t length);
+static int buffer_append(struct prepared_client* client, void* data, size_t length);
+static int buffer_flush(struct prepared_client* client, char* data, size_t* flushed, size_t offset);
+
+static int write_close(struct prepared_client* client, uint64_t hash);
+static int write_describe(struct prepared_client* client, uint64_t hash);
+static int write_prepare(struct prepared_client* client, struct prepared_slot* ps, struct prepared_statement* stmt, bool injected);
+static int write_parse(struct prepared_client* client, uint64_t hash, char* query, size_t length);
+
+static int needed_bytes(char* data, size_t available);
+static int rewrite_parse(struct prepared_client* client, struct prepared_slot* ps, char* data, size_t* flushed, size_t offset, int total, int* handled);
+static int rewrite_bind(struct prepared_client* client, struct prepared_slot* ps, char* data, size_t* flushed, size_t offset, int total, int need, int* handled);
+static int rewrite_statement(struct prepared_client* client, struct prepared_slot* ps, char* data, size_t* flushed, size_t offset, int total, int* handled);
+
+static bool server_response(struct prepared_client* client, char kind);
+static int server_describe(struct prepared_client* client, char kind);
+static void server_error(struct prepared_client* client, struct prepared_slot* ps);
+static void server_ready(struct prepared_client* client);
+
+size_t
+pgagroal_prepared_size(void* shmem)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   return config->max_connections * sizeof(struct prepared_slot);
+}
+
+int
+pgagroal_prepared_create(void* slots, struct prepared_client** client)
+{
+   struct prepared_client* c = NULL;
+
+   *client = NULL;
+
+   c = (struct prepared_client*)calloc(1, sizeof(struct prepared_client));
+   if (c == NULL)
+   {
+      goto error;
+   }
+
+   c->slots = (struct prepared_slot*)slots;
+
+   if (pgagroal_art_create(&c->statements))
+   {
+      goto error;
+   }
+
+   *client = c;
+
+   return 0;
+
+error:
+
+   pgagroal_prepared_destroy(c);
+
+   return 1;
+}
+
+void
+pgagroal_prepared_destroy(struct prepared_client* client)
+{
+   if (client == NULL)
+   {
+      return;
+   }
+
+   pgagroal_art_destroy(client->statements);
+   free(client->requests);
+   free(client->pending);
+   free(client->buffer);
+   free(client);
+}
+
+void
+pgagroal_prepared_start(struct prepared_client* client, int slot)
+{
+   struct prepared_slot* ps = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   ps = get_slot(client, slot);
+
+   if (ps->backend_pid != config->connections[slot].backend_pid ||
+       ps->backend_secret != config->connections[slot].backend_secret)
+   {
+      slot_clear(ps);
+      ps->backend_pid = config->connections[slot].backend_pid;
+      ps->backend_secret = config->connections[slot].backend_secret;
+   }
+
+   /* The stream from the server starts over */
+   client->requests_head = 0;
+   client->requests_count = 0;
+   client->server_remaining = 0;
+   client->server_skip = false;
+   client->server_pending_length = 0;
+}
+
+int
+pgagroal_prepared_client(struct prepared_client* client, int slot, struct message* msg, struct message** result)
+{
+   char* data = NULL;
+   size_t length;
+   size_t offset = 0;
+   size_t flushed = 0;
+   size_t remaining;
+   struct prepared_slot* ps = NULL;
+
+   ps = get_slot(client, slot);
+
+   client->buffer_length = 0;
+
+   if (client->pending_length > 0)
+   {
+      if (buffer_ensure(&client->pending, &client->pending_size, client->pending_length + msg->length))
+      {
+         goto error;
+      }
+
+      memcpy(client->pending + client->pending_length, msg->data, msg->length);
+      client->pending_length += msg->length;
+
+      data = client->pending;
+      length = client->pending_length;
+   }
+   else
+   {
+      data = (char*)msg->data;
+      length = msg->length;
+   }
+
+   while (offset < length)
+   {
+      int need;
+      int total;
+      int handled = 0;
+
+      if (client->client_remaining > 0)
+      {
+         remaining = MIN((size_t)client->client_remaining, length - offset);
+         client->client_remaining -= remaining;
+         offset += remaining;
+         continue;
+      }
+
+      need = needed_bytes(data + offset, length - offset);
+      if (need < 0)
+      {
+         pgagroal_log_debug("pgagroal_prepared_client: Invalid message (slot %d)", slot);
+         goto error;
+      }
+      else if ((size_t)need > length - offset)
+      {
+         /* Wait for the rest of the message */
+         break;
+      }
+
+      total = pgagroal_read_int32(data + offset + 1) + 1;
+
+      switch (pgagroal_read_byte(data + offset))
+      {
+         case 'P':
+            if (rewrite_parse(client, ps, data, &flushed, offset, total, &handled))
+            {
+               goto error;
+            }
+            break;
+         case 'B':
+            if (rewrite_bind(client, ps, data, &flushed, offset, total, need, &handled))
+            {
+               goto error;
+            }
+            break;
+         case 'C':
+         case 'D':
+            if (rewrite_statement(client, ps, data, &flushed, offset, total, &handled))
+            {
+               goto error;
+            }
+            break;
+         case 'Q':
+            if (resets_statements(data + offset + 5, total - 5))
+            {
+               slot_clear(ps);
+            }
+            /* Fall through */
+         case 'S':
+         case 'F':
+            /* Answered by ReadyForQuery */
+            if (request_push(client, 'S', false, 0))
+            {
+               goto error;
+            }
+            break;
+         default:
+            break;
+      }
+
+      offset += handled;
+      remaining = MIN((size_t)(total - handled), length - offset);
+      client->client_remaining = total - handled - remaining;
+      offset += remaining;
+   }
+
+   if (client->buffer_length == 0 && data == msg->data)
+   {
+      /* Nothing was rewritten */
+      client->message.data = data;
+      client->message.length = offset;
+   }
+   else
+   {
+      if (buffer_flush(client, data, &flushed, offset))
+      {
+         goto error;
+      }
+
+      client->message.data = client->buffer;
+      client->message.length = client->buffer_length;
+   }
+
+   /* Keep the incomplete message */
+   remaining = length - offset;
+   if (remaining > 0)
+   {
+      if (data == client->pending)
+      {
+         memmove(client->pending, client->pending + offset, remaining);
+      }
+      else
+      {
+         if (buffer_ensure(&client->pending, &client->pending_size, remaining))
+         {
+            goto error;
+         }
+         memcpy(client->pending, data + offset, remaining);
+      }
+   }
+   client->pending_length = remaining;
+
+   client->message.kind = client->message.length > 0 ? pgagroal_read_byte(client->message.data) : 0;
+   *result = &client->message;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+pgagroal_prepared_server(struct prepared_client* client, int slot, struct message* msg, struct message** result)
+{
+   char* data = NULL;
+   size_t length;
+   size_t offset = 0;
+   size_t written = 0;
+   size_t remaining;
+   struct prepared_slot* ps = NULL;
+
+   ps = get_slot(client, slot);
+
+   /* The responses are only removed, so the messages are rewritten in place */
+   if (client->server_pending_length > 0)
+   {
+      if (buffer_ensure(&client->buffer, &client->buffer_size, client->server_pending_length + msg->length))
+      {
+         goto error;
+      }
+
+      memcpy(client->buffer, &client->server_pending[0], client->server_pending_length);
+      memcpy(client->buffer + client->server_pending_length, msg->data, msg->length);
+
+      data = client->buffer;
+      length = client->server_pending_length + msg->length;
+   }
+   else
+   {
+      data = (char*)msg->data;
+      length = msg->length;
+   }
+
+   while (offset < length)
+   {
+      char kind;
+      int total;
+      bool drop = false;
+
+      if (client->server_remaining > 0)
+      {
+         remaining = MIN((size_t)client->server_remaining, length - offset);
+         if (!client->server_skip)
+         {
+            memmove(data + written, data + offset, remaining);
+            written += remaining;
+         }
+         client->server_remaining -= remaining;
+         offset += remaining;
+         continue;
+      }
+
+      if (length - offset < 5)
+      {
+         break;
+      }
+
+      kind = pgagroal_read_byte(data + offset);
+      total = pgagroal_read_int32(data + offset + 1) + 1;
+
+      if (total < 5)
+      {
+         pgagroal_log_debug("pgagroal_prepared_server: Invalid message (slot %d)", slot);
+         goto error;
+      }
+
+      if ((kind == '1' || kind == '3' || kind == 'Z') &&
+          (size_t)total > length - offset && (size_t)total <= sizeof(client->server_pending))
+      {
+         /* Wait for the rest of the response */
+         break;
+      }
+
+      switch (kind)
+      {
+         case '1':
+            drop = server_response(client, 'P');
+            break;
+         case '3':
+            drop = server_response(client, 'C');
+            break;
+         case 'E':
+            server_error(client, ps);
+            break;
+         case 'Z':
+            server_ready(client);
+            break;
+         case 't':
+         case 'T':
+         case 'n':
+            switch (server_describe(client, kind))
+            {
+               case DESCRIBE_PARSED:
+                  /* The ParameterDescription of the statement answers the Parse of the client */
+                  pgagroal_write_byte(data + written, '1');
+                  pgagroal_write_int32(data + written + 1, 4);
+                  written += 5;
+                  drop = true;
+                  break;
+               case DESCRIBE_DROP:
+                  drop = true;
+                  break;
+               default:
+                  break;
+            }
+            break;
+         default:
+            break;
+      }
+
+      remaining = MIN((size_t)total, length - offset);
+      if (!drop)
+      {
+         memmove(data + written, data + offset, remaining);
+         written += remaining;
+      }
+      client->server_remaining = total - remaining;
+      client->server_skip = drop;
+      offset += remaining;
+   }
+
+   client->server_pending_length = length - offset;
+   memcpy(&client->server_pending[0], data + offset, client->server_pending_length);
+
+   client->message.data = data;
+   client->message.length = written;
+   client->message.kind = written > 0 ? pgagroal_read_byte(data) : 0;
+   *result = &client->message;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static struct prepared_slot*
+get_slot(struct prepared_client* client, int slot)
+{
+   return client->slots + slot;
+}
+
+static bool
+slot_contains(struct prepared_slot* ps, uint64_t hash)
+{
+   for (int i = 0; i < MAX_PREPARED_STATEMENTS; i++)
+   {
+      if (ps->hashes[i] == hash)
+      {
+         ps->used[i] = ++ps->clock;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static uint64_t
+slot_add(struct prepared_slot* ps, uint64_t hash)
+{
+   int index = 0;
+   uint64_t evicted = 0;
+
+   for (int i = 0; i < MAX_PREPARED_STATEMENTS; i++)
+   {
+      if (ps->hashes[i] == 0)
+      {
+         index = i;
+         goto done;
+      }
+
+      if (ps->used[i] < ps->used[index])
+      {
+         index = i;
+      }
+   }
+
+   /* The least recently used statement makes room */
+   evicted = ps->hashes[index];
+
+done:
+
+   ps->hashes[index] = hash;
+   ps->used[index] = ++ps->clock;
+
+   return evicted;
+}
+
+static void
+slot_remove(struct prepared_slot* ps, uint64_t hash)
+{
+   for (int i = 0; i < MAX_PREPARED_STATEMENTS; i++)
+   {
+      if (ps->hashes[i] == hash)
+      {
+         ps->hashes[i] = 0;
+         ps->used[i] = 0;
+         return;
+      }
+   }
+}
+
+static void
+slot_clear(struct prepared_slot* ps)
+{
+   ps->clock = 0;
+   memset(&ps->hashes[0], 0, sizeof(ps->hashes));
+   memset(&ps->used[0], 0, sizeof(ps->used));
+}
+
+static uint64_t
+statement_hash(char* data, size_t length)
+{
+   uint64_t hash = 14695981039346656037ULL;
+
+   /* FNV-1a over the name, query and parameter types */
+   for (size_t i = 0; i < length; i++)
+   {
+      hash ^= (unsigned char)data[i];
+      hash *= 1099511628211ULL;
+   }
+
+   return hash != 0 ? hash : 1;
+}
+
+static void
+statement_name(uint64_t hash, char* name)
+{
+   snprintf(name, STATEMENT_NAME_LENGTH, "pgagroal_%016" PRIx64, hash);
+}
+
+static bool
+resets_statements(char* query, size_t length)
+{
+   size_t i = 0;
+   size_t start;
+   size_t word;
+   int state = RESET_NONE;
+
+   /* Each statement of the query is checked for DISCARD ALL, DEALLOCATE ALL and
+      DEALLOCATE PREPARE ALL, outside of the literals and comments. A DEALLOCATE of
+      a name only reaches a statement of PREPARE, since the statements of the
+      protocol are renamed */
+   while (i < length && query[i] != '\0')
+   {
+      char c = query[i];
+
+      if (isspace((unsigned char)c))
+      {
+         i++;
+      }
+      else if (isalpha((unsigned char)c) || c == '_')
+      {
+         start = i;
+         while (i < length && (isalnum((unsigned char)query[i]) || query[i] == '_' || query[i] == '$'))
+         {
+            i++;
+         }
+         word = i - start;
+
+         /* An escape string constant */
+         if (word == 1 && (c == 'E' || c == 'e') && i < length && query[i] == '\'')
+         {
+            i = skip_literal(query, length, start);
+            state = RESET_NONE;
+            continue;
+         }
+
+         if (word == strlen("ALL") && !strncasecmp(query + start, "ALL", word) && state != RESET_NONE)
+         {
+            return true;
+         }
+         else if (word == strlen("DISCARD") && !strncasecmp(query + start, "DISCARD", word))
+         {
+            state = RESET_DISCARD;
+         }
+         else if (word == strlen("DEALLOCATE") && !strncasecmp(query + start, "DEALLOCATE", word))
+         {
+            state = RESET_DEALLOCATE;
+         }
+         else if (word == strlen("PREPARE") && !strncasecmp(query + start, "PREPARE", word) && state == RESET_DEALLOCATE)
+         {
+            state = RESET_PREPARE;
+         }
+         else
+         {
+            state = RESET_NONE;
+         }
+      }
+      else if (c == '-' && i + 1 < length && query[i + 1] == '-')
+      {
+         while (i < length && query[i] != '\n')
+         {
+            i++;
+         }
+      }
+      else if (c == '/' && i + 1 < length && query[i + 1] == '*')
+      {
+         int depth = 0;
+
+         /* Block comments nest */
+         while (i < length)
+         {
+            if (query[i] == '/' && i + 1 < length && query[i + 1] == '*')
+            {
+               depth++;
+               i += 2;
+            }
+            else if (query[i] == '*' && i + 1 < length && query[i + 1] == '/')
+            {
+               i += 2;
+               if (--depth == 0)
+               {
+                  break;
+               }
+            }
+            else
+            {
+               i++;
+            }
+         }
+      }
+      else if (c == '\'' || c == '"' || c == '$')
+      {
+         i = skip_literal(query, length, i);
+         state = RESET_NONE;
+      }
+      else
+      {
+         i++;
+         state = RESET_NONE;
+      }
+   }
+
+   return false;
+}
+
+static size_t
+skip_literal(char* query, size_t length, size_t i)
+{
+   char quote;
+   bool escapes = false;
+   size_t tag;
+   size_t tag_length;
+
+   if (query[i] == 'E' || query[i] == 'e')
+   {
+      escapes = true;
+      i++;
+   }
+
+   quote = query[i];
+
+   if (quote == '$')
+   {
+      /* A dollar quote, $tag$ ... $tag$, or a parameter like $1 */
+      tag = i;
+      i++;
+      while (i < length && (isalnum((unsigned char)query[i]) || query[i] == '_'))
+      {
+         i++;
+      }
+
+      if (i >= length || query[i] != '$' || (i > tag + 1 && isdigit((unsigned char)query[tag + 1])))
+      {
+         return i;
+      }
+
+      tag_length = i - tag + 1;
+      i++;
+
+      while (i + tag_length <= length)
+      {
+         if (query[i] == '$' && !strncmp(query + i, query + tag, tag_length))
+         {
+            return i + tag_length;
+         }
+         i++;
+      }
+
+      return length;
+   }
+
+   /* A string constant or a quoted identifier, where a doubled quote is part of it */
+   i++;
+   while (i < length)
+   {
+      if (escapes && query[i] == '\\')
+      {
+         i += 2;
+      }
+      else if (query[i] == quote)
+      {
+         if (i + 1 < length && query[i + 1] == quote)
+         {
+            i += 2;
+         }
+         else
+         {
+            return i + 1;
+         }
+      }
+      else
+      {
+         i++;
+      }
+   }
+
+   return length;
+}
+
+static int
+request_push(struct prepared_client* client, char kind, bool injected, uint64_t hash)
+{
+   int index;
+   int size;
+   struct prepared_request* requests = NULL;
+
+   if (client->requests_count == client->requests_size)
+   {
+      size = client->requests_size > 0 ? client->requests_size * 2 : INITIAL_REQUESTS;
+
+      requests = (struct prepared_request*)malloc(size * sizeof(struct prepared_request));
+      if (requests == NULL)
+      {
+         goto error;
+      }
+
+      for (int i = 0; i < client->requests_count; i++)
+      {
+         requests[i] = client->requests[(client->requests_head + i) % client->requests_size];
+      }
+
+      free(client->requests);
+      client->requests = requests;
+      client->requests_size = size;
+      client->requests_head = 0;
+   }
+
+   index = (client->requests_head + client->requests_count) % client->requests_size;
+   client->requests[index].kind = kind;
+   client->requests[index].injected = injected;
+   client->requests[index].hash = hash;
+   client->requests_count++;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static struct prepared_request*
+request_first(struct prepared_client* client)
+{
+   if (client->requests_count == 0)
+   {
+      return NULL;
+   }
+
+   return &client->requests[client->requests_head];
+}
+
+static void
+request_pop(struct prepared_client* client)
+{
+   if (client->requests_count > 0)
+   {
+      client->requests_head = (client->requests_head + 1) % client->requests_size;
+      client->requests_count--;
+   }
+}
+
+static int
+buffer_ensure(char** buffer, size_t* size, size_t length)
+{
+   size_t s;
+   char* b = NULL;
+
+   if (length <= *size)
+   {
+      return 0;
+   }
+
+   s = *size > 0 ? *size : INITIAL_BUFFER_SIZE;
+   while (s < length)
+   {
+      s *= 2;
+   }
+
+   b = (char*)realloc(*buffer, s);
+   if (b == NULL)
+   {
+      return 1;
+   }
+
+   *buffer = b;
+   *size = s;
+
+   return 0;
+}
+
+static int
+buffer_append(struct prepared_client* client, void* data, size_t length)
+{
+   if (buffer_ensure(&client->buffer, &client->buffer_size, client->buffer_length + length))
+   {
+      return 1;
+   }
+
+   memcpy(client->buffer + client->buffer_length, data, length);
+   client->buffer_length += length;
+
+   return 0;
+}
+
+static int
+buffer_flush(struct prepared_client* client, char* data, size_t* flushed, size_t offset)
+{
+   if (offset > *flushed)
+   {
+      if (buffer_append(client, data + *flushed, offset - *flushed))
+      {
+         return 1;
+      }
+      *flushed = offset;
+   }
+
+   return 0;
+}
+
+static int
+write_close(struct prepared_client* client, uint64_t hash)
+{
+   char name[STATEMENT_NAME_LENGTH];
+   char close[1 + 4 + 1 + STATEMENT_NAME_LENGTH];
+   size_t size;
+
+   statement_name(hash, &name[0]);
+   size = 1 + 4 + 1 + strlen(&name[0]) + 1;
+
+   memset(&close[0], 0, sizeof(close));
+   pgagroal_write_byte(&close[0], 'C');
+   pgagroal_write_int32(&close[1], size - 1);
+   pgagroal_write_byte(&close[5], 'S');
+   pgagroal_write_string(&close[6], &name[0]);
+
+   if (buffer_append(client, &close[0], size))
+   {
+      return 1;
+   }
+
+   return request_push(client, 'C', true, hash);
+}
+
+static int
+write_describe(struct prepared_client* client, uint64_t hash)
+{
+   char name[STATEMENT_NAME_LENGTH];
+   char describe[1 + 4 + 1 + STATEMENT_NAME_LENGTH];
+   size_t size;
+
+   statement_name(hash, &name[0]);
+   size = 1 + 4 + 1 + strlen(&name[0]) + 1;
+
+   memset(&describe[0], 0, sizeof(describe));
+   pgagroal_write_byte(&describe[0], 'D');
+   pgagroal_write_int32(&describe[1], size - 1);
+   pgagroal_write_byte(&describe[5], 'S');
+   pgagroal_write_string(&describe[6], &name[0]);
+
+   if (buffer_append(client, &describe[0], size))
+   {
+      return 1;
+   }
+
+   return request_push(client, 'D', true, hash);
+}
+
+static int
+write_prepare(struct prepared_client* client, struct prepared_slot* ps, struct prepared_statement* stmt, bool injected)
+{
+   uint64_t evicted;
+
+   /* Only called for a statement which the connection doesn't list */
+   evicted = slot_add(ps, stmt->hash);
+   if (evicted != 0 && write_close(client, evicted))
+   {
+      return 1;
+   }
+
+   /* The statement may exist although it isn't known, so it is closed first */
+   if (write_close(client, stmt->hash))
+   {
+      return 1;
+   }
+
+   if (buffer_append(client, &stmt->data[0], stmt->length))
+   {
+      return 1;
+   }
+
+   return request_push(client, 'P', injected, stmt->hash);
+}
+
+static int
+write_parse(struct prepared_client* client, uint64_t hash, char* query, size_t length)
+{
+   char server[STATEMENT_NAME_LENGTH];
+   char header[5];
+
+   statement_name(hash, &server[0]);
+
+   pgagroal_write_byte(&header[0], 'P');
+   pgagroal_write_int32(&header[1], 4 + strlen(&server[0]) + 1 + length);
+
+   if (buffer_append(client, &header[0], sizeof(header)) ||
+       buffer_append(client, &server[0], strlen(&server[0]) + 1) ||
+       buffer_append(client, query, length))
+   {
+      return 1;
+   }
+
+   return request_push(client, 'P', false, 0);
+}
+
+static int
+needed_bytes(char* data, size_t available)
+{
+   int total;
+   int nuls = 0;
+
+   if (available < 5)
+   {
+      return 5;
+   }
+
+   total = pgagroal_read_int32(data + 1) + 1;
+   if (total < 5)
+   {
+      return -1;
+   }
+
+   switch (pgagroal_read_byte(data))
+   {
+      case 'P':
+      case 'C':
+      case 'D':
+      case 'Q':
+         return total;
+      case 'B':
+         /* The portal and the statement */
+         for (int i = 5; i < total && (size_t)i < available; i++)
+         {
+            if (data[i] == '\0' && ++nuls == 2)
+            {
+               return i + 1;
+            }
+         }
+         return (size_t)total <= available ? total : (int)available + 1;
+      default:
+         return 5;
+   }
+}
+
+static int
+rewrite_parse(struct prepared_client* client, struct prepared_slot* ps, char* data, size_t* flushed, size_t offset, int total, int* handled)
+{
+   char* name = NULL;
+   char* query = NULL;
+   char server[STATEMENT_NAME_LENGTH];
+   size_t name_length;
+   size_t rest;
+   struct prepared_statement* stmt = NULL;
+
+   *handled = 0;
+
+   name = data + offset + 5;
+   name_length = strnlen(name, total - 5);
+   if (name_length == (size_t)(total - 5))
+   {
+      goto error;
+   }
+
+   query = name + name_length + 1;
+   rest = total - 5 - name_length - 1;
+
+   if (resets_statements(query, rest))
+   {
+      slot_clear(ps);
+   }
+
+   if (name_length == 0)
+   {
+      /* The unnamed statement is only used by the current transaction */
+      return request_push(client, 'P', false, 0);
+   }
+
+   stmt = (struct prepared_statement*)pgagroal_art_search(client->statements, name);
+   if (stmt != NULL)
+   {
+      /* The name is taken, so the Parse is sent under the name of the existing
+       * statement, which the server refuses as it already exists */
+      if (buffer_flush(client, data, flushed, offset))
+      {
+         goto error;
+      }
+
+      if (!slot_contains(ps, stmt->hash) && write_prepare(client, ps, stmt, true))
+      {
+         goto error;
+      }
+
+      if (write_parse(client, stmt->hash, query, rest))
+      {
+         goto error;
+      }
+
+      *handled = total;
+      *flushed = offset + total;
+
+      return 0;
+   }
+
+   stmt = (struct prepared_statement*)malloc(sizeof(struct prepared_statement) + 5 + STATEMENT_NAME_LENGTH + rest);
+   if (stmt == NULL)
+   {
+      goto error;
+   }
+
+   stmt->hash = statement_hash(name, total - 5);
+   statement_name(stmt->hash, &server[0]);
+   stmt->length = 5 + strlen(&server[0]) + 1 + rest;
+
+   pgagroal_write_byte(&stmt->data[0], 'P');
+   pgagroal_write_int32(&stmt->data[1], stmt->length - 1);
+   memcpy(&stmt->data[5], &server[0], strlen(&server[0]) + 1);
+   memcpy(&stmt->data[5 + strlen(&server[0]) + 1], query, rest);
+
+   if (pgagroal_art_insert(client->statements, name, (uintptr_t)stmt, ValueMem))
+   {
+      free(stmt);
+      goto error;
+   }
+
+   if (buffer_flush(client, data, flushed, offset))
+   {
+      goto error;
+   }
+
+   /* The connection has the statement already, so it is only described for the response */
+   if (slot_contains(ps, stmt->hash))
+   {
+      if (write_describe(client, stmt->hash))
+      {
+         goto error;
+      }
+   }
+   else if (write_prepare(client, ps, stmt, false))
+   {
+      goto error;
+   }
+
+   *handled = total;
+   *flushed = offset + total;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+rewrite_bind(struct prepared_client* client, struct prepared_slot* ps, char* data, size_t* flushed, size_t offset, int total, int need, int* handled)
+{
+   char* portal = NULL;
+   char* name = NULL;
+   size_t portal_length;
+   size_t name_length;
+   char server[STATEMENT_NAME_LENGTH];
+   char header[5];
+   struct prepared_statement* stmt = NULL;
+
+   *handled = 0;
+
+   portal = data + offset + 5;
+   portal_length = strnlen(portal, need - 5);
+   if (portal_length == (size_t)(need - 5))
+   {
+      return 0;
+   }
+
+   name = portal + portal_length + 1;
+   name_length = strnlen(name, need - 5 - portal_length - 1);
+   if (name_length == 0 || name_length == (size_t)(need - 5 - portal_length - 1))
+   {
+      return 0;
+   }
+
+   stmt = (struct prepared_statement*)pgagroal_art_search(client->statements, name);
+   if (stmt == NULL)
+   {
+      /* A statement from PREPARE, or one that doesn't exist */
+      return 0;
+   }
+
+   if (buffer_flush(client, data, flushed, offset))
+   {
+      return 1;
+   }
+
+   if (!slot_contains(ps, stmt->hash) && write_prepare(client, ps, stmt, true))
+   {
+      return 1;
+   }
+
+   statement_name(stmt->hash, &server[0]);
+
+   pgagroal_write_byte(&header[0], 'B');
+   pgagroal_write_int32(&header[1], total - 1 - name_length + strlen(&server[0]));
+
+   if (buffer_append(client, &header[0], sizeof(header)) ||
+       buffer_append(client, portal, portal_length + 1) ||
+       buffer_append(client, &server[0], strlen(&server[0]) + 1))
+   {
+      return 1;
+   }
+
+   *handled = need;
+   *flushed = offset + need;
+
+   return 0;
+}
+
+static int
+rewrite_statement(struct prepared_client* client, struct prepared_slot* ps, char* data, size_t* flushed, size_t offset, int total, int* handled)
+{
+   char kind;
+   char type = 0;
+   char* name = NULL;
+   char server[STATEMENT_NAME_LENGTH];
+   char header[6];
+   struct prepared_statement* stmt = NULL;
+
+   *handled = 0;
+
+   kind = pgagroal_read_byte(data + offset);
+   name = data + offset + 6;
+
+   if (total > 6)
+   {
+      type = pgagroal_read_byte(data + offset + 5);
+   }
+
+   if (type == 'S' && *name != '\0' && strnlen(name, total - 6) < (size_t)(total - 6))
+   {
+      stmt = (struct prepared_statement*)pgagroal_art_search(client->statements, name);
+   }
+
+   if (stmt == NULL)
+   {
+      /* The portals and the unnamed statement are only used by the current transaction */
+      return request_push(client, kind == 'C' ? 'C' : 'd', false, 0);
+   }
+
+   if (buffer_flush(client, data, flushed, offset))
+   {
+      return 1;
+   }
+
+   if (kind == 'D' && !slot_contains(ps, stmt->hash) && write_prepare(client, ps, stmt, true))
+   {
+      return 1;
+   }
+
+   statement_name(stmt->hash, &server[0]);
+
+   pgagroal_write_byte(&header[0], kind);
+   pgagroal_write_int32(&header[1], 4 + 1 + strlen(&server[0]) + 1);
+   pgagroal_write_byte(&header[5], 'S');
+
+   if (buffer_append(client, &header[0], sizeof(header)) ||
+       buffer_append(client, &server[0], strlen(&server[0]) + 1))
+   {
+      return 1;
+   }
+
+   if (kind == 'D' && request_push(client, 'd', false, 0))
+   {
+      return 1;
+   }
+
+   if (kind == 'C')
+   {
+      if (request_push(client, 'C', false, stmt->hash))
+      {
+         return 1;
+      }
+
+      slot_remove(ps, stmt->hash);
+      pgagroal_art_delete(client->statements, name);
+   }
+
+   *handled = total;
+   *flushed = offset + total;
+
+   return 0;
+}
+
+static bool
+server_response(struct prepared_client* client, char kind)
+{
+   bool injected;
+   struct prepared_request* r = NULL;
+
+   r = request_first(client);
+   if (r == NULL || r->kind != kind)
+   {
+      return false;
+   }
+
+   injected = r->injected;
+   request_pop(client);
+
+   return injected;
+}
+
+static int
+server_describe(struct prepared_client* client, char kind)
+{
+   struct prepared_request* r = NULL;
+
+   r = request_first(client);
+   if (r == NULL)
+   {
+      return DESCRIBE_KEEP;
+   }
+
+   /* A statement is described with a ParameterDescription, and then a RowDescription or NoData */
+   if (r->kind == 'd')
+   {
+      if (kind != 't')
+      {
+         request_pop(client);
+      }
+
+      return DESCRIBE_KEEP;
+   }
+
+   if (r->kind == 'D')
+   {
+      if (kind == 't')
+      {
+         return DESCRIBE_PARSED;
+      }
+
+      request_pop(client);
+
+      return DESCRIBE_DROP;
+   }
+
+   return DESCRIBE_KEEP;
+}
+
+static void
+server_error(struct prepared_client* client, struct prepared_slot* ps)
+{
+   struct prepared_request* r = NULL;
+
+   /* The server skips the requests until the next Sync, so their statements weren't created */
+   while ((r = request_first(client)) != NULL && r->kind != 'S')
+   {
+      if ((r->kind == 'P' || r->kind == 'D') && r->hash != 0)
+      {
+         slot_remove(ps, r->hash);
+      }
+
+      request_pop(client);
+   }
+}
+
+static void
+server_ready(struct prepared_client* client)
+{
+   struct prepared_request* r = NULL;
+
+   while ((r = request_first(client)) != NULL)
+   {
+      char kind = r->kind;
+
+      request_pop(client);
+
+      if (kind == 'S')
+      {
+         break;
+      }
+   }
+}
@@ -36,12 +36,15 @@
 #include <prometheus.h>
 #include <utils.h>
 #include <shmem.h>
+#include <worker.h>
 
 /* system */
 #include <ev.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <stddef.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <openssl/pem.h>
 #include <openssl/x509.h>
@@ -49,6 +52,10 @@
 #include <openssl/err.h>
 #include <time.h>
 #include <errno.h>
+#include <signal.h>
+#if HAVE_LINUX
+#include <sched.h>
+#endif
 
 #define CHUNK_SIZE                   32768
 
@@ -77,6 +84,53 @@
 
 #define CERT_EXPIRING_THRESHOLD_DAYS 30
 
+#define METRICS_IDLE_TIMEOUT         120
+#define METRICS_FLUSH_INTERVAL       10
+
+#define LATENCY_CLAIM_TIMEOUT        1000000ULL
+
+#define METRICS_CLIENT_PEEK          0
+#define METRICS_CLIENT_ACCEPT        1
+#define METRICS_CLIENT_READY         2
+/** @struct metrics_client
+ * A keep-alive client of the metrics server
+ */
+struct metrics_client
+{
+   struct worker_io io;              /**< The I/O watcher */
+   int state;                        /**< The state of the TLS handshake */
+   time_t active;                    /**< The time of the last request, or of the last write */
+   bool keep_alive;                  /**< Is the client kept after the response */
+   bool writing;                     /**< Is the I/O stopped until the response is written */
+   char* output;                     /**< The response waiting to be written */
+   size_t output_size;               /**< The size of the output */
+   size_t output_length;             /**< The length of the response */
+   size_t output_offset;             /**< The part of the response written */
+   bool closed;                      /**< Is the client disconnected */
+   struct metrics_client* previous;  /**< The previous client */
+   struct metrics_client* next;      /**< The next client */
+};
+
+static void metrics_accept_cb(struct io_watcher* watcher);
+static void metrics_client_cb(struct io_watcher* watcher);
+static void metrics_handshake(struct metrics_client* c);
+static void metrics_respond(struct metrics_client* c);
+static int metrics_flush(struct metrics_client* c);
+static void metrics_flush_cb(void);
+static int metrics_write(SSL* client_ssl, int client_fd, struct message* msg);
+static bool is_keep_alive(struct message* msg);
+static void metrics_disconnect(struct metrics_client* c);
+static void metrics_reap(void);
+static void metrics_idle_cb(void);
+static void metrics_signal_cb(void);
+
+static void latency_claim(struct prometheus_latency* latency, char* username, char* database);
+static bool latency_reference(struct prometheus_latency* latency, char* username, char* database);
+static bool latency_wait(struct prometheus_latency* latency, uint64_t* start);
+static int latency_match(char* username, char* database);
+static bool latency_reclaim_lock(void);
+static bool is_process_gone(pid_t pid);
+
 static int resolve_page(struct message* msg);
 static int badrequest_page(SSL* client_ssl, int client_fd);
 static int unknown_page(SSL* client_ssl, int client_fd);
@@ -92,6 +146,8 @@ static void general_vault_information(SSL* client_ssl, int client_fd);
 static void connection_information(SSL* client_ssl, int client_fd);
 static void limit_information(SSL* client_ssl, int client_fd);
 static void session_information(SSL* client_ssl, int client_fd);
+static void latency_information(SSL* client_ssl, int client_fd);
+static void acquire_information(SSL* client_ssl, int client_fd);
 static void pool_information(SSL* client_ssl, int client_fd);
 static void auth_information(SSL* client_ssl, int client_fd);
 static void client_information(SSL* client_ssl, int client_fd);
@@ -105,130 +161,677 @@ static void certificate_information(SSL* client_ssl, int client_fd);
 static int send_chunk(SSL* cilent_ssl, int client_fd, char* data);
 
 static bool is_metrics_cache_configured(void);
-static bool is_metrics_cache_valid(void);
+static bool is_metrics_cache_valid(int index);
+static int metrics_cache_acquire(void);
+static void metrics_cache_release(int index);
+static bool metrics_cache_begin(void);
 static bool metrics_cache_append(char* data);
+static int metrics_cache_send(SSL* client_ssl, int client_fd, int index);
 static bool metrics_cache_finalize(void);
+static void metrics_cache_abort(void);
 static size_t metrics_cache_size_to_alloc(void);
 static void metrics_cache_invalidate(void);
 static bool is_prometheus_enabled(void);
+static struct prometheus_shard* prometheus_shard(struct main_prometheus* prometheus);
+static unsigned long long prometheus_shard_sum(struct main_prometheus* prometheus, size_t offset);
+static uint64_t latency_percentile(atomic_ullong* buckets, double percentile);
+static char* latency_histogram(char* data, char* name, char* labels, atomic_ullong* buckets, unsigned long long sum);
+
+static struct io_watcher* metrics_watchers = NULL;
+static int metrics_watchers_length = 0;
+static struct metrics_client* metrics_clients = NULL;
+static struct metrics_client* metrics_closed_clients = NULL;
+static struct metrics_client* metrics_reaped_clients = NULL;
+static struct metrics_client* metrics_output = NULL;
+static struct periodic_watcher metrics_flush_watcher;
+static bool metrics_flushing = false;
+static bool cache_writer = false;
+static int cache_index = -1;
 
 void
-pgagroal_prometheus(SSL* client_ssl, int client_fd)
+pgagroal_prometheus_server(int* fds, int fds_length, char** argv)
+{
+   struct signal_watcher signal_watcher;
+   struct periodic_watcher idle;
+
+   pgagroal_start_logging();
+   pgagroal_memory_init();
+
+   pgagroal_set_proc_title(1, argv, "metrics", NULL);
+
+   if (!is_prometheus_enabled())
+   {
+      goto error;
+   }
+
+   if (pgagroal_event_loop_init() == NULL)
+   {
+      pgagroal_log_fatal("pgagroal: Failed to create loop for the metrics server");
+      goto error;
+   }
+
+   metrics_watchers = (struct io_watcher*)calloc(fds_length, sizeof(struct io_watcher));
+   if (metrics_watchers == NULL)
+   {
+      pgagroal_log_fatal("pgagroal: Couldn't allocate memory for the metrics server");
+      goto error;
+   }
+   metrics_watchers_length = fds_length;
+
+   for (int i = 0; i < fds_length; i++)
+   {
+      pgagroal_event_accept_init(&metrics_watchers[i], *(fds + i), metrics_accept_cb);
+      pgagroal_io_start(&metrics_watchers[i]);
+   }
+
+   pgagroal_signal_init(&signal_watcher, metrics_signal_cb, SIGQUIT);
+   pgagroal_signal_start(&signal_watcher);
+
+   memset(&idle, 0, sizeof(struct periodic_watcher));
+   pgagroal_periodic_init(&idle, metrics_idle_cb, 1000);
+   pgagroal_periodic_start(&idle);
+
+   pgagroal_log_debug("pgagroal: Metrics server (%d)", getpid());
+
+   pgagroal_event_loop_run();
+
+   if (metrics_flushing)
+   {
+      pgagroal_periodic_stop(&metrics_flush_watcher);
+      metrics_flushing = false;
+   }
+
+   while (metrics_clients != NULL)
+   {
+      metrics_disconnect(metrics_clients);
+   }
+
+   metrics_reap();
+   metrics_reap();
+
+   for (int i = 0; i < metrics_watchers_length; i++)
+   {
+      pgagroal_io_stop(&metrics_watchers[i]);
+      pgagroal_disconnect(*(fds + i));
+   }
+
+   free(metrics_watchers);
+   metrics_watchers = NULL;
+   metrics_watchers_length = 0;
+
+   pgagroal_event_loop_destroy();
+
+   pgagroal_memory_destroy();
+   pgagroal_stop_logging();
+
+   exit(0);
+
+error:
+
+   free(metrics_watchers);
+   metrics_watchers = NULL;
+   metrics_watchers_length = 0;
+
+   pgagroal_memory_destroy();
+   pgagroal_stop_logging();
+
+   exit(1);
+}
+
+static void
+metrics_accept_cb(struct io_watcher* watcher)
+{
+   int client_fd;
+   SSL_CTX* ctx = NULL;
+   SSL* client_ssl = NULL;
+   struct metrics_client* c = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   client_fd = watcher->fds.main.client_fd;
+
+   if (client_fd == -1)
+   {
+      pgagroal_log_debug("accept: %s (%d)", strerror(errno), client_fd);
+      errno = 0;
+      return;
+   }
+
+   pgagroal_prometheus_self_sockets_add();
+
+   if (strlen(config->common.metrics_cert_file) > 0 && strlen(config->common.metrics_key_file) > 0)
+   {
+      if (pgagroal_create_ssl_ctx(false, &ctx))
+      {
+         pgagroal_log_error("Could not create metrics SSL context");
+         goto error;
+      }
+
+      if (pgagroal_create_ssl_server(ctx, config->common.metrics_key_file, config->common.metrics_cert_file, config->common.metrics_ca_file, client_fd, &client_ssl))
+      {
+         pgagroal_log_error("Could not create metrics SSL server");
+         SSL_CTX_free(ctx);
+         goto error;
+      }
+   }
+
+   /* The handshake and the responses are driven by the events of the client, so a slow client doesn't stall the others */
+   if (pgagroal_socket_nonblocking(client_fd, true))
+   {
+      goto error;
+   }
+
+   c = (struct metrics_client*)calloc(1, sizeof(struct metrics_client));
+   if (c == NULL)
+   {
+      pgagroal_log_error("Couldn't allocate memory for a metrics client");
+      goto error;
+   }
+
+   pgagroal_event_worker_init(&c->io.io, client_fd, client_fd, metrics_client_cb);
+   c->io.client_fd = client_fd;
+   c->io.server_fd = -1;
+   c->io.slot = -1;
+   c->io.client_ssl = client_ssl;
+   c->state = client_ssl != NULL ? METRICS_CLIENT_PEEK : METRICS_CLIENT_READY;
+   c->active = time(NULL);
+
+   if (pgagroal_io_start(&c->io.io))
+   {
+      free(c);
+      goto error;
+   }
+
+   c->next = metrics_clients;
+   if (metrics_clients != NULL)
+   {
+      metrics_clients->previous = c;
+   }
+   metrics_clients = c;
+
+   return;
+
+error:
+
+   pgagroal_close_ssl(client_ssl);
+   pgagroal_disconnect(client_fd);
+   pgagroal_prometheus_self_sockets_sub();
+}
+
+static void
+metrics_client_cb(struct io_watcher* watcher)
 {
    int status;
    int page;
+   bool keep_alive;
    struct message* msg = NULL;
-   struct main_configuration* config;
+   struct metrics_client* c = NULL;
 
-   if (!is_prometheus_enabled())
+   c = (struct metrics_client*)watcher;
+
+   if (c->closed)
    {
-      exit(1);
+      /* A stale event for a client that was disconnected earlier in the same batch */
+      return;
    }
 
-   pgagroal_start_logging();
-   pgagroal_memory_init();
+   if (c->state != METRICS_CLIENT_READY)
+   {
+      metrics_handshake(c);
+      return;
+   }
 
-   config = (struct main_configuration*)shmem;
+   status = pgagroal_recv_message(watcher, &msg);
+   if (status != MESSAGE_STATUS_OK)
+   {
+      metrics_disconnect(c);
+      return;
+   }
+
+   c->active = time(NULL);
+
+   /* resolve_page() terminates the path, so the headers are checked first */
+   keep_alive = is_keep_alive(msg);
 
-   if (client_ssl)
+   page = resolve_page(msg);
+
+   /* The page is rendered into the output of the client, see metrics_write */
+   metrics_output = c;
+
+   if (page == PAGE_HOME)
+   {
+      status = home_page(c->io.client_ssl, c->io.client_fd);
+   }
+   else if (page == PAGE_METRICS)
+   {
+      status = metrics_page(c->io.client_ssl, c->io.client_fd) ? MESSAGE_STATUS_ERROR : MESSAGE_STATUS_OK;
+   }
+   else if (page == PAGE_UNKNOWN)
    {
-      if (pgagroal_is_ssl_request(client_fd))
+      unknown_page(c->io.client_ssl, c->io.client_fd);
+      keep_alive = false;
+   }
+   else
+   {
+      bad_request(c->io.client_ssl, c->io.client_fd);
+      keep_alive = false;
+   }
+
+   metrics_output = NULL;
+
+   if (status != MESSAGE_STATUS_OK)
+   {
+      metrics_disconnect(c);
+      return;
+   }
+
+   c->keep_alive = keep_alive;
+
+   metrics_respond(c);
+}
+
+static void
+metrics_respond(struct metrics_client* c)
+{
+   int ret;
+
+   ret = metrics_flush(c);
+
+   if (ret == 1)
+   {
+      /* The rest is written once the client reads it, and no request is read meanwhile */
+      pgagroal_io_stop(&c->io.io);
+      c->writing = true;
+
+      if (!metrics_flushing)
       {
-         if (SSL_accept(client_ssl) <= 0)
-         {
-            pgagroal_log_error("Failed to accept SSL connection");
-            goto error;
-         }
+         memset(&metrics_flush_watcher, 0, sizeof(struct periodic_watcher));
+         pgagroal_periodic_init(&metrics_flush_watcher, metrics_flush_cb, METRICS_FLUSH_INTERVAL);
+         pgagroal_periodic_start(&metrics_flush_watcher);
+         metrics_flushing = true;
       }
-      else
+
+      return;
+   }
+
+   if (ret == -1 || !c->keep_alive)
+   {
+      metrics_disconnect(c);
+   }
+}
+
+static int
+metrics_flush(struct metrics_client* c)
+{
+   ssize_t numbytes;
+   int flags = 0;
+
+#ifdef MSG_NOSIGNAL
+   /* The client may be gone */
+   flags = MSG_NOSIGNAL;
+#endif
+
+   while (c->output_offset < c->output_length)
+   {
+      if (c->io.client_ssl != NULL)
       {
-         char* path = "/";
-         char* base_url = NULL;
+         /* A retry has to use the same arguments */
+         numbytes = SSL_write(c->io.client_ssl, c->output + c->output_offset, c->output_length - c->output_offset);
 
-         if (pgagroal_read_timeout_message(NULL, client_fd, config->common.authentication_timeout, &msg) != MESSAGE_STATUS_OK)
+         if (numbytes <= 0)
          {
-            pgagroal_log_error("Failed to read message");
-            goto error;
+            int err = SSL_get_error(c->io.client_ssl, numbytes);
+
+            if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ)
+            {
+               errno = 0;
+               return 1;
+            }
+
+            pgagroal_log_debug("pgagroal: Metrics client %d: SSL error %d", c->io.client_fd, err);
+            errno = 0;
+            return -1;
          }
+      }
+      else
+      {
+         numbytes = send(c->io.client_fd, c->output + c->output_offset, c->output_length - c->output_offset, flags);
 
-         char* path_start = strstr(msg->data, " ");
-         if (path_start)
+         if (numbytes == -1)
          {
-            path_start++;
-            char* path_end = strstr(path_start, " ");
-            if (path_end)
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
             {
-               *path_end = '\0';
-               path = path_start;
+               errno = 0;
+               return 1;
             }
+
+            pgagroal_log_debug("pgagroal: Metrics client %d: %s", c->io.client_fd, strerror(errno));
+            errno = 0;
+            return -1;
          }
+      }
+
+      c->output_offset += numbytes;
+      c->active = time(NULL);
+   }
+
+   c->output_length = 0;
+   c->output_offset = 0;
+
+   return 0;
+}
+
+static void
+metrics_flush_cb(void)
+{
+   int ret;
+   bool pending = false;
+   struct metrics_client* c = NULL;
+   struct metrics_client* next = NULL;
+
+   c = metrics_clients;
+   while (c != NULL)
+   {
+      next = c->next;
 
-         base_url = pgagroal_format_and_append(base_url, "https://localhost:%d%s", config->common.metrics, path);
+      if (c->writing)
+      {
+         ret = metrics_flush(c);
 
-         if (redirect_page(NULL, client_fd, base_url) != MESSAGE_STATUS_OK)
+         if (ret == 1)
          {
-            pgagroal_log_error("Failed to redirect to: %s", base_url);
-            free(base_url);
-            goto error;
+            pending = true;
+         }
+         else if (ret == -1 || !c->keep_alive)
+         {
+            metrics_disconnect(c);
+         }
+         else if (pgagroal_io_start(&c->io.io))
+         {
+            metrics_disconnect(c);
          }
+         else
+         {
+            c->writing = false;
+         }
+      }
 
-         pgagroal_close_ssl(client_ssl);
-         pgagroal_disconnect(client_fd);
+      c = next;
+   }
+
+   if (!pending)
+   {
+      pgagroal_periodic_stop(&metrics_flush_watcher);
+      metrics_flushing = false;
+   }
+}
+
+static int
+metrics_write(SSL* client_ssl, int client_fd, struct message* msg)
+{
+   size_t size;
+   char* output = NULL;
+   struct metrics_client* c = metrics_output;
+
+   /* Outside of the metrics server, as for the vault, the page is written as it is rendered */
+   if (c == NULL)
+   {
+      return pgagroal_write_message(client_ssl, client_fd, msg);
+   }
 
-         pgagroal_memory_destroy();
-         pgagroal_stop_logging();
+   if (c->output_length + msg->length > c->output_size)
+   {
+      size = c->output_size > 0 ? c->output_size : 8192;
 
-         free(base_url);
+      while (size < c->output_length + msg->length)
+      {
+         size *= 2;
+      }
 
-         exit(0);
+      output = (char*)realloc(c->output, size);
+      if (output == NULL)
+      {
+         pgagroal_log_error("Couldn't allocate memory for a metrics response");
+         return MESSAGE_STATUS_ERROR;
       }
+
+      c->output = output;
+      c->output_size = size;
    }
 
-   status = pgagroal_read_timeout_message(client_ssl, client_fd, config->common.authentication_timeout, &msg);
-   if (status != MESSAGE_STATUS_OK)
+   memcpy(c->output + c->output_length, msg->data, msg->length);
+   c->output_length += msg->length;
+
+   return MESSAGE_STATUS_OK;
+}
+
+static void
+metrics_handshake(struct metrics_client* c)
+{
+   int ret;
+   bool ssl_request = false;
+   ssize_t length;
+   char request[MAX_PATH];
+   char* path = "/";
+   char* path_start = NULL;
+   char* path_end = NULL;
+   char* base_url = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   if (c->state == METRICS_CLIENT_PEEK)
+   {
+      ret = pgagroal_is_ssl_request(c->io.client_fd, false, &ssl_request);
+
+      if (ret == 1)
+      {
+         return;
+      }
+      else if (ret)
+      {
+         goto error;
+      }
+
+      if (!ssl_request)
+      {
+         goto redirect;
+      }
+
+      c->state = METRICS_CLIENT_ACCEPT;
+   }
+
+   ret = SSL_accept(c->io.client_ssl);
+   if (ret <= 0)
    {
+      int err = SSL_get_error(c->io.client_ssl, ret);
+
+      /* The rest of the handshake follows with the next data of the client */
+      if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+      {
+         errno = 0;
+         return;
+      }
+
+      pgagroal_log_error("Failed to accept SSL connection");
       goto error;
    }
 
-   page = resolve_page(msg);
+   c->state = METRICS_CLIENT_READY;
+   c->active = time(NULL);
 
-   if (page == PAGE_HOME)
+   return;
+
+redirect:
+
+   /* A plain HTTP request on the TLS port is redirected */
+   memset(&request[0], 0, sizeof(request));
+   length = recv(c->io.client_fd, &request[0], sizeof(request) - 1, MSG_DONTWAIT);
+   if (length <= 0)
    {
-      home_page(client_ssl, client_fd);
+      pgagroal_log_error("Failed to read message");
+      errno = 0;
+      goto error;
    }
-   else if (page == PAGE_METRICS)
+
+   path_start = strstr(&request[0], " ");
+   if (path_start)
    {
-      metrics_page(client_ssl, client_fd);
+      path_start++;
+      path_end = strstr(path_start, " ");
+      if (path_end)
+      {
+         *path_end = '\0';
+         path = path_start;
+      }
    }
-   else if (page == PAGE_UNKNOWN)
+
+   base_url = pgagroal_format_and_append(base_url, "https://localhost:%d%s", config->common.metrics, path);
+
+   if (redirect_page(NULL, c->io.client_fd, base_url) != MESSAGE_STATUS_OK)
    {
-      unknown_page(client_ssl, client_fd);
+      pgagroal_log_error("Failed to redirect to: %s", base_url);
+   }
+
+   free(base_url);
+
+error:
+
+   metrics_disconnect(c);
+}
+
+static bool
+is_keep_alive(struct message* msg)
+{
+   char* request = NULL;
+   char* headers = NULL;
+   bool keep_alive = false;
+
+   request = strndup((char*)msg->data, msg->length);
+   if (request == NULL)
+   {
+      return false;
+   }
+
+   headers = strstr(request, "\r\n");
+   if (headers != NULL)
+   {
+      *headers = '\0';
+      headers += 2;
+
+      /* HTTP/1.1 keeps the connection open unless the client asks to close it */
+      keep_alive = strstr(request, "HTTP/1.1") != NULL && strcasestr(headers, "Connection: close") == NULL;
+   }
+
+   free(request);
+
+   return keep_alive;
+}
+
+static void
+metrics_disconnect(struct metrics_client* c)
+{
+   if (c->closed)
+   {
+      return;
+   }
+
+   /* The I/O of a client writing its response is stopped already */
+   if (!c->writing)
+   {
+      pgagroal_io_stop(&c->io.io);
+   }
+
+   free(c->output);
+   c->output = NULL;
+   c->output_size = 0;
+   c->output_length = 0;
+   c->output_offset = 0;
+
+   pgagroal_close_ssl(c->io.client_ssl);
+   c->io.client_ssl = NULL;
+   pgagroal_disconnect(c->io.client_fd);
+   pgagroal_prometheus_self_sockets_sub();
+
+   c->closed = true;
+
+   if (c->previous != NULL)
+   {
+      c->previous->next = c->next;
    }
    else
    {
-      bad_request(client_ssl, client_fd);
+      metrics_clients = c->next;
    }
 
-   pgagroal_close_ssl(client_ssl);
-   pgagroal_disconnect(client_fd);
+   if (c->next != NULL)
+   {
+      c->next->previous = c->previous;
+   }
 
-   pgagroal_memory_destroy();
-   pgagroal_stop_logging();
+   /* The loop may still hold events for the client, so it is freed later */
+   c->previous = NULL;
+   c->next = metrics_closed_clients;
+   metrics_closed_clients = c;
+}
 
-   exit(0);
+static void
+metrics_reap(void)
+{
+   struct metrics_client* c = NULL;
 
-error:
+   /* Clients are freed one period after they were closed, so no event batch refers to them */
+   while (metrics_reaped_clients != NULL)
+   {
+      c = metrics_reaped_clients;
+      metrics_reaped_clients = c->next;
+      free(c);
+   }
+
+   metrics_reaped_clients = metrics_closed_clients;
+   metrics_closed_clients = NULL;
+}
+
+static void
+metrics_idle_cb(void)
+{
+   time_t now;
+   struct metrics_client* c = NULL;
+   struct metrics_client* next = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   now = time(NULL);
+
+   c = metrics_clients;
+   while (c != NULL)
+   {
+      next = c->next;
 
-   badrequest_page(client_ssl, client_fd);
+      if (difftime(now, c->active) >= METRICS_IDLE_TIMEOUT)
+      {
+         pgagroal_log_debug("pgagroal: Metrics client %d idle", c->io.client_fd);
+         metrics_disconnect(c);
+      }
+      else if (c->state != METRICS_CLIENT_READY && config->common.authentication_timeout > 0 &&
+               difftime(now, c->active) >= config->common.authentication_timeout)
+      {
+         pgagroal_log_debug("pgagroal: Metrics client %d didn't complete the handshake", c->io.client_fd);
+         metrics_disconnect(c);
+      }
 
-   pgagroal_log_debug("pgagroal_prometheus: disconnect %d", client_fd);
-   pgagroal_close_ssl(client_ssl);
-   pgagroal_disconnect(client_fd);
+      c = next;
+   }
 
-   pgagroal_memory_destroy();
-   pgagroal_stop_logging();
+   metrics_reap();
+}
 
-   exit(1);
+static void
+metrics_signal_cb(void)
+{
+   pgagroal_event_loop_break();
 }
 
 void
@@ -353,11 +956,41 @@ pgagroal_init_prometheus(size_t* p_size, void** p_shmem)
    atomic_init(&prometheus->client_active, 0);
    atomic_init(&prometheus->client_wait_time, 0);
 
-   atomic_init(&prometheus->query_count, 0);
-   atomic_init(&prometheus->tx_count, 0);
+   for (int i = 0; i < PROMETHEUS_SHARDS; i++)
+   {
+      atomic_init(&prometheus->shards[i].query_count, 0);
+      atomic_init(&prometheus->shards[i].tx_count, 0);
+      atomic_init(&prometheus->shards[i].network_sent, 0);
+      atomic_init(&prometheus->shards[i].network_received, 0);
+   }
+
+   for (int i = 0; i < NUMBER_OF_LATENCIES; i++)
+   {
+      atomic_init(&prometheus->latencies[i].state, LATENCY_FREE);
+      atomic_init(&prometheus->latencies[i].claimer, 0);
+      atomic_init(&prometheus->latencies[i].references, 0);
+      memset(&prometheus->latencies[i].username[0], 0, MAX_USERNAME_LENGTH);
+      memset(&prometheus->latencies[i].database[0], 0, MAX_DATABASE_LENGTH);
+      for (int j = 0; j < LATENCY_BUCKETS; j++)
+      {
+         atomic_init(&prometheus->latencies[i].buckets[j], 0);
+      }
+      atomic_init(&prometheus->latencies[i].count, 0);
+      atomic_init(&prometheus->latencies[i].sum, 0);
+   }
+   atomic_init(&prometheus->latency_reclaimer, 0);
 
-   atomic_init(&prometheus->network_sent, 0);
-   atomic_init(&prometheus->network_received, 0);
+   for (int i = 0; i < NUMBER_OF_LIMITS + 1; i++)
+   {
+      for (int j = 0; j < LATENCY_BUCKETS; j++)
+      {
+         atomic_init(&prometheus->acquires[i].buckets[j], 0);
+      }
+      atomic_init(&prometheus->acquires[i].sum, 0);
+      atomic_init(&prometheus->acquires[i].hit, 0);
+      atomic_init(&prometheus->acquires[i].wait, 0);
+      atomic_init(&prometheus->acquires[i].timeout, 0);
+   }
 
    atomic_init(&prometheus->prometheus_base.client_sockets, 0);
    atomic_init(&prometheus->prometheus_base.self_sockets, 0);
@@ -519,6 +1152,169 @@ pgagroal_prometheus_session_time(double time)
    }
 }
 
+int
+pgagroal_prometheus_query_latency_index(char* username, char* database)
+{
+   int index;
+   int references;
+   int state;
+   struct main_prometheus* prometheus;
+   struct prometheus_latency* latency;
+
+   if (!is_prometheus_enabled())
+   {
+      return -1;
+   }
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   index = latency_match(username, database);
+   if (index != -2)
+   {
+      return index;
+   }
+
+   /* All entries are claimed, so an entry without clients is reused. The reuse is
+      serialized such that two processes don't create the same user and database twice */
+   if (!latency_reclaim_lock())
+   {
+      return -1;
+   }
+
+   index = latency_match(username, database);
+
+   for (int i = 0; index == -2 && i < NUMBER_OF_LATENCIES; i++)
+   {
+      latency = &prometheus->latencies[i];
+      references = 0;
+
+      if (atomic_load(&latency->state) != LATENCY_READY ||
+          !atomic_compare_exchange_strong(&latency->references, &references, -1))
+      {
+         continue;
+      }
+
+      state = LATENCY_READY;
+      if (!atomic_compare_exchange_strong(&latency->state, &state, LATENCY_CLAIMING))
+      {
+         atomic_store(&latency->references, 0);
+         continue;
+      }
+
+      for (int j = 0; j < LATENCY_BUCKETS; j++)
+      {
+         atomic_store(&latency->buckets[j], 0);
+      }
+      atomic_store(&latency->count, 0);
+      atomic_store(&latency->sum, 0);
+
+      latency_claim(latency, username, database);
+
+      index = i;
+   }
+
+   atomic_store(&prometheus->latency_reclaimer, 0);
+
+   return index == -2 ? -1 : index;
+}
+
+void
+pgagroal_prometheus_query_latency_release(int index)
+{
+   struct main_prometheus* prometheus;
+
+   if (index < 0 || index >= NUMBER_OF_LATENCIES || !is_prometheus_enabled())
+   {
+      return;
+   }
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   atomic_fetch_sub(&prometheus->latencies[index].references, 1);
+}
+
+void
+pgagroal_prometheus_query_latency(int index, uint64_t micros)
+{
+   struct main_prometheus* prometheus;
+   struct prometheus_latency* latency;
+
+   if (index < 0 || index >= NUMBER_OF_LATENCIES || !is_prometheus_enabled())
+   {
+      return;
+   }
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+   latency = &prometheus->latencies[index];
+
+   atomic_fetch_add_explicit(&latency->buckets[pgagroal_latency_bucket(micros)], 1, memory_order_relaxed);
+   atomic_fetch_add_explicit(&latency->sum, micros, memory_order_relaxed);
+   atomic_fetch_add_explicit(&latency->count, 1, memory_order_relaxed);
+}
+
+uint64_t
+pgagroal_prometheus_query_latency_percentile(int index, double percentile)
+{
+   struct main_prometheus* prometheus;
+
+   if (index < 0 || index >= NUMBER_OF_LATENCIES || !is_prometheus_enabled())
+   {
+      return 0;
+   }
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   return latency_percentile(&prometheus->latencies[index].buckets[0], percentile);
+}
+
+void
+pgagroal_prometheus_connection_acquire(int limit_index, int result, uint64_t micros)
+{
+   struct main_prometheus* prometheus;
+   struct prometheus_acquire* acquire;
+
+   if (limit_index >= NUMBER_OF_LIMITS || !is_prometheus_enabled())
+   {
+      return;
+   }
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+   acquire = &prometheus->acquires[limit_index >= 0 ? limit_index : NUMBER_OF_LIMITS];
+
+   switch (result)
+   {
+      case ACQUIRE_HIT:
+         atomic_fetch_add_explicit(&acquire->hit, 1, memory_order_relaxed);
+         break;
+      case ACQUIRE_WAIT:
+         atomic_fetch_add_explicit(&acquire->wait, 1, memory_order_relaxed);
+         break;
+      case ACQUIRE_TIMEOUT:
+         atomic_fetch_add_explicit(&acquire->timeout, 1, memory_order_relaxed);
+         return;
+      default:
+         return;
+   }
+
+   atomic_fetch_add_explicit(&acquire->buckets[pgagroal_latency_bucket(micros)], 1, memory_order_relaxed);
+   atomic_fetch_add_explicit(&acquire->sum, micros, memory_order_relaxed);
+}
+
+uint64_t
+pgagroal_prometheus_connection_acquire_percentile(int limit_index, double percentile)
+{
+   struct main_prometheus* prometheus;
+
+   if (limit_index >= NUMBER_OF_LIMITS || !is_prometheus_enabled())
+   {
+      return 0;
+   }
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   return latency_percentile(&prometheus->acquires[limit_index >= 0 ? limit_index : NUMBER_OF_LIMITS].buckets[0], percentile);
+}
+
 void
 pgagroal_prometheus_connection_error(void)
 {
@@ -844,7 +1640,7 @@ pgagroal_prometheus_query_count_add(void)
 
    prometheus = (struct main_prometheus*)prometheus_shmem;
 
-   atomic_fetch_add(&prometheus->query_count, 1);
+   atomic_fetch_add_explicit(&prometheus_shard(prometheus)->query_count, 1, memory_order_relaxed);
 }
 
 void
@@ -889,7 +1685,7 @@ pgagroal_prometheus_tx_count_add(void)
 
    prometheus = (struct main_prometheus*)prometheus_shmem;
 
-   atomic_fetch_add(&prometheus->tx_count, 1);
+   atomic_fetch_add_explicit(&prometheus_shard(prometheus)->tx_count, 1, memory_order_relaxed);
 }
 
 void
@@ -904,7 +1700,7 @@ pgagroal_prometheus_network_sent_add(ssize_t s)
 
    prometheus = (struct main_prometheus*)prometheus_shmem;
 
-   atomic_fetch_add(&prometheus->network_sent, s);
+   atomic_fetch_add_explicit(&prometheus_shard(prometheus)->network_sent, s, memory_order_relaxed);
 }
 
 void
@@ -919,7 +1715,7 @@ pgagroal_prometheus_network_received_add(ssize_t s)
 
    prometheus = (struct main_prometheus*)prometheus_shmem;
 
-   atomic_fetch_add(&prometheus->network_received, s);
+   atomic_fetch_add_explicit(&prometheus_shard(prometheus)->network_received, s, memory_order_relaxed);
 }
 
 void
@@ -1037,11 +1833,36 @@ pgagroal_prometheus_clear(void)
    atomic_store(&prometheus->client_wait, 0);
    atomic_store(&prometheus->client_wait_time, 0);
 
-   atomic_store(&prometheus->query_count, 0);
-   atomic_store(&prometheus->tx_count, 0);
+   for (int i = 0; i < PROMETHEUS_SHARDS; i++)
+   {
+      atomic_store(&prometheus->shards[i].query_count, 0);
+      atomic_store(&prometheus->shards[i].tx_count, 0);
+      atomic_store(&prometheus->shards[i].network_sent, 0);
+      atomic_store(&prometheus->shards[i].network_received, 0);
+   }
+
+   // the entries stay claimed since the workers keep their index
+   for (int i = 0; i < NUMBER_OF_LATENCIES; i++)
+   {
+      for (int j = 0; j < LATENCY_BUCKETS; j++)
+      {
+         atomic_store(&prometheus->latencies[i].buckets[j], 0);
+      }
+      atomic_store(&prometheus->latencies[i].count, 0);
+      atomic_store(&prometheus->latencies[i].sum, 0);
+   }
 
-   atomic_store(&prometheus->network_sent, 0);
-   atomic_store(&prometheus->network_received, 0);
+   for (int i = 0; i < NUMBER_OF_LIMITS + 1; i++)
+   {
+      for (int j = 0; j < LATENCY_BUCKETS; j++)
+      {
+         atomic_store(&prometheus->acquires[i].buckets[j], 0);
+      }
+      atomic_store(&prometheus->acquires[i].sum, 0);
+      atomic_store(&prometheus->acquires[i].hit, 0);
+      atomic_store(&prometheus->acquires[i].wait, 0);
+      atomic_store(&prometheus->acquires[i].timeout, 0);
+   }
 
    atomic_store(&prometheus->prometheus_base.client_sockets, 0);
    atomic_store(&prometheus->prometheus_base.self_sockets, 0);
@@ -1179,7 +2000,7 @@ redirect_page(SSL* client_ssl, int client_fd, char* path)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_write(client_ssl, client_fd, &msg);
 
    free(data);
 
@@ -1247,7 +2068,7 @@ badrequest_page(SSL* client_ssl, int client_fd)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_write(client_ssl, client_fd, &msg);
 
    free(data);
 
@@ -1281,7 +2102,7 @@ unknown_page(SSL* client_ssl, int client_fd)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_write(client_ssl, client_fd, &msg);
 
    free(data);
 
@@ -1337,7 +2158,7 @@ home_page(SSL* client_ssl, int client_fd)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_write(client_ssl, client_fd, &msg);
    if (status != MESSAGE_STATUS_OK)
    {
       goto done;
@@ -1420,6 +2241,9 @@ home_page(SSL* client_ssl, int client_fd)
    data = pgagroal_append(data, "  <h2>pgagroal_logging_fatal</h2>\n");
    data = pgagroal_append(data, "  The number of FATAL logging statements\n");
    data = pgagroal_append(data, "  <p>\n");
+   data = pgagroal_append(data, "  <h2>pgagroal_logging_dropped</h2>\n");
+   data = pgagroal_append(data, "  The number of logging statements dropped by the log writer\n");
+   data = pgagroal_append(data, "  <p>\n");
    data = pgagroal_append(data, "  <h2>pgagroal_server_error</h2>\n");
    data = pgagroal_append(data, "  <p>\n");
    data = pgagroal_append(data, "   Errors for servers\n");
@@ -1580,10 +2404,64 @@ home_page(SSL* client_ssl, int client_fd)
    data = pgagroal_append(data, "       </tr>\n");
    data = pgagroal_append(data, "     </tbody>\n");
    data = pgagroal_append(data, "   </table>\n");
+   data = pgagroal_append(data, "  <h2>pgagroal_connection_acquire_seconds</h2>\n");
+   data = pgagroal_append(data, "  <p>\n");
+   data = pgagroal_append(data, "   Histogram of the wait times of the acquired connections per limit rule\n");
+   data = pgagroal_append(data, "  </p>\n");
+   data = pgagroal_append(data, "  <table>\n");
+   data = pgagroal_append(data, "    <tbody>\n");
+   data = pgagroal_append(data, "      <tr>\n");
+   data = pgagroal_append(data, "        <td>rule</td>\n");
+   data = pgagroal_append(data, "        <td>The limit rule, or -1 without a rule</td>\n");
+   data = pgagroal_append(data, "      </tr>\n");
+   data = pgagroal_append(data, "      <tr>\n");
+   data = pgagroal_append(data, "        <td>user</td>\n");
+   data = pgagroal_append(data, "        <td>The user name</td>\n");
+   data = pgagroal_append(data, "      </tr>\n");
+   data = pgagroal_append(data, "      <tr>\n");
+   data = pgagroal_append(data, "        <td>database</td>\n");
+   data = pgagroal_append(data, "        <td>The database</td>\n");
+   data = pgagroal_append(data, "      </tr>\n");
+   data = pgagroal_append(data, "    </tbody>\n");
+   data = pgagroal_append(data, "  </table>\n");
+   data = pgagroal_append(data, "  <h2>pgagroal_connection_acquire</h2>\n");
+   data = pgagroal_append(data, "  <p>\n");
+   data = pgagroal_append(data, "   The number of acquisitions per limit rule and result\n");
+   data = pgagroal_append(data, "  </p>\n");
+   data = pgagroal_append(data, "  <table>\n");
+   data = pgagroal_append(data, "    <tbody>\n");
+   data = pgagroal_append(data, "      <tr>\n");
+   data = pgagroal_append(data, "        <td>result</td>\n");
+   data = pgagroal_append(data, "        <td>\n");
+   data = pgagroal_append(data, "          <ul>\n");
+   data = pgagroal_append(data, "            <li>hit</li>\n");
+   data = pgagroal_append(data, "            <li>wait</li>\n");
+   data = pgagroal_append(data, "            <li>timeout</li>\n");
+   data = pgagroal_append(data, "          </ul>\n");
+   data = pgagroal_append(data, "        </td>\n");
+   data = pgagroal_append(data, "      </tr>\n");
+   data = pgagroal_append(data, "    </tbody>\n");
+   data = pgagroal_append(data, "  </table>\n");
    data = pgagroal_append(data, "  <h2>pgagroal_session_time</h2>\n");
    data = pgagroal_append(data, "  <p>\n");
    data = pgagroal_append(data, "   Histogram of session times\n");
    data = pgagroal_append(data, "  </p>\n");
+   data = pgagroal_append(data, "  <h2>pgagroal_query_latency_seconds</h2>\n");
+   data = pgagroal_append(data, "  <p>\n");
+   data = pgagroal_append(data, "   Histogram of query latencies from Query or Execute to ReadyForQuery\n");
+   data = pgagroal_append(data, "  </p>\n");
+   data = pgagroal_append(data, "  <table>\n");
+   data = pgagroal_append(data, "    <tbody>\n");
+   data = pgagroal_append(data, "      <tr>\n");
+   data = pgagroal_append(data, "        <td>user</td>\n");
+   data = pgagroal_append(data, "        <td>The user name</td>\n");
+   data = pgagroal_append(data, "      </tr>\n");
+   data = pgagroal_append(data, "      <tr>\n");
+   data = pgagroal_append(data, "        <td>database</td>\n");
+   data = pgagroal_append(data, "        <td>The database</td>\n");
+   data = pgagroal_append(data, "      </tr>\n");
+   data = pgagroal_append(data, "    </tbody>\n");
+   data = pgagroal_append(data, "  </table>\n");
    data = pgagroal_append(data, "  <h2>pgagroal_connection_error</h2>\n");
    data = pgagroal_append(data, "  <p>\n");
    data = pgagroal_append(data, "   Number of connection errors\n");
@@ -1847,7 +2725,7 @@ home_page(SSL* client_ssl, int client_fd)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_write(client_ssl, client_fd, &msg);
 
 done:
    if (data != NULL)
@@ -1888,7 +2766,7 @@ home_vault_page(SSL* client_ssl, int client_fd)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_write(client_ssl, client_fd, &msg);
    if (status != MESSAGE_STATUS_OK)
    {
       goto done;
@@ -1949,7 +2827,7 @@ home_vault_page(SSL* client_ssl, int client_fd)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_write(client_ssl, client_fd, &msg);
 
 done:
    if (data != NULL)
@@ -1966,101 +2844,94 @@ metrics_page(SSL* client_ssl, int client_fd)
    char* data = NULL;
    time_t now;
    char time_buf[32];
+   int index;
    int status;
    struct message msg;
-   struct prometheus_cache* cache;
-   signed char cache_is_free;
-
-   cache = (struct prometheus_cache*)prometheus_cache_shmem;
 
    memset(&msg, 0, sizeof(struct message));
 
-retry_cache_locking:
-   cache_is_free = STATE_FREE;
-   if (atomic_compare_exchange_strong(&cache->lock, &cache_is_free, STATE_IN_USE))
+   if (is_metrics_cache_configured())
    {
-      // can serve the message out of cache?
-      if (is_metrics_cache_configured() && is_metrics_cache_valid())
-      {
-         // serve the message directly out of the cache
-         pgagroal_log_debug("Serving metrics out of cache (%d/%d bytes valid until %lld)",
-                            strlen(cache->data),
-                            cache->size,
-                            cache->valid_until);
+      index = metrics_cache_acquire();
 
-         msg.kind = 0;
-         msg.length = strlen(cache->data);
-         msg.data = cache->data;
-      }
-      else
+      // serve the last snapshot if it is valid, or if another process is rendering a new one
+      if (index != -1 && (is_metrics_cache_valid(index) || !metrics_cache_begin()))
       {
-         // build the message without the cache
-         metrics_cache_invalidate();
-
-         now = time(NULL);
+         status = metrics_cache_send(client_ssl, client_fd, index);
+         metrics_cache_release(index);
 
-         memset(&time_buf, 0, sizeof(time_buf));
-         ctime_r(&now, &time_buf[0]);
-         time_buf[strlen(time_buf) - 1] = 0;
-
-         data = pgagroal_append(data, "HTTP/1.1 200 OK\r\n");
-         data = pgagroal_append(data, "Content-Type: text/plain; version=0.0.3; charset=utf-8\r\n");
-         data = pgagroal_append(data, "Date: ");
-         data = pgagroal_append(data, &time_buf[0]);
-         data = pgagroal_append(data, "\r\n");
-         metrics_cache_append(data); // cache here to avoid the chunking for the cache
-         data = pgagroal_append(data, "Transfer-Encoding: chunked\r\n");
-         data = pgagroal_append(data, "\r\n");
-
-         msg.kind = 0;
-         msg.length = strlen(data);
-         msg.data = data;
-
-         status = pgagroal_write_message(client_ssl, client_fd, &msg);
          if (status != MESSAGE_STATUS_OK)
          {
-            metrics_cache_invalidate();
-            atomic_store(&cache->lock, STATE_FREE);
-
             goto error;
          }
 
-         free(data);
-         data = NULL;
+         return 0;
+      }
 
-         general_information(client_ssl, client_fd);
-         connection_information(client_ssl, client_fd);
-         limit_information(client_ssl, client_fd);
-         session_information(client_ssl, client_fd);
-         pool_information(client_ssl, client_fd);
-         auth_information(client_ssl, client_fd);
-         client_information(client_ssl, client_fd);
-         internal_information(client_ssl, client_fd);
-         connection_awaiting_information(client_ssl, client_fd);
-         write_os_kernel_version(client_ssl, client_fd);
-         certificate_information(client_ssl, client_fd);
+      if (index != -1)
+      {
+         metrics_cache_release(index);
+      }
+      else
+      {
+         metrics_cache_begin();
+      }
+   }
 
-         /* Footer */
-         data = pgagroal_append(data, "0\r\n\r\n");
+   now = time(NULL);
 
-         msg.kind = 0;
-         msg.length = strlen(data);
-         msg.data = data;
+   memset(&time_buf, 0, sizeof(time_buf));
+   ctime_r(&now, &time_buf[0]);
+   time_buf[strlen(time_buf) - 1] = 0;
 
-         metrics_cache_finalize();
-      }
+   data = pgagroal_append(data, "HTTP/1.1 200 OK\r\n");
+   data = pgagroal_append(data, "Content-Type: text/plain; version=0.0.3; charset=utf-8\r\n");
+   data = pgagroal_append(data, "Date: ");
+   data = pgagroal_append(data, &time_buf[0]);
+   data = pgagroal_append(data, "\r\n");
+   data = pgagroal_append(data, "Transfer-Encoding: chunked\r\n");
+   data = pgagroal_append(data, "\r\n");
 
-      // free the cache
-      atomic_store(&cache->lock, STATE_FREE);
+   msg.kind = 0;
+   msg.length = strlen(data);
+   msg.data = data;
 
-   } // end of cache locking
-   else
+   status = metrics_write(client_ssl, client_fd, &msg);
+   if (status != MESSAGE_STATUS_OK)
    {
-      /* Sleep for 1ms */
-      SLEEP_AND_GOTO(1000000L, retry_cache_locking)
+      metrics_cache_abort();
+
+      goto error;
    }
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   free(data);
+   data = NULL;
+
+   general_information(client_ssl, client_fd);
+   connection_information(client_ssl, client_fd);
+   limit_information(client_ssl, client_fd);
+   session_information(client_ssl, client_fd);
+   latency_information(client_ssl, client_fd);
+   pool_information(client_ssl, client_fd);
+   acquire_information(client_ssl, client_fd);
+   auth_information(client_ssl, client_fd);
+   client_information(client_ssl, client_fd);
+   internal_information(client_ssl, client_fd);
+   connection_awaiting_information(client_ssl, client_fd);
+   write_os_kernel_version(client_ssl, client_fd);
+   certificate_information(client_ssl, client_fd);
+
+   // publish the snapshot rendered along the response
+   metrics_cache_finalize();
+
+   /* Footer */
+   data = pgagroal_append(data, "0\r\n\r\n");
+
+   msg.kind = 0;
+   msg.length = strlen(data);
+   msg.data = data;
+
+   status = metrics_write(client_ssl, client_fd, &msg);
 
    if (status != MESSAGE_STATUS_OK)
    {
@@ -2084,92 +2955,83 @@ metrics_vault_page(SSL* client_ssl, int client_fd)
    char* data = NULL;
    time_t now;
    char time_buf[32];
+   int index;
    int status;
    struct message msg;
-   struct prometheus_cache* cache;
-   signed char cache_is_free;
-
-   cache = (struct prometheus_cache*)prometheus_cache_shmem;
 
    memset(&msg, 0, sizeof(struct message));
 
-retry_cache_locking:
-   cache_is_free = STATE_FREE;
-   if (atomic_compare_exchange_strong(&cache->lock, &cache_is_free, STATE_IN_USE))
+   if (is_metrics_cache_configured())
    {
-      // can serve the message out of cache?
-      if (is_metrics_cache_configured() && is_metrics_cache_valid())
+      index = metrics_cache_acquire();
+
+      // serve the last snapshot if it is valid, or if another process is rendering a new one
+      if (index != -1 && (is_metrics_cache_valid(index) || !metrics_cache_begin()))
       {
-         // serve the message directly out of the cache
-         pgagroal_log_debug("Serving metrics out of cache (%d/%d bytes valid until %lld)",
-                            strlen(cache->data),
-                            cache->size,
-                            cache->valid_until);
+         status = metrics_cache_send(client_ssl, client_fd, index);
+         metrics_cache_release(index);
+
+         if (status != MESSAGE_STATUS_OK)
+         {
+            goto error;
+         }
+
+         return 0;
+      }
 
-         msg.kind = 0;
-         msg.length = strlen(cache->data);
-         msg.data = cache->data;
+      if (index != -1)
+      {
+         metrics_cache_release(index);
       }
       else
       {
-         // build the message without the cache
-         metrics_cache_invalidate();
-
-         now = time(NULL);
-
-         memset(&time_buf, 0, sizeof(time_buf));
-         ctime_r(&now, &time_buf[0]);
-         time_buf[strlen(time_buf) - 1] = 0;
+         metrics_cache_begin();
+      }
+   }
 
-         data = pgagroal_append(data, "HTTP/1.1 200 OK\r\n");
-         data = pgagroal_append(data, "Content-Type: text/plain; version=0.0.3; charset=utf-8\r\n");
-         data = pgagroal_append(data, "Date: ");
-         data = pgagroal_append(data, &time_buf[0]);
-         data = pgagroal_append(data, "\r\n");
-         metrics_cache_append(data); // cache here to avoid the chunking for the cache
-         data = pgagroal_append(data, "Transfer-Encoding: chunked\r\n");
-         data = pgagroal_append(data, "\r\n");
+   now = time(NULL);
 
-         msg.kind = 0;
-         msg.length = strlen(data);
-         msg.data = data;
+   memset(&time_buf, 0, sizeof(time_buf));
+   ctime_r(&now, &time_buf[0]);
+   time_buf[strlen(time_buf) - 1] = 0;
 
-         status = pgagroal_write_message(client_ssl, client_fd, &msg);
-         if (status != MESSAGE_STATUS_OK)
-         {
-            metrics_cache_invalidate();
-            atomic_store(&cache->lock, STATE_FREE);
+   data = pgagroal_append(data, "HTTP/1.1 200 OK\r\n");
+   data = pgagroal_append(data, "Content-Type: text/plain; version=0.0.3; charset=utf-8\r\n");
+   data = pgagroal_append(data, "Date: ");
+   data = pgagroal_append(data, &time_buf[0]);
+   data = pgagroal_append(data, "\r\n");
+   data = pgagroal_append(data, "Transfer-Encoding: chunked\r\n");
+   data = pgagroal_append(data, "\r\n");
 
-            goto error;
-         }
+   msg.kind = 0;
+   msg.length = strlen(data);
+   msg.data = data;
 
-         free(data);
-         data = NULL;
+   status = metrics_write(client_ssl, client_fd, &msg);
+   if (status != MESSAGE_STATUS_OK)
+   {
+      metrics_cache_abort();
 
-         general_vault_information(client_ssl, client_fd);
-         internal_vault_information(client_ssl, client_fd);
+      goto error;
+   }
 
-         /* Footer */
-         data = pgagroal_append(data, "0\r\n\r\n");
+   free(data);
+   data = NULL;
 
-         msg.kind = 0;
-         msg.length = strlen(data);
-         msg.data = data;
+   general_vault_information(client_ssl, client_fd);
+   internal_vault_information(client_ssl, client_fd);
 
-         metrics_cache_finalize();
-      }
+   // publish the snapshot rendered along the response
+   metrics_cache_finalize();
 
-      // free the cache
-      atomic_store(&cache->lock, STATE_FREE);
+   /* Footer */
+   data = pgagroal_append(data, "0\r\n\r\n");
 
-   } // end of cache locking
-   else
-   {
-      /* Sleep for 1ms */
-      SLEEP_AND_GOTO(1000000L, retry_cache_locking)
-   }
+   msg.kind = 0;
+   msg.length = strlen(data);
+   msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_write(client_ssl, client_fd, &msg);
 
    if (status != MESSAGE_STATUS_OK)
    {
@@ -2214,7 +3076,7 @@ bad_request(SSL* client_ssl, int client_fd)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_write(client_ssl, client_fd, &msg);
 
    free(data);
 
@@ -2314,6 +3176,11 @@ general_information(SSL* client_ssl, int client_fd)
    data = pgagroal_append(data, "pgagroal_logging_fatal ");
    data = pgagroal_append_ulong(data, atomic_load(&prometheus->prometheus_base.logging_fatal));
    data = pgagroal_append(data, "\n\n");
+   data = pgagroal_append(data, "#HELP pgagroal_logging_dropped The number of logging statements dropped by the log writer\n");
+   data = pgagroal_append(data, "#TYPE pgagroal_logging_dropped counter\n");
+   data = pgagroal_append(data, "pgagroal_logging_dropped ");
+   data = pgagroal_append_ulong(data, pgagroal_log_dropped());
+   data = pgagroal_append(data, "\n\n");
 
    data = pgagroal_append(data, "#HELP pgagroal_failed_servers The number of failed servers\n");
    data = pgagroal_append(data, "#TYPE pgagroal_failed_servers gauge\n");
@@ -2330,7 +3197,7 @@ general_information(SSL* client_ssl, int client_fd)
    data = pgagroal_append(data, "#HELP pgagroal_query_count The number of queries\n");
    data = pgagroal_append(data, "#TYPE pgagroal_query_count counter\n");
    data = pgagroal_append(data, "pgagroal_query_count ");
-   data = pgagroal_append_ullong(data, atomic_load(&prometheus->query_count));
+   data = pgagroal_append_ullong(data, prometheus_shard_sum(prometheus, offsetof(struct prometheus_shard, query_count)));
    data = pgagroal_append(data, "\n\n");
 
    data = pgagroal_append(data, "#HELP pgagroal_connection_query_count The number of queries per connection\n");
@@ -2363,7 +3230,7 @@ general_information(SSL* client_ssl, int client_fd)
    data = pgagroal_append(data, "#HELP pgagroal_tx_count The number of transactions\n");
    data = pgagroal_append(data, "#TYPE pgagroal_tx_count counter\n");
    data = pgagroal_append(data, "pgagroal_tx_count ");
-   data = pgagroal_append_ullong(data, atomic_load(&prometheus->tx_count));
+   data = pgagroal_append_ullong(data, prometheus_shard_sum(prometheus, offsetof(struct prometheus_shard, tx_count)));
    data = pgagroal_append(data, "\n\n");
 
    if (data != NULL)
@@ -2718,68 +3585,428 @@ session_information(SSL* client_ssl, int client_fd)
    data = pgagroal_append_ulong(data, counter);
    data = pgagroal_append(data, "\n");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"1200\"} ");
-   counter += atomic_load(&prometheus->session_time[8]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"1200\"} ");
+   counter += atomic_load(&prometheus->session_time[8]);
+   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "\n");
+
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"1800\"} ");
+   counter += atomic_load(&prometheus->session_time[9]);
+   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "\n");
+
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"2700\"} ");
+   counter += atomic_load(&prometheus->session_time[10]);
+   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "\n");
+
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"3600\"} ");
+   counter += atomic_load(&prometheus->session_time[11]);
+   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "\n");
+
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"7200\"} ");
+   counter += atomic_load(&prometheus->session_time[12]);
+   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "\n");
+
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"14400\"} ");
+   counter += atomic_load(&prometheus->session_time[13]);
+   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "\n");
+
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"21600\"} ");
+   counter += atomic_load(&prometheus->session_time[14]);
+   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "\n");
+
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"43200\"} ");
+   counter += atomic_load(&prometheus->session_time[15]);
+   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "\n");
+
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"86400\"} ");
+   counter += atomic_load(&prometheus->session_time[16]);
+   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "\n");
+
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"+Inf\"} ");
+   counter += atomic_load(&prometheus->session_time[17]);
+   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "\n");
+
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_sum ");
+   data = pgagroal_append_ulong(data, atomic_load(&prometheus->session_time_sum));
+   data = pgagroal_append(data, "\n");
+
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_count ");
+   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "\n\n");
+
+   send_chunk(client_ssl, client_fd, data);
+   metrics_cache_append(data);
+   free(data);
+   data = NULL;
+}
+
+static void
+latency_claim(struct prometheus_latency* latency, char* username, char* database)
+{
+   atomic_store(&latency->claimer, getpid());
+
+   memset(&latency->username[0], 0, MAX_USERNAME_LENGTH);
+   memset(&latency->database[0], 0, MAX_DATABASE_LENGTH);
+   memcpy(&latency->username[0], username, MIN(strlen(username), MAX_USERNAME_LENGTH - 1));
+   memcpy(&latency->database[0], database, MIN(strlen(database), MAX_DATABASE_LENGTH - 1));
+
+   atomic_store(&latency->references, 1);
+   atomic_store(&latency->state, LATENCY_READY);
+}
+
+static bool
+latency_reference(struct prometheus_latency* latency, char* username, char* database)
+{
+   int references;
+
+   if (strcmp(&latency->username[0], username) || strcmp(&latency->database[0], database))
+   {
+      return false;
+   }
+
+   references = atomic_load(&latency->references);
+   do
+   {
+      if (references < 0)
+      {
+         return false;
+      }
+   }
+   while (!atomic_compare_exchange_weak(&latency->references, &references, references + 1));
+
+   /* The entry may have been reused between the comparison and the reference */
+   if (atomic_load(&latency->state) == LATENCY_READY &&
+       !strcmp(&latency->username[0], username) && !strcmp(&latency->database[0], database))
+   {
+      return true;
+   }
+
+   atomic_fetch_sub(&latency->references, 1);
+
+   return false;
+}
+
+static bool
+latency_wait(struct prometheus_latency* latency, uint64_t* start)
+{
+   int claimer;
+   uint64_t now;
+
+   now = pgagroal_get_monotonic_micros();
+
+   if (*start == 0)
+   {
+      *start = now;
+   }
+
+   if (now - *start < LATENCY_CLAIM_TIMEOUT)
+   {
+      /* Sleep for 1us */
+      SLEEP(1000L);
+      return true;
+   }
+
+   claimer = atomic_load(&latency->claimer);
+
+   if (is_process_gone(claimer) && atomic_compare_exchange_strong(&latency->claimer, &claimer, 0))
+   {
+      /* The claimer died, so the entry is left without a user and database,
+         and without clients such that it can be reused */
+      memset(&latency->username[0], 0, MAX_USERNAME_LENGTH);
+      memset(&latency->database[0], 0, MAX_DATABASE_LENGTH);
+      for (int j = 0; j < LATENCY_BUCKETS; j++)
+      {
+         atomic_store(&latency->buckets[j], 0);
+      }
+      atomic_store(&latency->count, 0);
+      atomic_store(&latency->sum, 0);
+      atomic_store(&latency->references, 0);
+      atomic_store(&latency->state, LATENCY_READY);
+
+      pgagroal_log_debug("Query latency entry abandoned by %d", claimer);
+
+      *start = 0;
+      return true;
+   }
+
+   return false;
+}
+
+/**
+ * Find the entry of an user and database, or claim a free entry
+ * @param username The user name
+ * @param database The database
+ * @return The index, -1 if an entry is stuck, or -2 if all entries are taken
+ */
+static int
+latency_match(char* username, char* database)
+{
+   int state;
+   uint64_t start;
+   struct main_prometheus* prometheus;
+   struct prometheus_latency* latency;
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   // entries are claimed in order, so the first free entry ends the search
+   for (int i = 0; i < NUMBER_OF_LATENCIES; i++)
+   {
+      latency = &prometheus->latencies[i];
+      start = 0;
+
+retry:
+      state = atomic_load(&latency->state);
+
+      if (state == LATENCY_FREE)
+      {
+         if (!atomic_compare_exchange_strong(&latency->state, &state, LATENCY_CLAIMING))
+         {
+            goto retry;
+         }
+
+         latency_claim(latency, username, database);
+
+         return i;
+      }
+      else if (state == LATENCY_CLAIMING)
+      {
+         if (latency_wait(latency, &start))
+         {
+            goto retry;
+         }
+
+         /* The claimer is alive but stuck, so the client isn't tracked */
+         return -1;
+      }
+
+      if (latency_reference(latency, username, database))
+      {
+         return i;
+      }
+   }
+
+   return -2;
+}
+
+static bool
+latency_reclaim_lock(void)
+{
+   int reclaimer;
+   uint64_t start;
+   struct main_prometheus* prometheus;
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+   start = pgagroal_get_monotonic_micros();
+
+   for (;;)
+   {
+      reclaimer = 0;
+      if (atomic_compare_exchange_strong(&prometheus->latency_reclaimer, &reclaimer, getpid()))
+      {
+         return true;
+      }
+
+      /* A reclaimer that died leaves the lock behind */
+      if (is_process_gone(reclaimer) &&
+          atomic_compare_exchange_strong(&prometheus->latency_reclaimer, &reclaimer, getpid()))
+      {
+         return true;
+      }
+
+      if (pgagroal_get_monotonic_micros() - start >= LATENCY_CLAIM_TIMEOUT)
+      {
+         return false;
+      }
+
+      /* Sleep for 1us */
+      SLEEP(1000L);
+   }
+}
+
+static bool
+is_process_gone(pid_t pid)
+{
+   bool gone;
+
+   if (pid <= 0)
+   {
+      return false;
+   }
+
+   gone = kill(pid, 0) == -1 && errno == ESRCH;
+   errno = 0;
+
+   return gone;
+}
+
+static void
+latency_information(SSL* client_ssl, int client_fd)
+{
+   int state;
+   char* data = NULL;
+   char* labels = NULL;
+   bool header = false;
+   struct main_prometheus* prometheus;
+   struct prometheus_latency* latency;
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   for (int i = 0; i < NUMBER_OF_LATENCIES; i++)
+   {
+      latency = &prometheus->latencies[i];
+      state = atomic_load(&latency->state);
+
+      if (state == LATENCY_FREE)
+      {
+         break;
+      }
+
+      /* An entry that is being reused, or that was abandoned */
+      if (state != LATENCY_READY || latency->username[0] == '\0')
+      {
+         continue;
+      }
+
+      if (!header)
+      {
+         data = pgagroal_append(data, "#HELP pgagroal_query_latency_seconds The query latencies\n");
+         data = pgagroal_append(data, "#TYPE pgagroal_query_latency_seconds histogram\n");
+         header = true;
+      }
+
+      labels = pgagroal_append(labels, "user=\"");
+      labels = pgagroal_append(labels, &latency->username[0]);
+      labels = pgagroal_append(labels, "\",database=\"");
+      labels = pgagroal_append(labels, &latency->database[0]);
+      labels = pgagroal_append(labels, "\"");
+
+      data = latency_histogram(data, "pgagroal_query_latency_seconds", labels, &latency->buckets[0], atomic_load(&latency->sum));
+
+      free(labels);
+      labels = NULL;
+
+      if (strlen(data) > CHUNK_SIZE)
+      {
+         send_chunk(client_ssl, client_fd, data);
+         metrics_cache_append(data);
+         free(data);
+         data = NULL;
+      }
+   }
+
+   if (header)
+   {
+      data = pgagroal_append(data, "\n");
+
+      send_chunk(client_ssl, client_fd, data);
+      metrics_cache_append(data);
+      free(data);
+      data = NULL;
+   }
+}
+
+static void
+acquire_information(SSL* client_ssl, int client_fd)
+{
+   char* data = NULL;
+   char* labels[NUMBER_OF_LIMITS + 1];
+   int number_of_labels;
+   struct main_configuration* config;
+   struct main_prometheus* prometheus;
+   struct prometheus_acquire* acquire;
+
+   config = (struct main_configuration*)shmem;
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   // the limit rules followed by the connections without a rule
+   number_of_labels = config->number_of_limits + 1;
+
+   for (int i = 0; i < number_of_labels; i++)
+   {
+      labels[i] = NULL;
+
+      if (i < config->number_of_limits)
+      {
+         labels[i] = pgagroal_append(labels[i], "rule=\"");
+         labels[i] = pgagroal_append_int(labels[i], i);
+         labels[i] = pgagroal_append(labels[i], "\",user=\"");
+         labels[i] = pgagroal_append(labels[i], config->limits[i].username);
+         labels[i] = pgagroal_append(labels[i], "\",database=\"");
+         labels[i] = pgagroal_append(labels[i], config->limits[i].database);
+         labels[i] = pgagroal_append(labels[i], "\"");
+      }
+      else
+      {
+         labels[i] = pgagroal_append(labels[i], "rule=\"-1\",user=\"*\",database=\"*\"");
+      }
+   }
+
+   data = pgagroal_append(data, "#HELP pgagroal_connection_acquire_seconds The wait times of the acquired connections\n");
+   data = pgagroal_append(data, "#TYPE pgagroal_connection_acquire_seconds histogram\n");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"1800\"} ");
-   counter += atomic_load(&prometheus->session_time[9]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+   for (int i = 0; i < number_of_labels; i++)
+   {
+      acquire = &prometheus->acquires[i < config->number_of_limits ? i : NUMBER_OF_LIMITS];
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"2700\"} ");
-   counter += atomic_load(&prometheus->session_time[10]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+      data = latency_histogram(data, "pgagroal_connection_acquire_seconds", labels[i], &acquire->buckets[0], atomic_load(&acquire->sum));
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"3600\"} ");
-   counter += atomic_load(&prometheus->session_time[11]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+      if (strlen(data) > CHUNK_SIZE)
+      {
+         send_chunk(client_ssl, client_fd, data);
+         metrics_cache_append(data);
+         free(data);
+         data = NULL;
+      }
+   }
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"7200\"} ");
-   counter += atomic_load(&prometheus->session_time[12]);
-   data = pgagroal_append_ulong(data, counter);
    data = pgagroal_append(data, "\n");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"14400\"} ");
-   counter += atomic_load(&prometheus->session_time[13]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+   data = pgagroal_append(data, "#HELP pgagroal_connection_acquire The number of acquisitions per result\n");
+   data = pgagroal_append(data, "#TYPE pgagroal_connection_acquire counter\n");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"21600\"} ");
-   counter += atomic_load(&prometheus->session_time[14]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+   for (int i = 0; i < number_of_labels; i++)
+   {
+      acquire = &prometheus->acquires[i < config->number_of_limits ? i : NUMBER_OF_LIMITS];
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"43200\"} ");
-   counter += atomic_load(&prometheus->session_time[15]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+      data = pgagroal_append(data, "pgagroal_connection_acquire{");
+      data = pgagroal_append(data, labels[i]);
+      data = pgagroal_append(data, ",result=\"hit\"} ");
+      data = pgagroal_append_ullong(data, atomic_load(&acquire->hit));
+      data = pgagroal_append(data, "\n");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"86400\"} ");
-   counter += atomic_load(&prometheus->session_time[16]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+      data = pgagroal_append(data, "pgagroal_connection_acquire{");
+      data = pgagroal_append(data, labels[i]);
+      data = pgagroal_append(data, ",result=\"wait\"} ");
+      data = pgagroal_append_ullong(data, atomic_load(&acquire->wait));
+      data = pgagroal_append(data, "\n");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"+Inf\"} ");
-   counter += atomic_load(&prometheus->session_time[17]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+      data = pgagroal_append(data, "pgagroal_connection_acquire{");
+      data = pgagroal_append(data, labels[i]);
+      data = pgagroal_append(data, ",result=\"timeout\"} ");
+      data = pgagroal_append_ullong(data, atomic_load(&acquire->timeout));
+      data = pgagroal_append(data, "\n");
+   }
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_sum ");
-   data = pgagroal_append_ulong(data, atomic_load(&prometheus->session_time_sum));
    data = pgagroal_append(data, "\n");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_count ");
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n\n");
-
    send_chunk(client_ssl, client_fd, data);
    metrics_cache_append(data);
    free(data);
    data = NULL;
+
+   for (int i = 0; i < number_of_labels; i++)
+   {
+      free(labels[i]);
+   }
 }
 
 static void
@@ -2974,13 +4201,13 @@ internal_information(SSL* client_ssl, int client_fd)
    data = pgagroal_append(data, "#HELP pgagroal_network_sent Bytes sent by clients\n");
    data = pgagroal_append(data, "#TYPE pgagroal_network_sent gauge\n");
    data = pgagroal_append(data, "pgagroal_network_sent ");
-   data = pgagroal_append_ullong(data, atomic_load(&prometheus->network_sent));
+   data = pgagroal_append_ullong(data, prometheus_shard_sum(prometheus, offsetof(struct prometheus_shard, network_sent)));
    data = pgagroal_append(data, "\n\n");
 
    data = pgagroal_append(data, "#HELP pgagroal_network_received Bytes received from servers\n");
    data = pgagroal_append(data, "#TYPE pgagroal_network_received gauge\n");
    data = pgagroal_append(data, "pgagroal_network_received ");
-   data = pgagroal_append_ullong(data, atomic_load(&prometheus->network_received));
+   data = pgagroal_append_ullong(data, prometheus_shard_sum(prometheus, offsetof(struct prometheus_shard, network_received)));
    data = pgagroal_append(data, "\n\n");
 
    data = pgagroal_append(data, "#HELP pgagroal_client_sockets Number of sockets the client used\n");
@@ -3113,7 +4340,7 @@ send_chunk(SSL* client_ssl, int client_fd, char* data)
    msg.length = strlen(m);
    msg.data = m;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_write(client_ssl, client_fd, &msg);
 
    free(m);
 
@@ -3145,29 +4372,31 @@ is_metrics_cache_configured(void)
 }
 
 /**
- * Checks if the cache is still valid, and therefore can be
- * used to serve as a response.
- * A cache is considred valid if it has non-empty payload and
+ * Checks if a snapshot of the cache is still valid, and therefore
+ * can be used to serve as a response.
+ * A snapshot is considered valid if it has a non-empty payload and
  * a timestamp in the future.
  *
- * @return true if the cache is still valid
+ * Requires the caller to hold a reader reference on the snapshot!
+ *
+ * @param index The buffer of the snapshot
+ * @return true if the snapshot is still valid
  */
 static bool
-is_metrics_cache_valid(void)
+is_metrics_cache_valid(int index)
 {
    time_t now;
-
    struct prometheus_cache* cache;
 
    cache = (struct prometheus_cache*)prometheus_cache_shmem;
 
-   if (cache->valid_until == 0 || strlen(cache->data) == 0)
+   if (cache->valid_until[index] == 0 || cache->length[index] == 0)
    {
       return false;
    }
 
    now = time(NULL);
-   return now <= cache->valid_until;
+   return now <= cache->valid_until[index];
 }
 
 int
@@ -3178,23 +4407,30 @@ pgagroal_init_prometheus_cache(size_t* p_size, void** p_shmem)
    size_t cache_size = 0;
    size_t struct_size = 0;
 
-   // first of all, allocate the overall cache structure
+   // first of all, allocate the overall cache structure with its two buffers
    cache_size = metrics_cache_size_to_alloc();
    struct_size = sizeof(struct prometheus_cache);
 
-   if (pgagroal_create_shared_memory(struct_size + cache_size, config->hugepage, (void*)&cache))
+   if (pgagroal_create_shared_memory(struct_size + 2 * cache_size, config->hugepage, (void*)&cache))
    {
       goto error;
    }
 
-   memset(cache, 0, struct_size + cache_size);
-   cache->valid_until = 0;
+   memset(cache, 0, struct_size + 2 * cache_size);
    cache->size = cache_size;
+   atomic_init(&cache->generation, 0);
    atomic_init(&cache->lock, STATE_FREE);
 
+   for (int i = 0; i < 2; i++)
+   {
+      atomic_init(&cache->readers[i], 0);
+      cache->valid_until[i] = 0;
+      cache->length[i] = 0;
+   }
+
    // success! do the memory swap
    *p_shmem = cache;
-   *p_size = cache_size + struct_size;
+   *p_size = 2 * cache_size + struct_size;
    return 0;
 
 error:
@@ -3208,7 +4444,7 @@ error:
 }
 
 /**
- * Provides the size of the cache to allocate.
+ * Provides the size of each buffer of the cache to allocate.
  *
  * It checks if the metrics cache is configured, and
  * computers the right minimum value between the
@@ -3239,35 +4475,134 @@ metrics_cache_size_to_alloc(void)
 }
 
 /**
- * Invalidates the cache.
+ * Takes a reader reference on the last published snapshot.
  *
- * Requires the caller to hold the lock on the cache!
+ * Never waits: the generation is read again after the reference is
+ * taken, so a reader never holds a buffer that a writer may render into.
+ *
+ * @return the buffer of the snapshot, or -1 if there is no snapshot
+ */
+static int
+metrics_cache_acquire(void)
+{
+   unsigned int generation;
+   int index;
+   struct prometheus_cache* cache;
+
+   cache = (struct prometheus_cache*)prometheus_cache_shmem;
+
+   while (true)
+   {
+      generation = atomic_load(&cache->generation);
+      index = generation & 1;
+
+      atomic_fetch_add(&cache->readers[index], 1);
+
+      if (atomic_load(&cache->generation) == generation)
+      {
+         break;
+      }
+
+      /* A new snapshot was published in the meantime */
+      atomic_fetch_sub(&cache->readers[index], 1);
+   }
+
+   if (cache->length[index] == 0)
+   {
+      atomic_fetch_sub(&cache->readers[index], 1);
+      return -1;
+   }
+
+   return index;
+}
+
+/**
+ * Releases a reader reference taken with metrics_cache_acquire().
  *
- * Invalidating the cache means that the payload is zero-filled
- * and that the valid_until field is set to zero too.
+ * @param index The buffer of the snapshot
  */
 static void
-metrics_cache_invalidate(void)
+metrics_cache_release(int index)
+{
+   struct prometheus_cache* cache;
+
+   cache = (struct prometheus_cache*)prometheus_cache_shmem;
+
+   atomic_fetch_sub(&cache->readers[index], 1);
+}
+
+/**
+ * Starts the render of a new snapshot into the inactive buffer.
+ *
+ * Never waits: if another process is rendering, or a slow reader
+ * still holds the inactive buffer, the caller renders without
+ * caching.
+ *
+ * @return true if the caller renders into the cache
+ */
+static bool
+metrics_cache_begin(void)
 {
+   int index;
+   signed char cache_is_free;
    struct prometheus_cache* cache;
 
    cache = (struct prometheus_cache*)prometheus_cache_shmem;
 
-   memset(cache->data, 0, cache->size);
-   cache->valid_until = 0;
+   cache_is_free = STATE_FREE;
+   if (!atomic_compare_exchange_strong(&cache->lock, &cache_is_free, STATE_IN_USE))
+   {
+      return false;
+   }
+
+   index = (atomic_load(&cache->generation) + 1) & 1;
+
+   if (atomic_load(&cache->readers[index]) != 0)
+   {
+      atomic_store(&cache->lock, STATE_FREE);
+      return false;
+   }
+
+   cache->valid_until[index] = 0;
+   cache->length[index] = 0;
+   cache->data[index * cache->size] = '\0';
+
+   cache_writer = true;
+   cache_index = index;
+
+   return true;
 }
 
 /**
- * Appends data to the cache.
+ * Invalidates the published snapshots.
  *
  * Requires the caller to hold the lock on the cache!
  *
- * If the input data is empty, nothing happens.
- * The data is appended only if the cache does not overflows, that
- * means the current size of the cache plus the size of the data
- * to append does not exceed the current cache size.
- * If the cache overflows, the cache is flushed and marked
- * as invalid.
+ * Invalidating the cache means that the valid_until fields
+ * are set to zero, so the next scrape renders a new snapshot.
+ */
+static void
+metrics_cache_invalidate(void)
+{
+   struct prometheus_cache* cache;
+
+   cache = (struct prometheus_cache*)prometheus_cache_shmem;
+
+   for (int i = 0; i < 2; i++)
+   {
+      cache->valid_until[i] = 0;
+   }
+}
+
+/**
+ * Appends data to the snapshot being rendered.
+ *
+ * If the process is not rendering into the cache, nothing happens.
+ * The data is appended only if the buffer does not overflow, that
+ * means the current length of the snapshot plus the size of the data
+ * to append does not exceed the buffer size.
+ * If the buffer overflows, the snapshot is abandoned, and
+ * will not be published.
  * This makes safe to call this method along the workflow of
  * building the Prometheus response.
  *
@@ -3279,48 +4614,122 @@ metrics_cache_append(char* data)
 {
    size_t origin_length = 0;
    size_t append_length = 0;
+   char* buffer = NULL;
    struct prometheus_cache* cache;
 
    cache = (struct prometheus_cache*)prometheus_cache_shmem;
 
-   if (!is_metrics_cache_configured())
+   if (cache_index == -1)
    {
       return false;
    }
 
-   origin_length = strlen(cache->data);
+   buffer = cache->data + cache_index * cache->size;
+   origin_length = cache->length[cache_index];
    append_length = strlen(data);
    // need to append the data to the cache
    if (origin_length + append_length >= cache->size)
    {
-      // cannot append new data, so invalidate cache
+      // cannot append new data, so abandon the snapshot
       pgagroal_log_debug("Cannot append %d bytes to the Prometheus cache because it will overflow the size of %d bytes (currently at %d bytes). HINT: try adjusting `metrics_cache_max_size`",
                          append_length,
                          cache->size,
                          origin_length);
-      metrics_cache_invalidate();
+      cache_index = -1;
       return false;
    }
 
-   // append the data to the data field
-   memcpy(cache->data + origin_length, data, append_length);
-   cache->data[origin_length + append_length + 1] = '\0';
+   // append the data to the buffer
+   memcpy(buffer + origin_length, data, append_length);
+   buffer[origin_length + append_length] = '\0';
+   cache->length[cache_index] = origin_length + append_length;
    return true;
 }
 
 /**
- * Finalizes the cache.
+ * Sends a snapshot of the cache.
  *
- * Requires the caller to hold the lock on the cache!
+ * Requires the caller to hold a reader reference on the snapshot!
+ *
+ * The cache holds the body of the response, so it is sent
+ * with a Content-Length such that the connection can be kept
+ * alive for the next scrape.
+ *
+ * @param client_ssl The client SSL structure
+ * @param client_fd The client descriptor
+ * @param index The buffer of the snapshot
+ * @return The status of the write
+ */
+static int
+metrics_cache_send(SSL* client_ssl, int client_fd, int index)
+{
+   char* data = NULL;
+   time_t now;
+   char time_buf[32];
+   int status;
+   struct message msg;
+   struct prometheus_cache* cache;
+
+   cache = (struct prometheus_cache*)prometheus_cache_shmem;
+
+   pgagroal_log_debug("Serving metrics out of cache (%d/%d bytes valid until %lld)",
+                      cache->length[index],
+                      cache->size,
+                      cache->valid_until[index]);
+
+   memset(&msg, 0, sizeof(struct message));
+
+   now = time(NULL);
+
+   memset(&time_buf, 0, sizeof(time_buf));
+   ctime_r(&now, &time_buf[0]);
+   time_buf[strlen(time_buf) - 1] = 0;
+
+   data = pgagroal_append(data, "HTTP/1.1 200 OK\r\n");
+   data = pgagroal_append(data, "Content-Type: text/plain; version=0.0.3; charset=utf-8\r\n");
+   data = pgagroal_append(data, "Date: ");
+   data = pgagroal_append(data, &time_buf[0]);
+   data = pgagroal_append(data, "\r\n");
+   data = pgagroal_append(data, "Content-Length: ");
+   data = pgagroal_append_ulong(data, cache->length[index]);
+   data = pgagroal_append(data, "\r\n");
+   data = pgagroal_append(data, "\r\n");
+
+   msg.kind = 0;
+   msg.length = strlen(data);
+   msg.data = data;
+
+   status = metrics_write(client_ssl, client_fd, &msg);
+   if (status != MESSAGE_STATUS_OK)
+   {
+      free(data);
+      return status;
+   }
+
+   msg.kind = 0;
+   msg.length = cache->length[index];
+   msg.data = cache->data + index * cache->size;
+
+   status = metrics_write(client_ssl, client_fd, &msg);
+
+   free(data);
+
+   return status;
+}
+
+/**
+ * Finalizes the render.
  *
- * This method should be invoked when the cache is complete
- * and therefore can be served.
+ * If the process rendered a complete snapshot it is published
+ * by increasing the generation, so the readers switch to it,
+ * and the lock on the cache is released.
  *
- * @return true if the cache has a validity
+ * @return true if a snapshot was published
  */
 static bool
 metrics_cache_finalize(void)
 {
+   bool published = false;
    struct main_configuration* config;
    struct prometheus_cache* cache;
    time_t now;
@@ -3328,14 +4737,37 @@ metrics_cache_finalize(void)
    cache = (struct prometheus_cache*)prometheus_cache_shmem;
    config = (struct main_configuration*)shmem;
 
-   if (!is_metrics_cache_configured())
+   if (!cache_writer)
    {
       return false;
    }
 
-   now = time(NULL);
-   cache->valid_until = now + config->common.metrics_cache_max_age;
-   return cache->valid_until > now;
+   if (cache_index != -1)
+   {
+      now = time(NULL);
+      cache->valid_until[cache_index] = now + config->common.metrics_cache_max_age;
+
+      atomic_fetch_add(&cache->generation, 1);
+      published = true;
+   }
+
+   cache_writer = false;
+   cache_index = -1;
+
+   atomic_store(&cache->lock, STATE_FREE);
+
+   return published;
+}
+
+/**
+ * Abandons the render of a snapshot, and releases
+ * the lock on the cache.
+ */
+static void
+metrics_cache_abort(void)
+{
+   cache_index = -1;
+   metrics_cache_finalize();
 }
 
 static bool
@@ -3346,6 +4778,127 @@ is_prometheus_enabled(void)
    return (config->metrics > 0 && prometheus != NULL);
 }
 
+static struct prometheus_shard*
+prometheus_shard(struct main_prometheus* prometheus)
+{
+   int cpu = -1;
+
+#if HAVE_LINUX
+   cpu = sched_getcpu();
+#endif
+
+   if (cpu < 0)
+   {
+      cpu = (int)getpid();
+   }
+
+   return &prometheus->shards[(unsigned int)cpu % PROMETHEUS_SHARDS];
+}
+
+static unsigned long long
+prometheus_shard_sum(struct main_prometheus* prometheus, size_t offset)
+{
+   unsigned long long sum = 0;
+
+   for (int i = 0; i < PROMETHEUS_SHARDS; i++)
+   {
+      sum += atomic_load_explicit((atomic_ullong*)((char*)&prometheus->shards[i] + offset), memory_order_relaxed);
+   }
+
+   return sum;
+}
+
+static uint64_t
+latency_percentile(atomic_ullong* buckets, double percentile)
+{
+   unsigned long long total = 0;
+   unsigned long long counter = 0;
+   unsigned long long rank;
+   unsigned long long values[LATENCY_BUCKETS];
+
+   for (int i = 0; i < LATENCY_BUCKETS; i++)
+   {
+      values[i] = atomic_load_explicit(&buckets[i], memory_order_relaxed);
+      total += values[i];
+   }
+
+   if (total == 0)
+   {
+      return 0;
+   }
+
+   rank = (unsigned long long)((percentile / 100.0) * total);
+   rank = MAX(rank, 1);
+
+   for (int i = 0; i < LATENCY_BUCKETS; i++)
+   {
+      counter += values[i];
+
+      if (counter >= rank)
+      {
+         return pgagroal_latency_bucket_upper(i);
+      }
+   }
+
+   return pgagroal_latency_bucket_upper(LATENCY_BUCKETS - 1);
+}
+
+static char*
+latency_histogram(char* data, char* name, char* labels, atomic_ullong* buckets, unsigned long long sum)
+{
+   char value[32];
+   unsigned long long counter = 0;
+
+   // the sub-buckets are folded into one bucket per power of two
+   for (int i = 0; i < LATENCY_BUCKETS - 1; i++)
+   {
+      counter += atomic_load(&buckets[i]);
+
+      if (i % 4 == 3)
+      {
+         memset(&value[0], 0, sizeof(value));
+         snprintf(&value[0], sizeof(value), "%.6f", pgagroal_latency_bucket_upper(i) / 1000000.0);
+
+         data = pgagroal_append(data, name);
+         data = pgagroal_append(data, "_bucket{");
+         data = pgagroal_append(data, labels);
+         data = pgagroal_append(data, ",le=\"");
+         data = pgagroal_append(data, &value[0]);
+         data = pgagroal_append(data, "\"} ");
+         data = pgagroal_append_ullong(data, counter);
+         data = pgagroal_append(data, "\n");
+      }
+   }
+
+   counter += atomic_load(&buckets[LATENCY_BUCKETS - 1]);
+
+   data = pgagroal_append(data, name);
+   data = pgagroal_append(data, "_bucket{");
+   data = pgagroal_append(data, labels);
+   data = pgagroal_append(data, ",le=\"+Inf\"} ");
+   data = pgagroal_append_ullong(data, counter);
+   data = pgagroal_append(data, "\n");
+
+   memset(&value[0], 0, sizeof(value));
+   snprintf(&value[0], sizeof(value), "%.6f", sum / 1000000.0);
+
+   data = pgagroal_append(data, name);
+   data = pgagroal_append(data, "_sum{");
+   data = pgagroal_append(data, labels);
+   data = pgagroal_append(data, "} ");
+   data = pgagroal_append(data, &value[0]);
+   data = pgagroal_append(data, "\n");
+
+   data = pgagroal_append(data, name);
+   data = pgagroal_append(data, "_count{");
+   data = pgagroal_append(data, labels);
+   data = pgagroal_append(data, "} ");
+   data = pgagroal_append_ullong(data, counter);
+   data = pgagroal_append(data, "\n");
+
+   return data;
+}
+
 static int
 parse_certificate_file(const char* cert_path, struct certificate_info* cert_info)
 {
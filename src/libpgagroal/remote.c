@@ -86,14 +86,16 @@ pgagroal_remote_management(int client_fd, char* address)
       pgagroal_json_destroy(payload);
       payload = NULL;
 
-      if (pgagroal_management_read_json(NULL, server_fd, &compression, &encryption, &payload))
+      /* Relay until pgagroal closes the connection, as the tracker streams its responses */
+      while (!pgagroal_management_read_json(NULL, server_fd, &compression, &encryption, &payload))
       {
-         goto done;
-      }
+         if (pgagroal_management_write_json(client_ssl, client_fd, compression, encryption, payload))
+         {
+            goto done;
+         }
 
-      if (pgagroal_management_write_json(client_ssl, client_fd, compression, encryption, payload))
-      {
-         goto done;
+         pgagroal_json_destroy(payload);
+         payload = NULL;
       }
    }
    else
@@ -29,6 +29,7 @@
 /* pgagroal */
 #include <pgagroal.h>
 #include <aes.h>
+#include <configuration.h>
 #include <logging.h>
 #include <memory.h>
 #include <message.h>
@@ -124,7 +125,8 @@ static int server_signature(char* password, char* salt, int salt_length, int ite
 static bool is_tls_user(char* username, char* database);
 static int create_ssl_client(SSL_CTX* ctx, char* key, char* cert, char* root, int socket, SSL** ssl);
 static int establish_client_tls_connection(int server, int fd, SSL** ssl);
-static int create_client_tls_connection(int fd, SSL** ssl, char* tls_key_file, char* tls_cert_file, char* tls_ca_file);
+static int create_client_tls_connection(int fd, SSL** ssl, char* tls_key_file, char* tls_cert_file, char* tls_ca_file, bool ktls);
+static void offload_client_tls_connection(int fd, SSL** ssl);
 
 static int auth_query(SSL* c_ssl, int client_fd, int slot, char* username, char* database, int hba_method);
 static int auth_query_get_connection(char* username, char* password, char* database, int* server_fd, SSL** server_ssl);
@@ -358,7 +360,7 @@ pgagroal_authenticate(int client_fd, char* address, int* slot, SSL** client_ssl,
 
       /* Get connection */
       pgagroal_tracking_event_basic(TRACKER_AUTHENTICATE, username, database);
-      ret = pgagroal_get_connection(username, database, true, false, slot, server_ssl);
+      ret = pgagroal_get_connection(username, database, true, false, true, -1, slot, server_ssl);
       if (ret != 0)
       {
          if (ret == 1)
@@ -547,7 +549,7 @@ pgagroal_prefill_auth(char* username, char* password, char* database, int* slot,
 
    /* Get connection */
    pgagroal_tracking_event_basic(TRACKER_PREFILL, username, database);
-   ret = pgagroal_get_connection(username, database, false, false, slot, server_ssl);
+   ret = pgagroal_get_connection(username, database, false, false, true, -1, slot, server_ssl);
    if (ret != 0)
    {
       goto error;
@@ -1344,6 +1346,7 @@ static int
 use_pooled_connection(SSL* c_ssl, int client_fd, int slot, char* username, char* database, int hba_method, SSL** server_ssl __attribute__((unused)))
 {
    int status = MESSAGE_STATUS_ERROR;
+   struct connection_security* security = NULL;
    struct main_configuration* config = NULL;
    struct message* auth_msg = NULL;
    struct message* msg = NULL;
@@ -1352,6 +1355,7 @@ use_pooled_connection(SSL* c_ssl, int client_fd, int slot, char* username, char*
    database = resolve_database_alias(username, database);
 
    config = (struct main_configuration*)shmem;
+   security = (struct connection_security*)security_shmem;
 
    password = get_frontend_password(username);
    if (password == NULL)
@@ -1379,8 +1383,8 @@ use_pooled_connection(SSL* c_ssl, int client_fd, int slot, char* username, char*
    else if (password == NULL)
    {
       /* We can only deal with SECURITY_TRUST, SECURITY_PASSWORD and SECURITY_MD5 */
-      pgagroal_create_message(&config->connections[slot].security_messages[0],
-                              config->connections[slot].security_lengths[0],
+      pgagroal_create_message(&security[slot].messages[0],
+                              security[slot].lengths[0],
                               &auth_msg);
 
       status = pgagroal_write_message(c_ssl, client_fd, auth_msg);
@@ -1400,8 +1404,8 @@ use_pooled_connection(SSL* c_ssl, int client_fd, int slot, char* username, char*
             goto error;
          }
 
-         pgagroal_create_message(&config->connections[slot].security_messages[1],
-                                 config->connections[slot].security_lengths[1],
+         pgagroal_create_message(&security[slot].messages[1],
+                                 security[slot].lengths[1],
                                  &auth_msg);
 
          if (compare_auth_response(auth_msg, msg, config->connections[slot].has_security))
@@ -1415,8 +1419,8 @@ use_pooled_connection(SSL* c_ssl, int client_fd, int slot, char* username, char*
          pgagroal_free_message(auth_msg);
          auth_msg = NULL;
 
-         pgagroal_create_message(&config->connections[slot].security_messages[2],
-                                 config->connections[slot].security_lengths[2],
+         pgagroal_create_message(&security[slot].messages[2],
+                                 security[slot].lengths[2],
                                  &auth_msg);
 
          status = pgagroal_write_message(c_ssl, client_fd, auth_msg);
@@ -2147,42 +2151,44 @@ client_ok(SSL* c_ssl, int client_fd, int slot)
    size_t size;
    char* data;
    struct message msg;
+   struct connection_security* security;
    struct main_configuration* config;
 
    data = NULL;
    memset(&msg, 0, sizeof(msg));
 
    config = (struct main_configuration*)shmem;
+   security = (struct connection_security*)security_shmem;
 
    if (config->connections[slot].has_security == SECURITY_TRUST)
    {
-      size = config->connections[slot].security_lengths[0];
+      size = security[slot].lengths[0];
       data = malloc(size);
       if (data == NULL)
       {
          goto error;
       }
-      memcpy(data, config->connections[slot].security_messages[0], size);
+      memcpy(data, security[slot].messages[0], size);
    }
    else if (config->connections[slot].has_security == SECURITY_PASSWORD || config->connections[slot].has_security == SECURITY_MD5)
    {
-      size = config->connections[slot].security_lengths[2];
+      size = security[slot].lengths[2];
       data = malloc(size);
       if (data == NULL)
       {
          goto error;
       }
-      memcpy(data, config->connections[slot].security_messages[2], size);
+      memcpy(data, security[slot].messages[2], size);
    }
    else if (config->connections[slot].has_security == SECURITY_SCRAM256)
    {
-      size = config->connections[slot].security_lengths[4] - 55;
+      size = security[slot].lengths[4] - 55;
       data = malloc(size);
       if (data == NULL)
       {
          goto error;
       }
-      memcpy(data, config->connections[slot].security_messages[4] + 55, size);
+      memcpy(data, security[slot].messages[4] + 55, size);
    }
    else
    {
@@ -2219,16 +2225,18 @@ server_passthrough(struct message* msg, int auth_type, SSL* c_ssl, int client_fd
    int auth_response = -1;
    struct message* smsg = NULL;
    struct message* kmsg = NULL;
+   struct connection_security* security = NULL;
    struct main_configuration* config = NULL;
 
    config = (struct main_configuration*)shmem;
+   security = (struct connection_security*)security_shmem;
    server_fd = config->connections[slot].fd;
 
    pgagroal_log_trace("server_passthrough %d %d", auth_type, slot);
 
    for (int i = 0; i < NUMBER_OF_SECURITY_MESSAGES; i++)
    {
-      memset(&config->connections[slot].security_messages[i], 0, SECURITY_BUFFER_SIZE);
+      memset(&security[slot].messages[i], 0, SECURITY_BUFFER_SIZE);
    }
 
    if (msg->length > SECURITY_BUFFER_SIZE)
@@ -2238,8 +2246,8 @@ server_passthrough(struct message* msg, int auth_type, SSL* c_ssl, int client_fd
       goto error;
    }
 
-   config->connections[slot].security_lengths[auth_index] = msg->length;
-   memcpy(&config->connections[slot].security_messages[auth_index], msg->data, msg->length);
+   security[slot].lengths[auth_index] = msg->length;
+   memcpy(&security[slot].messages[auth_index], msg->data, msg->length);
    auth_index++;
 
    status = pgagroal_write_message(c_ssl, client_fd, msg);
@@ -2266,8 +2274,8 @@ server_passthrough(struct message* msg, int auth_type, SSL* c_ssl, int client_fd
          goto error;
       }
 
-      config->connections[slot].security_lengths[auth_index] = msg->length;
-      memcpy(&config->connections[slot].security_messages[auth_index], msg->data, msg->length);
+      security[slot].lengths[auth_index] = msg->length;
+      memcpy(&security[slot].messages[auth_index], msg->data, msg->length);
       auth_index++;
 
       status = pgagroal_write_message(NULL, server_fd, msg);
@@ -2292,8 +2300,8 @@ server_passthrough(struct message* msg, int auth_type, SSL* c_ssl, int client_fd
             goto error;
          }
 
-         config->connections[slot].security_lengths[auth_index] = msg->length;
-         memcpy(&config->connections[slot].security_messages[auth_index], msg->data, msg->length);
+         security[slot].lengths[auth_index] = msg->length;
+         memcpy(&security[slot].messages[auth_index], msg->data, msg->length);
          auth_index++;
 
          status = pgagroal_write_message(c_ssl, client_fd, msg);
@@ -2316,8 +2324,8 @@ server_passthrough(struct message* msg, int auth_type, SSL* c_ssl, int client_fd
             goto error;
          }
 
-         config->connections[slot].security_lengths[auth_index] = msg->length;
-         memcpy(&config->connections[slot].security_messages[auth_index], msg->data, msg->length);
+         security[slot].lengths[auth_index] = msg->length;
+         memcpy(&security[slot].messages[auth_index], msg->data, msg->length);
          auth_index++;
 
          status = pgagroal_write_message(NULL, server_fd, msg);
@@ -2347,8 +2355,8 @@ server_passthrough(struct message* msg, int auth_type, SSL* c_ssl, int client_fd
             goto error;
          }
 
-         config->connections[slot].security_lengths[auth_index] = msg->length;
-         memcpy(&config->connections[slot].security_messages[auth_index], msg->data, msg->length);
+         security[slot].lengths[auth_index] = msg->length;
+         memcpy(&security[slot].messages[auth_index], msg->data, msg->length);
 
          config->connections[slot].has_security = auth_type;
       }
@@ -2373,20 +2381,20 @@ server_passthrough(struct message* msg, int auth_type, SSL* c_ssl, int client_fd
 
    if (config->connections[slot].has_security == SECURITY_TRUST)
    {
-      pgagroal_create_message(&config->connections[slot].security_messages[0],
-                              config->connections[slot].security_lengths[0],
+      pgagroal_create_message(&security[slot].messages[0],
+                              security[slot].lengths[0],
                               &smsg);
    }
    else if (config->connections[slot].has_security == SECURITY_PASSWORD || config->connections[slot].has_security == SECURITY_MD5)
    {
-      pgagroal_create_message(&config->connections[slot].security_messages[2],
-                              config->connections[slot].security_lengths[2],
+      pgagroal_create_message(&security[slot].messages[2],
+                              security[slot].lengths[2],
                               &smsg);
    }
    else if (config->connections[slot].has_security == SECURITY_SCRAM256)
    {
-      pgagroal_create_message(&config->connections[slot].security_messages[4],
-                              config->connections[slot].security_lengths[4],
+      pgagroal_create_message(&security[slot].messages[4],
+                              security[slot].lengths[4],
                               &smsg);
    }
 
@@ -2420,13 +2428,15 @@ server_authenticate(struct message* msg, int auth_type, char* username, char* pa
    int ret = AUTH_ERROR;
    struct message* smsg = NULL;
    struct message* kmsg = NULL;
+   struct connection_security* security = NULL;
    struct main_configuration* config = NULL;
 
    config = (struct main_configuration*)shmem;
+   security = (struct connection_security*)security_shmem;
 
    for (int i = 0; i < NUMBER_OF_SECURITY_MESSAGES; i++)
    {
-      memset(&config->connections[slot].security_messages[i], 0, SECURITY_BUFFER_SIZE);
+      memset(&security[slot].messages[i], 0, SECURITY_BUFFER_SIZE);
    }
 
    if (msg->length > SECURITY_BUFFER_SIZE)
@@ -2436,8 +2446,8 @@ server_authenticate(struct message* msg, int auth_type, char* username, char* pa
       goto error;
    }
 
-   config->connections[slot].security_lengths[0] = msg->length;
-   memcpy(&config->connections[slot].security_messages[0], msg->data, msg->length);
+   security[slot].lengths[0] = msg->length;
+   memcpy(&security[slot].messages[0], msg->data, msg->length);
 
    if (auth_type == SECURITY_TRUST)
    {
@@ -2458,20 +2468,20 @@ server_authenticate(struct message* msg, int auth_type, char* username, char* pa
 
    if (config->connections[slot].has_security == SECURITY_TRUST)
    {
-      pgagroal_create_message(&config->connections[slot].security_messages[0],
-                              config->connections[slot].security_lengths[0],
+      pgagroal_create_message(&security[slot].messages[0],
+                              security[slot].lengths[0],
                               &smsg);
    }
    else if (config->connections[slot].has_security == SECURITY_PASSWORD || config->connections[slot].has_security == SECURITY_MD5)
    {
-      pgagroal_create_message(&config->connections[slot].security_messages[2],
-                              config->connections[slot].security_lengths[2],
+      pgagroal_create_message(&security[slot].messages[2],
+                              security[slot].lengths[2],
                               &smsg);
    }
    else if (config->connections[slot].has_security == SECURITY_SCRAM256)
    {
-      pgagroal_create_message(&config->connections[slot].security_messages[4],
-                              config->connections[slot].security_lengths[4],
+      pgagroal_create_message(&security[slot].messages[4],
+                              security[slot].lengths[4],
                               &smsg);
    }
 
@@ -2524,9 +2534,11 @@ server_password(char* username, char* password, int slot, SSL* server_ssl)
    int server_fd;
    struct message* auth_msg = NULL;
    struct message* password_msg = NULL;
+   struct connection_security* security = NULL;
    struct main_configuration* config = NULL;
 
    config = (struct main_configuration*)shmem;
+   security = (struct connection_security*)security_shmem;
    server_fd = config->connections[slot].fd;
 
    pgagroal_log_trace("server_password");
@@ -2543,8 +2555,8 @@ server_password(char* username, char* password, int slot, SSL* server_ssl)
       goto error;
    }
 
-   config->connections[slot].security_lengths[auth_index] = password_msg->length;
-   memcpy(&config->connections[slot].security_messages[auth_index], password_msg->data, password_msg->length);
+   security[slot].lengths[auth_index] = password_msg->length;
+   memcpy(&security[slot].messages[auth_index], password_msg->data, password_msg->length);
    auth_index++;
 
    status = pgagroal_read_block_message(server_ssl, server_fd, &auth_msg);
@@ -2567,8 +2579,8 @@ server_password(char* username, char* password, int slot, SSL* server_ssl)
          goto error;
       }
 
-      config->connections[slot].security_lengths[auth_index] = auth_msg->length;
-      memcpy(&config->connections[slot].security_messages[auth_index], auth_msg->data, auth_msg->length);
+      security[slot].lengths[auth_index] = auth_msg->length;
+      memcpy(&security[slot].messages[auth_index], auth_msg->data, auth_msg->length);
 
       config->connections[slot].has_security = SECURITY_PASSWORD;
    }
@@ -2615,14 +2627,16 @@ server_md5(char* username, char* password, int slot, SSL* server_ssl)
    char* salt = NULL;
    struct message* auth_msg = NULL;
    struct message* md5_msg = NULL;
+   struct connection_security* security = NULL;
    struct main_configuration* config = NULL;
 
    config = (struct main_configuration*)shmem;
+   security = (struct connection_security*)security_shmem;
    server_fd = config->connections[slot].fd;
 
    pgagroal_log_trace("server_md5");
 
-   if (get_salt(config->connections[slot].security_messages[0], &salt))
+   if (get_salt(security[slot].messages[0], &salt))
    {
       goto error;
    }
@@ -2662,8 +2676,8 @@ server_md5(char* username, char* password, int slot, SSL* server_ssl)
       goto error;
    }
 
-   config->connections[slot].security_lengths[auth_index] = md5_msg->length;
-   memcpy(&config->connections[slot].security_messages[auth_index], md5_msg->data, md5_msg->length);
+   security[slot].lengths[auth_index] = md5_msg->length;
+   memcpy(&security[slot].messages[auth_index], md5_msg->data, md5_msg->length);
    auth_index++;
 
    status = pgagroal_read_block_message(server_ssl, server_fd, &auth_msg);
@@ -2686,8 +2700,8 @@ server_md5(char* username, char* password, int slot, SSL* server_ssl)
          goto error;
       }
 
-      config->connections[slot].security_lengths[auth_index] = auth_msg->length;
-      memcpy(&config->connections[slot].security_messages[auth_index], auth_msg->data, auth_msg->length);
+      security[slot].lengths[auth_index] = auth_msg->length;
+      memcpy(&security[slot].messages[auth_index], auth_msg->data, auth_msg->length);
 
       config->connections[slot].has_security = SECURITY_MD5;
    }
@@ -2768,9 +2782,11 @@ server_scram256(char* username, char* password, int slot, SSL* server_ssl)
    struct message* sasl_continue_response = NULL;
    struct message* sasl_final = NULL;
    struct message* msg = NULL;
+   struct connection_security* security = NULL;
    struct main_configuration* config = NULL;
 
    config = (struct main_configuration*)shmem;
+   security = (struct connection_security*)security_shmem;
    server_fd = config->connections[slot].fd;
 
    pgagroal_log_trace("server_scram256");
@@ -2789,8 +2805,8 @@ server_scram256(char* username, char* password, int slot, SSL* server_ssl)
       goto error;
    }
 
-   config->connections[slot].security_lengths[auth_index] = sasl_response->length;
-   memcpy(&config->connections[slot].security_messages[auth_index], sasl_response->data, sasl_response->length);
+   security[slot].lengths[auth_index] = sasl_response->length;
+   memcpy(&security[slot].messages[auth_index], sasl_response->data, sasl_response->length);
    auth_index++;
 
    status = pgagroal_write_message(server_ssl, server_fd, sasl_response);
@@ -2809,8 +2825,8 @@ server_scram256(char* username, char* password, int slot, SSL* server_ssl)
 
    sasl_continue = pgagroal_copy_message(msg);
 
-   config->connections[slot].security_lengths[auth_index] = sasl_continue->length;
-   memcpy(&config->connections[slot].security_messages[auth_index], sasl_continue->data, sasl_continue->length);
+   security[slot].lengths[auth_index] = sasl_continue->length;
+   memcpy(&security[slot].messages[auth_index], sasl_continue->data, sasl_continue->length);
    auth_index++;
 
    get_scram_attribute('r', (char*)(sasl_continue->data + 9), sasl_continue->length - 9, &combined_nounce);
@@ -2832,14 +2848,14 @@ server_scram256(char* username, char* password, int slot, SSL* server_ssl)
    snprintf(&wo_proof[0], sizeof(wo_proof), "c=biws,r=%s", combined_nounce);
 
    /* n=,r=... */
-   client_first_message_bare = config->connections[slot].security_messages[1] + 26;
+   client_first_message_bare = security[slot].messages[1] + 26;
 
    /* r=...,s=...,i=4096 */
-   server_first_message = config->connections[slot].security_messages[2] + 9;
+   server_first_message = security[slot].messages[2] + 9;
 
    if (client_proof(password_prep, salt, salt_length, iteration,
-                    client_first_message_bare, config->connections[slot].security_lengths[1] - 26,
-                    server_first_message, config->connections[slot].security_lengths[2] - 9,
+                    client_first_message_bare, security[slot].lengths[1] - 26,
+                    server_first_message, security[slot].lengths[2] - 9,
                     &wo_proof[0], strlen(wo_proof),
                     &proof, &proof_length))
    {
@@ -2854,8 +2870,8 @@ server_scram256(char* username, char* password, int slot, SSL* server_ssl)
       goto error;
    }
 
-   config->connections[slot].security_lengths[auth_index] = sasl_continue_response->length;
-   memcpy(&config->connections[slot].security_messages[auth_index], sasl_continue_response->data, sasl_continue_response->length);
+   security[slot].lengths[auth_index] = sasl_continue_response->length;
+   memcpy(&security[slot].messages[auth_index], sasl_continue_response->data, sasl_continue_response->length);
    auth_index++;
 
    status = pgagroal_write_message(server_ssl, server_fd, sasl_continue_response);
@@ -2872,8 +2888,8 @@ server_scram256(char* username, char* password, int slot, SSL* server_ssl)
       goto error;
    }
 
-   config->connections[slot].security_lengths[auth_index] = msg->length;
-   memcpy(&config->connections[slot].security_messages[auth_index], msg->data, msg->length);
+   security[slot].lengths[auth_index] = msg->length;
+   memcpy(&security[slot].messages[auth_index], msg->data, msg->length);
    auth_index++;
 
    if (pgagroal_extract_message('R', msg, &sasl_final))
@@ -2888,8 +2904,8 @@ server_scram256(char* username, char* password, int slot, SSL* server_ssl)
 
    if (server_signature(password_prep, salt, salt_length, iteration,
                         NULL, 0,
-                        client_first_message_bare, config->connections[slot].security_lengths[1] - 26,
-                        server_first_message, config->connections[slot].security_lengths[2] - 9,
+                        client_first_message_bare, security[slot].lengths[1] - 26,
+                        server_first_message, security[slot].lengths[2] - 9,
                         &wo_proof[0], strlen(wo_proof),
                         &server_signature_calc, &server_signature_calc_length))
    {
@@ -3004,28 +3020,34 @@ is_allowed_username(char* username, char* entry)
 static bool
 is_allowed_database(char* database, char* entry)
 {
-   struct main_configuration* config = (struct main_configuration*)shmem;
+   bool allowed;
+   unsigned int generation;
+   struct limit_index* index;
+   struct limit_name* name;
+   struct limit_name* alias;
 
    if (!strcasecmp(entry, "all") || !strcmp(database, entry))
    {
       return true;
    }
 
-   // Check if the database is an alias in any limit entry
-   for (int i = 0; i < config->number_of_limits; i++)
+   // Check if the database is an alias of a limit entry for the entry
+   do
    {
-      if (!strcmp(entry, config->limits[i].database))
-      {
-         // Check if database is an alias of this entry
-         for (int j = 0; j < config->limits[i].aliases_count; j++)
-         {
-            if (!strcmp(database, config->limits[i].aliases[j]))
-            {
-               pgagroal_log_debug("HBA: Database '%s' matched as alias of '%s'", database, entry);
-               return true;
-            }
-         }
-      }
+      generation = pgagroal_limit_read_begin(shmem);
+
+      index = pgagroal_get_limit_index(shmem);
+      name = pgagroal_find_limit_name(index, entry);
+      alias = pgagroal_find_limit_name(index, database);
+
+      allowed = name != NULL && alias != NULL && (name->databases & alias->aliases) != 0;
+   }
+   while (pgagroal_limit_read_retry(shmem, generation));
+
+   if (allowed)
+   {
+      pgagroal_log_debug("HBA: Database '%s' matched as alias of '%s'", database, entry);
+      return true;
    }
 
    return false;
@@ -3406,6 +3428,97 @@ pgagroal_md5(char* str, int length, char** md5)
    return 0;
 }
 
+int
+pgagroal_scram256_proof(char* password, char* salt, int salt_length, int iterations,
+                        char* client_first_message_bare, char* server_first_message,
+                        char* client_final_message_wo_proof,
+                        unsigned char** proof, unsigned char** signature)
+{
+   unsigned char* s_p = NULL;
+   int s_p_length;
+   unsigned char* c_k = NULL;
+   int c_k_length;
+   unsigned char* s_k = NULL;
+   int s_k_length;
+   unsigned char* sv_k = NULL;
+   int sv_k_length;
+   unsigned char* c_s = NULL;
+   size_t c_s_length;
+   unsigned char* p = NULL;
+   unsigned char* sig = NULL;
+   size_t sig_length;
+
+   *proof = NULL;
+   *signature = NULL;
+
+   /* The salted password is calculated once for both keys */
+   if (salted_password(password, salt, salt_length, iterations, &s_p, &s_p_length))
+   {
+      goto error;
+   }
+
+   if (salted_password_key(s_p, s_p_length, "Client Key", &c_k, &c_k_length) ||
+       stored_key(c_k, c_k_length, &s_k, &s_k_length) ||
+       salted_password_key(s_p, s_p_length, "Server Key", &sv_k, &sv_k_length))
+   {
+      goto error;
+   }
+
+   /* ClientSignature and ServerSignature are both HMAC(Key, AuthMessage),
+      with the StoredKey and the ServerKey */
+   if (server_signature(NULL, NULL, 0, 0, (char*)s_k, s_k_length,
+                        client_first_message_bare, strlen(client_first_message_bare),
+                        server_first_message, strlen(server_first_message),
+                        client_final_message_wo_proof, strlen(client_final_message_wo_proof),
+                        &c_s, &c_s_length))
+   {
+      goto error;
+   }
+
+   if (server_signature(NULL, NULL, 0, 0, (char*)sv_k, sv_k_length,
+                        client_first_message_bare, strlen(client_first_message_bare),
+                        server_first_message, strlen(server_first_message),
+                        client_final_message_wo_proof, strlen(client_final_message_wo_proof),
+                        &sig, &sig_length))
+   {
+      goto error;
+   }
+
+   p = calloc(1, c_s_length);
+   if (p == NULL)
+   {
+      goto error;
+   }
+
+   /* ClientProof: ClientKey XOR ClientSignature */
+   for (size_t i = 0; i < c_s_length; i++)
+   {
+      *(p + i) = *(c_k + i) ^ *(c_s + i);
+   }
+
+   *proof = p;
+   *signature = sig;
+
+   free(s_p);
+   free(c_k);
+   free(s_k);
+   free(sv_k);
+   free(c_s);
+
+   return 0;
+
+error:
+
+   free(s_p);
+   free(c_k);
+   free(s_k);
+   free(sv_k);
+   free(c_s);
+   free(sig);
+
+   return 1;
+}
+
 bool
 pgagroal_user_known(char* user)
 {
@@ -5660,7 +5773,8 @@ establish_client_tls_connection(int server, int fd, SSL** ssl)
 
       if (msg->kind == 'S')
       {
-         create_client_tls_connection(fd, ssl, config->servers[server].tls_key_file, config->servers[server].tls_cert_file, config->servers[server].tls_ca_file);
+         create_client_tls_connection(fd, ssl, config->servers[server].tls_key_file, config->servers[server].tls_cert_file, config->servers[server].tls_ca_file,
+                                      config->servers[server].tls_ktls);
       }
    }
 
@@ -5678,7 +5792,7 @@ error:
 }
 
 static int
-create_client_tls_connection(int fd, SSL** ssl, char* tls_key_file, char* tls_cert_file, char* tls_ca_file)
+create_client_tls_connection(int fd, SSL** ssl, char* tls_key_file, char* tls_cert_file, char* tls_ca_file, bool ktls)
 {
    SSL_CTX* ctx = NULL;
    SSL* s = NULL;
@@ -5698,6 +5812,17 @@ create_client_tls_connection(int fd, SSL** ssl, char* tls_key_file, char* tls_ce
       goto error;
    }
 
+   if (ktls)
+   {
+#ifdef SSL_OP_ENABLE_KTLS
+      /* TLSv1.3 session tickets arrive as records the kernel can't hand to read() */
+      SSL_set_options(s, SSL_OP_ENABLE_KTLS);
+      SSL_set_max_proto_version(s, TLS1_2_VERSION);
+#else
+      pgagroal_log_debug("kTLS not supported by the TLS library: FD %d", fd);
+#endif
+   }
+
    do
    {
       status = SSL_connect(s);
@@ -5743,6 +5868,11 @@ create_client_tls_connection(int fd, SSL** ssl, char* tls_key_file, char* tls_ce
 
    *ssl = s;
 
+   if (ktls)
+   {
+      offload_client_tls_connection(fd, ssl);
+   }
+
    return AUTH_SUCCESS;
 
 error:
@@ -5752,6 +5882,34 @@ error:
    return AUTH_ERROR;
 }
 
+static void
+offload_client_tls_connection(int fd, SSL** ssl)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+   SSL* s = *ssl;
+   SSL_CTX* ctx = NULL;
+
+   if (BIO_get_ktls_send(SSL_get_wbio(s)) && BIO_get_ktls_recv(SSL_get_rbio(s)))
+   {
+      /* The kernel owns the record layer now, so the socket can be pooled as plain text */
+      ctx = SSL_get_SSL_CTX(s);
+      SSL_free(s);
+      SSL_CTX_free(ctx);
+
+      *ssl = NULL;
+
+      pgagroal_log_debug("kTLS: FD %d", fd);
+   }
+   else
+   {
+      pgagroal_log_debug("kTLS not available: FD %d", fd);
+   }
+#else
+   (void)fd;
+   (void)ssl;
+#endif
+}
+
 void
 pgagroal_initialize_random()
 {
@@ -5808,10 +5966,10 @@ pgagroal_extract_server_parameters(int slot, struct deque** server_parameters)
    char* value = NULL;
    struct message* msg;
    struct deque* sp = NULL;
-   struct main_configuration* config;
+   struct connection_security* security;
 
    *server_parameters = NULL;
-   config = (struct main_configuration*)shmem;
+   security = (struct connection_security*)security_shmem;
 
    if (pgagroal_deque_create(false, &sp))
    {
@@ -5820,9 +5978,9 @@ pgagroal_extract_server_parameters(int slot, struct deque** server_parameters)
 
    for (i = 0; i < NUMBER_OF_SECURITY_MESSAGES; ++i)
    {
-      if ((data_length = config->connections[slot].security_lengths[i]) > 0)
+      if ((data_length = security[slot].lengths[i]) > 0)
       {
-         data = config->connections[slot].security_messages[i];
+         data = security[slot].messages[i];
          offset = 0;
 
          while (offset < data_length)
@@ -5862,20 +6020,34 @@ pgagroal_close_ssl(SSL* ssl)
    }
 }
 
-bool
-pgagroal_is_ssl_request(int client_fd)
+int
+pgagroal_is_ssl_request(int client_fd, bool wait, bool* ssl_request)
 {
    ssize_t peek_bytes;
    char peek_buffer[HTTP_BUFFER_SIZE];
-   bool ssl_req = false;
+
+   *ssl_request = false;
 
    // MSG_Peek
-   peek_bytes = recv(client_fd, peek_buffer, sizeof(peek_buffer), MSG_PEEK);
+   peek_bytes = recv(client_fd, peek_buffer, sizeof(peek_buffer), MSG_PEEK | (wait ? 0 : MSG_DONTWAIT));
+   if (peek_bytes < 0 && !wait && (errno == EAGAIN || errno == EWOULDBLOCK))
+   {
+      errno = 0;
+      return 1;
+   }
+
    if (peek_bytes <= 0)
    {
       pgagroal_log_error("unable to peek network data from client");
-      close(client_fd);
-      exit(1);
+      errno = 0;
+      return 2;
+   }
+
+   if (peek_bytes < 3)
+   {
+      /* Only a TLS record starts with 0x16 */
+      *ssl_request = (unsigned char)peek_buffer[0] == 0x16;
+      return 0;
    }
 
    // Check for SSL request by matching `Client Hello` bytes
@@ -5884,10 +6056,10 @@ pgagroal_is_ssl_request(int client_fd)
       ((unsigned char)peek_buffer[1] == 0x03) &&
       ((unsigned char)peek_buffer[2] == 0x01 || (unsigned char)peek_buffer[2] == 0x02 || (unsigned char)peek_buffer[2] == 0x03 || (unsigned char)peek_buffer[2] == 0x04))
    {
-      ssl_req = true;
+      *ssl_request = true;
    }
 
-   return ssl_req;
+   return 0;
 }
 
 char*
@@ -6095,27 +6267,38 @@ pgagroal_is_cert_authorized(const char* cert_identity, const char* requested_use
 static char*
 resolve_database_alias(char* username, char* database)
 {
+   uint64_t rules;
+   unsigned int generation;
+   struct limit_index* index;
+   struct limit_name* name;
+   struct limit_name* alias;
    struct main_configuration* config = (struct main_configuration*)shmem;
 
-   // Find the best rule for this user/database combination
-   for (int i = 0; i < config->number_of_limits; i++)
+   do
    {
-      bool username_match = (!strcmp("all", config->limits[i].username) || !strcmp(username, config->limits[i].username));
+      rules = 0;
+      generation = pgagroal_limit_read_begin(shmem);
+
+      index = pgagroal_get_limit_index(shmem);
+      alias = pgagroal_find_limit_name(index, database);
 
-      if (username_match)
+      if (alias != NULL && alias->aliases != 0)
       {
-         // Check if database matches any alias for this limit entry
-         for (int j = 0; j < config->limits[i].aliases_count; j++)
-         {
-            if (!strcmp(database, config->limits[i].aliases[j]))
-            {
-               pgagroal_log_debug("resolve_database_alias: '%s' -> '%s' (rule %d)",
-                                  database, config->limits[i].database, i);
-               return config->limits[i].database; // Return real database name
-            }
-         }
+         // Find the first rule for this user having the database as alias
+         name = pgagroal_find_limit_name(index, username);
+         rules = alias->aliases & (index->all_usernames | (name != NULL ? name->usernames : 0));
       }
    }
+   while (pgagroal_limit_read_retry(shmem, generation));
+
+   if (rules != 0)
+   {
+      int i = __builtin_ctzll(rules);
+
+      pgagroal_log_debug("resolve_database_alias: '%s' -> '%s' (rule %d)",
+                         database, config->limits[i].database, i);
+      return config->limits[i].database; // Return real database name
+   }
 
    // Not an alias, return original name
    return database;
@@ -39,6 +39,9 @@ void* shmem = NULL;
 void* pipeline_shmem = NULL;
 void* prometheus_shmem = NULL;
 void* prometheus_cache_shmem = NULL;
+void* security_shmem = NULL;
+void* log_shmem = NULL;
+void* tracker_shmem = NULL;
 
 int
 pgagroal_create_shared_memory(size_t size, unsigned char hp, void** shmem)
@@ -81,8 +84,7 @@ pgagroal_create_shared_memory(size_t size, unsigned char hp, void** shmem)
       }
    }
 
-   memset(s, 0, size);
-
+   /* Anonymous mappings are zero filled, and populated upon first access */
    *shmem = s;
 
    return 0;
@@ -101,7 +103,6 @@ pgagroal_resize_shared_memory(size_t size, void* shmem, size_t* new_size, void**
       return 1;
    }
 
-   memset(*new_shmem, 0, *new_size);
    memcpy(*new_shmem, shmem, size);
 
    return 0;
@@ -33,6 +33,7 @@
 #include <management.h>
 #include <memory.h>
 #include <network.h>
+#include <prometheus.h>
 #include <status.h>
 #include <utils.h>
 
@@ -234,6 +235,19 @@ status_details(bool details, struct json* response)
          pgagroal_json_put(js, MANAGEMENT_ARGUMENT_INITIAL_CONNECTIONS, (uintptr_t)config->limits[i].initial_size, ValueUInt32);
          pgagroal_json_put(js, MANAGEMENT_ARGUMENT_MIN_CONNECTIONS, (uintptr_t)config->limits[i].min_size, ValueUInt32);
 
+         if (config->common.metrics > 0 && prometheus_shmem != NULL)
+         {
+            struct main_prometheus* prometheus = (struct main_prometheus*)prometheus_shmem;
+
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_HITS, (uintptr_t)atomic_load(&prometheus->acquires[i].hit), ValueUInt64);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_WAITS, (uintptr_t)atomic_load(&prometheus->acquires[i].wait), ValueUInt64);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_TIMEOUTS, (uintptr_t)atomic_load(&prometheus->acquires[i].timeout), ValueUInt64);
+
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_P50, (uintptr_t)pgagroal_prometheus_connection_acquire_percentile(i, 50.0), ValueUInt64);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_P90, (uintptr_t)pgagroal_prometheus_connection_acquire_percentile(i, 90.0), ValueUInt64);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_P99, (uintptr_t)pgagroal_prometheus_connection_acquire_percentile(i, 99.0), ValueUInt64);
+         }
+
          pgagroal_json_append(limits, (uintptr_t)js, ValueJSON);
       }
 
@@ -292,5 +306,40 @@ status_details(bool details, struct json* response)
       }
 
       pgagroal_json_put(response, MANAGEMENT_ARGUMENT_CONNECTIONS, (uintptr_t)connections, ValueJSON);
+
+      if (config->common.metrics > 0 && prometheus_shmem != NULL)
+      {
+         struct json* latencies = NULL;
+         struct main_prometheus* prometheus = (struct main_prometheus*)prometheus_shmem;
+
+         pgagroal_json_create(&latencies);
+
+         for (int i = 0; i < NUMBER_OF_LATENCIES; i++)
+         {
+            struct json* js = NULL;
+            struct prometheus_latency* latency = &prometheus->latencies[i];
+
+            if (atomic_load(&latency->state) != LATENCY_READY)
+            {
+               break;
+            }
+
+            pgagroal_json_create(&js);
+
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_DATABASE, (uintptr_t)latency->database, ValueString);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_USERNAME, (uintptr_t)latency->username, ValueString);
+
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_COUNT, (uintptr_t)atomic_load(&latency->count), ValueUInt64);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_SUM, (uintptr_t)atomic_load(&latency->sum), ValueUInt64);
+
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_P50, (uintptr_t)pgagroal_prometheus_query_latency_percentile(i, 50.0), ValueUInt64);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_P90, (uintptr_t)pgagroal_prometheus_query_latency_percentile(i, 90.0), ValueUInt64);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_P99, (uintptr_t)pgagroal_prometheus_query_latency_percentile(i, 99.0), ValueUInt64);
+
+            pgagroal_json_append(latencies, (uintptr_t)js, ValueJSON);
+         }
+
+         pgagroal_json_put(response, MANAGEMENT_ARGUMENT_LATENCIES, (uintptr_t)latencies, ValueJSON);
+      }
    }
 }
@@ -28,162 +28,448 @@
 
 /* pgagroal */
 #include <pgagroal.h>
+#include <json.h>
 #include <logging.h>
-#include <server.h>
+#include <management.h>
+#include <memory.h>
+#include <network.h>
+#include <shmem.h>
 #include <tracker.h>
 
 /* system */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/time.h>
 #include <sys/types.h>
 
-static int count_connections(void);
+#define TRACKER_BATCH     256
+#define TRACKER_SLEEP     10000000L
+#define TRACKER_HEARTBEAT 1
+#define TRACKER_STALL     100
 
-void
-pgagroal_tracking_event_basic(int id, char* username, char* database)
+static struct tracker_event* event_claim(int id, unsigned long* position);
+static void event_publish(struct tracker_event* event, unsigned long position);
+static void event_name(char* dst, char* src);
+static struct json* event_json(struct tracker_event* event);
+
+int
+pgagroal_init_tracker(size_t* p_size, void** p_shmem)
 {
-   int primary;
+   struct tracker_ring* ring = NULL;
    struct main_configuration* config;
 
    config = (struct main_configuration*)shmem;
 
-   if (config->tracker)
+   /* The segment is zero filled, and a zero sequence is an unwritten event */
+   if (pgagroal_create_shared_memory(sizeof(struct tracker_ring), config->common.hugepage, (void**)&ring))
    {
-      struct timeval t;
-      long long milliseconds;
+      goto error;
+   }
 
-      gettimeofday(&t, NULL);
-      milliseconds = t.tv_sec * 1000 + t.tv_usec / 1000;
+   atomic_init(&ring->head, 0);
 
-      if (username == NULL)
-      {
-         username = "";
-      }
+   *p_shmem = ring;
+   *p_size = sizeof(struct tracker_ring);
 
-      if (database == NULL)
-      {
-         database = "";
-      }
+   return 0;
+
+error:
+
+   *p_shmem = NULL;
+   *p_size = 0;
+
+   return 1;
+}
+
+char*
+pgagroal_tracker_event_name(int id)
+{
+   switch (id)
+   {
+      case TRACKER_CLIENT_START:
+         return "CLIENT_START";
+      case TRACKER_CLIENT_STOP:
+         return "CLIENT_STOP";
+      case TRACKER_GET_CONNECTION_SUCCESS:
+         return "GET_CONNECTION_SUCCESS";
+      case TRACKER_GET_CONNECTION_TIMEOUT:
+         return "GET_CONNECTION_TIMEOUT";
+      case TRACKER_GET_CONNECTION_ERROR:
+         return "GET_CONNECTION_ERROR";
+      case TRACKER_RETURN_CONNECTION_SUCCESS:
+         return "RETURN_CONNECTION_SUCCESS";
+      case TRACKER_RETURN_CONNECTION_KILL:
+         return "RETURN_CONNECTION_KILL";
+      case TRACKER_KILL_CONNECTION:
+         return "KILL_CONNECTION";
+      case TRACKER_AUTHENTICATE:
+         return "AUTHENTICATE";
+      case TRACKER_BAD_CONNECTION:
+         return "BAD_CONNECTION";
+      case TRACKER_IDLE_TIMEOUT:
+         return "IDLE_TIMEOUT";
+      case TRACKER_MAX_CONNECTION_AGE:
+         return "MAX_CONNECTION_AGE";
+      case TRACKER_INVALID_CONNECTION:
+         return "INVALID_CONNECTION";
+      case TRACKER_FLUSH:
+         return "FLUSH";
+      case TRACKER_REMOVE_CONNECTION:
+         return "REMOVE_CONNECTION";
+      case TRACKER_PREFILL:
+         return "PREFILL";
+      case TRACKER_PREFILL_RETURN:
+         return "PREFILL_RETURN";
+      case TRACKER_PREFILL_KILL:
+         return "PREFILL_KILL";
+      case TRACKER_WORKER_RETURN1:
+         return "WORKER_RETURN1";
+      case TRACKER_WORKER_RETURN2:
+         return "WORKER_RETURN2";
+      case TRACKER_WORKER_KILL1:
+         return "WORKER_KILL1";
+      case TRACKER_WORKER_KILL2:
+         return "WORKER_KILL2";
+      case TRACKER_TX_RETURN_CONNECTION_START:
+         return "TX_RETURN_CONNECTION_START";
+      case TRACKER_TX_RETURN_CONNECTION_STOP:
+         return "TX_RETURN_CONNECTION_STOP";
+      case TRACKER_TX_GET_CONNECTION:
+         return "TX_GET_CONNECTION";
+      case TRACKER_TX_RETURN_CONNECTION:
+         return "TX_RETURN_CONNECTION";
+      case TRACKER_SOCKET_ASSOCIATE_CLIENT:
+         return "SOCKET_ASSOCIATE_CLIENT";
+      case TRACKER_SOCKET_ASSOCIATE_SERVER:
+         return "SOCKET_ASSOCIATE_SERVER";
+      case TRACKER_SOCKET_DISASSOCIATE_CLIENT:
+         return "SOCKET_DISASSOCIATE_CLIENT";
+      case TRACKER_SOCKET_DISASSOCIATE_SERVER:
+         return "SOCKET_DISASSOCIATE_SERVER";
+      default:
+         return "UNKNOWN";
+   }
+}
+
+void
+pgagroal_tracking_event_basic(int id, char* username, char* database)
+{
+   unsigned long position;
+   struct tracker_event* event = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
 
-      pgagroal_get_primary(&primary);
-
-      pgagroal_log_info("PGAGROAL|%d|%d|%d|%lld|%d|%s|%s|%s|%d|%d|%d|%d|%d|%d|%d|%d|",
-                        id,
-                        -1,
-                        -3,
-                        milliseconds,
-                        getpid(),
-                        username,
-                        database,
-                        "",
-                        -1,
-                        primary,
-                        -1,
-                        -3,
-                        -1,
-                        -1,
-                        atomic_load(&config->active_connections),
-                        count_connections());
+   if (config->tracker && tracker_shmem != NULL)
+   {
+      event = event_claim(id, &position);
+
+      event_name(&event->username[0], username);
+      event_name(&event->database[0], database);
+
+      event_publish(event, position);
    }
 }
 
 void
 pgagroal_tracking_event_slot(int id, int slot)
 {
+   unsigned long position;
+   struct tracker_event* event = NULL;
    struct main_configuration* config;
 
    config = (struct main_configuration*)shmem;
 
-   if (config->tracker)
+   if (config->tracker && tracker_shmem != NULL)
    {
-      char* username = NULL;
-      char* database = NULL;
-      char* appname = NULL;
-      struct timeval t;
-      long long milliseconds;
-
-      gettimeofday(&t, NULL);
-      milliseconds = t.tv_sec * 1000 + t.tv_usec / 1000;
+      event = event_claim(id, &position);
 
       if (slot != -1)
       {
-         username = &config->connections[slot].username[0];
-         database = &config->connections[slot].database[0];
-         appname = &config->connections[slot].appname[0];
-      }
-      else
-      {
-         username = "";
-         database = "";
-         appname = "";
+         event->slot = slot;
+         event->state = atomic_load(&config->states[slot]);
+         event->new = config->connections[slot].new;
+         event->server = config->connections[slot].server;
+         event->tx_mode = config->connections[slot].tx_mode;
+         event->has_security = config->connections[slot].has_security;
+         event->limit_rule = config->connections[slot].limit_rule;
+         event->fd = config->connections[slot].fd;
+
+         event_name(&event->username[0], &config->connections[slot].username[0]);
+         event_name(&event->database[0], &config->connections[slot].database[0]);
+         event_name(&event->appname[0], &config->connections[slot].appname[0]);
       }
 
-      pgagroal_log_info("PGAGROAL|%d|%d|%d|%lld|%d|%s|%s|%s|%d|%d|%d|%d|%d|%d|%d|%d|",
-                        id,
-                        slot,
-                        atomic_load(&config->states[slot]),
-                        milliseconds,
-                        getpid(),
-                        username,
-                        database,
-                        appname,
-                        config->connections[slot].new,
-                        config->connections[slot].server,
-                        config->connections[slot].tx_mode,
-                        config->connections[slot].has_security,
-                        config->connections[slot].limit_rule,
-                        config->connections[slot].fd,
-                        atomic_load(&config->active_connections),
-                        count_connections());
+      event_publish(event, position);
    }
 }
 
 void
 pgagroal_tracking_event_socket(int id, int socket)
 {
+   unsigned long position;
+   struct tracker_event* event = NULL;
    struct main_configuration* config;
 
    config = (struct main_configuration*)shmem;
 
-   if (config->tracker)
+   if (config->tracker && tracker_shmem != NULL)
    {
-      struct timeval t;
-      long long milliseconds;
+      event = event_claim(id, &position);
 
-      gettimeofday(&t, NULL);
-      milliseconds = t.tv_sec * 1000 + t.tv_usec / 1000;
+      event->socket = socket;
 
-      pgagroal_log_info("PGAGROAL|%d|%lld|%d|%d|",
-                        id,
-                        milliseconds,
-                        getpid(),
-                        socket);
+      event_publish(event, position);
    }
 }
 
-static int
-count_connections(void)
+void
+pgagroal_tracker_stream(SSL* ssl __attribute__((unused)), int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
 {
-   int active = 0;
-   struct main_configuration* config;
+   int count;
+   int stalled = 0;
+   unsigned long cursor;
+   unsigned long head;
+   unsigned long sequence;
+   unsigned long lost;
+   time_t start_time;
+   time_t last_time;
+   struct tracker_event copy;
+   struct tracker_event* event = NULL;
+   struct tracker_ring* ring = NULL;
+   struct json* response = NULL;
+   struct json* events = NULL;
 
-   config = (struct main_configuration*)shmem;
+   pgagroal_memory_init();
+   pgagroal_start_logging();
 
-   for (int i = 0; i < config->max_connections; i++)
+   ring = (struct tracker_ring*)tracker_shmem;
+
+   if (ring == NULL)
    {
-      int state = atomic_load(&config->states[i]);
-      switch (state)
+      pgagroal_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_TRACKER_DISABLED, compression, encryption, payload);
+      pgagroal_log_warn("Tracker: Not enabled at startup");
+
+      goto error;
+   }
+
+   if (pgagroal_management_create_response(payload, -1, &response))
+   {
+      goto error;
+   }
+
+   start_time = time(NULL);
+   last_time = start_time;
+
+   /* Only the events from now on */
+   cursor = atomic_load(&ring->head);
+
+   while (true)
+   {
+      count = 0;
+      lost = 0;
+      events = NULL;
+
+      if (pgagroal_json_create(&events))
+      {
+         goto error;
+      }
+
+      head = atomic_load(&ring->head);
+
+      if (head - cursor > TRACKER_RING_SLOTS)
+      {
+         lost += head - cursor - TRACKER_RING_SLOTS;
+         cursor = head - TRACKER_RING_SLOTS;
+      }
+
+      while (cursor != head && count < TRACKER_BATCH)
+      {
+         event = &ring->events[cursor & (TRACKER_RING_SLOTS - 1)];
+
+         sequence = atomic_load_explicit(&event->sequence, memory_order_acquire);
+
+         if (sequence == 0 || sequence < cursor + 1)
+         {
+            /* The event is still written, unless the process is gone */
+            if (++stalled < TRACKER_STALL)
+            {
+               break;
+            }
+
+            lost++;
+            cursor++;
+            stalled = 0;
+            continue;
+         }
+
+         stalled = 0;
+
+         if (sequence == cursor + 1)
+         {
+            memcpy(&copy, event, sizeof(struct tracker_event));
+            atomic_thread_fence(memory_order_acquire);
+
+            if (atomic_load_explicit(&event->sequence, memory_order_relaxed) == sequence)
+            {
+               pgagroal_json_append(events, (uintptr_t)event_json(&copy), ValueJSON);
+               count++;
+            }
+            else
+            {
+               lost++;
+            }
+         }
+         else
+         {
+            /* Overwritten by a newer event */
+            lost++;
+         }
+
+         cursor++;
+      }
+
+      if (count > 0 || lost > 0 || time(NULL) - last_time >= TRACKER_HEARTBEAT)
       {
-         case STATE_IN_USE:
-         case STATE_GRACEFULLY:
-            active++;
-         default:
+         pgagroal_json_put(response, MANAGEMENT_ARGUMENT_EVENTS, (uintptr_t)events, ValueJSON);
+         pgagroal_json_put(response, MANAGEMENT_ARGUMENT_LOST, (uintptr_t)lost, ValueUInt64);
+         events = NULL;
+
+         last_time = time(NULL);
+
+         /* The client has disconnected */
+         if (pgagroal_management_response_ok(NULL, client_fd, start_time, last_time, compression, encryption, payload))
+         {
             break;
+         }
+      }
+      else
+      {
+         pgagroal_json_destroy(events);
+         events = NULL;
+      }
+
+      if (count < TRACKER_BATCH)
+      {
+         SLEEP(TRACKER_SLEEP);
       }
    }
 
-   return active;
+   pgagroal_log_debug("Tracker: Stream closed");
+
+   pgagroal_json_destroy(payload);
+
+   pgagroal_disconnect(client_fd);
+
+   pgagroal_stop_logging();
+   pgagroal_memory_destroy();
+
+   exit(0);
+
+error:
+
+   pgagroal_json_destroy(events);
+   pgagroal_json_destroy(payload);
+
+   pgagroal_disconnect(client_fd);
+
+   pgagroal_stop_logging();
+   pgagroal_memory_destroy();
+
+   exit(1);
+}
+
+static struct tracker_event*
+event_claim(int id, unsigned long* position)
+{
+   unsigned long pos;
+   struct timespec ts;
+   struct tracker_event* event = NULL;
+   struct tracker_ring* ring;
+   struct main_configuration* config;
+
+   ring = (struct tracker_ring*)tracker_shmem;
+   config = (struct main_configuration*)shmem;
+
+   pos = atomic_fetch_add(&ring->head, 1);
+   event = &ring->events[pos & (TRACKER_RING_SLOTS - 1)];
+
+   /* Readers skip the event until it is published */
+   atomic_store_explicit(&event->sequence, 0, memory_order_relaxed);
+   atomic_thread_fence(memory_order_release);
+
+   clock_gettime(CLOCK_REALTIME, &ts);
+
+   event->timestamp = (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+   event->id = id;
+   event->pid = (int)getpid();
+   event->slot = -1;
+   event->state = -3;
+   event->server = -1;
+   event->fd = -1;
+   event->socket = -1;
+   event->limit_rule = -1;
+   event->active_connections = atomic_load(&config->active_connections);
+   event->new = -1;
+   event->tx_mode = -1;
+   event->has_security = -3;
+   event->username[0] = '\0';
+   event->database[0] = '\0';
+   event->appname[0] = '\0';
+
+   *position = pos;
+
+   return event;
+}
+
+static void
+event_publish(struct tracker_event* event, unsigned long position)
+{
+   atomic_store_explicit(&event->sequence, position + 1, memory_order_release);
+}
+
+static void
+event_name(char* dst, char* src)
+{
+   size_t length = 0;
+
+   if (src != NULL)
+   {
+      length = strnlen(src, TRACKER_NAME_LENGTH - 1);
+      memcpy(dst, src, length);
+   }
+
+   dst[length] = '\0';
+}
+
+static struct json*
+event_json(struct tracker_event* event)
+{
+   struct json* j = NULL;
+
+   if (pgagroal_json_create(&j))
+   {
+      return NULL;
+   }
+
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_TIMESTAMP, (uintptr_t)event->timestamp, ValueInt64);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_EVENT, (uintptr_t)pgagroal_tracker_event_name(event->id), ValueString);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_PID, (uintptr_t)event->pid, ValueInt32);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_SLOT, (uintptr_t)event->slot, ValueInt32);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_STATE, (uintptr_t)event->state, ValueInt32);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_USERNAME, (uintptr_t)event->username, ValueString);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_DATABASE, (uintptr_t)event->database, ValueString);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_APPNAME, (uintptr_t)event->appname, ValueString);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_NEW, (uintptr_t)event->new, ValueInt32);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)event->server, ValueInt32);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_TX_MODE, (uintptr_t)event->tx_mode, ValueInt32);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_HAS_SECURITY, (uintptr_t)event->has_security, ValueInt32);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_LIMIT_RULE, (uintptr_t)event->limit_rule, ValueInt32);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_FD, (uintptr_t)event->fd, ValueInt32);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_SOCKET, (uintptr_t)event->socket, ValueInt32);
+   pgagroal_json_put(j, MANAGEMENT_ARGUMENT_ACTIVE_CONNECTIONS, (uintptr_t)event->active_connections, ValueInt32);
+
+   return j;
 }
@@ -510,6 +510,47 @@ pgagroal_get_timestamp_string(time_t start_time, time_t end_time, int32_t* secon
    return result;
 }
 
+uint64_t
+pgagroal_get_monotonic_micros(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)(ts.tv_nsec / 1000);
+}
+
+int
+pgagroal_latency_bucket(uint64_t micros)
+{
+   int msb;
+
+   if (micros < 4)
+   {
+      return (int)micros;
+   }
+
+   // the power of two selects the octave, the next two bits the sub-bucket
+   msb = 63 - __builtin_clzll(micros);
+
+   return MIN((msb - 1) * 4 + (int)((micros >> (msb - 2)) & 3), LATENCY_BUCKETS - 1);
+}
+
+uint64_t
+pgagroal_latency_bucket_upper(int bucket)
+{
+   int msb;
+
+   if (bucket < 4)
+   {
+      return (uint64_t)bucket + 1;
+   }
+
+   msb = bucket / 4 + 1;
+
+   return (uint64_t)(4 + (bucket % 4) + 1) << (msb - 2);
+}
+
 char*
 pgagroal_get_home_directory(void)
 {
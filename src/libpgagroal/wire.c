@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgagroal */
+#include <pgagroal.h>
+#include <utils.h>
+#include <wire.h>
+
+/* system */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void
+pgagroal_wire_reset(struct wire* w, int fd)
+{
+   w->fd = fd;
+   w->input_start = 0;
+   w->input_end = 0;
+   w->output_length = 0;
+   w->failed = false;
+}
+
+void
+pgagroal_wire_destroy(struct wire* w)
+{
+   free(w->message);
+   w->message = NULL;
+   w->message_size = 0;
+
+   free(w->output);
+   w->output = NULL;
+   w->output_length = 0;
+   w->output_size = 0;
+}
+
+int
+pgagroal_wire_read(struct wire* w, void* data, size_t length)
+{
+   size_t offset = 0;
+
+   while (offset < length)
+   {
+      size_t n;
+
+      if (w->input_start == w->input_end)
+      {
+         ssize_t r = read(w->fd, &w->input[0], WIRE_BUFFER_SIZE);
+
+         if (r <= 0)
+         {
+            if (r == -1 && errno == EINTR)
+            {
+               continue;
+            }
+
+            return 1;
+         }
+
+         w->input_start = 0;
+         w->input_end = (size_t)r;
+      }
+
+      n = MIN(length - offset, w->input_end - w->input_start);
+      if (data != NULL)
+      {
+         memcpy((char*)data + offset, &w->input[w->input_start], n);
+      }
+
+      w->input_start += n;
+      offset += n;
+   }
+
+   return 0;
+}
+
+int
+pgagroal_wire_read_message(struct wire* w, char* kind, int* length)
+{
+   char header[5];
+
+   *length = 0;
+
+   if (pgagroal_wire_read(w, &header[0], sizeof(header)))
+   {
+      return 1;
+   }
+
+   *kind = pgagroal_read_byte(&header[0]);
+   *length = pgagroal_read_int32(&header[1]) - 4;
+
+   if (*length < 0)
+   {
+      return 1;
+   }
+
+   /* One more byte so the payload is always terminated */
+   if ((size_t)*length + 1 > w->message_size)
+   {
+      char* message = realloc(w->message, *length + 1);
+
+      if (message == NULL)
+      {
+         return 1;
+      }
+
+      w->message = message;
+      w->message_size = *length + 1;
+   }
+
+   w->message[*length] = '\0';
+
+   return pgagroal_wire_read(w, w->message, *length);
+}
+
+int
+pgagroal_wire_flush(struct wire* w)
+{
+   size_t offset = 0;
+
+   if (w->failed)
+   {
+      return 1;
+   }
+
+   while (offset < w->output_length)
+   {
+      ssize_t n = write(w->fd, w->output + offset, w->output_length - offset);
+
+      if (n == -1)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+
+         w->output_length = 0;
+         return 1;
+      }
+
+      offset += (size_t)n;
+   }
+
+   w->output_length = 0;
+
+   return 0;
+}
+
+int
+pgagroal_wire_append(struct wire* w, void* data, size_t length)
+{
+   if (w->failed)
+   {
+      return 1;
+   }
+
+   if (w->output_length + length > w->output_size)
+   {
+      size_t size = MAX(w->output_size * 2, w->output_length + length + WIRE_BUFFER_SIZE);
+      char* output = realloc(w->output, size);
+
+      if (output == NULL)
+      {
+         /* The message would be incomplete, so nothing is written */
+         w->output_length = 0;
+         w->failed = true;
+         return 1;
+      }
+
+      w->output = output;
+      w->output_size = size;
+   }
+
+   memcpy(w->output + w->output_length, data, length);
+   w->output_length += length;
+
+   return 0;
+}
+
+int
+pgagroal_wire_append_byte(struct wire* w, char b)
+{
+   return pgagroal_wire_append(w, &b, 1);
+}
+
+int
+pgagroal_wire_append_int16(struct wire* w, int16_t i)
+{
+   unsigned char data[2];
+
+   data[0] = (unsigned char)((i >> 8) & 0xFF);
+   data[1] = (unsigned char)(i & 0xFF);
+
+   return pgagroal_wire_append(w, &data[0], sizeof(data));
+}
+
+int
+pgagroal_wire_append_int32(struct wire* w, int32_t i)
+{
+   char data[4];
+
+   pgagroal_write_int32(&data[0], i);
+
+   return pgagroal_wire_append(w, &data[0], sizeof(data));
+}
+
+int
+pgagroal_wire_append_string(struct wire* w, char* str)
+{
+   return pgagroal_wire_append(w, str, strlen(str) + 1);
+}
+
+int
+pgagroal_wire_append_header(struct wire* w, char kind, int32_t length)
+{
+   if (pgagroal_wire_append_byte(w, kind))
+   {
+      return 1;
+   }
+
+   return pgagroal_wire_append_int32(w, length);
+}
@@ -52,6 +52,7 @@
 volatile int exit_code = WORKER_FAILURE;
 
 static void signal_callback(void);
+static int handover_client(int client_fd, char* address, int slot, SSL* client_ssl, SSL* server_ssl);
 
 void
 pgagroal_worker(int client_fd, char* address, char** argv)
@@ -70,6 +71,7 @@ pgagroal_worker(int client_fd, char* address, char** argv)
    int transfer_fd = -1;
    SSL* client_ssl = NULL;
    SSL* server_ssl = NULL;
+   bool handed_over = false;
 
    pgagroal_start_logging();
    pgagroal_memory_init();
@@ -91,7 +93,15 @@ pgagroal_worker(int client_fd, char* address, char** argv)
    pgagroal_prometheus_client_wait_add();
    /* Authentication */
    auth_status = pgagroal_authenticate(client_fd, address, &slot, &client_ssl, &server_ssl);
-   if (auth_status == AUTH_SUCCESS)
+   if (auth_status == AUTH_SUCCESS && !handover_client(client_fd, address, slot, client_ssl, server_ssl))
+   {
+      /* The client is served by a transaction worker, and the connection is back in the pool */
+      handed_over = true;
+      slot = -1;
+
+      pgagroal_prometheus_client_wait_sub();
+   }
+   else if (auth_status == AUTH_SUCCESS)
    {
       pgagroal_log_debug("pgagroal_worker: Slot %d (%d -> %d)", slot, client_fd, config->connections[slot].fd);
 
@@ -183,12 +193,6 @@ pgagroal_worker(int client_fd, char* address, char** argv)
 
       pgagroal_event_loop_run();
 
-      if (config->pipeline == PIPELINE_TRANSACTION)
-      {
-         /* The slot may have been updated */
-         slot = client_io.slot;
-      }
-
       pgagroal_prometheus_client_active_sub();
    }
    else
@@ -200,7 +204,7 @@ pgagroal_worker(int client_fd, char* address, char** argv)
       pgagroal_prometheus_client_wait_sub();
    }
 
-   if (config->common.log_disconnections)
+   if (config->common.log_disconnections && !handed_over)
    {
       if (auth_status == AUTH_SUCCESS)
       {
@@ -213,16 +217,22 @@ pgagroal_worker(int client_fd, char* address, char** argv)
       }
    }
 
-   /* Return to pool */
-   if (slot != -1)
+   if (started)
    {
-      if (started)
+      p.stop(loop, &client_io);
+      pgagroal_prometheus_session_time(difftime(time(NULL), start_time));
+      pgagroal_event_loop_destroy();
+
+      if (config->pipeline == PIPELINE_TRANSACTION)
       {
-         p.stop(loop, &client_io);
-         pgagroal_prometheus_session_time(difftime(time(NULL), start_time));
-         pgagroal_event_loop_destroy();
+         /* The slot may have been updated */
+         slot = client_io.slot;
       }
+   }
 
+   /* Return to pool */
+   if (slot != -1)
+   {
       if ((auth_status == AUTH_SUCCESS || auth_status == AUTH_BAD_PASSWORD) &&
           (exit_code == WORKER_SUCCESS || exit_code == WORKER_CLIENT_FAILURE ||
            (exit_code == WORKER_FAILURE && config->connections[slot].has_security != SECURITY_INVALID)))
@@ -295,7 +305,10 @@ pgagroal_worker(int client_fd, char* address, char** argv)
    pgagroal_disconnect(client_fd);
 
    pgagroal_prometheus_client_sockets_sub();
-   pgagroal_prometheus_query_count_specified_reset(slot);
+   if (slot != -1)
+   {
+      pgagroal_prometheus_query_count_specified_reset(slot);
+   }
 
    pgagroal_pool_status();
    pgagroal_log_debug("After client: PID %d Slot %d (%d)", getpid(), slot, exit_code);
@@ -317,3 +330,37 @@ signal_callback(void)
    exit_code = WORKER_SHUTDOWN;
    pgagroal_event_loop_break();
 }
+
+static int
+handover_client(int client_fd, char* address, int slot, SSL* client_ssl, SSL* server_ssl)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   /* The TLS state of a client can't be moved to another process */
+   if (config->pipeline != PIPELINE_TRANSACTION || config->transaction_workers <= 0 ||
+       client_ssl != NULL || server_ssl != NULL)
+   {
+      return 1;
+   }
+
+   if (pgagroal_transaction_handover(client_fd, config->connections[slot].username, config->connections[slot].database,
+                                     config->connections[slot].appname, address))
+   {
+      pgagroal_log_debug("pgagroal_worker: No transaction worker for client %d", client_fd);
+      return 1;
+   }
+
+   if (config->common.log_connections)
+   {
+      pgagroal_log_info("connect: user=%s database=%s address=%s", config->connections[slot].username,
+                        config->connections[slot].database, address);
+   }
+
+   pgagroal_tracking_event_slot(TRACKER_TX_RETURN_CONNECTION_START, slot);
+
+   pgagroal_return_connection(slot, server_ssl, true);
+
+   return 0;
+}
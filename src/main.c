@@ -44,6 +44,7 @@
 #include <server.h>
 #include <shmem.h>
 #include <status.h>
+#include <tracker.h>
 #include <utils.h>
 #include <worker.h>
 
@@ -74,10 +75,12 @@
 #define MAX_FDS        64
 #define SIGNALS_NUMBER 8
 
+#define RESPAWN_STABLE    60
+#define RESPAWN_MAX_DELAY 60
+
 static void accept_main_cb(struct io_watcher* watcher);
 static void accept_mgt_cb(struct io_watcher* watcher);
 static void accept_transfer_cb(struct io_watcher* watcher);
-static void accept_metrics_cb(struct io_watcher* watcher);
 static void accept_management_cb(struct io_watcher* watcher);
 static void shutdown_cb(void);
 static void reload_cb(void);
@@ -88,6 +91,7 @@ static void sigchld_cb(void);
 static void idle_timeout_cb(void);
 static void max_connection_age_cb(void);
 static void rotate_frontend_password_cb(void);
+static void respawn_cb(void);
 static void validation_cb(void);
 static void disconnect_client_cb(void);
 static void frontend_user_password_startup(struct main_configuration* config);
@@ -100,6 +104,22 @@ static void reload_set_configuration(SSL* ssl, int client_fd, uint8_t compressio
 static void create_pidfile_or_exit(void);
 static void remove_pidfile(void);
 static void shutdown_ports(void);
+static int spawn_spare_worker(void);
+static int dispatch_spare_worker(int client_fd, char* address);
+static void maintain_spare_workers(int max_spawn);
+static void close_spare_workers(void);
+static void spare_worker(int fd);
+static void start_transaction_workers(void);
+static int spawn_transaction_worker(int index);
+static void transaction_worker_exited(pid_t pid);
+static void respawn_started(struct respawn* r);
+static int respawn_schedule(struct respawn* r);
+static bool respawn_due(struct respawn* r, time_t now);
+static void start_log_writer(void);
+static int spawn_log_writer(void);
+static void stop_log_writer(void);
+static void restart_metrics(void);
+static void stop_metrics_server(void);
 
 static char** argv_ptr;
 static struct event_loop* main_loop = NULL;
@@ -111,7 +131,6 @@ static int main_fds_length = -1;
 static int unix_management_socket = -1;
 static int unix_transfer_socket = -1;
 static int unix_pgsql_socket = -1;
-static struct accept_io io_metrics[MAX_FDS];
 static int* metrics_fds = NULL;
 static int metrics_fds_length = -1;
 static struct accept_io io_management[MAX_FDS];
@@ -120,6 +139,16 @@ static int management_fds_length = -1;
 static struct pipeline main_pipeline;
 static int known_fds[MAX_NUMBER_OF_CONNECTIONS];
 static struct client* clients = NULL;
+static struct spare_worker* spare_workers = NULL;
+static int number_of_spare_workers = 0;
+static unsigned long spare_workers_generation = 0;
+static pid_t transaction_workers[NUMBER_OF_TRANSACTION_WORKERS];
+static struct respawn transaction_workers_respawn[NUMBER_OF_TRANSACTION_WORKERS];
+static pid_t log_writer = 0;
+static struct respawn log_writer_respawn;
+static pid_t metrics_server = 0;
+static struct respawn metrics_respawn;
+static size_t log_shmem_size = 0;
 static struct accept_io io_transfer;
 
 static void
@@ -221,51 +250,82 @@ shutdown_io(void)
 }
 
 static void
-start_metrics(void)
+start_management(void)
 {
-   for (int i = 0; i < metrics_fds_length; i++)
+   for (int i = 0; i < management_fds_length; i++)
    {
-      int sockfd = *(metrics_fds + i);
+      int sockfd = *(management_fds + i);
 
-      memset(&io_metrics[i], 0, sizeof(struct accept_io));
-      pgagroal_event_accept_init(&io_metrics[i].watcher, sockfd, accept_metrics_cb);
-      io_metrics[i].socket = sockfd;
-      io_metrics[i].argv = argv_ptr;
-      pgagroal_io_start(&io_metrics[i].watcher);
+      memset(&io_management[i], 0, sizeof(struct accept_io));
+      pgagroal_event_accept_init(&io_management[i].watcher, sockfd, accept_management_cb);
+      io_management[i].socket = sockfd;
+      io_management[i].argv = argv_ptr;
+      pgagroal_io_start(&io_management[i].watcher);
    }
 }
 
 static void
-shutdown_metrics(void)
+shutdown_management(void)
 {
-   for (int i = 0; i < metrics_fds_length; i++)
+   for (int i = 0; i < management_fds_length; i++)
    {
-      pgagroal_disconnect(io_metrics[i].socket);
+      pgagroal_disconnect(io_management[i].socket);
       errno = 0;
    }
 }
 
 static void
-start_management(void)
+start_metrics(void)
 {
-   for (int i = 0; i < management_fds_length; i++)
+   pid_t pid;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   respawn_started(&metrics_respawn);
+
+   /* The metrics server owns the metrics ports, and serves every scrape */
+   pid = fork();
+   if (pid == -1)
    {
-      int sockfd = *(management_fds + i);
+      /* No process */
+      pgagroal_log_error("Cannot create process");
+      metrics_server = 0;
+      respawn_schedule(&metrics_respawn);
+   }
+   else if (pid > 0)
+   {
+      metrics_server = pid;
+   }
+   else
+   {
+      /* See accept_main_cb */
+      if (setpgid(0, 0) == -1)
+      {
+         pgagroal_log_error("setpgid error: %s", strerror(errno));
+         exit(1);
+      }
 
-      memset(&io_management[i], 0, sizeof(struct accept_io));
-      pgagroal_event_accept_init(&io_management[i].watcher, sockfd, accept_management_cb);
-      io_management[i].socket = sockfd;
-      io_management[i].argv = argv_ptr;
-      pgagroal_io_start(&io_management[i].watcher);
+      pgagroal_event_loop_fork();
+      shutdown_io();
+
+      if (config->management > 0)
+      {
+         shutdown_management();
+      }
+
+      close_spare_workers();
+
+      pgagroal_prometheus_server(metrics_fds, metrics_fds_length, argv_ptr);
    }
 }
 
 static void
-shutdown_management(void)
+shutdown_metrics(void)
 {
-   for (int i = 0; i < management_fds_length; i++)
+   for (int i = 0; i < metrics_fds_length; i++)
    {
-      pgagroal_disconnect(io_management[i].socket);
+      pgagroal_disconnect(*(metrics_fds + i));
       errno = 0;
    }
 }
@@ -345,11 +405,14 @@ main(int argc, char** argv)
    struct periodic_watcher validation;
    struct periodic_watcher disconnect_client;
    struct periodic_watcher rotate_frontend_password;
+   struct periodic_watcher respawn;
    struct rlimit flimit;
    size_t shmem_size;
    size_t pipeline_shmem_size = 0;
    size_t prometheus_shmem_size = 0;
    size_t prometheus_cache_shmem_size = 0;
+   size_t security_shmem_size = 0;
+   size_t tracker_shmem_size = 0;
    size_t tmp_size;
    struct main_configuration* config = NULL;
    int ret;
@@ -939,6 +1002,15 @@ read_superuser_path:
       }
    }
 
+   /* The pages are only used once tracker is enabled */
+   if (pgagroal_init_tracker(&tracker_shmem_size, &tracker_shmem))
+   {
+#ifdef HAVE_SYSTEMD
+      sd_notifyf(0, "STATUS=Error in creating and initializing tracker shared memory");
+#endif
+      errx(1, "Error in creating and initializing tracker shared memory");
+   }
+
    if (pgagroal_validate_configuration(shmem, has_unix_socket, has_main_sockets))
    {
 #ifdef HAVE_SYSTEMD
@@ -960,6 +1032,13 @@ read_superuser_path:
    {
 #ifdef HAVE_SYSTEMD
       sd_notify(0, "STATUS=Invalid LIMIT configuration");
+#endif
+      errx(1, "Invalid LIMIT configuration");
+   }
+   if (pgagroal_build_limit_index(shmem))
+   {
+#ifdef HAVE_SYSTEMD
+      sd_notify(0, "STATUS=Invalid LIMIT configuration");
 #endif
       errx(1, "Invalid LIMIT configuration");
    }
@@ -1003,6 +1082,16 @@ read_superuser_path:
    shmem = tmp_shmem;
    config = (struct main_configuration*)shmem;
 
+   /* The security messages are only populated for the slots in use */
+   security_shmem_size = config->max_connections * sizeof(struct connection_security);
+   if (pgagroal_create_shared_memory(security_shmem_size, HUGEPAGE_OFF, &security_shmem))
+   {
+#ifdef HAVE_SYSTEMD
+      sd_notifyf(0, "STATUS=Error in creating shared memory");
+#endif
+      errx(1, "Error in creating shared memory");
+   }
+
    pgagroal_memory_init();
 
    if (getrlimit(RLIMIT_NOFILE, &flimit) == -1)
@@ -1066,6 +1155,8 @@ read_superuser_path:
 
    pgagroal_set_proc_title(argc, argv, "main", NULL);
 
+   start_log_writer();
+
    free(os);
 
    /* Bind Unix Domain Socket: Main */
@@ -1239,6 +1330,10 @@ read_superuser_path:
       pgagroal_periodic_start(&rotate_frontend_password);
    }
 
+   /* The helper processes that exited too soon are restarted after a delay, and the spare workers are refilled */
+   pgagroal_periodic_init(&respawn, respawn_cb, 1000);
+   pgagroal_periodic_start(&respawn);
+
    if (config->common.metrics > 0)
    {
       /* Bind metrics socket */
@@ -1311,6 +1406,7 @@ read_superuser_path:
    pgagroal_log_debug("Pipeline size: %lu", pipeline_shmem_size);
    pgagroal_log_debug("%s", OpenSSL_version(OPENSSL_VERSION));
    pgagroal_log_debug("Configuration size: %lu", shmem_size);
+   pgagroal_log_debug("Security size: %lu", security_shmem_size);
    pgagroal_log_debug("Max connections: %d", config->max_connections);
    pgagroal_log_debug("Known users: %d", config->number_of_users);
    pgagroal_log_debug("Known frontend users: %d", config->number_of_frontend_users);
@@ -1335,6 +1431,9 @@ read_superuser_path:
       }
    }
 
+   start_transaction_workers();
+   maintain_spare_workers(config->min_spare_workers);
+
 #ifdef HAVE_SYSTEMD
    sd_notifyf(0,
               "READY=1\n"
@@ -1351,6 +1450,8 @@ read_superuser_path:
 #endif
    pgagroal_pool_shutdown();
 
+   close_spare_workers();
+
    if (clients != NULL)
    {
       struct client* c = clients;
@@ -1365,6 +1466,7 @@ read_superuser_path:
    }
 
    shutdown_management();
+   stop_metrics_server();
    shutdown_metrics();
    shutdown_mgt();
    shutdown_transfer();
@@ -1382,9 +1484,12 @@ read_superuser_path:
 
    remove_pidfile();
 
+   stop_log_writer();
    pgagroal_stop_logging();
    pgagroal_destroy_shared_memory(prometheus_shmem, prometheus_shmem_size);
    pgagroal_destroy_shared_memory(prometheus_cache_shmem, prometheus_cache_shmem_size);
+   pgagroal_destroy_shared_memory(security_shmem, security_shmem_size);
+   pgagroal_destroy_shared_memory(tracker_shmem, tracker_shmem_size);
    pgagroal_destroy_shared_memory(shmem, shmem_size);
 
    pgagroal_memory_destroy();
@@ -1482,6 +1587,13 @@ accept_main_cb(struct io_watcher* watcher)
 
    pgagroal_log_trace("accept_main_cb: client address: %s", address);
 
+   if (!dispatch_spare_worker(client_fd, &address[0]))
+   {
+      /* The spare worker is replaced by respawn_cb */
+      pgagroal_disconnect(client_fd);
+      return;
+   }
+
    pid = fork();
    if (pid == -1)
    {
@@ -1834,6 +1946,29 @@ accept_mgt_cb(struct io_watcher* watcher)
 
       pgagroal_management_response_ok(NULL, client_fd, start_time, end_time, compression, encryption, payload);
    }
+   else if (id == MANAGEMENT_TRACKER)
+   {
+      pgagroal_log_debug("pgagroal: Management tracker");
+
+      pid = fork();
+      if (pid == -1)
+      {
+         pgagroal_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_TRACKER_NOFORK, compression, encryption, payload);
+         pgagroal_log_error("Tracker: No fork %s (%d)", NULL, MANAGEMENT_ERROR_TRACKER_NOFORK);
+         goto error;
+      }
+      else if (pid == 0)
+      {
+         struct json* pyl = NULL;
+
+         shutdown_ports();
+
+         pgagroal_json_clone(payload, &pyl);
+
+         pgagroal_set_proc_title(1, ai->argv, "tracker", NULL);
+         pgagroal_tracker_stream(NULL, client_fd, compression, encryption, pyl);
+      }
+   }
    else if (id == MANAGEMENT_CLEAR)
    {
       pgagroal_log_debug("pgagroal: Management clear");
@@ -2161,33 +2296,13 @@ accept_transfer_cb(struct io_watcher* watcher)
 
       config->connections[slot].fd = fd;
       known_fds[slot] = config->connections[slot].fd;
+      pgagroal_pool_descriptor_changed(slot);
 
-      if (config->pipeline == PIPELINE_TRANSACTION)
+      /* Acknowledge, so the process can free the slot */
+      if (pgagroal_connection_slot_write(client_fd, slot))
       {
-         struct client* c = clients;
-         while (c != NULL)
-         {
-            int c_fd = -1;
-
-            if (pgagroal_connection_get_pid(c->pid, &c_fd))
-            {
-               goto error;
-            }
-
-            if (pgagroal_connection_id_write(c_fd, CONNECTION_CLIENT_FD))
-            {
-               goto error;
-            }
-
-            if (pgagroal_connection_transfer_write(c_fd, slot))
-            {
-               goto error;
-            }
-
-            pgagroal_disconnect(c_fd);
-
-            c = c->next;
-         }
+         pgagroal_log_error("pgagroal: Transfer connection: Acknowledge slot %d", slot);
+         goto error;
       }
 
       pgagroal_log_debug("pgagroal: Transfer connection: Slot %d FD %d", slot, fd);
@@ -2216,36 +2331,36 @@ accept_transfer_cb(struct io_watcher* watcher)
 
       if (known_fds[slot] == fd)
       {
-         struct client* c = clients;
-         while (c != NULL)
-         {
-            int c_fd = -1;
-
-            if (pgagroal_connection_get_pid(c->pid, &c_fd))
-            {
-               goto error;
-            }
-
-            if (pgagroal_connection_id_write(c_fd, CONNECTION_REMOVE_FD))
-            {
-               goto error;
-            }
+         pgagroal_disconnect(fd);
+         known_fds[slot] = 0;
+         pgagroal_pool_descriptor_changed(slot);
+      }
 
-            if (pgagroal_connection_transfer_write(c_fd, slot))
-            {
-               goto error;
-            }
+      pgagroal_log_debug("pgagroal: Transfer kill connection: Slot %d FD %d", slot, fd);
+   }
+   else if (id == CONNECTION_FETCH_FD)
+   {
+      pgagroal_log_trace("pgagroal: Transfer fetch connection");
 
-            pgagroal_disconnect(c_fd);
+      if (pgagroal_connection_slot_read(client_fd, &slot) || slot < 0 || slot >= config->max_connections)
+      {
+         pgagroal_log_error("pgagroal: Transfer fetch connection: Slot %d", slot);
+         goto error;
+      }
 
-            c = c->next;
-         }
+      /* Closing the socket without a descriptor tells the process that the slot isn't known */
+      if (known_fds[slot] <= 0 || known_fds[slot] != config->connections[slot].fd)
+      {
+         pgagroal_log_debug("pgagroal: Transfer fetch connection: Unknown slot %d", slot);
+         goto error;
+      }
 
-         pgagroal_disconnect(fd);
-         known_fds[slot] = 0;
+      if (pgagroal_connection_transfer_write(client_fd, slot))
+      {
+         goto error;
       }
 
-      pgagroal_log_debug("pgagroal: Transfer kill connection: Slot %d FD %d", slot, fd);
+      pgagroal_log_debug("pgagroal: Transfer fetch connection: Slot %d FD %d", slot, known_fds[slot]);
    }
    else if (id == CONNECTION_CLIENT_DONE)
    {
@@ -2275,88 +2390,6 @@ error:
    pgagroal_prometheus_self_sockets_sub();
 }
 
-static void
-accept_metrics_cb(struct io_watcher* watcher)
-{
-   int client_fd;
-   struct main_configuration* config;
-   SSL_CTX* ctx = NULL;
-   SSL* client_ssl = NULL;
-
-   config = (struct main_configuration*)shmem;
-
-   errno = 0;
-
-   client_fd = watcher->fds.main.client_fd;
-
-   pgagroal_prometheus_self_sockets_add();
-
-   if (client_fd == -1)
-   {
-      if (accept_fatal(errno) && config->keep_running)
-      {
-         pgagroal_log_warn("Restarting listening port due to: %s (%d)", strerror(errno), client_fd);
-
-         shutdown_metrics();
-
-         free(metrics_fds);
-         metrics_fds = NULL;
-         metrics_fds_length = 0;
-
-         if (pgagroal_bind(config->common.host, config->common.metrics, &metrics_fds, &metrics_fds_length, config->nodelay, config->backlog))
-         {
-            pgagroal_log_fatal("pgagroal: Could not bind to %s:%d", config->common.host, config->common.metrics);
-            exit(1);
-         }
-
-         if (metrics_fds_length > MAX_FDS)
-         {
-            pgagroal_log_fatal("pgagroal: Too many descriptors %d", metrics_fds_length);
-            exit(1);
-         }
-
-         start_metrics();
-
-         for (int i = 0; i < metrics_fds_length; i++)
-         {
-            pgagroal_log_debug("Metrics: %d", *(metrics_fds + i));
-         }
-      }
-      else
-      {
-         pgagroal_log_debug("accept: %s (%d)", strerror(errno), client_fd);
-      }
-      errno = 0;
-      return;
-   }
-
-   if (!fork())
-   {
-      pgagroal_event_loop_fork();
-      shutdown_ports();
-      if (strlen(config->common.metrics_cert_file) > 0 && strlen(config->common.metrics_key_file) > 0)
-      {
-         if (pgagroal_create_ssl_ctx(false, &ctx))
-         {
-            pgagroal_log_error("Could not create metrics SSL context");
-            return;
-         }
-
-         if (pgagroal_create_ssl_server(ctx, config->common.metrics_key_file, config->common.metrics_cert_file, config->common.metrics_ca_file, client_fd, &client_ssl))
-         {
-            pgagroal_log_error("Could not create metrics SSL server");
-            return;
-         }
-      }
-      /* We are leaving the socket descriptor valid such that the client won't reuse it */
-      pgagroal_prometheus(client_ssl, client_fd);
-   }
-
-   pgagroal_close_ssl(client_ssl);
-   pgagroal_disconnect(client_fd);
-   pgagroal_prometheus_self_sockets_sub();
-}
-
 static void
 accept_management_cb(struct io_watcher* watcher)
 {
@@ -2484,9 +2517,61 @@ coredump_cb(void)
 static void
 sigchld_cb(void)
 {
-   while (waitpid(-1, NULL, WNOHANG) > 0)
+   pid_t pid;
+
+   while ((pid = waitpid(-1, NULL, WNOHANG)) > 0)
    {
-      ;
+      if (pid == log_writer)
+      {
+         struct main_configuration* config = (struct main_configuration*)shmem;
+
+         pgagroal_log_debug("pgagroal: Log writer (%d) exited", (int)pid);
+
+         log_writer = 0;
+
+         if (config->keep_running)
+         {
+            int delay = respawn_schedule(&log_writer_respawn);
+
+            if (delay == 0)
+            {
+               spawn_log_writer();
+            }
+            else
+            {
+               pgagroal_log_warn("pgagroal: Log writer exited after a short run, restarting in %d seconds", delay);
+            }
+         }
+
+         continue;
+      }
+
+      if (pid == metrics_server)
+      {
+         struct main_configuration* config = (struct main_configuration*)shmem;
+
+         pgagroal_log_debug("pgagroal: Metrics server (%d) exited", (int)pid);
+
+         metrics_server = 0;
+
+         if (config->keep_running && config->common.metrics > 0)
+         {
+            int delay = respawn_schedule(&metrics_respawn);
+
+            if (delay == 0)
+            {
+               restart_metrics();
+            }
+            else
+            {
+               pgagroal_log_warn("pgagroal: Metrics server exited after a short run, restarting in %d seconds", delay);
+            }
+         }
+
+         continue;
+      }
+
+      transaction_worker_exited(pid);
    }
 }
 
@@ -2679,6 +2764,7 @@ reload_configuration(void)
 
    shutdown_io();
    shutdown_uds();
+   stop_metrics_server();
    shutdown_metrics();
    shutdown_management();
 
@@ -2776,6 +2862,10 @@ reload_configuration(void)
       exit(0);
    }
 
+   /* The spare workers were forked with the previous configuration */
+   spare_workers_generation++;
+   maintain_spare_workers(config->max_spare_workers);
+
    return true;
 
 error:
@@ -2794,6 +2884,7 @@ reload_services_only(void)
    // Shutdown services
    shutdown_io();
    shutdown_uds();
+   stop_metrics_server();
    shutdown_metrics();
    shutdown_management();
 
@@ -2998,4 +3089,511 @@ shutdown_ports(void)
    {
       shutdown_management();
    }
+
+   close_spare_workers();
+}
+
+static int
+spawn_spare_worker(void)
+{
+   int sv[2];
+   pid_t pid;
+   struct spare_worker* s = NULL;
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1)
+   {
+      pgagroal_log_error("Cannot create spare worker: %s", strerror(errno));
+      errno = 0;
+      return 1;
+   }
+
+   pid = fork();
+   if (pid == -1)
+   {
+      /* No process */
+      pgagroal_log_error("Cannot create process");
+      close(sv[0]);
+      close(sv[1]);
+      return 1;
+   }
+   else if (pid > 0)
+   {
+      close(sv[1]);
+
+      s = (struct spare_worker*)malloc(sizeof(struct spare_worker));
+      if (s == NULL)
+      {
+         close(sv[0]);
+         return 1;
+      }
+
+      s->pid = pid;
+      s->fd = sv[0];
+      s->generation = spare_workers_generation;
+      s->next = spare_workers;
+
+      spare_workers = s;
+      number_of_spare_workers++;
+   }
+   else
+   {
+      close(sv[0]);
+
+      /* See accept_main_cb */
+      if (setpgid(0, 0) == -1)
+      {
+         pgagroal_log_error("setpgid error: %s", strerror(errno));
+         exit(1);
+      }
+
+      pgagroal_event_loop_fork();
+      shutdown_ports();
+      spare_worker(sv[1]);
+   }
+
+   return 0;
+}
+
+static int
+dispatch_spare_worker(int client_fd, char* address)
+{
+   struct spare_worker* s = NULL;
+
+   while (spare_workers != NULL)
+   {
+      s = spare_workers;
+      spare_workers = s->next;
+      number_of_spare_workers--;
+
+      /* A spare worker must have the same configuration as the main process */
+      if (s->generation == spare_workers_generation &&
+          !pgagroal_connection_client_write(s->fd, client_fd, address))
+      {
+         pgagroal_log_trace("dispatch_spare_worker: PID %d", (int)s->pid);
+         add_client(s->pid);
+         close(s->fd);
+         free(s);
+         return 0;
+      }
+
+      /* The spare worker exits when its descriptor is closed */
+      close(s->fd);
+      free(s);
+   }
+
+   return 1;
+}
+
+static void
+maintain_spare_workers(int max_spawn)
+{
+   struct spare_worker* s = NULL;
+   struct spare_worker* p = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   /* Retire the spare workers which are outdated, or above the maximum */
+   s = spare_workers;
+   while (s != NULL)
+   {
+      struct spare_worker* next = s->next;
+
+      if (s->generation != spare_workers_generation || number_of_spare_workers > config->max_spare_workers)
+      {
+         if (p == NULL)
+         {
+            spare_workers = next;
+         }
+         else
+         {
+            p->next = next;
+         }
+
+         close(s->fd);
+         free(s);
+         number_of_spare_workers--;
+      }
+      else
+      {
+         p = s;
+      }
+
+      s = next;
+   }
+
+   for (int i = 0; i < max_spawn && number_of_spare_workers < config->min_spare_workers && config->keep_running; i++)
+   {
+      if (spawn_spare_worker())
+      {
+         break;
+      }
+   }
+}
+
+static void
+close_spare_workers(void)
+{
+   struct spare_worker* s = NULL;
+
+   while (spare_workers != NULL)
+   {
+      s = spare_workers;
+      spare_workers = s->next;
+
+      close(s->fd);
+      free(s);
+   }
+
+   number_of_spare_workers = 0;
+}
+
+static void
+spare_worker(int fd)
+{
+   int client_fd = -1;
+   char* address = NULL;
+
+   pgagroal_set_proc_title(1, argv_ptr, "spare", NULL);
+
+   /* Wait for a client, or for the main process to close the descriptor */
+   if (pgagroal_connection_client_read(fd, &client_fd, &address))
+   {
+      close(fd);
+      exit(0);
+   }
+
+   close(fd);
+
+   pgagroal_worker(client_fd, address, argv_ptr);
+}
+
+static void
+start_transaction_workers(void)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   for (int i = 0; i < config->transaction_workers; i++)
+   {
+      if (spawn_transaction_worker(i))
+      {
+         pgagroal_log_warn("pgagroal: Unable to start transaction worker %d", i);
+      }
+   }
+}
+
+static int
+spawn_transaction_worker(int index)
+{
+   pid_t pid;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   /* The worker announces its pid when it is ready for clients */
+   atomic_store(&config->tx_workers[index].pid, 0);
+   atomic_store(&config->tx_workers[index].clients, 0);
+
+   /* The clients waiting in a previous worker are gone */
+   if (atomic_exchange(&config->tx_workers[index].parked, false))
+   {
+      atomic_fetch_sub(&config->parked_workers, 1);
+   }
+
+   respawn_started(&transaction_workers_respawn[index]);
+
+   pid = fork();
+   if (pid == -1)
+   {
+      /* No process */
+      pgagroal_log_error("Cannot create process");
+      transaction_workers[index] = 0;
+      respawn_schedule(&transaction_workers_respawn[index]);
+      return 1;
+   }
+   else if (pid > 0)
+   {
+      transaction_workers[index] = pid;
+
+      /* The worker is signalled at shutdown like any other client */
+      add_client(pid);
+   }
+   else
+   {
+      /* See accept_main_cb */
+      if (setpgid(0, 0) == -1)
+      {
+         pgagroal_log_error("setpgid error: %s", strerror(errno));
+         exit(1);
+      }
+
+      pgagroal_event_loop_fork();
+      shutdown_ports();
+      pgagroal_transaction_worker(index, argv_ptr);
+   }
+
+   return 0;
+}
+
+static void
+transaction_worker_exited(pid_t pid)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   for (int i = 0; i < config->transaction_workers; i++)
+   {
+      if (transaction_workers[i] == pid)
+      {
+         pgagroal_log_debug("pgagroal: Transaction worker %d (%d) exited", i, (int)pid);
+
+         remove_client(pid);
+         transaction_workers[i] = 0;
+         atomic_store(&config->tx_workers[i].pid, 0);
+
+         if (config->keep_running)
+         {
+            int delay = respawn_schedule(&transaction_workers_respawn[i]);
+
+            if (delay == 0)
+            {
+               spawn_transaction_worker(i);
+            }
+            else
+            {
+               pgagroal_log_warn("pgagroal: Transaction worker %d exited after a short run, restarting in %d seconds", i, delay);
+            }
+         }
+
+         return;
+      }
+   }
+}
+
+static void
+respawn_started(struct respawn* r)
+{
+   r->started = time(NULL);
+   r->next = 0;
+}
+
+static int
+respawn_schedule(struct respawn* r)
+{
+   int delay = 0;
+   time_t now;
+
+   now = time(NULL);
+
+   /* A process that ran for a while is restarted at once, otherwise the delay doubles */
+   if (r->started == 0 || difftime(now, r->started) >= RESPAWN_STABLE)
+   {
+      r->failures = 0;
+   }
+   else
+   {
+      delay = MIN(1 << MIN(r->failures, 6), RESPAWN_MAX_DELAY);
+      r->failures++;
+   }
+
+   r->next = now + delay;
+
+   return delay;
+}
+
+static bool
+respawn_due(struct respawn* r, time_t now)
+{
+   return r->next != 0 && difftime(now, r->next) >= 0;
+}
+
+static void
+respawn_cb(void)
+{
+   time_t now;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   if (!config->keep_running)
+   {
+      return;
+   }
+
+   now = time(NULL);
+
+   if (log_writer == 0 && log_shmem != NULL && respawn_due(&log_writer_respawn, now))
+   {
+      pgagroal_log_info("pgagroal: Restarting the log writer");
+      spawn_log_writer();
+   }
+
+   if (metrics_server == 0 && config->common.metrics > 0 && respawn_due(&metrics_respawn, now))
+   {
+      restart_metrics();
+   }
+
+   for (int i = 0; i < config->transaction_workers; i++)
+   {
+      if (transaction_workers[i] == 0 && respawn_due(&transaction_workers_respawn[i], now))
+      {
+         pgagroal_log_info("pgagroal: Restarting transaction worker %d", i);
+         spawn_transaction_worker(i);
+      }
+   }
+
+   /* Replace the spare workers handed a client outside of the accept path */
+   maintain_spare_workers(config->min_spare_workers);
+}
+
+static void
+start_log_writer(void)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   if (!config->log_async)
+   {
+      return;
+   }
+
+   if (pgagroal_init_log_ring(&log_shmem_size, &log_shmem))
+   {
+      pgagroal_log_warn("pgagroal: Unable to create the log ring, logging synchronously");
+      return;
+   }
+
+   if (spawn_log_writer())
+   {
+      pgagroal_log_warn("pgagroal: Unable to start the log writer, logging synchronously");
+
+      pgagroal_destroy_shared_memory(log_shmem, log_shmem_size);
+      log_shmem = NULL;
+      log_shmem_size = 0;
+   }
+}
+
+static int
+spawn_log_writer(void)
+{
+   pid_t pid;
+
+   respawn_started(&log_writer_respawn);
+
+   pid = fork();
+   if (pid == -1)
+   {
+      /* No process */
+      pgagroal_log_error("Cannot create process");
+      respawn_schedule(&log_writer_respawn);
+      return 1;
+   }
+   else if (pid > 0)
+   {
+      log_writer = pid;
+   }
+   else
+   {
+      if (main_loop != NULL)
+      {
+         pgagroal_event_loop_fork();
+         shutdown_ports();
+      }
+
+      pgagroal_set_proc_title(1, argv_ptr, "log writer", NULL);
+
+      pgagroal_log_writer();
+
+      exit(0);
+   }
+
+   return 0;
+}
+
+static void
+stop_log_writer(void)
+{
+   void* ring = log_shmem;
+
+   if (ring == NULL)
+   {
+      return;
+   }
+
+   /* The log writer writes the remaining lines before it exits */
+   pgagroal_stop_log_writer();
+
+   if (log_writer > 0)
+   {
+      waitpid(log_writer, NULL, 0);
+      log_writer = 0;
+   }
+
+   log_shmem = NULL;
+   pgagroal_destroy_shared_memory(ring, log_shmem_size);
+   log_shmem_size = 0;
+}
+
+static void
+restart_metrics(void)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   pgagroal_log_warn("Restarting the metrics server");
+
+   shutdown_metrics();
+
+   free(metrics_fds);
+   metrics_fds = NULL;
+   metrics_fds_length = 0;
+
+   if (pgagroal_bind(config->common.host, config->common.metrics, &metrics_fds, &metrics_fds_length, config->nodelay, config->backlog))
+   {
+      /* Retried by respawn_cb, as a run that ended at once */
+      pgagroal_log_error("pgagroal: Could not bind to %s:%d", config->common.host, config->common.metrics);
+      respawn_started(&metrics_respawn);
+      respawn_schedule(&metrics_respawn);
+      return;
+   }
+
+   if (metrics_fds_length > MAX_FDS)
+   {
+      pgagroal_log_fatal("pgagroal: Too many descriptors %d", metrics_fds_length);
+      exit(1);
+   }
+
+   start_metrics();
+
+   for (int i = 0; i < metrics_fds_length; i++)
+   {
+      pgagroal_log_debug("Metrics: %d", *(metrics_fds + i));
+   }
+}
+
+static void
+stop_metrics_server(void)
+{
+   pid_t pid = metrics_server;
+
+   if (pid <= 0)
+   {
+      return;
+   }
+
+   /* Forget the server first, so sigchld_cb doesn't restart it */
+   metrics_server = 0;
+
+   if (kill(pid, SIGQUIT))
+   {
+      pgagroal_log_debug("kill: %s", strerror(errno));
+      errno = 0;
+   }
+
+   waitpid(pid, NULL, 0);
 }
@@ -604,7 +604,13 @@ cleanup:
 static int
 get_connection_state(struct vault_configuration* config, int client_fd)
 {
-   int is_ssl_req = pgagroal_is_ssl_request(client_fd);
+   bool is_ssl_req = false;
+
+   if (pgagroal_is_ssl_request(client_fd, true, &is_ssl_req))
+   {
+      return -1;
+   }
+
    if (config->common.tls)
    {
       if (is_ssl_req)
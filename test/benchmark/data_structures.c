@@ -0,0 +1,580 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgagroal */
+#include <pgagroal.h>
+#include <art.h>
+#include <deque.h>
+#include <json.h>
+#include <value.h>
+
+/* system */
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_OPERATIONS 1000000
+#define DEFAULT_BUDGET     1000
+#define MAX_LOOKUPS        256
+#define MAX_JSON_SIZE      4096
+#define CHECK_INTERVAL     1024
+
+/** @struct measurement
+ * Defines the accumulated cost of the timed sections of a benchmark
+ */
+struct measurement
+{
+   struct timespec start;         /**< The start of the current section */
+   uint64_t start_allocations;    /**< The allocations at the start of the current section */
+   double nanos;                  /**< The total time */
+   uint64_t allocations;          /**< The total number of allocations */
+};
+
+static void bench_art(int size, long rounds);
+static void bench_deque(int size, long rounds);
+static void bench_json(int size, long rounds);
+static void bench_value(int size, long operations);
+static struct json* create_document(int size);
+static char** create_keys(int size);
+static void destroy_keys(char** keys, int size);
+static void start_budget(void);
+static bool expired(void);
+static void measure_start(struct measurement* m);
+static void measure_stop(struct measurement* m);
+static void record(char* structure, char* operation, int size, uint64_t operations, struct measurement* m);
+static double elapsed_ns(struct timespec* start, struct timespec* end);
+static void usage(void);
+
+static int sizes[] = {16, 256, 4096, 65536};
+
+static struct json* results = NULL;
+static uint64_t allocations = 0;
+static long budget = DEFAULT_BUDGET;
+static struct timespec deadline;
+
+/*
+ * glibc routes every allocation, including the ones made inside libpgagroal,
+ * through the malloc symbol of the executable, so the calls can be counted
+ */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define COUNT_ALLOCATIONS
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+void*
+malloc(size_t size)
+{
+   allocations++;
+   return __libc_malloc(size);
+}
+
+void*
+calloc(size_t nmemb, size_t size)
+{
+   allocations++;
+   return __libc_calloc(nmemb, size);
+}
+
+void*
+realloc(void* ptr, size_t size)
+{
+   allocations++;
+   return __libc_realloc(ptr, size);
+}
+#endif
+
+int
+main(int argc, char** argv)
+{
+   int c;
+   long operations = DEFAULT_OPERATIONS;
+   long rounds;
+   struct json* output = NULL;
+
+   while ((c = getopt(argc, argv, "n:t:h")) != -1)
+   {
+      switch (c)
+      {
+         case 'n':
+            operations = atol(optarg);
+            break;
+         case 't':
+            budget = atol(optarg);
+            break;
+         case 'h':
+         default:
+            usage();
+            exit(c == 'h' ? 0 : 1);
+      }
+   }
+
+   if (operations <= 0 || budget <= 0)
+   {
+      usage();
+      exit(1);
+   }
+
+   if (pgagroal_json_create(&results))
+   {
+      fprintf(stderr, "pgagroal_data_structures: Unable to create the results\n");
+      exit(1);
+   }
+
+   for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+   {
+      rounds = MAX(operations / sizes[i], 1L);
+
+      bench_art(sizes[i], rounds);
+      bench_deque(sizes[i], rounds);
+      if (sizes[i] <= MAX_JSON_SIZE)
+      {
+         bench_json(sizes[i], rounds);
+      }
+      bench_value(sizes[i], operations);
+   }
+
+   pgagroal_json_create(&output);
+   pgagroal_json_put(output, "Operations", (uintptr_t)operations, ValueInt64);
+   pgagroal_json_put(output, "Budget", (uintptr_t)budget, ValueInt64);
+#if defined(COUNT_ALLOCATIONS)
+   pgagroal_json_put(output, "Allocations", (uintptr_t)true, ValueBool);
+#else
+   pgagroal_json_put(output, "Allocations", (uintptr_t)false, ValueBool);
+#endif
+   pgagroal_json_put(output, "Results", (uintptr_t)results, ValueJSON);
+
+   pgagroal_json_print(output, FORMAT_JSON);
+
+   pgagroal_json_destroy(output);
+
+   return 0;
+}
+
+static void
+bench_art(int size, long rounds)
+{
+   long done;
+   char** keys = NULL;
+   struct art* tree = NULL;
+   struct art_iterator* iter = NULL;
+   struct measurement insert = {0};
+   struct measurement search = {0};
+   struct measurement iterate = {0};
+
+   keys = create_keys(size);
+
+   start_budget();
+
+   for (done = 0; done < rounds && !expired(); done++)
+   {
+      pgagroal_art_create(&tree);
+
+      measure_start(&insert);
+      for (int i = 0; i < size; i++)
+      {
+         pgagroal_art_insert(tree, keys[i], (uintptr_t)i, ValueInt64);
+      }
+      measure_stop(&insert);
+
+      measure_start(&search);
+      for (int i = 0; i < size; i++)
+      {
+         if (pgagroal_art_search(tree, keys[i]) != (uintptr_t)i)
+         {
+            fprintf(stderr, "pgagroal_data_structures: ART search failed for %s\n", keys[i]);
+            exit(1);
+         }
+      }
+      measure_stop(&search);
+
+      measure_start(&iterate);
+      pgagroal_art_iterator_create(tree, &iter);
+      while (pgagroal_art_iterator_next(iter))
+      {
+      }
+      pgagroal_art_iterator_destroy(iter);
+      measure_stop(&iterate);
+
+      pgagroal_art_destroy(tree);
+   }
+
+   record("art", "insert", size, done * size, &insert);
+   record("art", "search", size, done * size, &search);
+   record("art", "iterate", size, done * size, &iterate);
+
+   destroy_keys(keys, size);
+}
+
+static void
+bench_deque(int size, long rounds)
+{
+   long done;
+   int lookups;
+   char* tag = NULL;
+   char** keys = NULL;
+   struct deque* deque = NULL;
+   struct deque_iterator* iter = NULL;
+   struct measurement insert = {0};
+   struct measurement search = {0};
+   struct measurement iterate = {0};
+   struct measurement poll = {0};
+
+   keys = create_keys(size);
+
+   /* A tag lookup walks the deque, so only a sample of the tags is searched */
+   lookups = MIN(size, MAX_LOOKUPS);
+
+   start_budget();
+
+   for (done = 0; done < rounds && !expired(); done++)
+   {
+      pgagroal_deque_create(false, &deque);
+
+      measure_start(&insert);
+      for (int i = 0; i < size; i++)
+      {
+         pgagroal_deque_add(deque, keys[i], (uintptr_t)i, ValueInt64);
+      }
+      measure_stop(&insert);
+
+      measure_start(&search);
+      for (int i = 0; i < lookups; i++)
+      {
+         int index = (int)(((long)i * size) / lookups);
+
+         if (pgagroal_deque_get(deque, keys[index]) != (uintptr_t)index)
+         {
+            fprintf(stderr, "pgagroal_data_structures: Deque search failed for %s\n", keys[index]);
+            exit(1);
+         }
+      }
+      measure_stop(&search);
+
+      measure_start(&iterate);
+      pgagroal_deque_iterator_create(deque, &iter);
+      while (pgagroal_deque_iterator_next(iter))
+      {
+      }
+      pgagroal_deque_iterator_destroy(iter);
+      measure_stop(&iterate);
+
+      measure_start(&poll);
+      for (int i = 0; i < size; i++)
+      {
+         pgagroal_deque_poll(deque, &tag);
+         free(tag);
+         tag = NULL;
+      }
+      measure_stop(&poll);
+
+      pgagroal_deque_destroy(deque);
+   }
+
+   record("deque", "insert", size, done * size, &insert);
+   record("deque", "search", size, done * lookups, &search);
+   record("deque", "iterate", size, done * size, &iterate);
+   record("deque", "poll", size, done * size, &poll);
+
+   destroy_keys(keys, size);
+}
+
+static void
+bench_json(int size, long rounds)
+{
+   long done;
+   char* str = NULL;
+   struct json* document = NULL;
+   struct json* parsed = NULL;
+   struct json_iterator* iter = NULL;
+   struct measurement insert = {0};
+   struct measurement to_string = {0};
+   struct measurement parse = {0};
+   struct measurement iterate = {0};
+
+   start_budget();
+
+   for (done = 0; done < rounds && !expired(); done++)
+   {
+      measure_start(&insert);
+      document = create_document(size);
+      measure_stop(&insert);
+
+      measure_start(&to_string);
+      str = pgagroal_json_to_string(document, FORMAT_JSON, NULL, 0);
+      measure_stop(&to_string);
+
+      measure_start(&parse);
+      if (pgagroal_json_parse_string(str, &parsed))
+      {
+         fprintf(stderr, "pgagroal_data_structures: JSON parse failed for size %d\n", size);
+         exit(1);
+      }
+      measure_stop(&parse);
+
+      measure_start(&iterate);
+      pgagroal_json_iterator_create(parsed, &iter);
+      while (pgagroal_json_iterator_next(iter))
+      {
+      }
+      pgagroal_json_iterator_destroy(iter);
+      measure_stop(&iterate);
+
+      free(str);
+      pgagroal_json_destroy(parsed);
+      pgagroal_json_destroy(document);
+   }
+
+   /* The document operations are reported per entry, like the others */
+   record("json", "insert", size, done * size, &insert);
+   record("json", "to_string", size, done * size, &to_string);
+   record("json", "parse", size, done * size, &parse);
+   record("json", "iterate", size, done * size, &iterate);
+}
+
+static void
+bench_value(int size, long operations)
+{
+   long create_int_done;
+   long create_string_done;
+   long to_string_done;
+   long interval;
+   char* data = NULL;
+   char* str = NULL;
+   struct value* value = NULL;
+   struct measurement create_int = {0};
+   struct measurement create_string = {0};
+   struct measurement to_string = {0};
+
+   /* The size is the length of the string payload */
+   data = calloc(1, size + 1);
+   memset(data, 'x', size);
+
+   interval = MAX(CHECK_INTERVAL / size, 1);
+
+   start_budget();
+   measure_start(&create_int);
+   for (create_int_done = 0; create_int_done < operations; create_int_done++)
+   {
+      if (create_int_done % interval == 0 && expired())
+      {
+         break;
+      }
+
+      pgagroal_value_create(ValueInt64, (uintptr_t)create_int_done, &value);
+      pgagroal_value_destroy(value);
+   }
+   measure_stop(&create_int);
+
+   start_budget();
+   measure_start(&create_string);
+   for (create_string_done = 0; create_string_done < operations; create_string_done++)
+   {
+      if (create_string_done % interval == 0 && expired())
+      {
+         break;
+      }
+
+      pgagroal_value_create(ValueString, (uintptr_t)data, &value);
+      pgagroal_value_destroy(value);
+   }
+   measure_stop(&create_string);
+
+   pgagroal_value_create(ValueString, (uintptr_t)data, &value);
+
+   start_budget();
+   measure_start(&to_string);
+   for (to_string_done = 0; to_string_done < operations; to_string_done++)
+   {
+      if (to_string_done % interval == 0 && expired())
+      {
+         break;
+      }
+
+      str = pgagroal_value_to_string(value, FORMAT_JSON, NULL, 0);
+      free(str);
+   }
+   measure_stop(&to_string);
+
+   pgagroal_value_destroy(value);
+   free(data);
+
+   record("value", "create_int64", size, create_int_done, &create_int);
+   record("value", "create_string", size, create_string_done, &create_string);
+   record("value", "to_string", size, to_string_done, &to_string);
+}
+
+/* A status like document: one object per server with a few typed fields */
+static struct json*
+create_document(int size)
+{
+   char key[MISC_LENGTH];
+   struct json* document = NULL;
+   struct json* server = NULL;
+
+   pgagroal_json_create(&document);
+
+   for (int i = 0; i < size; i++)
+   {
+      snprintf(&key[0], sizeof(key), "server_%d", i);
+
+      pgagroal_json_create(&server);
+      pgagroal_json_put(server, "Host", (uintptr_t)"primary.example.com", ValueString);
+      pgagroal_json_put(server, "Port", (uintptr_t)5432, ValueInt32);
+      pgagroal_json_put(server, "Active", (uintptr_t)(i % 2 == 0), ValueBool);
+
+      pgagroal_json_put(document, &key[0], (uintptr_t)server, ValueJSON);
+   }
+
+   return document;
+}
+
+static char**
+create_keys(int size)
+{
+   char key[MISC_LENGTH];
+   char** keys = NULL;
+
+   keys = calloc(size, sizeof(char*));
+   if (keys == NULL)
+   {
+      fprintf(stderr, "pgagroal_data_structures: Unable to allocate the keys\n");
+      exit(1);
+   }
+
+   for (int i = 0; i < size; i++)
+   {
+      snprintf(&key[0], sizeof(key), "database_%d.user_%d", i % 64, i);
+      keys[i] = strdup(&key[0]);
+   }
+
+   return keys;
+}
+
+static void
+destroy_keys(char** keys, int size)
+{
+   for (int i = 0; i < size; i++)
+   {
+      free(keys[i]);
+   }
+   free(keys);
+}
+
+static void
+start_budget(void)
+{
+   clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+   deadline.tv_sec += budget / 1000;
+   deadline.tv_nsec += (budget % 1000) * 1000000;
+   if (deadline.tv_nsec >= 1000000000)
+   {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+   }
+}
+
+/* A measurement stops early once its time budget is spent */
+static bool
+expired(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+
+   return elapsed_ns(&deadline, &now) >= 0;
+}
+
+static void
+measure_start(struct measurement* m)
+{
+   m->start_allocations = allocations;
+   clock_gettime(CLOCK_MONOTONIC, &m->start);
+}
+
+static void
+measure_stop(struct measurement* m)
+{
+   struct timespec end;
+
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   m->nanos += elapsed_ns(&m->start, &end);
+   m->allocations += allocations - m->start_allocations;
+}
+
+static void
+record(char* structure, char* operation, int size, uint64_t operations, struct measurement* m)
+{
+   struct json* result = NULL;
+
+   if (operations == 0)
+   {
+      return;
+   }
+
+   pgagroal_json_create(&result);
+   pgagroal_json_put(result, "Structure", (uintptr_t)structure, ValueString);
+   pgagroal_json_put(result, "Operation", (uintptr_t)operation, ValueString);
+   pgagroal_json_put(result, "Size", (uintptr_t)size, ValueInt32);
+   pgagroal_json_put(result, "Operations", (uintptr_t)operations, ValueUInt64);
+   pgagroal_json_put(result, "NsPerOp", pgagroal_value_from_double(m->nanos / operations), ValueDouble);
+   pgagroal_json_put(result, "OpsPerSec", pgagroal_value_from_double(operations * 1000000000.0 / MAX(m->nanos, 1.0)), ValueDouble);
+#if defined(COUNT_ALLOCATIONS)
+   pgagroal_json_put(result, "AllocationsPerOp", pgagroal_value_from_double((double)m->allocations / operations), ValueDouble);
+#endif
+
+   pgagroal_json_append(results, (uintptr_t)result, ValueJSON);
+}
+
+static double
+elapsed_ns(struct timespec* start, struct timespec* end)
+{
+   return (end->tv_sec - start->tv_sec) * 1000000000.0 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void
+usage(void)
+{
+   printf("pgagroal_data_structures\n");
+   printf("  Measure the throughput and the allocations of the ART, deque, JSON and value APIs\n");
+   printf("\n");
+   printf("Usage:\n");
+   printf("  pgagroal_data_structures [ -n OPERATIONS ] [ -t MILLISECONDS ]\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -n OPERATIONS    The number of operations per measurement (default %d)\n", DEFAULT_OPERATIONS);
+   printf("  -t MILLISECONDS  The time budget per structure and size (default %d)\n", DEFAULT_BUDGET);
+   printf("  -h               Display help\n");
+}
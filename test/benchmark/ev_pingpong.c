@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgagroal */
+#include <pgagroal.h>
+#include <configuration.h>
+#include <ev.h>
+#include <logging.h>
+#include <memory.h>
+#include <message.h>
+#include <shmem.h>
+#include <worker.h>
+
+/* system */
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define DEFAULT_ROUND_TRIPS 100000
+#define DEFAULT_SIZE        64
+
+/** @struct variant
+ * An event loop setup to measure
+ */
+struct variant
+{
+   char* name;            /**< The name of the setup */
+   int ev_backend;        /**< The event backend */
+   bool multishot;        /**< io_uring multishot receive */
+   bool registered_files; /**< io_uring registered files */
+   bool sqpoll;           /**< io_uring submission thread */
+};
+
+static void echo_cb(struct io_watcher* watcher);
+static int echo(int fd);
+static int run(struct variant* v, long round_trips, size_t size);
+static void usage(void);
+
+static struct variant variants[] = {
+#if HAVE_LINUX
+   {"epoll", PGAGROAL_EVENT_BACKEND_EPOLL, false, false, false},
+   {"io_uring", PGAGROAL_EVENT_BACKEND_IO_URING, false, false, false},
+   {"io_uring multishot", PGAGROAL_EVENT_BACKEND_IO_URING, true, false, false},
+   {"io_uring registered_files", PGAGROAL_EVENT_BACKEND_IO_URING, false, true, false},
+   {"io_uring multishot registered_files", PGAGROAL_EVENT_BACKEND_IO_URING, true, true, false},
+   {"io_uring sqpoll", PGAGROAL_EVENT_BACKEND_IO_URING, false, false, true},
+   {"io_uring multishot registered_files sqpoll", PGAGROAL_EVENT_BACKEND_IO_URING, true, true, true},
+#else
+   {"kqueue", PGAGROAL_EVENT_BACKEND_KQUEUE, false, false, false},
+#endif
+};
+
+int
+main(int argc, char** argv)
+{
+   int c;
+   long round_trips = DEFAULT_ROUND_TRIPS;
+   size_t size = DEFAULT_SIZE;
+   struct main_configuration* config = NULL;
+
+   while ((c = getopt(argc, argv, "n:s:h")) != -1)
+   {
+      switch (c)
+      {
+         case 'n':
+            round_trips = atol(optarg);
+            break;
+         case 's':
+            size = (size_t)atol(optarg);
+            break;
+         case 'h':
+         default:
+            usage();
+            exit(c == 'h' ? 0 : 1);
+      }
+   }
+
+   if (round_trips <= 0 || size == 0 || size > MESSAGE_PARSE_BUFFER_SIZE)
+   {
+      usage();
+      exit(1);
+   }
+
+   if (pgagroal_create_shared_memory(sizeof(struct main_configuration), HUGEPAGE_OFF, &shmem))
+   {
+      fprintf(stderr, "pgagroal_ev_pingpong: Unable to create shared memory\n");
+      exit(1);
+   }
+
+   pgagroal_init_configuration(shmem);
+   config = (struct main_configuration*)shmem;
+   config->common.log_level = PGAGROAL_LOGGING_LEVEL_WARN;
+   pgagroal_start_logging();
+
+   signal(SIGPIPE, SIG_IGN);
+
+   printf("%-44s %14s %12s\n", "Event loop", "Round trips/s", "Latency us");
+
+   for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++)
+   {
+      run(&variants[i], round_trips, size);
+   }
+
+   pgagroal_stop_logging();
+   pgagroal_destroy_shared_memory(shmem, sizeof(struct main_configuration));
+
+   return 0;
+}
+
+static void
+echo_cb(struct io_watcher* watcher)
+{
+   int status;
+   struct message* msg = NULL;
+
+   status = pgagroal_recv_message(watcher, &msg);
+   if (status != MESSAGE_STATUS_OK)
+   {
+      pgagroal_event_loop_break();
+      return;
+   }
+
+   if (pgagroal_send_message(watcher, msg) != MESSAGE_STATUS_OK)
+   {
+      pgagroal_event_loop_break();
+   }
+}
+
+static int
+echo(int fd)
+{
+   struct worker_io wi;
+
+   pgagroal_memory_init();
+
+   if (pgagroal_event_loop_init() == NULL)
+   {
+      return 1;
+   }
+
+   memset(&wi, 0, sizeof(struct worker_io));
+   wi.client_fd = fd;
+   wi.server_fd = fd;
+   wi.slot = -1;
+
+   pgagroal_event_worker_init(&wi.io, fd, fd, echo_cb);
+   pgagroal_io_start(&wi.io);
+
+   pgagroal_event_loop_run();
+
+   pgagroal_event_loop_destroy();
+   pgagroal_memory_destroy();
+
+   return 0;
+}
+
+static int
+run(struct variant* v, long round_trips, size_t size)
+{
+   int sv[2];
+   pid_t pid;
+   char* buffer = NULL;
+   struct timespec start;
+   struct timespec end;
+   double elapsed;
+   struct main_configuration* config = (struct main_configuration*)shmem;
+
+   config->ev_backend = v->ev_backend;
+   config->io_uring_multishot = v->multishot;
+   config->io_uring_registered_files = v->registered_files;
+   config->io_uring_sqpoll = v->sqpoll;
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+   {
+      fprintf(stderr, "pgagroal_ev_pingpong: socketpair: %s\n", strerror(errno));
+      return 1;
+   }
+
+   pid = fork();
+   if (pid == -1)
+   {
+      fprintf(stderr, "pgagroal_ev_pingpong: fork: %s\n", strerror(errno));
+      close(sv[0]);
+      close(sv[1]);
+      return 1;
+   }
+   else if (pid == 0)
+   {
+      close(sv[0]);
+      exit(echo(sv[1]));
+   }
+
+   close(sv[1]);
+
+   buffer = calloc(1, size);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+
+   for (long i = 0; i < round_trips; i++)
+   {
+      size_t received = 0;
+
+      if (write(sv[0], buffer, size) != (ssize_t)size)
+      {
+         goto error;
+      }
+
+      while (received < size)
+      {
+         ssize_t n = read(sv[0], buffer + received, size - received);
+         if (n <= 0)
+         {
+            goto error;
+         }
+         received += n;
+      }
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+   printf("%-44s %14.0f %12.2f\n", v->name, round_trips / elapsed, elapsed * 1000000.0 / round_trips);
+
+   close(sv[0]);
+   waitpid(pid, NULL, 0);
+   free(buffer);
+
+   return 0;
+
+error:
+
+   printf("%-44s %14s %12s\n", v->name, "n/a", "n/a");
+
+   close(sv[0]);
+   waitpid(pid, NULL, 0);
+   free(buffer);
+
+   return 1;
+}
+
+static void
+usage(void)
+{
+   printf("pgagroal_ev_pingpong\n");
+   printf("  Measure round trips through the event loop backends\n");
+   printf("\n");
+   printf("Usage:\n");
+   printf("  pgagroal_ev_pingpong [ -n ROUND_TRIPS ] [ -s SIZE ]\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -n ROUND_TRIPS  The number of round trips (default %d)\n", DEFAULT_ROUND_TRIPS);
+   printf("  -s SIZE         The size of each message in bytes (default %d)\n", DEFAULT_SIZE);
+   printf("  -h              Display help\n");
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgagroal */
+#include <pgagroal.h>
+#include <memory.h>
+#include <message.h>
+#include <shmem.h>
+
+/* system */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_MESSAGES 100000
+
+static double full_clear(long messages, size_t size);
+static double used_clear(long messages, size_t size);
+static double elapsed_ns(struct timespec* start, struct timespec* end);
+static void usage(void);
+
+static size_t sizes[] = {5, 64, 512, 4096, 16384, DEFAULT_BUFFER_SIZE};
+
+int
+main(int argc, char** argv)
+{
+   int c;
+   long messages = DEFAULT_MESSAGES;
+
+   while ((c = getopt(argc, argv, "n:h")) != -1)
+   {
+      switch (c)
+      {
+         case 'n':
+            messages = atol(optarg);
+            break;
+         case 'h':
+         default:
+            usage();
+            exit(c == 'h' ? 0 : 1);
+      }
+   }
+
+   if (messages <= 0)
+   {
+      usage();
+      exit(1);
+   }
+
+   if (pgagroal_create_shared_memory(sizeof(struct main_configuration), HUGEPAGE_OFF, &shmem))
+   {
+      fprintf(stderr, "pgagroal_memory_clear: Unable to create shared memory\n");
+      exit(1);
+   }
+
+   pgagroal_memory_init();
+
+   printf("%10s %18s %18s\n", "Size", "Full clear ns/msg", "Used clear ns/msg");
+
+   for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+   {
+      double full = full_clear(messages, sizes[i]);
+      double used = used_clear(messages, sizes[i]);
+
+      printf("%10zu %18.1f %18.1f\n", sizes[i], full, used);
+   }
+
+   pgagroal_memory_destroy();
+   pgagroal_destroy_shared_memory(shmem, sizeof(struct main_configuration));
+
+   return 0;
+}
+
+/* The previous behaviour: the whole buffer is cleared for every message */
+static double
+full_clear(long messages, size_t size)
+{
+   struct message* msg = NULL;
+   struct timespec start;
+   struct timespec end;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+
+   for (long i = 0; i < messages; i++)
+   {
+      msg = pgagroal_memory_message();
+      memset(msg->data, 'Q', size);
+      msg->length = size;
+
+      memset(msg->data, 0, DEFAULT_BUFFER_SIZE);
+      msg->kind = 0;
+      msg->length = 0;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   return elapsed_ns(&start, &end) / messages;
+}
+
+static double
+used_clear(long messages, size_t size)
+{
+   struct message* msg = NULL;
+   struct timespec start;
+   struct timespec end;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+
+   for (long i = 0; i < messages; i++)
+   {
+      msg = pgagroal_memory_message();
+      memset(msg->data, 'Q', size);
+      msg->length = size;
+      pgagroal_memory_used(size);
+
+      pgagroal_clear_message(msg);
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   return elapsed_ns(&start, &end) / messages;
+}
+
+static double
+elapsed_ns(struct timespec* start, struct timespec* end)
+{
+   return (end->tv_sec - start->tv_sec) * 1000000000.0 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void
+usage(void)
+{
+   printf("pgagroal_memory_clear\n");
+   printf("  Measure the cost of clearing the message buffer between messages\n");
+   printf("\n");
+   printf("Usage:\n");
+   printf("  pgagroal_memory_clear [ -n MESSAGES ]\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -n MESSAGES  The number of messages per size (default %d)\n", DEFAULT_MESSAGES);
+   printf("  -h           Display help\n");
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* pgagroal */
+#include <pgagroal.h>
+#include <prometheus.h>
+#include <shmem.h>
+
+/* system */
+#include <getopt.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define DEFAULT_UPDATES 1000000
+
+/* The previous layout: one counter shared by every process */
+struct single_counter
+{
+   atomic_ullong network_sent;
+} __attribute__((aligned(64)));
+
+static double run(int processes, long updates, struct single_counter* single);
+static double elapsed_ns(struct timespec* start, struct timespec* end);
+static void usage(void);
+
+int
+main(int argc, char** argv)
+{
+   int c;
+   int max_processes;
+   long updates = DEFAULT_UPDATES;
+   struct single_counter* single = NULL;
+   struct main_configuration* config = NULL;
+   size_t prometheus_size = 0;
+
+   max_processes = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+   while ((c = getopt(argc, argv, "n:p:h")) != -1)
+   {
+      switch (c)
+      {
+         case 'n':
+            updates = atol(optarg);
+            break;
+         case 'p':
+            max_processes = atoi(optarg);
+            break;
+         case 'h':
+         default:
+            usage();
+            exit(c == 'h' ? 0 : 1);
+      }
+   }
+
+   if (updates <= 0 || max_processes <= 0)
+   {
+      usage();
+      exit(1);
+   }
+
+   if (pgagroal_create_shared_memory(sizeof(struct main_configuration), HUGEPAGE_OFF, &shmem))
+   {
+      fprintf(stderr, "pgagroal_prometheus_counters: Unable to create shared memory\n");
+      exit(1);
+   }
+
+   config = (struct main_configuration*)shmem;
+   config->common.metrics = 1;
+   config->common.hugepage = HUGEPAGE_OFF;
+   config->max_connections = 1;
+
+   if (pgagroal_init_prometheus(&prometheus_size, &prometheus_shmem))
+   {
+      fprintf(stderr, "pgagroal_prometheus_counters: Unable to create Prometheus shared memory\n");
+      exit(1);
+   }
+
+   if (pgagroal_create_shared_memory(sizeof(struct single_counter), HUGEPAGE_OFF, (void**)&single))
+   {
+      fprintf(stderr, "pgagroal_prometheus_counters: Unable to create shared memory\n");
+      exit(1);
+   }
+
+   printf("%10s %18s %18s\n", "Processes", "Single ns/update", "Sharded ns/update");
+
+   for (int processes = 1; processes <= max_processes; processes *= 2)
+   {
+      double sharded = run(processes, updates, NULL);
+      double shared = run(processes, updates, single);
+
+      printf("%10d %18.2f %18.2f\n", processes, shared, sharded);
+
+      if (processes < max_processes && processes * 2 > max_processes)
+      {
+         processes = max_processes / 2;
+      }
+   }
+
+   pgagroal_destroy_shared_memory(single, sizeof(struct single_counter));
+   pgagroal_destroy_shared_memory(prometheus_shmem, prometheus_size);
+   pgagroal_destroy_shared_memory(shmem, sizeof(struct main_configuration));
+
+   return 0;
+}
+
+/* Returns the wall time per update seen by each process */
+static double
+run(int processes, long updates, struct single_counter* single)
+{
+   pid_t pid;
+   struct timespec start;
+   struct timespec end;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+
+   for (int i = 0; i < processes; i++)
+   {
+      pid = fork();
+
+      if (pid == -1)
+      {
+         fprintf(stderr, "pgagroal_prometheus_counters: fork failed\n");
+         exit(1);
+      }
+      else if (pid == 0)
+      {
+         for (long j = 0; j < updates; j++)
+         {
+            if (single != NULL)
+            {
+               atomic_fetch_add(&single->network_sent, 1);
+            }
+            else
+            {
+               pgagroal_prometheus_network_sent_add(1);
+            }
+         }
+
+         _exit(0);
+      }
+   }
+
+   while (wait(NULL) > 0)
+   {
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   return elapsed_ns(&start, &end) / updates;
+}
+
+static double
+elapsed_ns(struct timespec* start, struct timespec* end)
+{
+   return (end->tv_sec - start->tv_sec) * 1000000000.0 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void
+usage(void)
+{
+   printf("pgagroal_prometheus_counters\n");
+   printf("  Measure the contention on the hot path Prometheus counters\n");
+   printf("\n");
+   printf("Usage:\n");
+   printf("  pgagroal_prometheus_counters [ -n UPDATES ] [ -p PROCESSES ]\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -n UPDATES    The number of updates per process (default %d)\n", DEFAULT_UPDATES);
+   printf("  -p PROCESSES  The maximum number of processes (default online CPUs)\n");
+   printf("  -h            Display help\n");
+}
@@ -0,0 +1,342 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/* pgagroal */
+#include <pgagroal.h>
+#include <pool.h>
+#include <shmem.h>
+
+/* system */
+#include <getopt.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_OPERATIONS  1000000
+#define DEFAULT_IDENTITIES  2
+#define MAX_SLOT_MISMATCHES 16
+
+/** @struct previous_list
+ * Defines the previous layout: a lock-free stack per hash of the username
+ * and database, shared by the identities with the same hash
+ */
+struct previous_list
+{
+   atomic_ullong head;                            /**< The head of the stack */
+   atomic_int next[MAX_NUMBER_OF_CONNECTIONS];    /**< The next slot in the stack */
+   atomic_bool queued[MAX_NUMBER_OF_CONNECTIONS]; /**< Is the slot in the stack */
+};
+
+static void previous_push(struct previous_list* list, int slot);
+static int previous_pop(struct previous_list* list);
+static int previous_get(struct previous_list* list, int* identities, int identity);
+static void previous_remove(struct previous_list* list, int slot);
+static double elapsed_ns(struct timespec* start, struct timespec* end);
+static void usage(void);
+
+int
+main(int argc, char** argv)
+{
+   int c;
+   int slots;
+   int identities = DEFAULT_IDENTITIES;
+   long operations = DEFAULT_OPERATIONS;
+   long hits;
+   int sizes[] = {100, 1000, 2500, 5000, 10000};
+   int* identity = NULL;
+   struct previous_list* previous = NULL;
+   struct main_configuration* config = NULL;
+   struct timespec start;
+   struct timespec end;
+   double previous_get_ns;
+   double current_get_ns;
+   double previous_remove_ns;
+   double current_remove_ns;
+
+   while ((c = getopt(argc, argv, "n:i:h")) != -1)
+   {
+      switch (c)
+      {
+         case 'n':
+            operations = atol(optarg);
+            break;
+         case 'i':
+            identities = atoi(optarg);
+            break;
+         case 'h':
+         default:
+            usage();
+            exit(c == 'h' ? 0 : 1);
+      }
+   }
+
+   if (operations <= 0 || identities <= 0 || identities >= NUMBER_OF_SLOT_LISTS)
+   {
+      usage();
+      exit(1);
+   }
+
+   if (pgagroal_create_shared_memory(sizeof(struct main_configuration), HUGEPAGE_OFF, &shmem))
+   {
+      fprintf(stderr, "pgagroal_slot_lists: Unable to create shared memory\n");
+      exit(1);
+   }
+
+   config = (struct main_configuration*)shmem;
+   config->common.hugepage = HUGEPAGE_OFF;
+
+   previous = calloc(1, sizeof(struct previous_list));
+   identity = calloc(MAX_NUMBER_OF_CONNECTIONS, sizeof(int));
+
+   if (previous == NULL || identity == NULL)
+   {
+      fprintf(stderr, "pgagroal_slot_lists: Out of memory\n");
+      exit(1);
+   }
+
+   printf("%8s %12s %14s %12s %16s %16s\n",
+          "Slots", "Previous get", "Previous hits", "Current get", "Previous remove", "Current remove");
+
+   for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+   {
+      slots = sizes[s] < MAX_NUMBER_OF_CONNECTIONS ? sizes[s] : MAX_NUMBER_OF_CONNECTIONS;
+      config->max_connections = slots;
+
+      /* The identities of the slots are interleaved, and share one hash in the previous layout */
+      memset(previous, 0, sizeof(struct previous_list));
+      memset(&config->free_slots, 0, sizeof(config->free_slots));
+
+      for (int i = 0; i < slots; i++)
+      {
+         identity[i] = i % identities;
+         atomic_store(&previous->next[i], -1);
+         pgagroal_slot_list_add(&config->free_slots[identity[i]], i);
+      }
+
+      /* The other identities returned their connections last */
+      for (int id = 0; id < identities; id++)
+      {
+         for (int i = id; i < slots; i += identities)
+         {
+            previous_push(previous, i);
+         }
+      }
+
+      /* Get and return a connection of the first identity */
+      hits = 0;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (long j = 0; j < operations; j++)
+      {
+         int slot = previous_get(previous, identity, 0);
+
+         if (slot != -1)
+         {
+            hits++;
+            previous_push(previous, slot);
+         }
+      }
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      previous_get_ns = elapsed_ns(&start, &end) / operations;
+
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (long j = 0; j < operations; j++)
+      {
+         int slot = pgagroal_slot_list_recent(&config->free_slots[0], 0);
+
+         if (slot == -1)
+         {
+            slot = pgagroal_slot_list_next(&config->free_slots[0], 0);
+         }
+
+         if (slot != -1)
+         {
+            pgagroal_slot_list_remove(&config->free_slots[0], slot);
+            pgagroal_slot_list_add(&config->free_slots[0], slot);
+         }
+      }
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      current_get_ns = elapsed_ns(&start, &end) / operations;
+
+      /* Kill a free connection, and create it again */
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (long j = 0; j < operations / 100; j++)
+      {
+         int slot = (int)((j * 7919) % slots);
+
+         previous_remove(previous, slot);
+         previous_push(previous, slot);
+      }
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      previous_remove_ns = elapsed_ns(&start, &end) / (operations / 100 > 0 ? operations / 100 : 1);
+
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (long j = 0; j < operations; j++)
+      {
+         int slot = (int)((j * 7919) % slots);
+
+         pgagroal_slot_list_remove(&config->free_slots[identity[slot]], slot);
+         pgagroal_slot_list_add(&config->free_slots[identity[slot]], slot);
+      }
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      current_remove_ns = elapsed_ns(&start, &end) / operations;
+
+      printf("%8d %12.2f %13.1f%% %12.2f %16.2f %16.2f\n", slots,
+             previous_get_ns, 100.0 * hits / operations, current_get_ns,
+             previous_remove_ns, current_remove_ns);
+
+      if (slots == MAX_NUMBER_OF_CONNECTIONS)
+      {
+         break;
+      }
+   }
+
+   free(identity);
+   free(previous);
+   pgagroal_destroy_shared_memory(shmem, sizeof(struct main_configuration));
+
+   return 0;
+}
+
+static void
+previous_push(struct previous_list* list, int slot)
+{
+   bool not_queued = false;
+   unsigned long long head;
+   unsigned long long new_head;
+
+   if (!atomic_compare_exchange_strong(&list->queued[slot], &not_queued, true))
+   {
+      return;
+   }
+
+   head = atomic_load(&list->head);
+
+   do
+   {
+      atomic_store(&list->next[slot], (int)(head & 0xFFFFFFFFULL) - 1);
+      new_head = (((head >> 32) + 1) << 32) | (unsigned long long)(slot + 1);
+   }
+   while (!atomic_compare_exchange_weak(&list->head, &head, new_head));
+}
+
+static int
+previous_pop(struct previous_list* list)
+{
+   int slot;
+   unsigned long long head;
+   unsigned long long new_head;
+
+   head = atomic_load(&list->head);
+
+   do
+   {
+      slot = (int)(head & 0xFFFFFFFFULL) - 1;
+
+      if (slot == -1)
+      {
+         return -1;
+      }
+
+      new_head = (((head >> 32) + 1) << 32) | (unsigned long long)(atomic_load(&list->next[slot]) + 1);
+   }
+   while (!atomic_compare_exchange_weak(&list->head, &head, new_head));
+
+   atomic_store(&list->queued[slot], false);
+
+   return slot;
+}
+
+/* The previous lookup gave up after MAX_SLOT_MISMATCHES slots of other identities */
+static int
+previous_get(struct previous_list* list, int* identities, int identity)
+{
+   int slot = -1;
+   int candidate;
+   int mismatches = 0;
+   int mismatch[MAX_SLOT_MISMATCHES];
+
+   while (slot == -1 && mismatches < MAX_SLOT_MISMATCHES && (candidate = previous_pop(list)) != -1)
+   {
+      if (identities[candidate] == identity)
+      {
+         slot = candidate;
+      }
+      else
+      {
+         mismatch[mismatches++] = candidate;
+      }
+   }
+
+   for (int i = 0; i < mismatches; i++)
+   {
+      previous_push(list, mismatch[i]);
+   }
+
+   return slot;
+}
+
+static void
+previous_remove(struct previous_list* list, int slot)
+{
+   int candidate;
+   int stashed = 0;
+   int stash[MAX_NUMBER_OF_CONNECTIONS];
+
+   while ((candidate = previous_pop(list)) != -1 && candidate != slot)
+   {
+      stash[stashed++] = candidate;
+   }
+
+   for (int i = stashed - 1; i >= 0; i--)
+   {
+      previous_push(list, stash[i]);
+   }
+}
+
+static double
+elapsed_ns(struct timespec* start, struct timespec* end)
+{
+   return (end->tv_sec - start->tv_sec) * 1000000000.0 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void
+usage(void)
+{
+   printf("pgagroal_slot_lists\n");
+   printf("  Measure getting and removing a free connection for pool sizes from 100 to 10000 slots\n");
+   printf("\n");
+   printf("Usage:\n");
+   printf("  pgagroal_slot_lists [ -n OPERATIONS ] [ -i IDENTITIES ]\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -n OPERATIONS  The number of operations per pool size (default %d)\n", DEFAULT_OPERATIONS);
+   printf("  -i IDENTITIES  The number of username / database pairs in the pool (default %d)\n", DEFAULT_IDENTITIES);
+   printf("  -h             Display help\n");
+}
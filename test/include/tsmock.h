@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGAGROAL_TSMOCK_H
+#define PGAGROAL_TSMOCK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgagroal.h>
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define MOCK_AUTH_TRUST     0
+#define MOCK_AUTH_MD5       1
+#define MOCK_AUTH_SCRAM256  2
+
+#define MOCK_DEFAULT_PORT   5433
+#define MOCK_DEFAULT_ROWS   1
+#define MOCK_MAX_RESPONSES  64
+#define MOCK_MAX_STATEMENTS 64
+
+/** @struct tsmock_response
+ * Defines a canned response to a query
+ */
+struct tsmock_response
+{
+   char query[MAX_PATH];     /**< The query */
+   char column[MISC_LENGTH]; /**< The column name */
+   char value[MISC_LENGTH];  /**< The value of each row */
+   int rows;                 /**< The number of rows */
+};
+
+/** @struct tsmock_configuration
+ * Defines the configuration of the mock PostgreSQL backend
+ */
+struct tsmock_configuration
+{
+   char host[MISC_LENGTH];                               /**< The host */
+   int port;                                             /**< The port */
+   int auth;                                             /**< The authentication method */
+   char username[MAX_USERNAME_LENGTH];                   /**< The user name, or empty for any user */
+   char password[MAX_PASSWORD_LENGTH];                   /**< The password */
+   int latency;                                          /**< The latency added to each query in microseconds */
+   int rows;                                             /**< The number of rows of the default response */
+   int number_of_responses;                              /**< The number of canned responses */
+   struct tsmock_response responses[MOCK_MAX_RESPONSES]; /**< The canned responses */
+};
+
+/**
+ * Initialize a mock configuration with the defaults
+ * @param config The configuration
+ */
+void
+pgagroal_tsmock_init(struct tsmock_configuration* config);
+
+/**
+ * Read canned responses from a file. Each line holds the query, the column
+ * name, the value and optionally the number of rows, separated by tabs
+ * @param config The configuration
+ * @param path The path of the file
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_tsmock_read_responses(struct tsmock_configuration* config, char* path);
+
+/**
+ * Serve clients until the process is terminated
+ * @param config The configuration
+ * @return 1 if the server could not be started
+ */
+int
+pgagroal_tsmock_run(struct tsmock_configuration* config);
+
+/**
+ * Start the mock backend in a child process
+ * @param config The configuration
+ * @param pid The process identifier of the backend
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_tsmock_start(struct tsmock_configuration* config, pid_t* pid);
+
+/**
+ * Stop a mock backend started by pgagroal_tsmock_start
+ * @param pid The process identifier of the backend
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_tsmock_stop(pid_t pid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
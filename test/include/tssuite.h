@@ -69,6 +69,27 @@ pgagroal_test_deque_suite();
 Suite*
 pgagroal_test_json_suite();
 
+/**
+ * Set up a mock backend suite for pgagroal
+ * @return The result
+ */
+Suite*
+pgagroal_test_mock_suite();
+
+/**
+ * Set up a session parameter suite for pgagroal
+ * @return The result
+ */
+Suite*
+pgagroal_test_parameters_suite();
+
+/**
+ * Set up a prepared statement suite for pgagroal
+ * @return The result
+ */
+Suite*
+pgagroal_test_prepared_suite();
+
 /**
  * Set up a UTF-8 user test suite for pgagroal
  * @return The result
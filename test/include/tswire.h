@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGAGROAL_TSWIRE_H
+#define PGAGROAL_TSWIRE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgagroal.h>
+#include <message.h>
+#include <wire.h>
+
+#include <stdlib.h>
+
+/**
+ * Rewrite a message of a slot
+ * @param client The client of the rewrite
+ * @param slot The slot
+ * @param msg The message
+ * @param result The rewritten message
+ * @return 0 upon success, otherwise 1
+ */
+typedef int (*tswire_rewrite)(void* client, int slot, struct message* msg, struct message** result);
+
+/**
+ * Append a message with an empty body, or an idle ReadyForQuery for 'Z'
+ * @param w The wire
+ * @param kind The kind of the message
+ */
+void
+pgagroal_tswire_append_message(struct wire* w, char kind);
+
+/**
+ * Rewrite the messages of a wire in chunks of a given size, like they arrive
+ * from a socket, and append the result to another wire. The input wire is
+ * emptied
+ * @param in The messages to rewrite
+ * @param out The rewritten messages
+ * @param chunk The size of the chunks, or 0 for a single chunk
+ * @param rewrite The rewrite
+ * @param client The client of the rewrite
+ * @param slot The slot
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_tswire_feed(struct wire* in, struct wire* out, size_t chunk, tswire_rewrite rewrite, void* client, int slot);
+
+/**
+ * List the kinds of the messages of a wire
+ * @param w The wire
+ * @param result The kinds as a string
+ * @param size The size of the result
+ */
+void
+pgagroal_tswire_kinds(struct wire* w, char* result, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1153 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgagroal */
+#include <pgagroal.h>
+#include <security.h>
+#include <tsmock.h>
+#include <utils.h>
+#include <wire.h>
+
+/* system */
+#include <ctype.h>
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/rand.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MOCK_PROTOCOL      196608
+#define MOCK_CANCEL        80877102
+#define MOCK_SSL_REQUEST   80877103
+#define MOCK_GSS_REQUEST   80877104
+#define MOCK_ITERATIONS    4096
+
+/** @struct statement
+ * Defines a prepared statement of a session
+ */
+struct statement
+{
+   char name[MISC_LENGTH]; /**< The name */
+   char* query;            /**< The query */
+};
+
+/** @struct result
+ * Defines the response to a query
+ */
+struct result
+{
+   char tag[MISC_LENGTH]; /**< The command tag */
+   char* column;          /**< The column name, or NULL without rows */
+   char* value;           /**< The value of each row */
+   int rows;              /**< The number of rows */
+   bool empty;            /**< Is the query empty */
+};
+
+/** @struct session
+ * Defines the state of a client of the mock backend
+ */
+struct session
+{
+   struct wire wire;                                  /**< The socket */
+   struct tsmock_configuration* config;               /**< The configuration */
+   char username[MAX_USERNAME_LENGTH];                /**< The user name */
+   char database[MAX_DATABASE_LENGTH];                /**< The database */
+   char tx_state;                                     /**< The transaction state */
+   bool skip;                                         /**< Are the messages discarded until Sync */
+   struct statement statements[MOCK_MAX_STATEMENTS];  /**< The prepared statements */
+   char* portal;                                      /**< The query of the unnamed portal */
+};
+
+static int listen_socket(struct tsmock_configuration* config);
+static void serve(struct tsmock_configuration* config, int fd);
+static void session(struct tsmock_configuration* config, int fd);
+
+static int startup(struct session* s);
+static int authenticate(struct session* s);
+static int auth_md5(struct session* s);
+static int auth_scram256(struct session* s);
+
+static void write_error(struct session* s, char* code, char* message);
+static void write_row_description(struct session* s, char* column);
+static void write_rows(struct session* s, struct result* r);
+static void write_ready(struct session* s);
+
+static void resolve(struct session* s, char* query, bool execute, struct result* r);
+static bool is_query(char* query, char* canned);
+static bool is_command(char* query, char* command);
+static struct statement* find_statement(struct session* s, char* name, bool create);
+static void latency(struct session* s);
+
+void
+pgagroal_tsmock_init(struct tsmock_configuration* config)
+{
+   memset(config, 0, sizeof(struct tsmock_configuration));
+
+   memcpy(&config->host[0], "localhost", strlen("localhost"));
+   config->port = MOCK_DEFAULT_PORT;
+   config->auth = MOCK_AUTH_TRUST;
+   config->rows = MOCK_DEFAULT_ROWS;
+}
+
+int
+pgagroal_tsmock_read_responses(struct tsmock_configuration* config, char* path)
+{
+   FILE* file = NULL;
+   char line[MAX_PATH + 2 * MISC_LENGTH + 16];
+
+   file = fopen(path, "r");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   while (fgets(&line[0], sizeof(line), file) != NULL)
+   {
+      char* fields[4] = {NULL, NULL, NULL, NULL};
+      char* p = &line[0];
+      struct tsmock_response* r = NULL;
+
+      line[strcspn(&line[0], "\r\n")] = '\0';
+
+      if (line[0] == '\0' || line[0] == '#')
+      {
+         continue;
+      }
+
+      for (int i = 0; i < 4 && p != NULL; i++)
+      {
+         fields[i] = p;
+         p = strchr(p, '\t');
+         if (p != NULL)
+         {
+            *p = '\0';
+            p++;
+         }
+      }
+
+      if (fields[1] == NULL || fields[2] == NULL)
+      {
+         goto error;
+      }
+
+      if (config->number_of_responses >= MOCK_MAX_RESPONSES)
+      {
+         goto error;
+      }
+
+      r = &config->responses[config->number_of_responses];
+      memset(r, 0, sizeof(struct tsmock_response));
+
+      memcpy(&r->query[0], fields[0], MIN(strlen(fields[0]), MAX_PATH - 1));
+      memcpy(&r->column[0], fields[1], MIN(strlen(fields[1]), MISC_LENGTH - 1));
+      memcpy(&r->value[0], fields[2], MIN(strlen(fields[2]), MISC_LENGTH - 1));
+      r->rows = fields[3] != NULL ? atoi(fields[3]) : 1;
+
+      config->number_of_responses++;
+   }
+
+   fclose(file);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+int
+pgagroal_tsmock_run(struct tsmock_configuration* config)
+{
+   int fd;
+
+   fd = listen_socket(config);
+   if (fd == -1)
+   {
+      return 1;
+   }
+
+   serve(config, fd);
+
+   close(fd);
+
+   return 1;
+}
+
+int
+pgagroal_tsmock_start(struct tsmock_configuration* config, pid_t* pid)
+{
+   int fd;
+
+   *pid = -1;
+
+   fd = listen_socket(config);
+   if (fd == -1)
+   {
+      return 1;
+   }
+
+   *pid = fork();
+   if (*pid == -1)
+   {
+      close(fd);
+      return 1;
+   }
+   else if (*pid == 0)
+   {
+      setpgid(0, 0);
+
+      serve(config, fd);
+
+      exit(1);
+   }
+
+   /* The socket is listening, so clients can connect right away */
+   close(fd);
+
+   return 0;
+}
+
+int
+pgagroal_tsmock_stop(pid_t pid)
+{
+   if (pid <= 0)
+   {
+      return 1;
+   }
+
+   /* The sessions are in the process group of the backend */
+   kill(-pid, SIGTERM);
+   kill(pid, SIGTERM);
+
+   if (waitpid(pid, NULL, 0) == -1)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+listen_socket(struct tsmock_configuration* config)
+{
+   int fd = -1;
+   int yes = 1;
+   char port[16];
+   struct addrinfo hints;
+   struct addrinfo* addrs = NULL;
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags = AI_PASSIVE;
+
+   memset(&port[0], 0, sizeof(port));
+   snprintf(&port[0], sizeof(port), "%d", config->port);
+
+   if (getaddrinfo(config->host, &port[0], &hints, &addrs) != 0)
+   {
+      return -1;
+   }
+
+   for (struct addrinfo* a = addrs; a != NULL; a = a->ai_next)
+   {
+      fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+      if (fd == -1)
+      {
+         continue;
+      }
+
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+      if (bind(fd, a->ai_addr, a->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0)
+      {
+         break;
+      }
+
+      close(fd);
+      fd = -1;
+   }
+
+   freeaddrinfo(addrs);
+
+   return fd;
+}
+
+static void
+serve(struct tsmock_configuration* config, int fd)
+{
+   int client_fd;
+   pid_t pid;
+
+   /* The sessions are reaped automatically */
+   signal(SIGCHLD, SIG_IGN);
+   signal(SIGPIPE, SIG_IGN);
+
+   while (true)
+   {
+      client_fd = accept(fd, NULL, NULL);
+      if (client_fd == -1)
+      {
+         if (errno == EINTR || errno == ECONNABORTED)
+         {
+            continue;
+         }
+
+         break;
+      }
+
+      pid = fork();
+      if (pid == 0)
+      {
+         int yes = 1;
+
+         close(fd);
+
+         setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+         session(config, client_fd);
+
+         close(client_fd);
+         exit(0);
+      }
+
+      close(client_fd);
+   }
+}
+
+static void
+session(struct tsmock_configuration* config, int fd)
+{
+   char kind;
+   char* data = NULL;
+   int length;
+   struct session* s = NULL;
+
+   s = (struct session*)calloc(1, sizeof(struct session));
+   if (s == NULL)
+   {
+      return;
+   }
+
+   pgagroal_wire_reset(&s->wire, fd);
+   s->config = config;
+   s->tx_state = 'I';
+
+   if (startup(s) || authenticate(s))
+   {
+      goto done;
+   }
+
+   while (pgagroal_wire_read_message(&s->wire, &kind, &length) == 0)
+   {
+      struct result r;
+
+      data = s->wire.message;
+
+      /* An error in the extended protocol discards the messages up to the next Sync */
+      if (s->skip && kind != 'S' && kind != 'X')
+      {
+         continue;
+      }
+
+      switch (kind)
+      {
+         case 'Q':
+         {
+            latency(s);
+
+            resolve(s, data, true, &r);
+
+            if (r.column != NULL)
+            {
+               write_row_description(s, r.column);
+            }
+            write_rows(s, &r);
+            write_ready(s);
+
+            if (pgagroal_wire_flush(&s->wire))
+            {
+               goto done;
+            }
+            break;
+         }
+         case 'P':
+         {
+            char* name = data;
+            char* query = data + strlen(name) + 1;
+            struct statement* st = find_statement(s, name, true);
+
+            if (st == NULL)
+            {
+               write_error(s, "53000", "too many prepared statements");
+               s->skip = true;
+               break;
+            }
+
+            free(st->query);
+            st->query = strdup(query);
+
+            pgagroal_wire_append_header(&s->wire, '1', 4);
+            break;
+         }
+         case 'B':
+         {
+            char* portal = data;
+            char* name = data + strlen(portal) + 1;
+            struct statement* st = find_statement(s, name, false);
+
+            if (st == NULL)
+            {
+               write_error(s, "26000", "prepared statement does not exist");
+               s->skip = true;
+               break;
+            }
+
+            free(s->portal);
+            s->portal = strdup(st->query);
+
+            pgagroal_wire_append_header(&s->wire, '2', 4);
+            break;
+         }
+         case 'D':
+         {
+            char* query = s->portal;
+
+            if (data[0] == 'S')
+            {
+               struct statement* st = find_statement(s, data + 1, false);
+
+               if (st == NULL)
+               {
+                  write_error(s, "26000", "prepared statement does not exist");
+                  s->skip = true;
+                  break;
+               }
+
+               query = st->query;
+
+               pgagroal_wire_append_header(&s->wire, 't', 6);
+               pgagroal_wire_append_int16(&s->wire, 0);
+            }
+
+            resolve(s, query != NULL ? query : "", false, &r);
+
+            if (r.column != NULL)
+            {
+               write_row_description(s, r.column);
+            }
+            else
+            {
+               pgagroal_wire_append_header(&s->wire, 'n', 4);
+            }
+            break;
+         }
+         case 'E':
+         {
+            latency(s);
+
+            resolve(s, s->portal != NULL ? s->portal : "", true, &r);
+            write_rows(s, &r);
+            break;
+         }
+         case 'C':
+         {
+            if (data[0] == 'S')
+            {
+               struct statement* st = find_statement(s, data + 1, false);
+
+               if (st != NULL)
+               {
+                  free(st->query);
+                  memset(st, 0, sizeof(struct statement));
+               }
+            }
+
+            pgagroal_wire_append_header(&s->wire, '3', 4);
+            break;
+         }
+         case 'H':
+         {
+            if (pgagroal_wire_flush(&s->wire))
+            {
+               goto done;
+            }
+            break;
+         }
+         case 'S':
+         {
+            s->skip = false;
+            write_ready(s);
+
+            if (pgagroal_wire_flush(&s->wire))
+            {
+               goto done;
+            }
+            break;
+         }
+         case 'X':
+         {
+            goto done;
+         }
+         default:
+         {
+            write_error(s, "0A000", "message not supported by the mock backend");
+            write_ready(s);
+
+            if (pgagroal_wire_flush(&s->wire))
+            {
+               goto done;
+            }
+            break;
+         }
+      }
+   }
+
+done:
+
+   for (int i = 0; i < MOCK_MAX_STATEMENTS; i++)
+   {
+      free(s->statements[i].query);
+   }
+   free(s->portal);
+   pgagroal_wire_destroy(&s->wire);
+   free(s);
+}
+
+static int
+startup(struct session* s)
+{
+   int32_t length;
+   int32_t code;
+   char header[8];
+   char* data = NULL;
+   char* p = NULL;
+
+retry:
+   if (pgagroal_wire_read(&s->wire, &header[0], sizeof(header)))
+   {
+      goto error;
+   }
+
+   length = pgagroal_read_int32(&header[0]);
+   code = pgagroal_read_int32(&header[4]);
+
+   if (length < 8 || length > WIRE_BUFFER_SIZE)
+   {
+      goto error;
+   }
+
+   if (code == MOCK_SSL_REQUEST || code == MOCK_GSS_REQUEST)
+   {
+      /* TLS and GSSAPI aren't supported, so the client continues in clear text */
+      pgagroal_wire_append_byte(&s->wire, 'N');
+      if (pgagroal_wire_flush(&s->wire))
+      {
+         goto error;
+      }
+      goto retry;
+   }
+
+   if (code != MOCK_PROTOCOL)
+   {
+      goto error;
+   }
+
+   data = calloc(1, length - 8 + 1);
+   if (data == NULL || pgagroal_wire_read(&s->wire, data, length - 8))
+   {
+      goto error;
+   }
+
+   p = data;
+   while (p < data + length - 8 && *p != '\0')
+   {
+      char* key = p;
+      char* value = p + strlen(key) + 1;
+
+      if (!strcmp(key, "user"))
+      {
+         memcpy(&s->username[0], value, MIN(strlen(value), MAX_USERNAME_LENGTH - 1));
+      }
+      else if (!strcmp(key, "database"))
+      {
+         memcpy(&s->database[0], value, MIN(strlen(value), MAX_DATABASE_LENGTH - 1));
+      }
+
+      p = value + strlen(value) + 1;
+   }
+
+   if (s->database[0] == '\0')
+   {
+      memcpy(&s->database[0], &s->username[0], MAX_DATABASE_LENGTH < MAX_USERNAME_LENGTH ? MAX_DATABASE_LENGTH - 1 : MAX_USERNAME_LENGTH - 1);
+   }
+
+   free(data);
+
+   return 0;
+
+error:
+
+   free(data);
+
+   return 1;
+}
+
+static int
+authenticate(struct session* s)
+{
+   char secret[4];
+   char* parameters[][2] = {
+      {"application_name", ""},
+      {"client_encoding", "UTF8"},
+      {"DateStyle", "ISO, MDY"},
+      {"integer_datetimes", "on"},
+      {"IntervalStyle", "postgres"},
+      {"is_superuser", "off"},
+      {"server_encoding", "UTF8"},
+      {"server_version", "17.0"},
+      {"session_authorization", &s->username[0]},
+      {"standard_conforming_strings", "on"},
+      {"TimeZone", "UTC"},
+   };
+   struct tsmock_configuration* config = s->config;
+
+   if (config->username[0] != '\0' && strcmp(&config->username[0], &s->username[0]))
+   {
+      write_error(s, "28000", "role does not exist");
+      pgagroal_wire_flush(&s->wire);
+      return 1;
+   }
+
+   switch (config->auth)
+   {
+      case MOCK_AUTH_MD5:
+         if (auth_md5(s))
+         {
+            goto bad_password;
+         }
+         break;
+      case MOCK_AUTH_SCRAM256:
+         if (auth_scram256(s))
+         {
+            goto bad_password;
+         }
+         break;
+      default:
+         break;
+   }
+
+   /* AuthenticationOk */
+   pgagroal_wire_append_header(&s->wire, 'R', 8);
+   pgagroal_wire_append_int32(&s->wire, 0);
+
+   for (size_t i = 0; i < sizeof(parameters) / sizeof(parameters[0]); i++)
+   {
+      pgagroal_wire_append_header(&s->wire, 'S', 4 + strlen(parameters[i][0]) + 1 + strlen(parameters[i][1]) + 1);
+      pgagroal_wire_append_string(&s->wire, parameters[i][0]);
+      pgagroal_wire_append_string(&s->wire, parameters[i][1]);
+   }
+
+   RAND_bytes((unsigned char*)&secret[0], sizeof(secret));
+
+   pgagroal_wire_append_header(&s->wire, 'K', 12);
+   pgagroal_wire_append_int32(&s->wire, getpid());
+   pgagroal_wire_append(&s->wire, &secret[0], sizeof(secret));
+
+   write_ready(s);
+
+   return pgagroal_wire_flush(&s->wire);
+
+bad_password:
+
+   write_error(s, "28P01", "password authentication failed");
+   pgagroal_wire_flush(&s->wire);
+
+   return 1;
+}
+
+static int
+auth_md5(struct session* s)
+{
+   char kind;
+   char salt[4];
+   char* data = NULL;
+   int length;
+   char* user_password = NULL;
+   char* hash = NULL;
+   char* salted = NULL;
+   char* expected = NULL;
+   size_t size;
+
+   RAND_bytes((unsigned char*)&salt[0], sizeof(salt));
+
+   pgagroal_wire_append_header(&s->wire, 'R', 12);
+   pgagroal_wire_append_int32(&s->wire, 5);
+   pgagroal_wire_append(&s->wire, &salt[0], sizeof(salt));
+
+   if (pgagroal_wire_flush(&s->wire) || pgagroal_wire_read_message(&s->wire, &kind, &length) || kind != 'p')
+   {
+      goto error;
+   }
+   data = s->wire.message;
+
+   /* md5(md5(password + user) + salt) */
+   size = strlen(s->config->password) + strlen(&s->username[0]);
+   user_password = calloc(1, size + 1);
+   memcpy(user_password, s->config->password, strlen(s->config->password));
+   memcpy(user_password + strlen(s->config->password), &s->username[0], strlen(&s->username[0]));
+
+   pgagroal_md5(user_password, size, &hash);
+
+   salted = calloc(1, 32 + sizeof(salt) + 1);
+   memcpy(salted, hash, 32);
+   memcpy(salted + 32, &salt[0], sizeof(salt));
+
+   free(hash);
+   hash = NULL;
+
+   pgagroal_md5(salted, 32 + sizeof(salt), &hash);
+
+   expected = pgagroal_append(expected, "md5");
+   expected = pgagroal_append(expected, hash);
+
+   if (strcmp(data, expected))
+   {
+      goto error;
+   }
+
+   free(user_password);
+   free(hash);
+   free(salted);
+   free(expected);
+
+   return 0;
+
+error:
+
+   free(user_password);
+   free(hash);
+   free(salted);
+   free(expected);
+
+   return 1;
+}
+
+static int
+auth_scram256(struct session* s)
+{
+   char kind;
+   char* data = NULL;
+   int length;
+   int offset;
+   char* client_first_bare = NULL;
+   char* client_nonce = NULL;
+   char* server_first = NULL;
+   char* client_final = NULL;
+   char* proof = NULL;
+   char* server_final = NULL;
+   char* base64 = NULL;
+   size_t base64_length;
+   char* received = NULL;
+   size_t received_length = 0;
+   unsigned char* expected = NULL;
+   unsigned char* signature = NULL;
+   unsigned char raw[18];
+   unsigned char salt[16];
+
+   /* AuthenticationSASL */
+   pgagroal_wire_append_header(&s->wire, 'R', 4 + 4 + strlen("SCRAM-SHA-256") + 2);
+   pgagroal_wire_append_int32(&s->wire, 10);
+   pgagroal_wire_append_string(&s->wire, "SCRAM-SHA-256");
+   pgagroal_wire_append_byte(&s->wire, '\0');
+
+   if (pgagroal_wire_flush(&s->wire) || pgagroal_wire_read_message(&s->wire, &kind, &length) || kind != 'p')
+   {
+      goto error;
+   }
+   data = s->wire.message;
+
+   /* SASLInitialResponse: the mechanism, the length and the client-first-message */
+   offset = strlen(data) + 1 + 4;
+   if (offset >= length)
+   {
+      goto error;
+   }
+
+   client_first_bare = strchr(data + offset, ',');
+   client_first_bare = client_first_bare != NULL ? strchr(client_first_bare + 1, ',') : NULL;
+   if (client_first_bare == NULL)
+   {
+      goto error;
+   }
+   client_first_bare = strdup(client_first_bare + 1);
+
+   client_nonce = strstr(client_first_bare, "r=");
+   if (client_nonce == NULL)
+   {
+      goto error;
+   }
+   client_nonce = strndup(client_nonce + 2, strcspn(client_nonce + 2, ","));
+
+   RAND_bytes(&raw[0], sizeof(raw));
+   RAND_bytes(&salt[0], sizeof(salt));
+
+   server_first = pgagroal_append(server_first, "r=");
+   server_first = pgagroal_append(server_first, client_nonce);
+   pgagroal_base64_encode(&raw[0], sizeof(raw), &base64, &base64_length);
+   server_first = pgagroal_append(server_first, base64);
+   free(base64);
+   base64 = NULL;
+   server_first = pgagroal_append(server_first, ",s=");
+   pgagroal_base64_encode(&salt[0], sizeof(salt), &base64, &base64_length);
+   server_first = pgagroal_append(server_first, base64);
+   free(base64);
+   base64 = NULL;
+   server_first = pgagroal_append(server_first, ",i=");
+   server_first = pgagroal_append_int(server_first, MOCK_ITERATIONS);
+
+   /* AuthenticationSASLContinue */
+   pgagroal_wire_append_header(&s->wire, 'R', 4 + 4 + strlen(server_first));
+   pgagroal_wire_append_int32(&s->wire, 11);
+   pgagroal_wire_append(&s->wire, server_first, strlen(server_first));
+
+   if (pgagroal_wire_flush(&s->wire) || pgagroal_wire_read_message(&s->wire, &kind, &length) || kind != 'p')
+   {
+      goto error;
+   }
+   data = s->wire.message;
+
+   proof = strstr(data, ",p=");
+   if (proof == NULL)
+   {
+      goto error;
+   }
+
+   client_final = strndup(data, proof - data);
+   proof += 3;
+
+   if (pgagroal_base64_decode(proof, strlen(proof), (void**)&received, &received_length) ||
+       received_length != 32)
+   {
+      goto error;
+   }
+
+   if (pgagroal_scram256_proof(s->config->password, (char*)&salt[0], sizeof(salt), MOCK_ITERATIONS,
+                               client_first_bare, server_first, client_final,
+                               &expected, &signature))
+   {
+      goto error;
+   }
+
+   if (memcmp(received, expected, received_length))
+   {
+      goto error;
+   }
+
+   pgagroal_base64_encode(signature, 32, &base64, &base64_length);
+
+   server_final = pgagroal_append(server_final, "v=");
+   server_final = pgagroal_append(server_final, base64);
+
+   /* AuthenticationSASLFinal */
+   pgagroal_wire_append_header(&s->wire, 'R', 4 + 4 + strlen(server_final));
+   pgagroal_wire_append_int32(&s->wire, 12);
+   pgagroal_wire_append(&s->wire, server_final, strlen(server_final));
+
+   free(client_first_bare);
+   free(client_nonce);
+   free(server_first);
+   free(client_final);
+   free(server_final);
+   free(base64);
+   free(received);
+   free(expected);
+   free(signature);
+
+   return 0;
+
+error:
+
+   free(client_first_bare);
+   free(client_nonce);
+   free(server_first);
+   free(client_final);
+   free(server_final);
+   free(base64);
+   free(received);
+   free(expected);
+   free(signature);
+
+   return 1;
+}
+
+static void
+write_error(struct session* s, char* code, char* message)
+{
+   pgagroal_wire_append_header(&s->wire, 'E', 4 + 1 + strlen("ERROR") + 1 + 1 + strlen("ERROR") + 1 + 1 + strlen(code) + 1 + 1 + strlen(message) + 1 + 1);
+   pgagroal_wire_append_byte(&s->wire, 'S');
+   pgagroal_wire_append_string(&s->wire, "ERROR");
+   pgagroal_wire_append_byte(&s->wire, 'V');
+   pgagroal_wire_append_string(&s->wire, "ERROR");
+   pgagroal_wire_append_byte(&s->wire, 'C');
+   pgagroal_wire_append_string(&s->wire, code);
+   pgagroal_wire_append_byte(&s->wire, 'M');
+   pgagroal_wire_append_string(&s->wire, message);
+   pgagroal_wire_append_byte(&s->wire, '\0');
+}
+
+static void
+write_row_description(struct session* s, char* column)
+{
+   pgagroal_wire_append_header(&s->wire, 'T', 4 + 2 + strlen(column) + 1 + 4 + 2 + 4 + 2 + 4 + 2);
+   pgagroal_wire_append_int16(&s->wire, 1);
+   pgagroal_wire_append_string(&s->wire, column);
+   pgagroal_wire_append_int32(&s->wire, 0);  /* table */
+   pgagroal_wire_append_int16(&s->wire, 0);  /* attribute number */
+   pgagroal_wire_append_int32(&s->wire, 25); /* text */
+   pgagroal_wire_append_int16(&s->wire, -1); /* size */
+   pgagroal_wire_append_int32(&s->wire, -1); /* modifier */
+   pgagroal_wire_append_int16(&s->wire, 0);  /* text format */
+}
+
+static void
+write_rows(struct session* s, struct result* r)
+{
+   if (r->empty)
+   {
+      pgagroal_wire_append_header(&s->wire, 'I', 4);
+      return;
+   }
+
+   for (int i = 0; r->column != NULL && i < r->rows; i++)
+   {
+      pgagroal_wire_append_header(&s->wire, 'D', 4 + 2 + 4 + strlen(r->value));
+      pgagroal_wire_append_int16(&s->wire, 1);
+      pgagroal_wire_append_int32(&s->wire, strlen(r->value));
+      pgagroal_wire_append(&s->wire, r->value, strlen(r->value));
+   }
+
+   pgagroal_wire_append_header(&s->wire, 'C', 4 + strlen(&r->tag[0]) + 1);
+   pgagroal_wire_append_string(&s->wire, &r->tag[0]);
+}
+
+static void
+write_ready(struct session* s)
+{
+   pgagroal_wire_append_header(&s->wire, 'Z', 5);
+   pgagroal_wire_append_byte(&s->wire, s->tx_state);
+}
+
+static void
+resolve(struct session* s, char* query, bool execute, struct result* r)
+{
+   char* p = query;
+   struct tsmock_configuration* config = s->config;
+
+   memset(r, 0, sizeof(struct result));
+
+   while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == '(')
+   {
+      p++;
+   }
+
+   if (*p == '\0' || *p == ';')
+   {
+      r->empty = true;
+      return;
+   }
+
+   for (int i = 0; i < config->number_of_responses; i++)
+   {
+      if (is_query(p, &config->responses[i].query[0]))
+      {
+         r->column = &config->responses[i].column[0];
+         r->value = &config->responses[i].value[0];
+         r->rows = config->responses[i].rows;
+         snprintf(&r->tag[0], sizeof(r->tag), "SELECT %d", r->rows);
+         return;
+      }
+   }
+
+   if (is_command(p, "BEGIN") || is_command(p, "START"))
+   {
+      snprintf(&r->tag[0], sizeof(r->tag), "BEGIN");
+      if (execute)
+      {
+         s->tx_state = 'T';
+      }
+   }
+   else if (is_command(p, "COMMIT") || is_command(p, "END"))
+   {
+      snprintf(&r->tag[0], sizeof(r->tag), "COMMIT");
+      if (execute)
+      {
+         s->tx_state = 'I';
+      }
+   }
+   else if (is_command(p, "ROLLBACK") || is_command(p, "ABORT"))
+   {
+      snprintf(&r->tag[0], sizeof(r->tag), "ROLLBACK");
+      if (execute)
+      {
+         s->tx_state = 'I';
+      }
+   }
+   else if (is_command(p, "INSERT"))
+   {
+      snprintf(&r->tag[0], sizeof(r->tag), "INSERT 0 1");
+   }
+   else if (is_command(p, "UPDATE") || is_command(p, "DELETE"))
+   {
+      snprintf(&r->tag[0], sizeof(r->tag), "%.6s 1", p);
+      for (int i = 0; i < 6; i++)
+      {
+         r->tag[i] = (char)toupper((unsigned char)r->tag[i]);
+      }
+   }
+   else if (is_command(p, "SET") || is_command(p, "RESET") || is_command(p, "DISCARD") ||
+            is_command(p, "DEALLOCATE") || is_command(p, "LISTEN") || is_command(p, "UNLISTEN"))
+   {
+      size_t length = strcspn(p, " \t\n;");
+
+      for (size_t i = 0; i < length && i < sizeof(r->tag) - 1; i++)
+      {
+         r->tag[i] = (char)toupper((unsigned char)p[i]);
+      }
+
+      if (is_command(p, "DISCARD") || is_command(p, "DEALLOCATE"))
+      {
+         snprintf(&r->tag[0] + strlen(&r->tag[0]), sizeof(r->tag) - strlen(&r->tag[0]), " ALL");
+      }
+   }
+   else if (strstr(p, "pg_is_in_recovery") != NULL)
+   {
+      /* pgagroal reads the primary state at a fixed offset of this response */
+      r->column = "pg_is_in_recovery";
+      r->value = "f";
+      r->rows = 1;
+      snprintf(&r->tag[0], sizeof(r->tag), "SELECT 1");
+   }
+   else
+   {
+      r->column = "?column?";
+      r->value = "1";
+      r->rows = config->rows;
+      snprintf(&r->tag[0], sizeof(r->tag), "SELECT %d", r->rows);
+   }
+}
+
+static bool
+is_query(char* query, char* canned)
+{
+   size_t query_length = strlen(query);
+   size_t canned_length = strlen(canned);
+
+   /* The trailing semicolons and white space don't matter */
+   while (query_length > 0 && strchr("; \t\r\n", query[query_length - 1]) != NULL)
+   {
+      query_length--;
+   }
+
+   while (canned_length > 0 && strchr("; \t\r\n", canned[canned_length - 1]) != NULL)
+   {
+      canned_length--;
+   }
+
+   return query_length == canned_length && !strncasecmp(query, canned, query_length);
+}
+
+static bool
+is_command(char* query, char* command)
+{
+   size_t length = strlen(command);
+
+   return !strncasecmp(query, command, length) && strchr(" \t\r\n;", query[length]) != NULL;
+}
+
+static struct statement*
+find_statement(struct session* s, char* name, bool create)
+{
+   struct statement* free_statement = NULL;
+
+   for (int i = 0; i < MOCK_MAX_STATEMENTS; i++)
+   {
+      struct statement* st = &s->statements[i];
+
+      if (st->query != NULL && !strcmp(&st->name[0], name))
+      {
+         return st;
+      }
+
+      if (st->query == NULL && free_statement == NULL)
+      {
+         free_statement = st;
+      }
+   }
+
+   if (create && free_statement != NULL)
+   {
+      memset(&free_statement->name[0], 0, MISC_LENGTH);
+      memcpy(&free_statement->name[0], name, MIN(strlen(name), MISC_LENGTH - 1));
+   }
+
+   return create ? free_statement : NULL;
+}
+
+static void
+latency(struct session* s)
+{
+   struct timespec ts;
+
+   if (s->config->latency <= 0)
+   {
+      return;
+   }
+
+   ts.tv_sec = s->config->latency / 1000000;
+   ts.tv_nsec = (long)(s->config->latency % 1000000) * 1000L;
+
+   while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+   {
+   }
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgagroal */
+#include <pgagroal.h>
+#include <message.h>
+#include <tswire.h>
+#include <utils.h>
+#include <wire.h>
+
+/* system */
+#include <stdlib.h>
+#include <string.h>
+
+void
+pgagroal_tswire_append_message(struct wire* w, char kind)
+{
+   if (kind == 'Z')
+   {
+      pgagroal_wire_append_header(w, 'Z', 5);
+      pgagroal_wire_append_byte(w, 'I');
+   }
+   else
+   {
+      pgagroal_wire_append_header(w, kind, 4);
+   }
+}
+
+int
+pgagroal_tswire_feed(struct wire* in, struct wire* out, size_t chunk, tswire_rewrite rewrite, void* client, int slot)
+{
+   char* data = NULL;
+   size_t offset = 0;
+   struct message msg;
+   struct message* result = NULL;
+
+   out->output_length = 0;
+
+   /* The input is copied, since it may be rewritten in place */
+   data = malloc(in->output_length);
+   if (data == NULL)
+   {
+      return 1;
+   }
+
+   while (offset < in->output_length)
+   {
+      size_t n = chunk > 0 ? MIN(chunk, in->output_length - offset) : in->output_length;
+
+      memcpy(data, in->output + offset, n);
+      msg.kind = pgagroal_read_byte(data);
+      msg.length = n;
+      msg.data = data;
+
+      if (rewrite(client, slot, &msg, &result) ||
+          pgagroal_wire_append(out, result->data, result->length))
+      {
+         free(data);
+         return 1;
+      }
+
+      offset += n;
+   }
+
+   free(data);
+   in->output_length = 0;
+
+   return 0;
+}
+
+void
+pgagroal_tswire_kinds(struct wire* w, char* result, size_t size)
+{
+   size_t offset = 0;
+   size_t n = 0;
+
+   memset(result, 0, size);
+
+   while (offset + 5 <= w->output_length && n < size - 1)
+   {
+      result[n++] = pgagroal_read_byte(w->output + offset);
+      offset += 1 + pgagroal_read_int32(w->output + offset + 1);
+   }
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgagroal */
+#include <pgagroal.h>
+#include <tsmock.h>
+
+/* system */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static void usage(void);
+
+int
+main(int argc, char** argv)
+{
+   int c;
+   struct tsmock_configuration config;
+
+   pgagroal_tsmock_init(&config);
+
+   while ((c = getopt(argc, argv, "H:p:a:u:P:l:r:f:h")) != -1)
+   {
+      switch (c)
+      {
+         case 'H':
+            memset(&config.host[0], 0, MISC_LENGTH);
+            memcpy(&config.host[0], optarg, MIN(strlen(optarg), MISC_LENGTH - 1));
+            break;
+         case 'p':
+            config.port = atoi(optarg);
+            break;
+         case 'a':
+            if (!strcasecmp(optarg, "trust"))
+            {
+               config.auth = MOCK_AUTH_TRUST;
+            }
+            else if (!strcasecmp(optarg, "md5"))
+            {
+               config.auth = MOCK_AUTH_MD5;
+            }
+            else if (!strcasecmp(optarg, "scram-sha-256"))
+            {
+               config.auth = MOCK_AUTH_SCRAM256;
+            }
+            else
+            {
+               usage();
+               exit(1);
+            }
+            break;
+         case 'u':
+            memset(&config.username[0], 0, MAX_USERNAME_LENGTH);
+            memcpy(&config.username[0], optarg, MIN(strlen(optarg), MAX_USERNAME_LENGTH - 1));
+            break;
+         case 'P':
+            memset(&config.password[0], 0, MAX_PASSWORD_LENGTH);
+            memcpy(&config.password[0], optarg, MIN(strlen(optarg), MAX_PASSWORD_LENGTH - 1));
+            break;
+         case 'l':
+            config.latency = atoi(optarg);
+            break;
+         case 'r':
+            config.rows = atoi(optarg);
+            break;
+         case 'f':
+            if (pgagroal_tsmock_read_responses(&config, optarg))
+            {
+               fprintf(stderr, "pgagroal_mock: Unable to read responses from %s\n", optarg);
+               exit(1);
+            }
+            break;
+         case 'h':
+         default:
+            usage();
+            exit(c == 'h' ? 0 : 1);
+      }
+   }
+
+   if (config.port <= 0 || config.latency < 0 || config.rows < 0)
+   {
+      usage();
+      exit(1);
+   }
+
+   printf("pgagroal_mock: Listening on %s:%d\n", config.host, config.port);
+   fflush(stdout);
+
+   if (pgagroal_tsmock_run(&config))
+   {
+      fprintf(stderr, "pgagroal_mock: Unable to listen on %s:%d\n", config.host, config.port);
+      exit(1);
+   }
+
+   return 0;
+}
+
+static void
+usage(void)
+{
+   printf("pgagroal_mock\n");
+   printf("  A mock PostgreSQL backend for load and regression testing\n");
+   printf("\n");
+   printf("Usage:\n");
+   printf("  pgagroal_mock [ -H HOST ] [ -p PORT ] [ -a AUTH ] [ -u USER ] [ -P PASSWORD ]\n");
+   printf("                [ -l LATENCY ] [ -r ROWS ] [ -f RESPONSES ]\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -H HOST       The host to listen on (default localhost)\n");
+   printf("  -p PORT       The port to listen on (default %d)\n", MOCK_DEFAULT_PORT);
+   printf("  -a AUTH       The authentication: trust, md5 or scram-sha-256 (default trust)\n");
+   printf("  -u USER       Only accept this user\n");
+   printf("  -P PASSWORD   The password for md5 and scram-sha-256\n");
+   printf("  -l LATENCY    The latency added to each query in microseconds (default 0)\n");
+   printf("  -r ROWS       The number of rows of the default response (default %d)\n", MOCK_DEFAULT_ROWS);
+   printf("  -f RESPONSES  A file of canned responses: query, column, value and rows separated by tabs\n");
+   printf("  -h            Display help\n");
+}
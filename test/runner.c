@@ -47,6 +47,9 @@ main(int argc, char* argv[])
    Suite* art_suite;
    Suite* deque_suite;
    Suite* json_suite;
+   Suite* mock_suite;
+   Suite* parameters_suite;
+   Suite* prepared_suite;
    Suite* utf8_suite;
    SRunner* sr;
 
@@ -64,12 +67,18 @@ main(int argc, char* argv[])
    art_suite = pgagroal_test_art_suite();
    deque_suite = pgagroal_test_deque_suite();
    json_suite = pgagroal_test_json_suite();
+   mock_suite = pgagroal_test_mock_suite();
+   parameters_suite = pgagroal_test_parameters_suite();
+   prepared_suite = pgagroal_test_prepared_suite();
 
    sr = srunner_create(connection_suite);
    srunner_add_suite(sr, alias_suite);
    srunner_add_suite(sr, art_suite);
    srunner_add_suite(sr, deque_suite);
    srunner_add_suite(sr, json_suite);
+   srunner_add_suite(sr, mock_suite);
+   srunner_add_suite(sr, parameters_suite);
+   srunner_add_suite(sr, prepared_suite);
    srunner_add_suite(sr, utf8_suite);
 
    // Run the tests in verbose mode
@@ -26,6 +26,8 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <pgagroal.h>
+#include <pipeline.h>
 #include <tsclient.h>
 #include <tssuite.h>
 
@@ -45,6 +47,24 @@ START_TEST(test_pgagroal_connection_load)
    ck_assert_msg(found, "success status not found");
 }
 
+// more clients than connections
+START_TEST(test_pgagroal_connection_overload)
+{
+   int found = 0;
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   // the clients share the connections between their transactions, test/conf/07 has 8
+   if (config->pipeline != PIPELINE_TRANSACTION)
+   {
+      return;
+   }
+
+   found = !pgagroal_tsclient_execute_pgbench(user, database, true, 32, 0, 100);
+   ck_assert_msg(found, "success status not found");
+}
+
 Suite*
 pgagroal_test_connection_suite()
 {
@@ -58,6 +78,7 @@ pgagroal_test_connection_suite()
    tcase_set_timeout(tc_core, 60);
    tcase_add_test(tc_core, test_pgagroal_connection);
    tcase_add_test(tc_core, test_pgagroal_connection_load);
+   tcase_add_test(tc_core, test_pgagroal_connection_overload);
    suite_add_tcase(s, tc_core);
 
    return s;
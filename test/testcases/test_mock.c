@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <pgagroal.h>
+#include <network.h>
+#include <tsmock.h>
+#include <tssuite.h>
+#include <wire.h>
+
+#define TEST_MOCK_PORT 6433
+
+static int mock_start(pid_t* pid);
+static int mock_connect(struct wire* w);
+static int mock_read(struct wire* w, char* kinds, size_t size);
+
+// simple query
+START_TEST(test_mock_simple_query)
+{
+   pid_t pid;
+   char kinds[16];
+   struct wire w;
+
+   memset(&w, 0, sizeof(struct wire));
+
+   ck_assert_int_eq(mock_start(&pid), 0);
+   ck_assert_int_eq(mock_connect(&w), 0);
+
+   pgagroal_wire_append_header(&w, 'Q', 4 + strlen("SELECT 1;") + 1);
+   pgagroal_wire_append_string(&w, "SELECT 1;");
+   ck_assert_int_eq(pgagroal_wire_flush(&w), 0);
+
+   ck_assert_int_eq(mock_read(&w, &kinds[0], sizeof(kinds)), 0);
+   ck_assert_str_eq(&kinds[0], "TDCZ");
+
+   pgagroal_disconnect(w.fd);
+   pgagroal_wire_destroy(&w);
+   pgagroal_tsmock_stop(pid);
+}
+END_TEST
+
+// extended query with a prepared statement
+START_TEST(test_mock_extended_query)
+{
+   pid_t pid;
+   char kinds[16];
+   struct wire w;
+
+   memset(&w, 0, sizeof(struct wire));
+
+   ck_assert_int_eq(mock_start(&pid), 0);
+   ck_assert_int_eq(mock_connect(&w), 0);
+
+   /* Parse, Bind, Describe, Execute and Sync */
+   pgagroal_wire_append_header(&w, 'P', 4 + strlen("s1") + 1 + strlen("SELECT 1") + 1 + 2);
+   pgagroal_wire_append_string(&w, "s1");
+   pgagroal_wire_append_string(&w, "SELECT 1");
+   pgagroal_wire_append_int16(&w, 0);
+   pgagroal_wire_append_header(&w, 'B', 4 + 1 + strlen("s1") + 1 + 2 + 2 + 2);
+   pgagroal_wire_append_string(&w, "");
+   pgagroal_wire_append_string(&w, "s1");
+   pgagroal_wire_append_int16(&w, 0);
+   pgagroal_wire_append_int16(&w, 0);
+   pgagroal_wire_append_int16(&w, 0);
+   pgagroal_wire_append_header(&w, 'D', 4 + 1 + 1);
+   pgagroal_wire_append_byte(&w, 'P');
+   pgagroal_wire_append_string(&w, "");
+   pgagroal_wire_append_header(&w, 'E', 4 + 1 + 4);
+   pgagroal_wire_append_string(&w, "");
+   pgagroal_wire_append_int32(&w, 0);
+   pgagroal_wire_append_header(&w, 'S', 4);
+   ck_assert_int_eq(pgagroal_wire_flush(&w), 0);
+
+   ck_assert_int_eq(mock_read(&w, &kinds[0], sizeof(kinds)), 0);
+   ck_assert_str_eq(&kinds[0], "12TDCZ");
+
+   pgagroal_disconnect(w.fd);
+   pgagroal_wire_destroy(&w);
+   pgagroal_tsmock_stop(pid);
+}
+END_TEST
+
+// an error skips the messages up to Sync
+START_TEST(test_mock_extended_error)
+{
+   pid_t pid;
+   char kinds[16];
+   struct wire w;
+
+   memset(&w, 0, sizeof(struct wire));
+
+   ck_assert_int_eq(mock_start(&pid), 0);
+   ck_assert_int_eq(mock_connect(&w), 0);
+
+   /* Bind of an unknown statement, Execute and Sync */
+   pgagroal_wire_append_header(&w, 'B', 4 + 1 + strlen("missing") + 1 + 2 + 2 + 2);
+   pgagroal_wire_append_string(&w, "");
+   pgagroal_wire_append_string(&w, "missing");
+   pgagroal_wire_append_int16(&w, 0);
+   pgagroal_wire_append_int16(&w, 0);
+   pgagroal_wire_append_int16(&w, 0);
+   pgagroal_wire_append_header(&w, 'E', 4 + 1 + 4);
+   pgagroal_wire_append_string(&w, "");
+   pgagroal_wire_append_int32(&w, 0);
+   pgagroal_wire_append_header(&w, 'S', 4);
+   ck_assert_int_eq(pgagroal_wire_flush(&w), 0);
+
+   ck_assert_int_eq(mock_read(&w, &kinds[0], sizeof(kinds)), 0);
+   ck_assert_str_eq(&kinds[0], "EZ");
+
+   /* The session continues after the Sync */
+   pgagroal_wire_append_header(&w, 'Q', 4 + strlen("SELECT 1;") + 1);
+   pgagroal_wire_append_string(&w, "SELECT 1;");
+   ck_assert_int_eq(pgagroal_wire_flush(&w), 0);
+
+   ck_assert_int_eq(mock_read(&w, &kinds[0], sizeof(kinds)), 0);
+   ck_assert_str_eq(&kinds[0], "TDCZ");
+
+   pgagroal_disconnect(w.fd);
+   pgagroal_wire_destroy(&w);
+   pgagroal_tsmock_stop(pid);
+}
+END_TEST
+
+Suite*
+pgagroal_test_mock_suite()
+{
+   Suite* s;
+   TCase* tc_mock;
+
+   s = suite_create("pgagroal_test_mock");
+
+   tc_mock = tcase_create("mock_test");
+   tcase_set_timeout(tc_mock, 60);
+   tcase_add_test(tc_mock, test_mock_simple_query);
+   tcase_add_test(tc_mock, test_mock_extended_query);
+   tcase_add_test(tc_mock, test_mock_extended_error);
+
+   suite_add_tcase(s, tc_mock);
+
+   return s;
+}
+
+static int
+mock_start(pid_t* pid)
+{
+   struct tsmock_configuration config;
+
+   pgagroal_tsmock_init(&config);
+   config.port = TEST_MOCK_PORT;
+
+   return pgagroal_tsmock_start(&config, pid);
+}
+
+static int
+mock_connect(struct wire* w)
+{
+   int fd = -1;
+   char kinds[32];
+
+   if (pgagroal_connect("localhost", TEST_MOCK_PORT, &fd, false, true))
+   {
+      return 1;
+   }
+
+   pgagroal_wire_reset(w, fd);
+
+   /* StartupMessage */
+   pgagroal_wire_append_int32(w, 4 + 4 + strlen("user") + 1 + strlen("test") + 1 + 1);
+   pgagroal_wire_append_int32(w, 196608);
+   pgagroal_wire_append_string(w, "user");
+   pgagroal_wire_append_string(w, "test");
+   pgagroal_wire_append_byte(w, '\0');
+
+   if (pgagroal_wire_flush(w) || mock_read(w, &kinds[0], sizeof(kinds)))
+   {
+      return 1;
+   }
+
+   return kinds[0] == 'R' ? 0 : 1;
+}
+
+static int
+mock_read(struct wire* w, char* kinds, size_t size)
+{
+   char kind;
+   int length;
+   size_t n = 0;
+
+   memset(kinds, 0, size);
+
+   /* The kinds of the messages up to and including ReadyForQuery */
+   while (n < size - 1)
+   {
+      if (pgagroal_wire_read_message(w, &kind, &length))
+      {
+         return 1;
+      }
+
+      kinds[n++] = kind;
+
+      if (kind == 'Z')
+      {
+         return 0;
+      }
+   }
+
+   return 1;
+}
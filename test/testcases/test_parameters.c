@@ -0,0 +1,388 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <pgagroal.h>
+#include <message.h>
+#include <parameters.h>
+#include <tssuite.h>
+#include <tswire.h>
+#include <utils.h>
+#include <wire.h>
+
+#define TEST_SLOTS 2
+
+struct test_parameters
+{
+   struct parameter_slot slots[TEST_SLOTS];           /**< The parameters of the slots */
+   struct parameter_client* client;                   /**< The client */
+   void* shmem;                                       /**< The configuration of the test runner */
+   void* security;                                    /**< The security segment of the test runner */
+   struct connection_security securities[TEST_SLOTS]; /**< The security messages of the slots */
+   struct wire in;                                    /**< The messages to rewrite */
+   struct wire out;                                   /**< The rewritten messages */
+};
+
+static void test_create(struct test_parameters* t);
+static void test_destroy(struct test_parameters* t);
+static void append_parameter(struct wire* w, char* name, char* value);
+static void append_response(struct wire* w);
+static int from_client(struct test_parameters* t);
+static int from_server(struct test_parameters* t, int slot, size_t chunk);
+static int rewrite_server(void* client, int slot, struct message* msg, struct message** result);
+static char* value(struct parameter_slot* ps, char* name);
+
+// the client sees its parameters on another connection
+START_TEST(test_parameters_replay)
+{
+   char k[16];
+   struct test_parameters t;
+
+   test_create(&t);
+
+   ck_assert_int_eq(pgagroal_parameters_start(t.client, 0), 0);
+   ck_assert_int_eq(from_client(&t), 0);
+   ck_assert_int_eq(pgagroal_read_byte(t.out.output), 'Q');
+   ck_assert_int_eq(t.out.output_length, 5 + strlen("SELECT 1") + 1);
+
+   append_parameter(&t.in, "TimeZone", "Europe/Paris");
+   append_response(&t.in);
+   ck_assert_int_eq(from_server(&t, 0, 0), 0);
+   ck_assert_str_eq(value(&t.slots[0], "TimeZone"), "Europe/Paris");
+
+   /* The other connection gets the value of the client first */
+   ck_assert_int_eq(pgagroal_parameters_start(t.client, 1), 0);
+   ck_assert_int_eq(from_client(&t), 0);
+   ck_assert_ptr_nonnull(strstr(t.out.output + 5, "pg_catalog.set_config(E'TimeZone', E'Europe/Paris', false)"));
+   ck_assert_int_eq(pgagroal_read_byte(t.out.output + 1 + pgagroal_read_int32(t.out.output + 1)), 'Q');
+
+   /* The response to the replay is removed */
+   pgagroal_tswire_append_message(&t.in, 'T');
+   append_parameter(&t.in, "TimeZone", "Europe/Paris");
+   pgagroal_tswire_append_message(&t.in, 'D');
+   pgagroal_tswire_append_message(&t.in, 'C');
+   pgagroal_tswire_append_message(&t.in, 'Z');
+   append_response(&t.in);
+   ck_assert_int_eq(from_server(&t, 1, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "CZ");
+   ck_assert_str_eq(value(&t.slots[1], "TimeZone"), "Europe/Paris");
+
+   /* Nothing is replayed on a connection with the same values */
+   ck_assert_int_eq(pgagroal_parameters_start(t.client, 1), 0);
+   ck_assert_int_eq(from_client(&t), 0);
+   ck_assert_int_eq(t.out.output_length, 5 + strlen("SELECT 1") + 1);
+
+   test_destroy(&t);
+}
+END_TEST
+
+// split messages are rewritten like whole messages
+START_TEST(test_parameters_split)
+{
+   char k[16];
+   char* whole = NULL;
+   size_t whole_length;
+   struct test_parameters t;
+
+   test_create(&t);
+
+   /* A value is known to the client */
+   ck_assert_int_eq(pgagroal_parameters_start(t.client, 0), 0);
+   append_parameter(&t.in, "DateStyle", "SQL, DMY");
+   append_response(&t.in);
+   ck_assert_int_eq(from_server(&t, 0, 0), 0);
+
+   for (size_t chunk = 0; chunk < 8; chunk++)
+   {
+      /* Partial headers and split ParameterStatus messages, up to the ReadyForQuery of the replay */
+      memset(&t.slots[1], 0, sizeof(struct parameter_slot));
+      ck_assert_int_eq(pgagroal_parameters_start(t.client, 1), 0);
+      ck_assert_int_eq(from_client(&t), 0);
+
+      append_parameter(&t.in, "DateStyle", "SQL, DMY");
+      pgagroal_tswire_append_message(&t.in, 'T');
+      pgagroal_tswire_append_message(&t.in, 'D');
+      pgagroal_tswire_append_message(&t.in, 'C');
+      pgagroal_tswire_append_message(&t.in, 'Z');
+      append_parameter(&t.in, "TimeZone", "Asia/Tokyo");
+      append_response(&t.in);
+      ck_assert_int_eq(from_server(&t, 1, chunk), 0);
+
+      pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+      ck_assert_str_eq(&k[0], "SCZ");
+      ck_assert_str_eq(value(&t.slots[1], "DateStyle"), "SQL, DMY");
+      ck_assert_str_eq(value(&t.slots[1], "TimeZone"), "Asia/Tokyo");
+      ck_assert_str_eq(value(&t.client->parameters, "TimeZone"), "Asia/Tokyo");
+
+      if (chunk == 0)
+      {
+         whole = malloc(t.out.output_length);
+         ck_assert_ptr_nonnull(whole);
+         memcpy(whole, t.out.output, t.out.output_length);
+         whole_length = t.out.output_length;
+      }
+      else
+      {
+         ck_assert_int_eq(t.out.output_length, whole_length);
+         ck_assert_int_eq(memcmp(t.out.output, whole, whole_length), 0);
+      }
+
+      /* The next replay starts from the value of the client */
+      append_parameter(&t.in, "TimeZone", "UTC");
+      append_response(&t.in);
+      ck_assert_int_eq(from_server(&t, 1, 0), 0);
+   }
+
+   free(whole);
+
+   test_destroy(&t);
+}
+END_TEST
+
+// a failed replay is passed on to the client
+START_TEST(test_parameters_error)
+{
+   char k[16];
+   struct test_parameters t;
+
+   test_create(&t);
+
+   ck_assert_int_eq(pgagroal_parameters_start(t.client, 0), 0);
+   append_parameter(&t.in, "TimeZone", "Europe/Paris");
+   append_response(&t.in);
+   ck_assert_int_eq(from_server(&t, 0, 0), 0);
+   ck_assert(!pgagroal_parameters_failed(t.client));
+
+   ck_assert_int_eq(pgagroal_parameters_start(t.client, 1), 0);
+   ck_assert_int_eq(from_client(&t), 0);
+
+   pgagroal_tswire_append_message(&t.in, 'E');
+   pgagroal_tswire_append_message(&t.in, 'Z');
+   append_response(&t.in);
+   ck_assert_int_eq(from_server(&t, 1, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "E");
+   ck_assert(pgagroal_parameters_failed(t.client));
+
+   test_destroy(&t);
+}
+END_TEST
+
+// a value which is too long isn't replayed
+START_TEST(test_parameters_too_long)
+{
+   char k[16];
+   char v[MAX_PARAMETER_VALUE_LENGTH + 100];
+   struct test_parameters t;
+
+   test_create(&t);
+
+   memset(&v[0], 'a', sizeof(v) - 1);
+   v[sizeof(v) - 1] = '\0';
+
+   ck_assert_int_eq(pgagroal_parameters_start(t.client, 0), 0);
+   append_parameter(&t.in, "TimeZone", "Europe/Paris");
+   append_parameter(&t.in, "application_name", "short");
+   append_response(&t.in);
+   ck_assert_int_eq(from_server(&t, 0, 0), 0);
+
+   /* The client sees a value which is too long */
+   append_parameter(&t.in, "application_name", &v[0]);
+   append_response(&t.in);
+   ck_assert_int_eq(from_server(&t, 0, 7), 0);
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "SCZ");
+   ck_assert_int_eq(t.out.output_length, 5 + strlen("application_name") + 1 + strlen(&v[0]) + 1 + 5 + strlen("SELECT 1") + 1 + 6);
+   ck_assert_ptr_null(value(&t.slots[0], "application_name"));
+   ck_assert_ptr_null(value(&t.client->parameters, "application_name"));
+
+   /* The server answers a replay with a value which is too long */
+   ck_assert_int_eq(pgagroal_parameters_start(t.client, 1), 0);
+   ck_assert_int_eq(from_client(&t), 0);
+   append_parameter(&t.in, "TimeZone", &v[0]);
+   pgagroal_tswire_append_message(&t.in, 'Z');
+   append_response(&t.in);
+   ck_assert_int_eq(from_server(&t, 1, 0), 0);
+   ck_assert_ptr_null(value(&t.slots[1], "TimeZone"));
+   ck_assert_ptr_null(value(&t.client->parameters, "TimeZone"));
+
+   /* and isn't replayed again */
+   ck_assert_int_eq(pgagroal_parameters_start(t.client, 1), 0);
+   ck_assert_int_eq(from_client(&t), 0);
+   ck_assert_int_eq(t.out.output_length, 5 + strlen("SELECT 1") + 1);
+
+   test_destroy(&t);
+}
+END_TEST
+
+Suite*
+pgagroal_test_parameters_suite()
+{
+   Suite* s;
+   TCase* tc_parameters;
+
+   s = suite_create("pgagroal_test_parameters");
+
+   tc_parameters = tcase_create("parameters_test");
+   tcase_set_timeout(tc_parameters, 60);
+   tcase_add_test(tc_parameters, test_parameters_replay);
+   tcase_add_test(tc_parameters, test_parameters_split);
+   tcase_add_test(tc_parameters, test_parameters_error);
+   tcase_add_test(tc_parameters, test_parameters_too_long);
+
+   suite_add_tcase(s, tc_parameters);
+
+   return s;
+}
+
+static void
+test_create(struct test_parameters* t)
+{
+   struct wire w;
+   struct main_configuration* config;
+
+   memset(t, 0, sizeof(struct test_parameters));
+
+   /* The slots of the test have their own configuration */
+   t->shmem = shmem;
+   shmem = calloc(1, sizeof(struct main_configuration) + TEST_SLOTS * sizeof(struct connection));
+   ck_assert_ptr_nonnull(shmem);
+
+   config = (struct main_configuration*)shmem;
+   config->max_connections = TEST_SLOTS;
+
+   pgagroal_wire_reset(&t->in, -1);
+   pgagroal_wire_reset(&t->out, -1);
+
+   /* The slots start with the parameters of their startup */
+   memset(&w, 0, sizeof(struct wire));
+   pgagroal_wire_reset(&w, -1);
+   append_parameter(&w, "server_version", "17.0");
+   append_parameter(&w, "TimeZone", "UTC");
+   append_parameter(&w, "DateStyle", "ISO, MDY");
+   append_parameter(&w, "application_name", "");
+   ck_assert(!w.failed);
+
+   t->security = security_shmem;
+   security_shmem = &t->securities[0];
+
+   for (int i = 0; i < TEST_SLOTS; i++)
+   {
+      config->connections[i].backend_pid = 100 + i;
+      config->connections[i].backend_secret = 200 + i;
+
+      memcpy(&t->securities[i].messages[0][0], w.output, w.output_length);
+      t->securities[i].lengths[0] = w.output_length;
+   }
+
+   pgagroal_wire_destroy(&w);
+
+   ck_assert_int_eq(pgagroal_parameters_create(&t->slots[0], &t->client), 0);
+}
+
+static void
+test_destroy(struct test_parameters* t)
+{
+   free(shmem);
+   shmem = t->shmem;
+   security_shmem = t->security;
+
+   pgagroal_parameters_destroy(t->client);
+   pgagroal_wire_destroy(&t->in);
+   pgagroal_wire_destroy(&t->out);
+}
+
+static void
+append_parameter(struct wire* w, char* name, char* value)
+{
+   pgagroal_wire_append_header(w, 'S', 4 + strlen(name) + 1 + strlen(value) + 1);
+   pgagroal_wire_append_string(w, name);
+   pgagroal_wire_append_string(w, value);
+}
+
+static void
+append_response(struct wire* w)
+{
+   pgagroal_wire_append_header(w, 'C', 4 + strlen("SELECT 1") + 1);
+   pgagroal_wire_append_string(w, "SELECT 1");
+   pgagroal_tswire_append_message(w, 'Z');
+}
+
+static int
+from_client(struct test_parameters* t)
+{
+   struct message msg;
+   struct message* result = NULL;
+
+   t->out.output_length = 0;
+
+   pgagroal_wire_append_header(&t->in, 'Q', 4 + strlen("SELECT 1") + 1);
+   pgagroal_wire_append_string(&t->in, "SELECT 1");
+
+   msg.kind = 'Q';
+   msg.length = t->in.output_length;
+   msg.data = t->in.output;
+
+   if (pgagroal_parameters_client(t->client, &msg, &result) ||
+       pgagroal_wire_append(&t->out, result->data, result->length))
+   {
+      return 1;
+   }
+
+   t->in.output_length = 0;
+
+   return 0;
+}
+
+static int
+from_server(struct test_parameters* t, int slot, size_t chunk)
+{
+   return pgagroal_tswire_feed(&t->in, &t->out, chunk, rewrite_server, t->client, slot);
+}
+
+static int
+rewrite_server(void* client, int slot, struct message* msg, struct message** result)
+{
+   return pgagroal_parameters_server((struct parameter_client*)client, slot, msg, result);
+}
+
+static char*
+value(struct parameter_slot* ps, char* name)
+{
+   for (int i = 0; i < ps->number_of_parameters; i++)
+   {
+      if (!strcmp(&ps->parameters[i].name[0], name))
+      {
+         return &ps->parameters[i].value[0];
+      }
+   }
+
+   return NULL;
+}
@@ -0,0 +1,501 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <pgagroal.h>
+#include <message.h>
+#include <prepared.h>
+#include <tssuite.h>
+#include <tswire.h>
+#include <utils.h>
+#include <wire.h>
+
+#define TEST_SLOTS 2
+
+struct test_prepared
+{
+   struct prepared_slot slots[TEST_SLOTS]; /**< The prepared statements of the slots */
+   struct prepared_client* client;         /**< The client */
+   struct wire in;                         /**< The messages to rewrite */
+   struct wire out;                        /**< The rewritten messages */
+};
+
+static void test_create(struct test_prepared* t);
+static void test_destroy(struct test_prepared* t);
+static void append_parse(struct wire* w, char* name, char* query);
+static void append_bind(struct wire* w, char* name);
+static void append_close(struct wire* w, char* name);
+static void append_query(struct wire* w, char* query);
+static int from_client(struct test_prepared* t, int slot, size_t chunk);
+static int from_server(struct test_prepared* t, int slot, size_t chunk);
+static int rewrite_client(void* client, int slot, struct message* msg, struct message** result);
+static int rewrite_server(void* client, int slot, struct message* msg, struct message** result);
+static char* statement(struct wire* w, char kind);
+static void prepare(struct test_prepared* t, int slot);
+static bool resets(char* query, size_t chunk);
+
+// Parse is renamed and closed first
+START_TEST(test_prepared_parse)
+{
+   char k[16];
+   char* name = NULL;
+   struct test_prepared t;
+
+   test_create(&t);
+
+   append_parse(&t.in, "s1", "SELECT 1");
+   pgagroal_tswire_append_message(&t.in, 'S');
+   ck_assert_int_eq(from_client(&t, 0, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "CPS");
+
+   name = statement(&t.out, 'P');
+   ck_assert_int_eq(strncmp(name, "pgagroal_", strlen("pgagroal_")), 0);
+   ck_assert_str_eq(statement(&t.out, 'C'), name);
+
+   /* The CloseComplete of pgagroal is removed */
+   pgagroal_tswire_append_message(&t.in, '3');
+   pgagroal_tswire_append_message(&t.in, '1');
+   pgagroal_tswire_append_message(&t.in, 'Z');
+   ck_assert_int_eq(from_server(&t, 0, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "1Z");
+
+   test_destroy(&t);
+}
+END_TEST
+
+// a Parse of a name the client uses already fails
+START_TEST(test_prepared_duplicate)
+{
+   char k[16];
+   char name[64];
+   struct test_prepared t;
+
+   test_create(&t);
+
+   prepare(&t, 0);
+
+   append_bind(&t.in, "s1");
+   pgagroal_tswire_append_message(&t.in, 'S');
+   ck_assert_int_eq(from_client(&t, 0, 0), 0);
+   memset(&name[0], 0, sizeof(name));
+   memcpy(&name[0], statement(&t.out, 'B'), MIN(strlen(statement(&t.out, 'B')), sizeof(name) - 1));
+
+   pgagroal_tswire_append_message(&t.in, '2');
+   pgagroal_tswire_append_message(&t.in, 'Z');
+   ck_assert_int_eq(from_server(&t, 0, 0), 0);
+
+   /* The Parse is sent under the name of the existing statement, without a Close */
+   append_parse(&t.in, "s1", "SELECT 2");
+   pgagroal_tswire_append_message(&t.in, 'S');
+   ck_assert_int_eq(from_client(&t, 0, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "PS");
+   ck_assert_str_eq(statement(&t.out, 'P'), &name[0]);
+
+   pgagroal_tswire_append_message(&t.in, 'E');
+   pgagroal_tswire_append_message(&t.in, 'Z');
+   ck_assert_int_eq(from_server(&t, 0, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "EZ");
+
+   /* The client keeps the first statement */
+   append_bind(&t.in, "s1");
+   pgagroal_tswire_append_message(&t.in, 'S');
+   ck_assert_int_eq(from_client(&t, 0, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "BS");
+   ck_assert_str_eq(statement(&t.out, 'B'), &name[0]);
+
+   test_destroy(&t);
+}
+END_TEST
+
+// a statement the connection has already is described instead of prepared
+START_TEST(test_prepared_shared)
+{
+   char k[16];
+   struct test_prepared t;
+   struct prepared_client* first = NULL;
+
+   test_create(&t);
+
+   prepare(&t, 0);
+
+   /* Another client of the same connections */
+   first = t.client;
+   ck_assert_int_eq(pgagroal_prepared_create(&t.slots[0], &t.client), 0);
+
+   append_parse(&t.in, "s1", "SELECT 1");
+   append_bind(&t.in, "s1");
+   pgagroal_tswire_append_message(&t.in, 'S');
+   ck_assert_int_eq(from_client(&t, 0, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "DBS");
+
+   /* The description answers the Parse */
+   pgagroal_tswire_append_message(&t.in, 't');
+   pgagroal_tswire_append_message(&t.in, 'n');
+   pgagroal_tswire_append_message(&t.in, '2');
+   pgagroal_tswire_append_message(&t.in, 'Z');
+   ck_assert_int_eq(from_server(&t, 0, 3), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "12Z");
+
+   pgagroal_prepared_destroy(first);
+   test_destroy(&t);
+}
+END_TEST
+
+// split messages are rewritten like whole messages
+START_TEST(test_prepared_split)
+{
+   char whole[64];
+   size_t whole_length;
+   struct test_prepared a;
+   struct test_prepared b;
+
+   test_create(&a);
+   test_create(&b);
+
+   append_parse(&a.in, "s1", "SELECT 1");
+   append_bind(&a.in, "s1");
+   pgagroal_tswire_append_message(&a.in, 'S');
+   append_parse(&b.in, "s1", "SELECT 1");
+   append_bind(&b.in, "s1");
+   pgagroal_tswire_append_message(&b.in, 'S');
+
+   ck_assert_int_eq(from_client(&a, 0, 0), 0);
+   ck_assert_int_eq(from_client(&b, 0, 1), 0);
+   ck_assert_int_eq(a.out.output_length, b.out.output_length);
+   ck_assert_int_eq(memcmp(a.out.output, b.out.output, a.out.output_length), 0);
+
+   pgagroal_tswire_append_message(&a.in, '3');
+   pgagroal_tswire_append_message(&a.in, '1');
+   pgagroal_tswire_append_message(&a.in, '2');
+   pgagroal_tswire_append_message(&a.in, 'Z');
+   pgagroal_tswire_append_message(&b.in, '3');
+   pgagroal_tswire_append_message(&b.in, '1');
+   pgagroal_tswire_append_message(&b.in, '2');
+   pgagroal_tswire_append_message(&b.in, 'Z');
+
+   ck_assert_int_eq(from_server(&a, 0, 0), 0);
+   ck_assert_int_eq(from_server(&b, 0, 1), 0);
+
+   pgagroal_tswire_kinds(&a.out, &whole[0], sizeof(whole));
+   ck_assert_str_eq(&whole[0], "12Z");
+   whole_length = a.out.output_length;
+   ck_assert_int_eq(b.out.output_length, whole_length);
+   ck_assert_int_eq(memcmp(a.out.output, b.out.output, whole_length), 0);
+
+   test_destroy(&a);
+   test_destroy(&b);
+}
+END_TEST
+
+// Bind prepares the statement again on a connection without it
+START_TEST(test_prepared_bind)
+{
+   char k[16];
+   struct test_prepared t;
+
+   test_create(&t);
+
+   prepare(&t, 0);
+
+   append_bind(&t.in, "s1");
+   pgagroal_tswire_append_message(&t.in, 'S');
+   ck_assert_int_eq(from_client(&t, 1, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "CPBS");
+   ck_assert_str_eq(statement(&t.out, 'B'), statement(&t.out, 'P'));
+
+   /* The responses to the requests of pgagroal are removed */
+   pgagroal_tswire_append_message(&t.in, '3');
+   pgagroal_tswire_append_message(&t.in, '1');
+   pgagroal_tswire_append_message(&t.in, '2');
+   pgagroal_tswire_append_message(&t.in, 'Z');
+   ck_assert_int_eq(from_server(&t, 1, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "2Z");
+
+   /* The connection of the first slot has the statement */
+   append_bind(&t.in, "s1");
+   pgagroal_tswire_append_message(&t.in, 'S');
+   ck_assert_int_eq(from_client(&t, 0, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "BS");
+
+   test_destroy(&t);
+}
+END_TEST
+
+// Close is renamed, and forgets the statement
+START_TEST(test_prepared_close)
+{
+   char k[16];
+   char name[64];
+   struct test_prepared t;
+
+   test_create(&t);
+
+   prepare(&t, 0);
+
+   append_close(&t.in, "s1");
+   pgagroal_tswire_append_message(&t.in, 'S');
+   ck_assert_int_eq(from_client(&t, 0, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "CS");
+   memset(&name[0], 0, sizeof(name));
+   memcpy(&name[0], statement(&t.out, 'C'), MIN(strlen(statement(&t.out, 'C')), sizeof(name) - 1));
+   ck_assert_int_eq(strncmp(&name[0], "pgagroal_", strlen("pgagroal_")), 0);
+
+   pgagroal_tswire_append_message(&t.in, '3');
+   pgagroal_tswire_append_message(&t.in, 'Z');
+   ck_assert_int_eq(from_server(&t, 0, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "3Z");
+
+   /* The statement of the client is gone */
+   append_bind(&t.in, "s1");
+   pgagroal_tswire_append_message(&t.in, 'S');
+   ck_assert_int_eq(from_client(&t, 0, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+   ck_assert_str_eq(&k[0], "BS");
+   ck_assert_str_eq(statement(&t.out, 'B'), "s1");
+
+   test_destroy(&t);
+}
+END_TEST
+
+// the queries that drop the statements of the connection
+START_TEST(test_prepared_reset)
+{
+   ck_assert(resets("DISCARD ALL", 0));
+   ck_assert(resets("SELECT 1; DISCARD ALL", 0));
+   ck_assert(resets("SELECT 1;\n  discard /* all of them */ all;", 0));
+   ck_assert(resets("DEALLOCATE ALL", 0));
+   ck_assert(resets("DEALLOCATE PREPARE ALL", 0));
+   ck_assert(resets("SELECT 'a--b'', $1'; DEALLOCATE ALL", 0));
+   ck_assert(resets("SELECT $$;'$$; SELECT E'\\''; DISCARD ALL", 0));
+   ck_assert(resets("SELECT 1; DISCARD ALL", 1));
+
+   ck_assert(!resets("SELECT 1", 0));
+   ck_assert(!resets("DISCARD PLANS", 0));
+   ck_assert(!resets("DEALLOCATE s1", 0));
+   ck_assert(!resets("/* DISCARD ALL */ SELECT 1", 0));
+   ck_assert(!resets("SELECT 'DISCARD ALL'", 0));
+   ck_assert(!resets("-- DISCARD ALL\nSELECT 1", 0));
+   ck_assert(!resets("SELECT $x$; DISCARD ALL $x$", 0));
+}
+END_TEST
+
+Suite*
+pgagroal_test_prepared_suite()
+{
+   Suite* s;
+   TCase* tc_prepared;
+
+   s = suite_create("pgagroal_test_prepared");
+
+   tc_prepared = tcase_create("prepared_test");
+   tcase_set_timeout(tc_prepared, 60);
+   tcase_add_test(tc_prepared, test_prepared_parse);
+   tcase_add_test(tc_prepared, test_prepared_duplicate);
+   tcase_add_test(tc_prepared, test_prepared_shared);
+   tcase_add_test(tc_prepared, test_prepared_split);
+   tcase_add_test(tc_prepared, test_prepared_bind);
+   tcase_add_test(tc_prepared, test_prepared_close);
+   tcase_add_test(tc_prepared, test_prepared_reset);
+
+   suite_add_tcase(s, tc_prepared);
+
+   return s;
+}
+
+static void
+test_create(struct test_prepared* t)
+{
+   memset(t, 0, sizeof(struct test_prepared));
+
+   pgagroal_wire_reset(&t->in, -1);
+   pgagroal_wire_reset(&t->out, -1);
+
+   ck_assert_int_eq(pgagroal_prepared_create(&t->slots[0], &t->client), 0);
+}
+
+static void
+test_destroy(struct test_prepared* t)
+{
+   pgagroal_prepared_destroy(t->client);
+   pgagroal_wire_destroy(&t->in);
+   pgagroal_wire_destroy(&t->out);
+}
+
+static void
+append_parse(struct wire* w, char* name, char* query)
+{
+   pgagroal_wire_append_header(w, 'P', 4 + strlen(name) + 1 + strlen(query) + 1 + 2);
+   pgagroal_wire_append_string(w, name);
+   pgagroal_wire_append_string(w, query);
+   pgagroal_wire_append_int16(w, 0);
+}
+
+static void
+append_bind(struct wire* w, char* name)
+{
+   pgagroal_wire_append_header(w, 'B', 4 + 1 + strlen(name) + 1 + 2 + 2 + 2);
+   pgagroal_wire_append_string(w, "");
+   pgagroal_wire_append_string(w, name);
+   pgagroal_wire_append_int16(w, 0);
+   pgagroal_wire_append_int16(w, 0);
+   pgagroal_wire_append_int16(w, 0);
+}
+
+static void
+append_close(struct wire* w, char* name)
+{
+   pgagroal_wire_append_header(w, 'C', 4 + 1 + strlen(name) + 1);
+   pgagroal_wire_append_byte(w, 'S');
+   pgagroal_wire_append_string(w, name);
+}
+
+static void
+append_query(struct wire* w, char* query)
+{
+   pgagroal_wire_append_header(w, 'Q', 4 + strlen(query) + 1);
+   pgagroal_wire_append_string(w, query);
+}
+
+static int
+from_client(struct test_prepared* t, int slot, size_t chunk)
+{
+   return pgagroal_tswire_feed(&t->in, &t->out, chunk, rewrite_client, t->client, slot);
+}
+
+static int
+from_server(struct test_prepared* t, int slot, size_t chunk)
+{
+   return pgagroal_tswire_feed(&t->in, &t->out, chunk, rewrite_server, t->client, slot);
+}
+
+static int
+rewrite_client(void* client, int slot, struct message* msg, struct message** result)
+{
+   return pgagroal_prepared_client((struct prepared_client*)client, slot, msg, result);
+}
+
+static int
+rewrite_server(void* client, int slot, struct message* msg, struct message** result)
+{
+   return pgagroal_prepared_server((struct prepared_client*)client, slot, msg, result);
+}
+
+static char*
+statement(struct wire* w, char kind)
+{
+   size_t offset = 0;
+
+   while (offset + 5 <= w->output_length)
+   {
+      char k = pgagroal_read_byte(w->output + offset);
+
+      if (k == kind)
+      {
+         switch (kind)
+         {
+            case 'P':
+               return w->output + offset + 5;
+            case 'B':
+               return w->output + offset + 5 + strlen(w->output + offset + 5) + 1;
+            case 'C':
+               return w->output + offset + 6;
+            default:
+               return NULL;
+         }
+      }
+
+      offset += 1 + pgagroal_read_int32(w->output + offset + 1);
+   }
+
+   return "";
+}
+
+static void
+prepare(struct test_prepared* t, int slot)
+{
+   append_parse(&t->in, "s1", "SELECT 1");
+   pgagroal_tswire_append_message(&t->in, 'S');
+   ck_assert_int_eq(from_client(t, slot, 0), 0);
+
+   pgagroal_tswire_append_message(&t->in, '3');
+   pgagroal_tswire_append_message(&t->in, '1');
+   pgagroal_tswire_append_message(&t->in, 'Z');
+   ck_assert_int_eq(from_server(t, slot, 0), 0);
+}
+
+static bool
+resets(char* query, size_t chunk)
+{
+   char k[16];
+   struct test_prepared t;
+
+   test_create(&t);
+
+   prepare(&t, 0);
+
+   append_query(&t.in, query);
+   ck_assert_int_eq(from_client(&t, 0, chunk), 0);
+
+   pgagroal_tswire_append_message(&t.in, 'Z');
+   ck_assert_int_eq(from_server(&t, 0, 0), 0);
+
+   /* A statement that was dropped is prepared again */
+   append_bind(&t.in, "s1");
+   pgagroal_tswire_append_message(&t.in, 'S');
+   ck_assert_int_eq(from_client(&t, 0, 0), 0);
+
+   pgagroal_tswire_kinds(&t.out, &k[0], sizeof(k));
+
+   test_destroy(&t);
+
+   return k[0] == 'C';
+}